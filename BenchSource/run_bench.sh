@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs the load generator against a freshly started server.
+# Usage: run_bench.sh <server binary> <loadgen binary>
+set -e
+
+SERVER=$(realpath "$1")
+LOADGEN=$(realpath "$2")
+PORT=${BENCH_PORT:-6969}
+CONCURRENCY=${BENCH_CONCURRENCY:-200}
+TRANSFERS=${BENCH_TRANSFERS:-2000}
+OUT=$(dirname "$LOADGEN")
+ROOT=$OUT/root
+
+mkdir -p "$ROOT"
+for size in 4k 64k 1m; do
+    [ -f "$ROOT/bench_$size.bin" ] || head -c "$size" /dev/urandom > "$ROOT/bench_$size.bin" 2>/dev/null ||
+        dd if=/dev/urandom of="$ROOT/bench_$size.bin" bs="$size" count=1 2>/dev/null
+done
+# PXE boot set: loader, kernel, initrd
+[ -f "$ROOT/pxelinux.0" ] || head -c 40k /dev/urandom > "$ROOT/pxelinux.0"
+[ -f "$ROOT/vmlinuz" ] || head -c 512k /dev/urandom > "$ROOT/vmlinuz"
+[ -f "$ROOT/initrd.img" ] || head -c 1m /dev/urandom > "$ROOT/initrd.img"
+
+cd "$ROOT"
+TFTP_LOG_LEVEL=warn "$SERVER" -p "$PORT" -s '' > "$OUT/server.log" 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null || true' EXIT
+sleep 0.3
+
+echo "--- Mixed RRQ/WRQ load ($CONCURRENCY clients, $TRANSFERS transfers) ---"
+"$LOADGEN" -p "$PORT" -c "$CONCURRENCY" -n "$TRANSFERS" -z 4k,64k,1m -r 0.8 \
+    -P "$SERVER_PID" -o "$OUT/results_mix.json" || true
+
+echo "--- PXE boot storm ($CONCURRENCY clients) ---"
+"$LOADGEN" -p "$PORT" -c "$CONCURRENCY" -n "$CONCURRENCY" -x pxelinux.0,vmlinuz,initrd.img \
+    -P "$SERVER_PID" -o "$OUT/results_pxe.json" || true
+
+echo "Results written to $OUT/results_mix.json and $OUT/results_pxe.json"
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Goodput versus loss rate through tftp_impair_proxy, per transfer mode.
+# Usage: run_impair_bench.sh <server binary> <loadgen binary> <proxy binary>
+set -e
+
+SERVER=$(realpath "$1")
+LOADGEN=$(realpath "$2")
+PROXY=$(realpath "$3")
+SERVER_PORT=${BENCH_PORT:-6969}
+PROXY_PORT=$((SERVER_PORT + 1))
+LOSS=${BENCH_LOSS:-"0 1 2 5 10"}
+SIZE=${BENCH_IMPAIR_SIZE:-64k}
+CLIENTS=${BENCH_IMPAIR_CLIENTS:-4}
+DELAY=${BENCH_IMPAIR_DELAY:-1}
+OUT=$(dirname "$LOADGEN")
+ROOT=$OUT/root
+
+# mode name -> loadgen arguments
+mode_args() {
+    case "$1" in
+        rrq) echo "-r 1" ;;
+        wrq) echo "-r 0" ;;
+    esac
+}
+MODES=${BENCH_MODES:-"rrq wrq"}
+
+mkdir -p "$ROOT"
+[ -f "$ROOT/bench_$SIZE.bin" ] || head -c "$SIZE" /dev/urandom > "$ROOT/bench_$SIZE.bin"
+
+cd "$ROOT"
+TFTP_LOG_LEVEL=error "$SERVER" -p "$SERVER_PORT" -s '' > "$OUT/server.log" 2>&1 &
+SERVER_PID=$!
+PROXY_PID=
+trap 'kill $SERVER_PID $PROXY_PID 2>/dev/null; wait 2>/dev/null || true' EXIT
+sleep 0.3
+
+echo "mode,loss_pct,completed,failed,retransmits,elapsed_s,goodput_kbit_s" > "$OUT/impair.csv"
+printf '%-6s %8s %10s %8s %12s %10s %16s\n' mode loss% completed failed retransmits elapsed goodput_kbit/s
+for mode in $MODES; do
+    for loss in $LOSS; do
+        "$PROXY" -l "$PROXY_PORT" -u "127.0.0.1:$SERVER_PORT" -L "$loss" -D "$DELAY" -S 7 2> "$OUT/proxy.log" &
+        PROXY_PID=$!
+        sleep 0.2
+        # shellcheck disable=SC2046
+        "$LOADGEN" -p "$PROXY_PORT" -c "$CLIENTS" -n "$CLIENTS" -z "$SIZE" $(mode_args "$mode") \
+            -o "$OUT/impair_run.json" > /dev/null || true
+        kill "$PROXY_PID"; wait "$PROXY_PID" 2>/dev/null || true
+        PROXY_PID=
+
+        field() { grep -o "\"$1\": [0-9.e+-]*" "$OUT/impair_run.json" | head -1 | awk '{print $2}'; }
+        line=$(printf '%s,%s,%s,%s,%s,%s,%s' "$mode" "$loss" "$(field completed)" "$(field failed)" \
+            "$(field retransmits)" "$(field elapsed_s)" \
+            "$(awk -v g="$(field gbit_per_s)" 'BEGIN { printf "%.1f", g * 1e6 }')")
+        echo "$line" >> "$OUT/impair.csv"
+        echo "$line" | awk -F, '{ printf "%-6s %8s %10s %8s %12s %10.2f %16s\n", $1, $2, $3, $4, $5, $6, $7 }'
+    done
+done
+echo "Results written to $OUT/impair.csv"
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Request-to-completion latency of single-block RRQs, one at a time, with the
+# server's default profile and then its low-latency profile (-L/-F).
+# Usage: run_latency_bench.sh <server binary> <loadgen binary>
+# Real-time priority needs root (or CAP_SYS_NICE); without it the second run
+# only busy-polls.
+set -e
+
+SERVER=$(realpath "$1")
+LOADGEN=$(realpath "$2")
+SERVER_PORT=${BENCH_PORT:-6971}
+TRANSFERS=${BENCH_LATENCY_TRANSFERS:-3000}
+SPIN=${BENCH_SPIN_US:-50}
+PRIORITY=${BENCH_RT_PRIORITY:-10}
+OUT=$(dirname "$LOADGEN")
+ROOT=$OUT/root
+
+mkdir -p "$ROOT"
+[ -f "$ROOT/bench_256.bin" ] || head -c 256 /dev/urandom > "$ROOT/bench_256.bin"
+cd "$ROOT"
+
+SERVER_PID=
+trap '[ -z "$SERVER_PID" ] || kill $SERVER_PID 2>/dev/null; wait 2>/dev/null; true' EXIT
+
+# profile name, then extra server arguments
+run() {
+    name=$1; shift
+    TFTP_LOG_LEVEL=error "$SERVER" -p "$SERVER_PORT" -s '' "$@" > "$OUT/server.log" 2>&1 &
+    SERVER_PID=$!
+    sleep 0.3
+    # Warm up the page cache and the server before measuring
+    "$LOADGEN" -p "$SERVER_PORT" -c 1 -n 100 -z 256 -o /dev/null > /dev/null
+    "$LOADGEN" -p "$SERVER_PORT" -c 1 -n "$TRANSFERS" -z 256 -o "$OUT/latency_$name.json" |
+        awk -v n="$name" '/^latency/ { printf "%-12s p50 %s  p99 %s  p999 %s ms\n", n, $4, $6, $8 }'
+    kill "$SERVER_PID"; wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+}
+
+echo "$TRANSFERS single-block RRQs, one at a time"
+run default
+if [ "$(id -u)" = 0 ]; then
+    run low-latency -L "$SPIN" -F "$PRIORITY"
+else
+    run low-latency -L "$SPIN"
+fi
+echo "Results written to $OUT/latency_default.json and $OUT/latency_low-latency.json"
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Multicast sessions with mixed-blksize joiners over loopback: starts a server
+# sending to the group through 127.0.0.1 and runs the checker against it.
+# Usage: run_mcast_check.sh <server binary> <checker binary>
+set -e
+
+SERVER=$(realpath "$1")
+CHECK=$(realpath "$2")
+SERVER_PORT=${BENCH_PORT:-6971}
+OUT=$(dirname "$CHECK")
+ROOT=$OUT/root
+
+mkdir -p "$ROOT"
+# Sizes that are not multiples of either block size
+[ -f "$ROOT/mcast_big.bin" ] || head -c 5000 /dev/urandom > "$ROOT/mcast_big.bin"
+[ -f "$ROOT/mcast_small.bin" ] || head -c 3000 /dev/urandom > "$ROOT/mcast_small.bin"
+cd "$ROOT"
+
+TFTP_LOG_LEVEL=error "$SERVER" -p "$SERVER_PORT" -s '' -i 127.0.0.1 > "$OUT/server.log" 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null; wait 2>/dev/null; true' EXIT
+sleep 0.3
+"$CHECK" -p "$SERVER_PORT" mcast_big.bin mcast_small.bin
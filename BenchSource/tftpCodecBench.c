@@ -0,0 +1,317 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tftpCodec.h"
+#include "tftpDigest.h"
+#include "tftpEngine.h"
+
+// --- CODEC / ENGINE MICROBENCHMARK ---
+//
+// Packets per second for building and parsing each packet type, and for one
+// engine step (ACK in -> next DATA read and sent). Every case runs in a tight
+// loop on one core with no I/O, so the numbers track the cost of the hot
+// path itself. A saved run (-w) can be compared against later ones (-b) to
+// catch regressions; the exit status is 1 when any case drops by more than
+// the tolerance.
+
+#define BATCH 4096
+#define MAX_CASES 16
+
+struct bench_result {
+    const char *name;
+    double pps;
+};
+
+static volatile uint64_t sink;      // Keeps the compiler from dropping the work
+static struct bench_result results[MAX_CASES];
+static int result_count;
+static double run_ms = 300;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// --- CASES (each does BATCH packets) ---
+
+static char data_packet[TFTP_HEADER_SIZE + 1428];
+static char payload[1428];
+static char small_packet[TFTP_HEADER_SIZE + 512];
+static char request[512];
+static size_t request_len;
+static char error_packet[128];
+static size_t error_len;
+
+static void encode_data_inplace(void) {
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        total += tftp_encode_data(small_packet, sizeof(small_packet), (uint16_t)i,
+                                  small_packet + TFTP_HEADER_SIZE, 512);
+    }
+    sink += total;
+}
+
+static void encode_data_copy(void) {
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        total += tftp_encode_data(data_packet, sizeof(data_packet), (uint16_t)i, payload, sizeof(payload));
+    }
+    sink += total;
+}
+
+static void decode_data(void) {
+    struct tftp_packet pkt;
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        if (tftp_decode(data_packet, sizeof(data_packet), &pkt) == 0) {
+            total += pkt.block + pkt.data_len;
+        }
+    }
+    sink += total;
+}
+
+static void encode_ack(void) {
+    char ack[TFTP_HEADER_SIZE];
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        total += tftp_encode_ack(ack, sizeof(ack), (uint16_t)i);
+        total += (unsigned char)ack[3];
+    }
+    sink += total;
+}
+
+static void decode_ack(void) {
+    char ack[TFTP_HEADER_SIZE];
+    struct tftp_packet pkt;
+    uint64_t total = 0;
+    tftp_encode_ack(ack, sizeof(ack), 4242);
+    for (int i = 0; i < BATCH; i++) {
+        if (tftp_decode(ack, sizeof(ack), &pkt) == 0) {
+            total += pkt.block;
+        }
+    }
+    sink += total;
+}
+
+static const struct tftp_option request_options[] = {
+    {"blksize", "1428"}, {"tsize", "0"}, {"timeout", "1"}, {"windowsize", "8"}
+};
+
+static void encode_request(void) {
+    char buf[512];
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        total += tftp_encode_request(buf, sizeof(buf), OP_RRQ, "pxelinux.cfg/01-aa-bb-cc-dd-ee-ff",
+                                     "octet", request_options, 4);
+    }
+    sink += total;
+}
+
+static void decode_request(void) {
+    struct tftp_packet pkt;
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        if (tftp_decode(request, request_len, &pkt) == 0) {
+            const char *blksize = tftp_find_option(&pkt, "blksize");
+            total += (uint64_t)pkt.option_count + (blksize != NULL ? (unsigned char)blksize[0] : 0);
+        }
+    }
+    sink += total;
+}
+
+static void encode_error(void) {
+    char buf[128];
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        total += tftp_encode_error(buf, sizeof(buf), 1, "File not found");
+    }
+    sink += total;
+}
+
+static void decode_error(void) {
+    struct tftp_packet pkt;
+    uint64_t total = 0;
+    for (int i = 0; i < BATCH; i++) {
+        if (tftp_decode(error_packet, error_len, &pkt) == 0) {
+            total += pkt.block + (unsigned char)pkt.message[0];
+        }
+    }
+    sink += total;
+}
+
+// Engine step: an endless file, a null network, one ACK per block
+static ssize_t null_send(void *ctx, const void *packet, size_t len) {
+    (void)ctx;
+    sink += ((const unsigned char *)packet)[3];
+    return (ssize_t)len;
+}
+
+static ssize_t endless_read(void *ctx, char *buf, size_t len) {
+    (void)ctx;
+    buf[0] = 'x';
+    return (ssize_t)len;
+}
+
+static const struct tftp_engine_ops null_ops = { null_send, endless_read, NULL, NULL, NULL, NULL };
+static struct tftp_engine engine;
+static char engine_packet[TFTP_HEADER_SIZE + 512];
+
+static void engine_step(void) {
+    char ack[TFTP_HEADER_SIZE];
+    for (int i = 0; i < BATCH; i++) {
+        size_t len = tftp_encode_ack(ack, sizeof(ack), (uint16_t)engine.block);
+        tftp_engine_receive(&engine, ack, len, 0);
+    }
+}
+
+// Streaming digest of one 512-byte block, as every transfer now does
+static void crc32c_block(void) {
+    uint32_t crc = 0;
+    for (int i = 0; i < BATCH; i++) {
+        crc = tftp_crc32c(crc, payload, 512);
+    }
+    sink += crc;
+}
+
+// --- DRIVER ---
+
+static void run_case(const char *name, void (*fn)(void)) {
+    double start;
+    double elapsed;
+    uint64_t packets = 0;
+
+    fn(); // Warm caches and branch predictors
+    start = now_sec();
+    do {
+        fn();
+        packets += BATCH;
+        elapsed = now_sec() - start;
+    } while (elapsed * 1000.0 < run_ms);
+
+    results[result_count].name = name;
+    results[result_count].pps = (double)packets / elapsed;
+    result_count++;
+}
+
+static int write_baseline(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < result_count; i++) {
+        fprintf(f, "%s %.0f\n", results[i].name, results[i].pps);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Returns the number of cases slower than (100 - tolerance)% of the baseline
+static int compare_baseline(const char *path, double tolerance) {
+    char name[64];
+    double pps;
+    int regressions = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    printf("\n%-22s %14s %14s %8s\n", "case", "baseline pps", "now pps", "change");
+    while (fscanf(f, "%63s %lf", name, &pps) == 2) {
+        for (int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].name, name) != 0 || pps <= 0) {
+                continue;
+            }
+            double change = (results[i].pps / pps - 1.0) * 100.0;
+            int regressed = change < -tolerance;
+            printf("%-22s %14.0f %14.0f %+7.1f%%%s\n", name, pps, results[i].pps, change,
+                   regressed ? "  REGRESSION" : "");
+            regressions += regressed;
+        }
+    }
+    fclose(f);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t ms          time per case (300)\n"
+            "  -w file        save this run as a baseline\n"
+            "  -b file        compare with a saved baseline\n"
+            "  -T pct         allowed slowdown against the baseline (20)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *write_path = NULL;
+    const char *baseline_path = NULL;
+    double tolerance = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:w:b:T:h")) != -1) {
+        switch (opt) {
+        case 't': run_ms = atof(optarg); break;
+        case 'w': write_path = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 'T': tolerance = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    memset(payload, 'p', sizeof(payload));
+    tftp_encode_data(data_packet, sizeof(data_packet), 7, payload, sizeof(payload));
+    request_len = tftp_encode_request(request, sizeof(request), OP_RRQ, "pxelinux.cfg/01-aa-bb-cc-dd-ee-ff",
+                                      "octet", request_options, 4);
+    error_len = tftp_encode_error(error_packet, sizeof(error_packet), 1, "File not found");
+    tftp_engine_init(&engine, TFTP_ENGINE_SEND, &null_ops, NULL, engine_packet, sizeof(engine_packet), 512);
+    tftp_engine_start(&engine, NULL, 0, 0);
+
+    run_case("encode_data_inplace", encode_data_inplace);
+    run_case("encode_data_copy1428", encode_data_copy);
+    run_case("decode_data", decode_data);
+    run_case("encode_ack", encode_ack);
+    run_case("decode_ack", decode_ack);
+    run_case("encode_rrq_4opts", encode_request);
+    run_case("decode_rrq_4opts", decode_request);
+    run_case("encode_error", encode_error);
+    run_case("decode_error", decode_error);
+    run_case("engine_ack_to_data", engine_step);
+
+    // Both CRC32C implementations must give the standard check value
+    if (tftp_crc32c_set_impl("table") < 0 || tftp_crc32c(0, "123456789", 9) != 0xE3069283u) {
+        fprintf(stderr, "crc32c (table) check value mismatch\n");
+        return 2;
+    }
+    run_case("crc32c_512_table", crc32c_block);
+    if (tftp_crc32c_set_impl("sse4.2") == 0) {
+        if (tftp_crc32c(0, "123456789", 9) != 0xE3069283u) {
+            fprintf(stderr, "crc32c (sse4.2) check value mismatch\n");
+            return 2;
+        }
+        run_case("crc32c_512_sse4.2", crc32c_block);
+    }
+
+    printf("%-22s %14s %10s\n", "case", "packets/s", "ns/packet");
+    for (int i = 0; i < result_count; i++) {
+        printf("%-22s %14.0f %10.2f\n", results[i].name, results[i].pps, 1e9 / results[i].pps);
+    }
+
+    if (write_path != NULL && write_baseline(write_path) < 0) {
+        return 2;
+    }
+    if (baseline_path != NULL) {
+        int regressions = compare_baseline(baseline_path, tolerance);
+        if (regressions != 0) {
+            return regressions < 0 ? 2 : 1;
+        }
+    }
+    return 0;
+}
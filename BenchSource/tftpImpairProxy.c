@@ -0,0 +1,603 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- TFTP IMPAIRMENT PROXY ---
+//
+// Userspace stand-in for netem: sits between TFTP clients and a server on
+// loopback and applies loss, latency, jitter, duplication, reordering and a
+// bandwidth cap to every datagram, independently per direction.
+//
+// TFTP moves each transfer to a fresh server port (the TID), so the proxy
+// keeps one session per client address with two ephemeral sockets:
+//
+//   client  <-->  down_fd (plays the server TID)   up_fd (plays the client)  <-->  server
+//
+// The first request arrives on the listen port and leaves through up_fd to the
+// server's well-known port; the first reply fixes the server TID, and from
+// then on the client sees down_fd's port as the server's TID.
+
+#define MAX_PACKET 65536
+#define DIR_UP 0                    // Client to server
+#define DIR_DOWN 1                  // Server to client
+#define SESSION_IDLE_US (30u * 1000000u)
+#define SESSION_REUSE_US (5u * 1000000u)  // A request after this much silence is a new transfer
+#define DEFAULT_MAX_SESSIONS 4096
+#define DEFAULT_QUEUE_LIMIT 1000    // Packets waiting on one direction's link
+
+struct impairment {
+    double loss;                    // Probability a packet is dropped
+    double burst;                   // Probability the next packet is lost too (Gilbert-style bursts)
+    double delay_ms;
+    double jitter_ms;               // Uniform +/- jitter added to delay
+    double duplicate;               // Probability a packet is sent twice
+    double reorder;                 // Probability a packet is held back reorder_ms extra
+    double reorder_ms;
+    double rate_bps;                // Link capacity in bits/s; 0 = unlimited
+};
+
+struct link_state {
+    uint64_t free_us;               // When the bandwidth-capped link next goes idle
+    int queued;
+    int in_burst;
+    uint64_t forwarded, dropped, duplicated, reordered, overflowed;
+};
+
+struct proxy_session {
+    int in_use;
+    uint32_t generation;            // Bumped on expiry so queued packets can be discarded
+    struct sockaddr_in client;
+    struct sockaddr_in server;      // Well-known port until the first reply, then the TID
+    int server_tid_known;
+    int up_fd;
+    int down_fd;
+    uint64_t last_us;
+    struct proxy_session *hash_next;
+};
+
+struct pending_packet {
+    uint64_t release_us;
+    uint64_t seq;                   // Keeps equal release times in arrival order
+    uint32_t session;
+    uint32_t generation;
+    int dir;
+    int to_listen_port;             // Arrived on the listen port: goes to the well-known port
+    size_t len;
+    char *data;
+};
+
+static struct impairment impair[2];
+static struct link_state links[2];
+static struct proxy_session *sessions;
+static struct proxy_session **hash_table;
+static uint32_t max_sessions;
+static uint32_t hash_size;
+static struct pending_packet *heap;
+static size_t heap_len, heap_cap;
+static uint64_t heap_seq;
+static int queue_limit = DEFAULT_QUEUE_LIMIT;
+static int epfd;
+static int listen_fd;
+static struct sockaddr_in server_addr;
+static unsigned int rng_state = 1;
+static uint64_t session_count;
+static volatile sig_atomic_t stop_requested;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// Uniform in [0, 1)
+static double next_uniform(void) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (double)(rng_state >> 8) / (double)(1u << 24);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// --- RELEASE QUEUE (binary min-heap on release time) ---
+
+static int heap_less(const struct pending_packet *a, const struct pending_packet *b) {
+    return a->release_us < b->release_us || (a->release_us == b->release_us && a->seq < b->seq);
+}
+
+static int heap_push(const struct pending_packet *p) {
+    if (heap_len == heap_cap) {
+        size_t cap = heap_cap ? heap_cap * 2 : 1024;
+        struct pending_packet *grown = realloc(heap, cap * sizeof(*heap));
+        if (grown == NULL) {
+            return -1;
+        }
+        heap = grown;
+        heap_cap = cap;
+    }
+    size_t i = heap_len++;
+    heap[i] = *p;
+    heap[i].seq = heap_seq++;
+    while (i > 0 && heap_less(&heap[i], &heap[(i - 1) / 2])) {
+        struct pending_packet tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+    return 0;
+}
+
+static struct pending_packet heap_pop(void) {
+    struct pending_packet top = heap[0];
+    heap[0] = heap[--heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < heap_len && heap_less(&heap[l], &heap[m])) m = l;
+        if (r < heap_len && heap_less(&heap[r], &heap[m])) m = r;
+        if (m == i) break;
+        struct pending_packet tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+    return top;
+}
+
+// --- SESSIONS ---
+
+static uint32_t addr_hash(const struct sockaddr_in *a) {
+    uint32_t h = a->sin_addr.s_addr * 2654435761u;
+    h ^= (uint32_t)a->sin_port * 40503u;
+    return h & (hash_size - 1);
+}
+
+static struct proxy_session *session_lookup(const struct sockaddr_in *client) {
+    for (struct proxy_session *s = hash_table[addr_hash(client)]; s; s = s->hash_next) {
+        if (s->client.sin_addr.s_addr == client->sin_addr.s_addr && s->client.sin_port == client->sin_port) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// 'side' records which socket this is for the event loop: DIR_UP is up_fd
+// (receives from the server), DIR_DOWN is down_fd (receives from the client)
+static int open_ephemeral(uint32_t index, int side) {
+    struct sockaddr_in local;
+    struct epoll_event ev;
+    int bufsize = 1 << 20;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    if (fd < 0) {
+        perror("proxy socket creation failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    if (bind(fd, (const struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("proxy bind failed");
+        close(fd);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)index << 1) | (uint64_t)side;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+static struct proxy_session *session_create(const struct sockaddr_in *client) {
+    for (uint32_t i = 0; i < max_sessions; i++) {
+        struct proxy_session *s = &sessions[i];
+        if (s->in_use) {
+            continue;
+        }
+        s->up_fd = open_ephemeral(i, DIR_UP);
+        s->down_fd = s->up_fd < 0 ? -1 : open_ephemeral(i, DIR_DOWN);
+        if (s->down_fd < 0) {
+            if (s->up_fd >= 0) close(s->up_fd);
+            return NULL;
+        }
+        s->in_use = 1;
+        s->client = *client;
+        s->server = server_addr;
+        s->server_tid_known = 0;
+        s->last_us = now_us();
+        uint32_t h = addr_hash(client);
+        s->hash_next = hash_table[h];
+        hash_table[h] = s;
+        session_count++;
+        return s;
+    }
+    fprintf(stderr, "Proxy session table full (%u), dropping request\n", max_sessions);
+    return NULL;
+}
+
+static void session_destroy(struct proxy_session *s) {
+    struct proxy_session **pp = &hash_table[addr_hash(&s->client)];
+    while (*pp != s) {
+        pp = &(*pp)->hash_next;
+    }
+    *pp = s->hash_next;
+    close(s->up_fd);
+    close(s->down_fd);
+    s->in_use = 0;
+    s->generation++;
+}
+
+static void expire_sessions(uint64_t now) {
+    for (uint32_t i = 0; i < max_sessions; i++) {
+        if (sessions[i].in_use && now - sessions[i].last_us > SESSION_IDLE_US) {
+            session_destroy(&sessions[i]);
+        }
+    }
+}
+
+// --- IMPAIRMENT ---
+
+// Decides the fate of one datagram and queues zero, one or two copies
+static void impair_packet(struct proxy_session *s, int dir, int to_listen_port, const char *data, size_t len) {
+    const struct impairment *im = &impair[dir];
+    struct link_state *link = &links[dir];
+    uint64_t now = now_us();
+    int copies = 1;
+
+    // Gilbert-style loss: once a loss starts, each following packet is lost with probability 'burst'
+    if (link->in_burst ? next_uniform() < im->burst : next_uniform() < im->loss) {
+        link->in_burst = im->burst > 0;
+        link->dropped++;
+        return;
+    }
+    link->in_burst = 0;
+    if (next_uniform() < im->duplicate) {
+        copies = 2;
+        link->duplicated++;
+    }
+
+    for (int c = 0; c < copies; c++) {
+        struct pending_packet p;
+        uint64_t depart = now;
+
+        if (link->queued >= queue_limit) {
+            link->overflowed++;
+            return;
+        }
+        if (im->rate_bps > 0) {
+            // Serialise onto the capped link behind whatever is already queued
+            if (link->free_us > depart) depart = link->free_us;
+            depart += (uint64_t)((double)(len + 28) * 8.0 * 1e6 / im->rate_bps);
+            link->free_us = depart;
+        }
+        double extra_ms = im->delay_ms;
+        if (im->jitter_ms > 0) {
+            extra_ms += (next_uniform() * 2.0 - 1.0) * im->jitter_ms;
+        }
+        if (c == 0 && im->reorder > 0 && next_uniform() < im->reorder) {
+            extra_ms += im->reorder_ms;
+            link->reordered++;
+        }
+        if (extra_ms < 0) extra_ms = 0;
+
+        p.release_us = depart + (uint64_t)(extra_ms * 1000.0);
+        p.session = (uint32_t)(s - sessions);
+        p.generation = s->generation;
+        p.dir = dir;
+        p.to_listen_port = to_listen_port;
+        p.len = len;
+        p.data = malloc(len ? len : 1);
+        if (p.data == NULL) {
+            return;
+        }
+        memcpy(p.data, data, len);
+        if (heap_push(&p) < 0) {
+            free(p.data);
+            return;
+        }
+        link->queued++;
+    }
+}
+
+static void release_due(uint64_t now) {
+    while (heap_len > 0 && heap[0].release_us <= now) {
+        struct pending_packet p = heap_pop();
+        struct proxy_session *s = &sessions[p.session];
+
+        links[p.dir].queued--;
+        if (s->in_use && s->generation == p.generation) {
+            if (p.dir == DIR_UP) {
+                // Requests (and their retransmissions) always go to the well-known port,
+                // even when a late duplicate is released after the TID is known
+                const struct sockaddr_in *to = p.to_listen_port ? &server_addr : &s->server;
+                sendto(s->up_fd, p.data, p.len, 0, (const struct sockaddr *)to, sizeof(*to));
+            } else {
+                sendto(s->down_fd, p.data, p.len, 0, (const struct sockaddr *)&s->client, sizeof(s->client));
+            }
+            links[p.dir].forwarded++;
+        }
+        free(p.data);
+    }
+}
+
+// --- ARGUMENTS ---
+
+// Parses "value" (both directions) or "up/down"
+static int parse_pair(const char *arg, double *up, double *down) {
+    char *end;
+    *up = strtod(arg, &end);
+    *down = *up;
+    if (*end == '/') {
+        *down = strtod(end + 1, &end);
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+static double parse_rate(const char *arg, int *ok) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (*end == 'k' || *end == 'K') { v *= 1e3; end++; }
+    else if (*end == 'm' || *end == 'M') { v *= 1e6; end++; }
+    else if (*end == 'g' || *end == 'G') { v *= 1e9; end++; }
+    *ok = *end == '\0';
+    return v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s -l listen_port -u server_ip:port [impairments]\n"
+            "Every impairment takes 'value' for both directions or 'up/down'\n"
+            "(up = client to server):\n"
+            "  -L pct         packet loss percentage (0)\n"
+            "  -B pct         burst: chance the packet after a loss is lost too (0)\n"
+            "  -D ms          one-way delay (0)\n"
+            "  -J ms          uniform jitter, +/- (0)\n"
+            "  -U pct         duplication percentage (0)\n"
+            "  -R pct[:ms]    reorder percentage, held back ms extra (0:10)\n"
+            "  -W rate        bandwidth cap in bit/s, k/m/g suffixes (unlimited)\n"
+            "  -q packets     queue limit per direction (%d)\n"
+            "  -m sessions    maximum concurrent transfers (%d)\n"
+            "  -S seed        random seed (1)\n", prog, DEFAULT_QUEUE_LIMIT, DEFAULT_MAX_SESSIONS);
+}
+
+static int parse_args(int argc, char *argv[], uint16_t *listen_port) {
+    double up, down;
+    char *colon;
+    int opt, ok;
+
+    max_sessions = DEFAULT_MAX_SESSIONS;
+    impair[DIR_UP].reorder_ms = impair[DIR_DOWN].reorder_ms = 10.0;
+    memset(&server_addr, 0, sizeof(server_addr));
+    *listen_port = 0;
+
+    while ((opt = getopt(argc, argv, "l:u:L:B:D:J:U:R:W:q:m:S:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            *listen_port = (uint16_t)atoi(optarg);
+            break;
+        case 'u':
+            colon = strrchr(optarg, ':');
+            if (colon == NULL) {
+                usage(argv[0]);
+                return -1;
+            }
+            *colon = '\0';
+            server_addr.sin_family = AF_INET;
+            server_addr.sin_port = htons((uint16_t)atoi(colon + 1));
+            if (inet_pton(AF_INET, optarg, &server_addr.sin_addr) <= 0) {
+                fprintf(stderr, "Invalid server address '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'L':
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].loss = up / 100.0;
+            impair[DIR_DOWN].loss = down / 100.0;
+            break;
+        case 'B':
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].burst = up / 100.0;
+            impair[DIR_DOWN].burst = down / 100.0;
+            break;
+        case 'D':
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].delay_ms = up;
+            impair[DIR_DOWN].delay_ms = down;
+            break;
+        case 'J':
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].jitter_ms = up;
+            impair[DIR_DOWN].jitter_ms = down;
+            break;
+        case 'U':
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].duplicate = up / 100.0;
+            impair[DIR_DOWN].duplicate = down / 100.0;
+            break;
+        case 'R':
+            colon = strchr(optarg, ':');
+            if (colon != NULL) {
+                *colon = '\0';
+                impair[DIR_UP].reorder_ms = impair[DIR_DOWN].reorder_ms = atof(colon + 1);
+            }
+            if (parse_pair(optarg, &up, &down) < 0) goto bad;
+            impair[DIR_UP].reorder = up / 100.0;
+            impair[DIR_DOWN].reorder = down / 100.0;
+            break;
+        case 'W': {
+            char *slash = strchr(optarg, '/');
+            if (slash != NULL) *slash = '\0';
+            impair[DIR_UP].rate_bps = impair[DIR_DOWN].rate_bps = parse_rate(optarg, &ok);
+            if (!ok) goto bad;
+            if (slash != NULL) {
+                impair[DIR_DOWN].rate_bps = parse_rate(slash + 1, &ok);
+                if (!ok) goto bad;
+            }
+            break;
+        }
+        case 'q': queue_limit = atoi(optarg); break;
+        case 'm': max_sessions = (uint32_t)atoi(optarg); break;
+        case 'S': rng_state = (unsigned int)strtoul(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (*listen_port == 0 || server_addr.sin_family != AF_INET || max_sessions == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+
+bad:
+    fprintf(stderr, "Invalid value '%s' for -%c\n", optarg, opt);
+    return -1;
+}
+
+static void print_stats(void) {
+    static const char *names[2] = {"client->server", "server->client"};
+    fprintf(stderr, "--- tftp_impair_proxy: %llu sessions ---\n", (unsigned long long)session_count);
+    for (int d = 0; d < 2; d++) {
+        fprintf(stderr, "%s: forwarded %llu, dropped %llu, duplicated %llu, reordered %llu, queue overflow %llu\n",
+                names[d], (unsigned long long)links[d].forwarded, (unsigned long long)links[d].dropped,
+                (unsigned long long)links[d].duplicated, (unsigned long long)links[d].reordered,
+                (unsigned long long)links[d].overflowed);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in local;
+    struct epoll_event events[256];
+    struct rlimit rl;
+    struct sigaction sa;
+    static char packet[MAX_PACKET];
+    uint16_t listen_port;
+    uint64_t next_expiry;
+
+    if (parse_args(argc, argv, &listen_port) < 0) {
+        return 1;
+    }
+
+    // Two sockets per proxied transfer
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    for (hash_size = 1; hash_size < max_sessions * 2; hash_size <<= 1) {
+    }
+    sessions = calloc(max_sessions, sizeof(*sessions));
+    hash_table = calloc(hash_size, sizeof(*hash_table));
+    if (sessions == NULL || hash_table == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    epfd = epoll_create1(0);
+    listen_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0) {
+        perror("socket creation failed");
+        return 1;
+    }
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(listen_port);
+    if (bind(listen_fd, (const struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("bind failed");
+        return 1;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = UINT64_MAX};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    fprintf(stderr, "Impairment proxy on port %u -> %s:%u\n", listen_port,
+            inet_ntoa(server_addr.sin_addr), ntohs(server_addr.sin_port));
+
+    next_expiry = now_us() + SESSION_IDLE_US;
+    while (!stop_requested) {
+        int wait_ms = 1000;
+        if (heap_len > 0) {
+            uint64_t now = now_us();
+            wait_ms = heap[0].release_us <= now ? 0 : (int)((heap[0].release_us - now + 999) / 1000);
+            if (wait_ms > 1000) wait_ms = 1000;
+        }
+
+        int n = epoll_wait(epfd, events, 256, wait_ms);
+        for (int e = 0; e < n; e++) {
+            struct sockaddr_in from;
+            socklen_t from_len;
+            ssize_t got;
+
+            if (events[e].data.u64 == UINT64_MAX) {
+                // New transfer request: a fresh session per client TID
+                for (;;) {
+                    from_len = sizeof(from);
+                    got = recvfrom(listen_fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+                    if (got < 0) break;
+                    struct proxy_session *s = session_lookup(&from);
+                    if (s == NULL && (s = session_create(&from)) == NULL) continue;
+                    if (s->server_tid_known && now_us() - s->last_us > SESSION_REUSE_US) {
+                        // A reused client port starts a new transfer: forget the old TID
+                        s->server = server_addr;
+                        s->server_tid_known = 0;
+                    }
+                    s->last_us = now_us();
+                    impair_packet(s, DIR_UP, 1, packet, (size_t)got);
+                }
+                continue;
+            }
+
+            uint32_t index = (uint32_t)(events[e].data.u64 >> 1);
+            int side = (int)(events[e].data.u64 & 1);
+            struct proxy_session *s = &sessions[index];
+            int fd = side == DIR_UP ? s->up_fd : s->down_fd;
+            if (!s->in_use) continue;
+
+            for (;;) {
+                from_len = sizeof(from);
+                got = recvfrom(fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+                if (got < 0) break;
+                s->last_us = now_us();
+                if (side == DIR_UP) {
+                    // From the server: the first reply reveals its transfer TID
+                    if (!s->server_tid_known) {
+                        s->server = from;
+                        s->server_tid_known = 1;
+                    } else if (from.sin_port != s->server.sin_port) {
+                        continue; // Stray packet from another TID
+                    }
+                    impair_packet(s, DIR_DOWN, 0, packet, (size_t)got);
+                } else {
+                    if (from.sin_port != s->client.sin_port || from.sin_addr.s_addr != s->client.sin_addr.s_addr) {
+                        continue;
+                    }
+                    impair_packet(s, DIR_UP, 0, packet, (size_t)got);
+                }
+            }
+        }
+
+        uint64_t now = now_us();
+        release_due(now);
+        if (now >= next_expiry) {
+            expire_sessions(now);
+            next_expiry = now + SESSION_IDLE_US / 4;
+        }
+    }
+
+    print_stats();
+    return 0;
+}
@@ -0,0 +1,781 @@
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- TFTP LOAD GENERATOR ---
+//
+// Simulates many concurrent RRQ/WRQ clients against one server from a single
+// epoll loop. Every simulated transfer has its own UDP socket (its TID), so
+// thousands of transfers really run in parallel against the server.
+//
+// Normal mode picks each transfer's direction, file size, blksize and
+// windowsize from the configured mixes. PXE-storm mode (-x) makes every
+// simulated client fetch the same ordered file set, one file after another,
+// as a network boot would.
+
+#define OP_RRQ  1
+#define OP_WRQ  2
+#define OP_DATA 3
+#define OP_ACK  4
+#define OP_ERROR 5
+#define OP_OACK 6
+#define MAX_BLKSIZE 65464
+#define MAX_LIST 16
+#define MAX_RETRIES 5
+#define SWEEP_INTERVAL_US 10000
+
+enum lg_state { LG_IDLE = 0, LG_REQUEST, LG_TRANSFER };
+
+struct lg_session {
+    int fd;
+    enum lg_state state;
+    int is_read;
+    int file_idx;                   // Index into the size list / storm file set
+    uint64_t size;                  // Bytes to upload (WRQ)
+    uint16_t blksize;               // Requested, then negotiated value
+    uint16_t window;
+    int options_sent;
+    uint32_t next_block;            // RRQ: expected block. WRQ: next block to send
+    uint32_t base;                  // WRQ: oldest unacknowledged block
+    uint32_t last_block;            // WRQ: number of the final (short) block
+    uint32_t since_ack;             // RRQ: blocks received since the last ACK
+    uint64_t bytes;
+    uint64_t start_us;
+    uint64_t deadline_us;
+    int retries;
+    int peer_known;
+    int storm_step;                 // PXE: next file of the set
+    uint64_t boot_start_us;
+};
+
+struct lg_config {
+    struct sockaddr_in server;
+    int concurrency;
+    long total;                     // Transfers (or boots in PXE mode) to run
+    double duration;                // Seconds; 0 = run until total is reached
+    double read_ratio;
+    uint64_t sizes[MAX_LIST];
+    int size_count;
+    const char *storm_files[MAX_LIST];
+    int storm_count;
+    uint16_t blksizes[MAX_LIST];
+    int blksize_count;
+    uint16_t windows[MAX_LIST];
+    int window_count;
+    int timeout_ms;
+    int spin_us;                    // Busy-poll this long before sleeping in epoll_wait
+    int server_pid;
+    unsigned int seed;
+    const char *json_path;
+    const char *size_spec;
+    const char *blksize_spec;
+    const char *window_spec;
+};
+
+struct lg_results {
+    long completed;
+    long failed;
+    long boots;
+    uint64_t bytes;
+    uint64_t retransmits;
+    uint64_t *latency_us;           // Per completed transfer
+    long latency_count;
+    uint64_t *boot_latency_us;      // Per completed PXE boot
+    long boot_count;
+};
+
+static struct lg_config cfg;
+static struct lg_results res;
+static struct lg_session *sessions;
+static int epfd;
+static char payload[MAX_BLKSIZE];
+static long launched;
+static long latency_capacity;       // Latency arrays wrap (ring) past this many samples
+static unsigned int rng_state;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static unsigned int next_rand(void) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+// --- ARGUMENT PARSING ---
+
+static uint64_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+    case 'k': case 'K': v *= 1024; break;
+    case 'm': case 'M': v *= 1024 * 1024; break;
+    case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    default: break;
+    }
+    return (uint64_t)v;
+}
+
+// Splits a comma-separated list in place
+static int split_list(char *spec, char **items) {
+    int count = 0;
+    for (char *tok = strtok(spec, ","); tok && count < MAX_LIST; tok = strtok(NULL, ",")) {
+        items[count++] = tok;
+    }
+    return count;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s ip          server address (127.0.0.1)\n"
+            "  -p port        server port (69)\n"
+            "  -c n           concurrent clients (100)\n"
+            "  -n n           transfers to run, boots with -x (1000)\n"
+            "  -d seconds     run for a fixed time instead of -n\n"
+            "  -r ratio       fraction of transfers that are reads (1.0)\n"
+            "  -z sizes       file size mix, e.g. 4k,64k,1m; reads fetch bench_<size>.bin (64k)\n"
+            "  -b blksizes    blksize mix, e.g. 512,1428 (512)\n"
+            "  -w windows     windowsize mix, e.g. 1,8 (1)\n"
+            "  -x files       PXE storm: every client reads this ordered file set\n"
+            "  -t ms          retransmission timeout (1000)\n"
+            "  -L us          low latency: SO_BUSY_POLL, and spin this long before sleeping\n"
+            "  -P pid         server pid, to report server CPU per GB\n"
+            "  -S seed        random seed for the mixes (1)\n"
+            "  -o file        write machine-readable results (JSON)\n", prog);
+}
+
+static int parse_args(int argc, char *argv[]) {
+    static char size_buf[256] = "64k", blk_buf[256] = "512", win_buf[256] = "1", storm_buf[1024];
+    char *items[MAX_LIST];
+    int opt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.server.sin_family = AF_INET;
+    cfg.server.sin_port = htons(69);
+    inet_pton(AF_INET, "127.0.0.1", &cfg.server.sin_addr);
+    cfg.concurrency = 100;
+    cfg.total = 1000;
+    cfg.read_ratio = 1.0;
+    cfg.timeout_ms = 1000;
+    cfg.seed = 1;
+
+    while ((opt = getopt(argc, argv, "s:p:c:n:d:r:z:b:w:x:t:L:P:S:o:h")) != -1) {
+        switch (opt) {
+        case 's':
+            if (inet_pton(AF_INET, optarg, &cfg.server.sin_addr) <= 0) {
+                fprintf(stderr, "Invalid server address '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p': cfg.server.sin_port = htons((uint16_t)atoi(optarg)); break;
+        case 'c': cfg.concurrency = atoi(optarg); break;
+        case 'n': cfg.total = atol(optarg); break;
+        case 'd': cfg.duration = atof(optarg); break;
+        case 'r': cfg.read_ratio = atof(optarg); break;
+        case 'z': snprintf(size_buf, sizeof(size_buf), "%s", optarg); break;
+        case 'b': snprintf(blk_buf, sizeof(blk_buf), "%s", optarg); break;
+        case 'w': snprintf(win_buf, sizeof(win_buf), "%s", optarg); break;
+        case 'x': snprintf(storm_buf, sizeof(storm_buf), "%s", optarg); break;
+        case 't': cfg.timeout_ms = atoi(optarg); break;
+        case 'L': cfg.spin_us = atoi(optarg); break;
+        case 'P': cfg.server_pid = atoi(optarg); break;
+        case 'S': cfg.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'o': cfg.json_path = optarg; break;
+        default: usage(argv[0]); return -1;
+        }
+    }
+    // Spinning on the only CPU would just keep the server from answering
+    if (cfg.spin_us > 0 && sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        fprintf(stderr, "Only one CPU online; -L will not busy-poll.\n");
+        cfg.spin_us = 0;
+    }
+    if (cfg.concurrency < 1 || cfg.timeout_ms < 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    cfg.size_spec = strdup(size_buf);
+    cfg.blksize_spec = strdup(blk_buf);
+    cfg.window_spec = strdup(win_buf);
+
+    cfg.size_count = split_list(size_buf, items);
+    for (int i = 0; i < cfg.size_count; i++) cfg.sizes[i] = parse_size(items[i]);
+    cfg.blksize_count = split_list(blk_buf, items);
+    for (int i = 0; i < cfg.blksize_count; i++) cfg.blksizes[i] = (uint16_t)atoi(items[i]);
+    cfg.window_count = split_list(win_buf, items);
+    for (int i = 0; i < cfg.window_count; i++) cfg.windows[i] = (uint16_t)atoi(items[i]);
+    cfg.storm_count = split_list(storm_buf, (char **)cfg.storm_files);
+
+    if (cfg.size_count == 0 || cfg.blksize_count == 0 || cfg.window_count == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+// --- PACKET HELPERS ---
+
+static void session_send(struct lg_session *s, const void *packet, size_t len) {
+    ssize_t n;
+    if (s->peer_known) {
+        n = send(s->fd, packet, len, 0);
+    } else {
+        n = sendto(s->fd, packet, len, 0, (const struct sockaddr *)&cfg.server, sizeof(cfg.server));
+    }
+    if (n < 0 && errno != EAGAIN && errno != ECONNREFUSED) {
+        perror("loadgen send failed");
+    }
+}
+
+static void size_name(uint64_t size, char *out, size_t out_size) {
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+        snprintf(out, out_size, "%llum", (unsigned long long)(size / (1024 * 1024)));
+    } else if (size >= 1024 && size % 1024 == 0) {
+        snprintf(out, out_size, "%lluk", (unsigned long long)(size / 1024));
+    } else {
+        snprintf(out, out_size, "%llu", (unsigned long long)size);
+    }
+}
+
+static void send_request(struct lg_session *s) {
+    char packet[512];
+    char name[256];
+    size_t off = 2;
+
+    if (cfg.storm_count > 0) {
+        snprintf(name, sizeof(name), "%s", cfg.storm_files[s->file_idx]);
+    } else if (s->is_read) {
+        char sz[32];
+        size_name(cfg.sizes[s->file_idx], sz, sizeof(sz));
+        snprintf(name, sizeof(name), "bench_%s.bin", sz);
+    } else {
+        // Bounded set of upload names so long runs do not fill the disk
+        snprintf(name, sizeof(name), "loadgen_up_%ld.bin", (long)(s - sessions));
+    }
+
+    *(uint16_t *)packet = htons(s->is_read ? OP_RRQ : OP_WRQ);
+    off += (size_t)snprintf(packet + off, sizeof(packet) - off, "%s", name) + 1;
+    off += (size_t)snprintf(packet + off, sizeof(packet) - off, "octet") + 1;
+    if (s->options_sent) {
+        if (s->blksize != 512) {
+            off += (size_t)snprintf(packet + off, sizeof(packet) - off, "blksize") + 1;
+            off += (size_t)snprintf(packet + off, sizeof(packet) - off, "%u", s->blksize) + 1;
+        }
+        if (s->window != 1) {
+            off += (size_t)snprintf(packet + off, sizeof(packet) - off, "windowsize") + 1;
+            off += (size_t)snprintf(packet + off, sizeof(packet) - off, "%u", s->window) + 1;
+        }
+    }
+    session_send(s, packet, off);
+}
+
+static void send_ack(struct lg_session *s, uint32_t block) {
+    char packet[4];
+    *(uint16_t *)packet = htons(OP_ACK);
+    *(uint16_t *)(packet + 2) = htons((uint16_t)block);
+    session_send(s, packet, sizeof(packet));
+}
+
+static void send_data_block(struct lg_session *s, uint32_t block) {
+    char packet[4 + MAX_BLKSIZE];
+    uint64_t offset = (uint64_t)(block - 1) * s->blksize;
+    size_t len = offset >= s->size ? 0 : (size_t)(s->size - offset < s->blksize ? s->size - offset : s->blksize);
+
+    *(uint16_t *)packet = htons(OP_DATA);
+    *(uint16_t *)(packet + 2) = htons((uint16_t)block);
+    memcpy(packet + 4, payload, len);
+    session_send(s, packet, 4 + len);
+}
+
+// WRQ: fill the send window starting at next_block
+static void send_window(struct lg_session *s) {
+    while (s->next_block <= s->last_block && s->next_block < s->base + s->window) {
+        send_data_block(s, s->next_block);
+        s->next_block++;
+    }
+}
+
+// --- SESSION LIFECYCLE ---
+
+static void arm_timer(struct lg_session *s) {
+    s->deadline_us = now_us() + (uint64_t)cfg.timeout_ms * 1000u;
+}
+
+static int open_session_socket(struct lg_session *s) {
+    struct sockaddr_in local;
+    struct epoll_event ev;
+    int bufsize = 1 << 20;
+
+    s->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (s->fd < 0) {
+        perror("loadgen socket creation failed");
+        return -1;
+    }
+    setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+#ifdef SO_BUSY_POLL
+    if (cfg.spin_us > 0) {
+        setsockopt(s->fd, SOL_SOCKET, SO_BUSY_POLL, &cfg.spin_us, sizeof(cfg.spin_us));
+    }
+#endif
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    if (bind(s->fd, (const struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("loadgen bind failed");
+        close(s->fd);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+    return 0;
+}
+
+// Starts one transfer in this slot; file_idx must already be set in PXE mode
+static int start_transfer(struct lg_session *s) {
+    if (open_session_socket(s) < 0) {
+        return -1;
+    }
+    s->blksize = cfg.blksizes[next_rand() % cfg.blksize_count];
+    s->window = cfg.windows[next_rand() % cfg.window_count];
+    s->options_sent = (s->blksize != 512 || s->window != 1);
+    if (cfg.storm_count > 0) {
+        s->is_read = 1;
+    } else {
+        s->is_read = (next_rand() % 10000) < (unsigned int)(cfg.read_ratio * 10000);
+        s->file_idx = (int)(next_rand() % (unsigned int)cfg.size_count);
+        s->size = cfg.sizes[s->file_idx];
+    }
+    s->state = LG_REQUEST;
+    s->next_block = 1;
+    s->base = 1;
+    s->since_ack = 0;
+    s->bytes = 0;
+    s->retries = 0;
+    s->peer_known = 0;
+    s->start_us = now_us();
+    send_request(s);
+    arm_timer(s);
+    return 0;
+}
+
+static int more_to_launch(uint64_t run_start) {
+    if (cfg.duration > 0) {
+        return now_us() - run_start < (uint64_t)(cfg.duration * 1e6);
+    }
+    return launched < cfg.total;
+}
+
+static void launch(struct lg_session *s) {
+    launched++;
+    s->storm_step = 0;
+    s->boot_start_us = now_us();
+    s->file_idx = 0;
+    if (start_transfer(s) < 0) {
+        res.failed++;
+        s->state = LG_IDLE;
+    }
+}
+
+static void finish_transfer(struct lg_session *s, int success, uint64_t run_start) {
+    uint64_t now = now_us();
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->fd = -1;
+    s->state = LG_IDLE;
+
+    if (success) {
+        res.completed++;
+        res.bytes += s->bytes;
+        res.latency_us[res.latency_count++ % latency_capacity] = now - s->start_us;
+    } else {
+        res.failed++;
+    }
+
+    // PXE storm: continue with the next file of the boot set
+    if (cfg.storm_count > 0) {
+        if (success && ++s->storm_step < cfg.storm_count) {
+            s->file_idx = s->storm_step;
+            if (start_transfer(s) < 0) {
+                res.failed++;
+            }
+            return;
+        }
+        if (success) {
+            res.boot_latency_us[res.boot_count++ % latency_capacity] = now - s->boot_start_us;
+            res.boots++;
+        }
+    }
+
+    if (more_to_launch(run_start)) {
+        launch(s);
+    }
+}
+
+// Maps a 16-bit block number onto the 32-bit counter nearest to ref
+static uint32_t extend_block(uint32_t ref, uint16_t block) {
+    return ref + (uint32_t)(int16_t)(uint16_t)(block - (uint16_t)ref);
+}
+
+static void parse_oack(struct lg_session *s, const char *packet, ssize_t n) {
+    const char *p = packet + 2;
+    const char *end = packet + n;
+    uint16_t blksize = 512, window = 1;
+
+    while (p < end) {
+        const char *name = p;
+        const char *name_end = memchr(p, '\0', (size_t)(end - p));
+        if (name_end == NULL || name_end + 1 >= end) break;
+        const char *value = name_end + 1;
+        const char *value_end = memchr(value, '\0', (size_t)(end - value));
+        if (value_end == NULL) break;
+        if (strcasecmp(name, "blksize") == 0) blksize = (uint16_t)atoi(value);
+        if (strcasecmp(name, "windowsize") == 0) window = (uint16_t)atoi(value);
+        p = value_end + 1;
+    }
+    s->blksize = blksize;
+    s->window = window ? window : 1;
+}
+
+static void handle_packet(struct lg_session *s, const char *packet, ssize_t n,
+                          const struct sockaddr_in *from, uint64_t run_start) {
+    if (n < 4) {
+        return;
+    }
+    uint16_t opcode = ntohs(*(const uint16_t *)packet);
+    uint16_t block = ntohs(*(const uint16_t *)(packet + 2));
+
+    if (!s->peer_known) {
+        // First reply: lock the socket onto the server's transfer TID
+        connect(s->fd, (const struct sockaddr *)from, sizeof(*from));
+        s->peer_known = 1;
+    }
+
+    if (opcode == OP_ERROR) {
+        finish_transfer(s, 0, run_start);
+        return;
+    }
+
+    if (s->state == LG_REQUEST) {
+        if (opcode == OP_OACK) {
+            parse_oack(s, packet, n);
+            s->state = LG_TRANSFER;
+            s->retries = 0;
+            if (s->is_read) {
+                send_ack(s, 0);
+            } else {
+                s->last_block = (uint32_t)(s->size / s->blksize) + 1;
+                send_window(s);
+            }
+            arm_timer(s);
+            return;
+        }
+        // Server ignored our options: fall back to RFC 1350 defaults
+        s->blksize = 512;
+        s->window = 1;
+        s->state = LG_TRANSFER;
+        if (!s->is_read) {
+            s->last_block = (uint32_t)(s->size / s->blksize) + 1;
+            if (opcode == OP_ACK && block == 0) {
+                s->retries = 0;
+                send_window(s);
+                arm_timer(s);
+            }
+            return;
+        }
+    }
+
+    if (s->is_read && opcode == OP_DATA) {
+        uint32_t b = extend_block(s->next_block, block);
+        ssize_t len = n - 4;
+        if (b == s->next_block) {
+            s->bytes += (uint64_t)len;
+            s->next_block++;
+            s->retries = 0;
+            s->since_ack++;
+            if (len < s->blksize) {
+                send_ack(s, b);
+                finish_transfer(s, 1, run_start);
+                return;
+            }
+            if (s->since_ack >= s->window) {
+                send_ack(s, b);
+                s->since_ack = 0;
+            }
+            arm_timer(s);
+        } else if (b > s->next_block) {
+            // Gap inside a window: re-ACK the last in-order block (RFC 7440)
+            send_ack(s, s->next_block - 1);
+            s->since_ack = 0;
+        }
+    } else if (!s->is_read && opcode == OP_ACK) {
+        uint32_t acked = extend_block(s->base - 1, block);
+        if (acked + 1 > s->base && acked < s->next_block) {
+            for (uint32_t b = s->base; b <= acked; b++) {
+                uint64_t offset = (uint64_t)(b - 1) * s->blksize;
+                s->bytes += offset >= s->size ? 0 : (s->size - offset < s->blksize ? s->size - offset : s->blksize);
+            }
+            s->base = acked + 1;
+            s->retries = 0;
+            if (acked == s->last_block) {
+                finish_transfer(s, 1, run_start);
+                return;
+            }
+            send_window(s);
+            arm_timer(s);
+        }
+    }
+}
+
+static void sweep_timeouts(uint64_t run_start) {
+    uint64_t now = now_us();
+    for (int i = 0; i < cfg.concurrency; i++) {
+        struct lg_session *s = &sessions[i];
+        if (s->state == LG_IDLE || now < s->deadline_us) {
+            continue;
+        }
+        if (++s->retries > MAX_RETRIES) {
+            finish_transfer(s, 0, run_start);
+            continue;
+        }
+        res.retransmits++;
+        if (s->state == LG_REQUEST) {
+            send_request(s);
+        } else if (s->is_read) {
+            send_ack(s, s->next_block - 1);
+            s->since_ack = 0;
+        } else {
+            s->next_block = s->base; // Go back N
+            send_window(s);
+        }
+        arm_timer(s);
+    }
+}
+
+// --- SERVER CPU ACCOUNTING ---
+
+// utime+stime of pid plus its reaped children, in clock ticks
+static unsigned long long proc_cpu_ticks(int pid, int include_children) {
+    char path[64];
+    char buf[1024];
+    unsigned long long utime, stime, cutime, cstime;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+    if (fgets(buf, sizeof(buf), fp) == NULL) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    char *p = strrchr(buf, ')');
+    if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %llu %llu",
+                            &utime, &stime, &cutime, &cstime) != 4) {
+        return 0;
+    }
+    return utime + stime + (include_children ? cutime + cstime : 0);
+}
+
+// Server process, reaped transfer children, and children still running
+static unsigned long long server_cpu_ticks(int pid) {
+    unsigned long long total = proc_cpu_ticks(pid, 1);
+    DIR *dir = opendir("/proc");
+    struct dirent *de;
+
+    if (dir == NULL) return total;
+    while ((de = readdir(dir)) != NULL) {
+        char path[64], buf[512];
+        int child = atoi(de->d_name), ppid = 0;
+        if (child <= 0) continue;
+        snprintf(path, sizeof(path), "/proc/%d/stat", child);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) continue;
+        if (fgets(buf, sizeof(buf), fp) != NULL) {
+            char *p = strrchr(buf, ')');
+            if (p != NULL) sscanf(p + 2, "%*c %d", &ppid);
+        }
+        fclose(fp);
+        if (ppid == pid) total += proc_cpu_ticks(child, 0);
+    }
+    closedir(dir);
+    return total;
+}
+
+// --- REPORTING ---
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(uint64_t *values, long count, double pct) {
+    if (count == 0) return 0.0;
+    long idx = (long)(pct / 100.0 * (double)(count - 1) + 0.5);
+    return (double)values[idx] / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    struct rlimit rl;
+    struct epoll_event events[256];
+    char packet[4 + MAX_BLKSIZE];
+    unsigned long long cpu_before = 0, cpu_after = 0;
+
+    if (parse_args(argc, argv) < 0) {
+        return 1;
+    }
+
+    // One socket per concurrent transfer
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        if ((rlim_t)cfg.concurrency + 16 > rl.rlim_cur) {
+            fprintf(stderr, "Concurrency %d exceeds the open file limit %lu\n",
+                    cfg.concurrency, (unsigned long)rl.rlim_cur);
+            return 1;
+        }
+    }
+
+    rng_state = cfg.seed;
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (char)next_rand();
+    }
+
+    long capacity = cfg.duration > 0 ? 1 << 22 : cfg.total * (cfg.storm_count + 1) + 1;
+    latency_capacity = capacity;
+    sessions = calloc((size_t)cfg.concurrency, sizeof(*sessions));
+    res.latency_us = calloc((size_t)capacity, sizeof(uint64_t));
+    res.boot_latency_us = calloc((size_t)capacity, sizeof(uint64_t));
+    if (sessions == NULL || res.latency_us == NULL || res.boot_latency_us == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    epfd = epoll_create1(0);
+
+    if (cfg.server_pid > 0) {
+        cpu_before = server_cpu_ticks(cfg.server_pid);
+    }
+
+    uint64_t run_start = now_us();
+    uint64_t next_sweep = run_start + SWEEP_INTERVAL_US;
+    for (int i = 0; i < cfg.concurrency; i++) {
+        sessions[i].fd = -1;
+        if (more_to_launch(run_start)) {
+            launch(&sessions[i]);
+        }
+    }
+
+    // --- EVENT LOOP ---
+    while (1) {
+        int active = 0;
+        for (int i = 0; i < cfg.concurrency && !active; i++) {
+            active = sessions[i].state != LG_IDLE;
+        }
+        if (!active) {
+            break;
+        }
+
+        // With -L, poll without sleeping for a while first: the reply to the
+        // packet just sent usually arrives within a few microseconds
+        int n = 0;
+        for (uint64_t spin_end = now_us() + (uint64_t)cfg.spin_us; cfg.spin_us > 0 && n == 0 && now_us() < spin_end;) {
+            n = epoll_wait(epfd, events, 256, 0);
+        }
+        if (n == 0) {
+            n = epoll_wait(epfd, events, 256, SWEEP_INTERVAL_US / 1000);
+        }
+        for (int e = 0; e < n; e++) {
+            struct lg_session *s = events[e].data.ptr;
+            int fd = s->fd;
+            // Drain the socket; the session may finish (and restart) mid-loop
+            while (s->state != LG_IDLE && s->fd == fd) {
+                struct sockaddr_in from;
+                socklen_t from_len = sizeof(from);
+                ssize_t got = recvfrom(fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+                if (got < 0) break;
+                handle_packet(s, packet, got, &from, run_start);
+            }
+        }
+
+        uint64_t now = now_us();
+        if (now >= next_sweep) {
+            sweep_timeouts(run_start);
+            next_sweep = now + SWEEP_INTERVAL_US;
+        }
+    }
+
+    double elapsed = (double)(now_us() - run_start) / 1e6;
+    if (cfg.server_pid > 0) {
+        cpu_after = server_cpu_ticks(cfg.server_pid);
+    }
+
+    long lat_n = res.latency_count < capacity ? res.latency_count : capacity;
+    long boot_n = res.boot_count < capacity ? res.boot_count : capacity;
+    qsort(res.latency_us, (size_t)lat_n, sizeof(uint64_t), cmp_u64);
+    qsort(res.boot_latency_us, (size_t)boot_n, sizeof(uint64_t), cmp_u64);
+
+    double tps = (double)res.completed / elapsed;
+    double gbps = (double)res.bytes * 8.0 / elapsed / 1e9;
+    double cpu_s = (double)(cpu_after - cpu_before) / (double)sysconf(_SC_CLK_TCK);
+    double gb = (double)res.bytes / 1e9;
+    double cpu_per_gb = cfg.server_pid > 0 && gb > 0 ? cpu_s / gb : -1.0;
+
+    printf("--- tftp_loadgen results ---\n");
+    printf("mode:            %s\n", cfg.storm_count > 0 ? "pxe-storm" : "mix");
+    printf("concurrency:     %d\n", cfg.concurrency);
+    printf("elapsed:         %.3f s\n", elapsed);
+    printf("transfers:       %ld ok, %ld failed, %llu retransmits\n", res.completed, res.failed,
+           (unsigned long long)res.retransmits);
+    printf("throughput:      %.1f transfers/s, %.3f Gbit/s\n", tps, gbps);
+    printf("latency (ms):    p50 %.3f  p99 %.3f  p999 %.3f\n", percentile_ms(res.latency_us, lat_n, 50),
+           percentile_ms(res.latency_us, lat_n, 99), percentile_ms(res.latency_us, lat_n, 99.9));
+    if (cfg.storm_count > 0) {
+        printf("boots:           %ld, boot latency (ms) p50 %.3f  p99 %.3f  p999 %.3f\n", res.boots,
+               percentile_ms(res.boot_latency_us, boot_n, 50), percentile_ms(res.boot_latency_us, boot_n, 99),
+               percentile_ms(res.boot_latency_us, boot_n, 99.9));
+    }
+    if (cpu_per_gb >= 0) {
+        printf("server CPU:      %.3f s total, %.3f s/GB\n", cpu_s, cpu_per_gb);
+    }
+
+    if (cfg.json_path != NULL) {
+        FILE *fp = fopen(cfg.json_path, "w");
+        if (fp == NULL) {
+            perror("Failed to open results file");
+            return 1;
+        }
+        fprintf(fp, "{\n  \"config\": {\"mode\": \"%s\", \"concurrency\": %d, \"sizes\": \"%s\", "
+                    "\"read_ratio\": %.3f, \"blksizes\": \"%s\", \"windowsizes\": \"%s\", "
+                    "\"timeout_ms\": %d, \"spin_us\": %d, \"seed\": %u},\n",
+                cfg.storm_count > 0 ? "pxe-storm" : "mix", cfg.concurrency, cfg.size_spec,
+                cfg.read_ratio, cfg.blksize_spec, cfg.window_spec, cfg.timeout_ms, cfg.spin_us, cfg.seed);
+        fprintf(fp, "  \"results\": {\"elapsed_s\": %.6f, \"completed\": %ld, \"failed\": %ld, "
+                    "\"retransmits\": %llu, \"bytes\": %llu, \"transfers_per_s\": %.3f, \"gbit_per_s\": %.6f,\n"
+                    "    \"latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f},\n"
+                    "    \"boots\": %ld, \"boot_latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f},\n"
+                    "    \"server_cpu_s\": %.3f, \"server_cpu_s_per_gb\": %.3f}\n}\n",
+                elapsed, res.completed, res.failed, (unsigned long long)res.retransmits,
+                (unsigned long long)res.bytes, tps, gbps,
+                percentile_ms(res.latency_us, lat_n, 50), percentile_ms(res.latency_us, lat_n, 99),
+                percentile_ms(res.latency_us, lat_n, 99.9), res.boots,
+                percentile_ms(res.boot_latency_us, boot_n, 50), percentile_ms(res.boot_latency_us, boot_n, 99),
+                percentile_ms(res.boot_latency_us, boot_n, 99.9), cfg.server_pid > 0 ? cpu_s : -1.0, cpu_per_gb);
+        fclose(fp);
+    }
+    return res.failed > 0 ? 2 : 0;
+}
@@ -0,0 +1,281 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tftpCodec.h"
+
+// --- MULTICAST BLKSIZE CHECK ---
+//
+// Loopback regression check for RFC 2090 sessions whose clients disagree on
+// blksize; the simulator does not cover multicast. A session takes its block
+// size from the client that opened it, so every later joiner must accept at
+// least that size, and one without the blksize option takes 512:
+//
+//   big:   A asks for 1024 and opens the session. B, without blksize, is
+//          given a 512-byte session of its own on another group port.
+//          C asks for 1428 and is told 1024.
+//   small: D, without blksize, opens the session and gets no blksize option.
+//          E asks for 1024 and is told 512.
+//
+// The clients that opened a session then run it as master from the group,
+// one after the other, and compare what they received with the file; the
+// other joiners leave with an ERROR. Run against a server started with '-i 127.0.0.1' in
+// the directory holding the files (see run_mcast_check.sh). Exits 1 when any
+// check fails.
+
+#define TIMEOUT_MS 2000
+#define PACKET_BUF_SIZE 1600
+
+static struct sockaddr_in server;
+static int failures;
+
+static void fail(const char *scenario, const char *what) {
+    printf("FAIL %-6s %s\n", scenario, what);
+    failures++;
+}
+
+struct client {
+    int fd;                         // Unicast socket: RRQ, OACK, ACKs
+    struct sockaddr_in tid;         // Session's transfer ID
+    struct tftp_packet reply;
+    char buffer[PACKET_BUF_SIZE];
+};
+
+static int client_open(struct client *c) {
+    struct sockaddr_in local;
+
+    memset(c, 0, sizeof(*c));
+    c->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (c->fd < 0 || bind(c->fd, (const struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("client socket");
+        return -1;
+    }
+    return 0;
+}
+
+// Next packet on 'fd', decoded into 'pkt'; -1 on timeout or a malformed one
+static int receive(int fd, char *buffer, size_t cap, struct tftp_packet *pkt, struct sockaddr_in *from) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    socklen_t from_len = sizeof(*from);
+
+    if (poll(&pfd, 1, TIMEOUT_MS) <= 0) {
+        return -1;
+    }
+    ssize_t n = recvfrom(fd, buffer, cap, 0, (struct sockaddr *)from, &from_len);
+    return n < 0 ? -1 : tftp_decode(buffer, (size_t)n, pkt);
+}
+
+// Sends a multicast RRQ, with blksize when non-NULL, and waits for the reply
+static int client_request(struct client *c, const char *file, const char *blksize) {
+    char packet[512];
+    struct tftp_option options[2] = {{"multicast", ""}, {"blksize", blksize}};
+
+    size_t len = tftp_encode_request(packet, sizeof(packet), OP_RRQ, file, "octet", options,
+                                     blksize != NULL ? 2 : 1);
+    sendto(c->fd, packet, len, 0, (const struct sockaddr *)&server, sizeof(server));
+    return receive(c->fd, c->buffer, sizeof(c->buffer), &c->reply, &c->tid);
+}
+
+static void client_send(struct client *c, const char *packet, size_t len) {
+    sendto(c->fd, packet, len, 0, (const struct sockaddr *)&c->tid, sizeof(c->tid));
+}
+
+static void client_leave(struct client *c) {
+    char packet[64];
+
+    client_send(c, packet, tftp_encode_error(packet, sizeof(packet), 0, "Leaving"));
+}
+
+// Checks an OACK: a multicast option and the blksize option (NULL = absent)
+static int check_oack(const char *scenario, const char *name, struct client *c, const char *blksize) {
+    char what[128];
+
+    if (c->reply.opcode != OP_OACK || tftp_find_option(&c->reply, "multicast") == NULL) {
+        snprintf(what, sizeof(what), "%s: expected a multicast OACK", name);
+        fail(scenario, what);
+        return -1;
+    }
+    const char *got = tftp_find_option(&c->reply, "blksize");
+    if ((got == NULL) != (blksize == NULL) || (got != NULL && strcmp(got, blksize) != 0)) {
+        snprintf(what, sizeof(what), "%s: OACK blksize %s, expected %s", name,
+                 got != NULL ? got : "absent", blksize != NULL ? blksize : "absent");
+        fail(scenario, what);
+        return -1;
+    }
+    return 0;
+}
+
+// Joins the group named in the master's OACK, ACKs every block to the
+// session and compares the data with 'file'
+static int run_master(const char *scenario, struct client *c, const char *file, size_t blksize) {
+    char group[48];
+    int port;
+    int reuse = 1;
+    struct ip_mreq mreq;
+    struct sockaddr_in bind_addr;
+    char packet[64];
+    char data[PACKET_BUF_SIZE];
+    struct tftp_packet pkt;
+    struct sockaddr_in from;
+
+    if (sscanf(tftp_find_option(&c->reply, "multicast"), "%47[^,],%d", group, &port) != 2) {
+        fail(scenario, "master: unparsable multicast option");
+        return -1;
+    }
+    int group_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(group_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, group, &bind_addr.sin_addr);
+    mreq.imr_multiaddr = bind_addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(group_fd, (const struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0 ||
+        setsockopt(group_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("group socket");
+        close(group_fd);
+        fail(scenario, "master: cannot join the group");
+        return -1;
+    }
+
+    FILE *expected = fopen(file, "rb");
+    char want[1500];
+    uint16_t block = 0;
+    int result = -1;
+    client_send(c, packet, tftp_encode_ack(packet, sizeof(packet), 0));
+    while (expected != NULL) {
+        if (receive(group_fd, data, sizeof(data), &pkt, &from) < 0 || pkt.opcode != OP_DATA) {
+            fail(scenario, "master: no DATA from the group");
+            break;
+        }
+        if (pkt.block != (uint16_t)(block + 1)) {
+            continue; // A retransmission of one already ACKed
+        }
+        size_t n = fread(want, 1, blksize, expected);
+        if (pkt.data_len != n || memcmp(pkt.data, want, n) != 0) {
+            fail(scenario, "master: DATA differs from the file");
+            break;
+        }
+        block = pkt.block;
+        client_send(c, packet, tftp_encode_ack(packet, sizeof(packet), block));
+        if (n < blksize) {
+            result = 0;
+            break;
+        }
+    }
+    if (expected != NULL) {
+        fclose(expected);
+    }
+    close(group_fd);
+    return result;
+}
+
+// Whether two OACKs name the same group address and port
+static int same_group(struct client *x, struct client *y) {
+    const char *gx = tftp_find_option(&x->reply, "multicast");
+    const char *gy = tftp_find_option(&y->reply, "multicast");
+
+    size_t nx = (size_t)(strrchr(gx, ',') - gx);     // "<addr>,<port>" before ",<mc>"
+    size_t ny = (size_t)(strrchr(gy, ',') - gy);
+
+    return nx == ny && strncmp(gx, gy, nx) == 0;
+}
+
+static void scenario_big(const char *file) {
+    struct client a, b, cl;
+    int before = failures;
+
+    if (client_open(&a) < 0 || client_open(&b) < 0 || client_open(&cl) < 0) {
+        exit(1);
+    }
+    if (client_request(&a, file, "1024") < 0) {
+        fail("big", "A (1024): no reply");
+        return;
+    }
+    if (check_oack("big", "A (1024)", &a, "1024") < 0) {
+        return;
+    }
+    int b_ok = 0;
+    if (client_request(&b, file, NULL) < 0) {
+        fail("big", "B (no blksize): no reply");
+    } else if (check_oack("big", "B (no blksize)", &b, NULL) == 0) {
+        if (same_group(&a, &b)) {
+            fail("big", "B (no blksize): put in A's 1024-byte session");
+        } else {
+            b_ok = 1;
+        }
+    }
+    if (client_request(&cl, file, "1428") < 0) {
+        fail("big", "C (1428): no reply");
+    } else if (check_oack("big", "C (1428)", &cl, "1024") == 0) {
+        client_leave(&cl);
+    }
+    run_master("big", &a, file, 1024);
+    if (b_ok && run_master("big", &b, file, TFTP_DEFAULT_BLKSIZE) == 0 && failures == before) {
+        printf("ok   big    1024-byte session, 1428 joiner told 1024; no-blksize joiner served by its own 512-byte session\n");
+    }
+    close(a.fd);
+    close(b.fd);
+    close(cl.fd);
+}
+
+static void scenario_small(const char *file) {
+    struct client d, e;
+    int before = failures;
+
+    if (client_open(&d) < 0 || client_open(&e) < 0) {
+        exit(1);
+    }
+    if (client_request(&d, file, NULL) < 0) {
+        fail("small", "D (no blksize): no reply");
+        return;
+    }
+    if (check_oack("small", "D (no blksize)", &d, NULL) < 0) {
+        return;
+    }
+    if (client_request(&e, file, "1024") < 0) {
+        fail("small", "E (1024): no reply");
+    } else if (check_oack("small", "E (1024)", &e, "512") == 0) {
+        client_leave(&e);
+    }
+    if (run_master("small", &d, file, TFTP_DEFAULT_BLKSIZE) == 0 && failures == before) {
+        printf("ok   small  512-byte session: 1024 joiner told 512\n");
+    }
+    close(d.fd);
+    close(e.fd);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int port = 69;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        if (opt == 'p') {
+            port = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-p port] <file for the big session> <file for the small one>\n", argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-p port] <file for the big session> <file for the small one>\n", argv[0]);
+        return 2;
+    }
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    scenario_big(argv[optind]);
+    scenario_small(argv[optind + 1]);
+    return failures > 0;
+}
@@ -0,0 +1,188 @@
+#include "tftpServer.h"
+
+#include <time.h>
+#include <sys/wait.h>
+
+// --- SESSION MEMORY BENCHMARK ---
+//
+// Resident memory per in-process transfer session (ServerSource/tftpSessions.c)
+// at each requested count. Each run forks a fresh process, opens that many
+// sessions from made-up loopback clients (127.1.x.x, requests and ACKs handed
+// straight to the session code) and reads its RSS from /proc/self/statm:
+//
+//   idle    RRQs for a file in the packet cache: DATA 1 sent, waiting for ACK 1.
+//           These hold no packet buffer and no descriptor.
+//   active  RRQs for a file read block by block: each holds a packet buffer
+//           with the block in flight, all of them share one descriptor.
+//
+// After the count is reached, every session gets one ACK (the next DATA goes
+// out) to time the steady-state step, then an ERROR that ends it. DATA goes
+// to addresses nobody listens on, which loopback drops.
+
+#define BENCH_FILE_SIZE (64 * 1024)
+#define BENCH_MAX_COUNTS 8
+
+struct server_config g_config;
+struct tftp_archive g_archive;      // Not mapped
+uint32_t g_transfer_id;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t rss_bytes(void) {
+    unsigned long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static void fake_peer(uint32_t i, struct sockaddr_in *peer) {
+    memset(peer, 0, sizeof(*peer));
+    peer->sin_family = AF_INET;
+    peer->sin_addr.s_addr = htonl(0x7f010001u + (i >> 14));
+    peer->sin_port = htons((uint16_t)(10000 + (i & 16383)));
+}
+
+static int write_file(const char *name) {
+    char block[4096];
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (char)(i * 31);
+    }
+    for (int i = 0; i < BENCH_FILE_SIZE / (int)sizeof(block); i++) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// One measurement, in its own process so every run starts from the same RSS
+static int run(const char *kind, uint32_t count) {
+    int idle = strcmp(kind, "idle") == 0;
+    const char *name = idle ? "hot.bin" : "cold.bin";
+    char request[64], packet[16];
+    struct tftp_packet req;
+
+    if (stats_init() < 0 || pcache_init(PCACHE_BUDGET_DEFAULT) < 0 || session_init(count) < 0) {
+        return -1;
+    }
+    if (idle) {
+        // Enough misses to get the file into the packet cache, then its build
+        int fd = open(name, O_RDONLY);
+        for (int i = 0; i < PCACHE_HOT_MISSES; i++) {
+            pcache_find(name, fd, NULL, BLOCK_SIZE);
+        }
+        close(fd);
+        do {
+            pcache_refresh(stats_now_us());
+        } while (pcache_timeout_ms() == 0);
+    }
+    tftp_decode(request, tftp_encode_request(request, sizeof(request), OP_RRQ, name, "octet", NULL, 0), &req);
+    uint64_t base = rss_bytes();
+
+    double start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        struct sockaddr_in peer;
+        fake_peer(i, &peer);
+        g_transfer_id = i + 1;
+        g_request_us = stats_now_us();
+        if (session_start(&req, &peer) < 0) {
+            fprintf(stderr, "%s: session %u not started\n", kind, i);
+            return -1;
+        }
+    }
+    double started = now_sec() - start;
+    uint64_t rss = rss_bytes();
+    int64_t buffers = g_stats->session_buffers;
+
+    // One ACK each: DATA 2 goes out (and, for 'active', is read into the buffer)
+    size_t ack_len = tftp_encode_ack(packet, sizeof(packet), 1);
+    start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        struct sockaddr_in peer;
+        fake_peer(i, &peer);
+        session_receive(session_socket(&peer), packet, ack_len, &peer);
+    }
+    double acked = now_sec() - start;
+    uint64_t sent = g_stats->blocks_sent;
+
+    size_t error_len = tftp_encode_error(packet, sizeof(packet), 0, "done");
+    for (uint32_t i = 0; i < count; i++) {
+        struct sockaddr_in peer;
+        fake_peer(i, &peer);
+        session_receive(session_socket(&peer), packet, error_len, &peer);
+    }
+
+    printf("%-7s %8u %10.1f %10.0f %9lld %10.2f %10.2f %8s\n", kind, count, (double)(rss - base) / (1 << 20),
+           (double)(rss - base) / count, (long long)buffers, started * 1e9 / count, acked * 1e9 / count,
+           g_stats->sessions == 0 && sent == 2ull * count ? "ok" : "FAIL");
+    return g_stats->sessions == 0 && sent == 2ull * count ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n count]...   (default: -n 10000 -n 100000)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t counts[BENCH_MAX_COUNTS];
+    int count_n = 0, opt, failures = 0;
+    char dir[] = "/tmp/tftp_session_bench.XXXXXX";
+
+    tftp_log_level = TFTP_LOG_ERROR;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        if (opt == 'n' && count_n < BENCH_MAX_COUNTS && atol(optarg) > 0 && atol(optarg) <= SESSION_MAX) {
+            counts[count_n++] = (uint32_t)atol(optarg);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (count_n == 0) {
+        counts[count_n++] = 10000;
+        counts[count_n++] = 100000;
+    }
+    if (mkdtemp(dir) == NULL || chdir(dir) < 0 || write_file("hot.bin") < 0 || write_file("cold.bin") < 0) {
+        perror("bench setup");
+        return 2;
+    }
+
+    printf("%d-byte packet buffers, %d KiB file, blksize %d\n\n", SESSION_PACKET_SIZE, BENCH_FILE_SIZE / 1024,
+           BLOCK_SIZE);
+    printf("%-7s %8s %10s %10s %9s %10s %10s %8s\n", "kind", "sessions", "rss MiB", "B/session", "buffers",
+           "start ns", "ack ns", "check");
+    for (int i = 0; i < count_n; i++) {
+        const char *kinds[] = { "idle", "active" };
+        for (int k = 0; k < 2; k++) {
+            int status;
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(run(kinds[k], counts[i]) == 0 ? 0 : 1);
+            }
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failures++;
+            }
+        }
+    }
+
+    unlink("hot.bin");
+    unlink("cold.bin");
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return failures > 0 ? 1 : 0;
+}
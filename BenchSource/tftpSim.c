@@ -0,0 +1,609 @@
+#include "tftpServer.h"
+#include <sys/mman.h>
+#include <time.h>
+
+// --- DETERMINISTIC TRANSFER SIMULATOR ---
+//
+// Runs the server's real tftpReadTransfer()/tftpWriteTransfer() against a
+// scripted client over a simulated network, through the struct tftp_io
+// interface (tftpIo.h). Time is virtual: when the server waits for a packet
+// the simulator jumps the clock straight to the next delivery, client timer
+// or server deadline, so a transfer that would spend minutes in 3-second
+// timeouts finishes in microseconds of real time.
+//
+// Every transfer draws loss, duplication, delay and reordering from its own
+// generator seeded with (seed, transfer index), so any run, and any single
+// transfer within it ('-x'), replays exactly.
+//
+// Only the child side of a transfer is simulated: the request itself is
+// assumed delivered. Client retransmissions of the RRQ/WRQ are counted but go
+// to the listening port, which the simulation does not model.
+
+#define SIM_MAX_IN_FLIGHT 256
+#define SIM_CLIENT_PORT 40000
+#define SIM_SERVER_PORT 50000
+#define SIM_MAX_SCENARIOS 32
+
+struct sim_params {
+    const char *name;
+    uint16_t opcode;                // OP_RRQ or OP_WRQ
+    size_t size;
+    double loss;                    // Per-packet probabilities, both directions
+    double duplicate;
+    double reorder;                 // Packet held back an extra reorder_ms
+    double delay_ms;                // One-way
+    double jitter_ms;               // Uniform +/-
+    double reorder_ms;
+    int client_timeout_ms;
+    int client_retries;
+    int dally;                      // Reader keeps re-ACKing after its last block
+    int expect_clean;               // Regression: every transfer must succeed on both sides
+};
+
+struct sim_packet {
+    uint64_t at_us;
+    int to_server;
+    size_t len;
+    char data[PACKET_BUF_SIZE];
+};
+
+struct sim_client {
+    int done;                       // Finished (successfully or not)
+    int ok;
+    int complete;                   // Reader saw the final short block
+    uint32_t block;                 // Reader: next expected. Writer: block in flight (0 = waiting for ACK 0)
+    int retries;
+    uint64_t timer_us;              // Next retransmission; 0 = none
+    uint64_t done_us;
+    size_t offset;                  // Bytes received / sent and acknowledged
+    size_t last_len;                // Writer: payload length of the block in flight
+    char *received;                 // Reader's copy of the file
+};
+
+struct sim_world {
+    const struct sim_params *p;
+    uint64_t now_us;
+    uint64_t rng;
+    struct sim_packet flight[SIM_MAX_IN_FLIGHT];
+    int flight_count;
+    struct sim_client client;
+    const char *source;             // File contents
+    struct sockaddr_in client_addr;
+    struct sockaddr_in server_addr;
+    uint64_t server_done_us;        // When the server's transfer function returned
+    uint64_t packets;               // Datagrams put on the wire
+    uint64_t dropped;
+    uint64_t server_data_sent;
+    uint64_t client_retransmits;
+};
+
+struct sim_totals {
+    long transfers;
+    long client_ok;
+    long server_ok;
+    long corrupt;
+    uint64_t packets;
+    uint64_t dropped;
+    uint64_t server_data_sent;
+    uint64_t client_retransmits;
+    uint64_t *duration_us;          // Virtual time until both sides were done
+};
+
+struct server_config g_config;     // Zeroed: no decompression cache
+struct tftp_archive g_archive;     // Not mapped: files come from memfds
+uint32_t g_transfer_id;
+
+// --- RANDOMNESS ---
+
+static uint64_t sim_rand(struct sim_world *w) {
+    // xorshift64*
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 2685821657736338717ull;
+}
+
+static double sim_uniform(struct sim_world *w) {
+    return (double)(sim_rand(w) >> 11) / (double)(1ull << 53);
+}
+
+// --- NETWORK ---
+
+static void net_send(struct sim_world *w, int to_server, const void *buf, size_t len) {
+    const struct sim_params *p = w->p;
+    int copies = 1;
+
+    w->packets++;
+    if (len > PACKET_BUF_SIZE) {
+        len = PACKET_BUF_SIZE;
+    }
+    if (sim_uniform(w) < p->loss) {
+        w->dropped++;
+        return;
+    }
+    if (sim_uniform(w) < p->duplicate) {
+        copies = 2;
+    }
+    for (int c = 0; c < copies && w->flight_count < SIM_MAX_IN_FLIGHT; c++) {
+        double delay_ms = p->delay_ms + (sim_uniform(w) * 2.0 - 1.0) * p->jitter_ms;
+        if (sim_uniform(w) < p->reorder) {
+            delay_ms += p->reorder_ms;
+        }
+        if (delay_ms < 0) {
+            delay_ms = 0;
+        }
+        struct sim_packet *pkt = &w->flight[w->flight_count++];
+        pkt->at_us = w->now_us + (uint64_t)(delay_ms * 1000.0);
+        pkt->to_server = to_server;
+        pkt->len = len;
+        memcpy(pkt->data, buf, len);
+    }
+}
+
+// Index of the earliest in-flight packet, -1 when the network is empty
+static int net_next(const struct sim_world *w) {
+    int best = -1;
+    for (int i = 0; i < w->flight_count; i++) {
+        if (best < 0 || w->flight[i].at_us < w->flight[best].at_us) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void net_remove(struct sim_world *w, int i) {
+    w->flight[i] = w->flight[--w->flight_count];
+}
+
+// --- SCRIPTED CLIENT (mirrors ClientReadSource / ClientWriteSource) ---
+
+static void client_send_ack(struct sim_world *w, uint32_t block) {
+    char packet[4];
+    *(uint16_t *)packet = htons(OP_ACK);
+    *(uint16_t *)(packet + 2) = htons((uint16_t)block);
+    net_send(w, 1, packet, sizeof(packet));
+}
+
+static void client_send_data(struct sim_world *w) {
+    struct sim_client *c = &w->client;
+    char packet[PACKET_BUF_SIZE];
+    size_t remaining = w->p->size - c->offset;
+
+    c->last_len = remaining < BLOCK_SIZE ? remaining : BLOCK_SIZE;
+    *(uint16_t *)packet = htons(OP_DATA);
+    *(uint16_t *)(packet + 2) = htons((uint16_t)c->block);
+    memcpy(packet + 4, w->source + c->offset, c->last_len);
+    net_send(w, 1, packet, 4 + c->last_len);
+}
+
+static void client_finish(struct sim_world *w, int ok) {
+    struct sim_client *c = &w->client;
+    c->done = 1;
+    c->ok = ok;
+    c->done_us = w->now_us;
+    c->timer_us = 0;
+}
+
+static void client_arm(struct sim_world *w) {
+    w->client.timer_us = w->now_us + (uint64_t)w->p->client_timeout_ms * 1000u;
+}
+
+// Maps a 16-bit block number onto the 32-bit counter nearest to ref
+static uint32_t extend_block(uint32_t ref, uint16_t block) {
+    return ref + (uint32_t)(int16_t)(uint16_t)(block - (uint16_t)ref);
+}
+
+static void client_receive(struct sim_world *w, const char *packet, size_t n) {
+    struct sim_client *c = &w->client;
+    if (n < 4) {
+        return;
+    }
+    uint16_t opcode = ntohs(*(const uint16_t *)packet);
+    uint32_t block = extend_block(c->block, ntohs(*(const uint16_t *)(packet + 2)));
+
+    if (opcode == OP_ERROR) {
+        if (!c->done) {
+            client_finish(w, 0);
+        }
+        return;
+    }
+
+    if (w->p->opcode == OP_RRQ && opcode == OP_DATA) {
+        size_t len = n - 4;
+        if (c->done) {
+            // Only a dallying reader still answers the server
+            if (w->p->dally && block < c->block) {
+                client_send_ack(w, block);
+            }
+            return;
+        }
+        if (block == c->block) {
+            if (c->offset + len > w->p->size) {
+                client_finish(w, 0);
+                return;
+            }
+            memcpy(c->received + c->offset, packet + 4, len);
+            c->offset += len;
+            client_send_ack(w, block);
+            c->block++;
+            c->retries = 0;
+            if (len < BLOCK_SIZE) {
+                c->complete = 1;
+                client_finish(w, c->offset == w->p->size &&
+                                 memcmp(c->received, w->source, w->p->size) == 0);
+            } else {
+                client_arm(w);
+            }
+        } else if (block < c->block) {
+            // Duplicate DATA: re-ACK it, as packetProcessingLogic() does
+            client_send_ack(w, block);
+            c->retries = 0;
+        } else {
+            client_finish(w, 0);
+        }
+    } else if (w->p->opcode == OP_WRQ && opcode == OP_ACK && !c->done) {
+        if (block != c->block) {
+            return; // Old ACK: ignored
+        }
+        if (block > 0) {
+            c->offset += c->last_len;
+            if (c->last_len < BLOCK_SIZE) {
+                client_finish(w, 1);
+                return;
+            }
+        }
+        c->block++;
+        c->retries = 0;
+        client_send_data(w);
+        client_arm(w);
+    }
+}
+
+static void client_timeout(struct sim_world *w) {
+    struct sim_client *c = &w->client;
+
+    if (++c->retries > w->p->client_retries) {
+        client_finish(w, 0);
+        return;
+    }
+    w->client_retransmits++;
+    if (w->p->opcode == OP_RRQ) {
+        // Before DATA 1 the real client resends the RRQ to the listening port
+        if (c->block > 1) {
+            client_send_ack(w, c->block - 1);
+        }
+    } else if (c->block > 0) {
+        client_send_data(w);
+    }
+    client_arm(w);
+}
+
+// --- SIMULATED I/O BACKEND FOR THE SERVER ---
+
+static ssize_t sim_io_send(void *ctx, const void *buf, size_t len,
+                           const struct sockaddr_in *to, socklen_t to_len) {
+    struct sim_world *w = ctx;
+    (void)to;
+    (void)to_len;
+    if (len >= 4 && ntohs(*(const uint16_t *)buf) == OP_DATA) {
+        w->server_data_sent++;
+    }
+    net_send(w, 0, buf, len);
+    return (ssize_t)len;
+}
+
+// Advances the world until a packet reaches the server or the timeout expires
+static ssize_t sim_io_recv(void *ctx, void *buf, size_t len,
+                           struct sockaddr_in *from, socklen_t *from_len, uint64_t timeout_us) {
+    struct sim_world *w = ctx;
+    uint64_t deadline = w->now_us + timeout_us;
+
+    for (;;) {
+        int next = net_next(w);
+        uint64_t packet_at = next >= 0 ? w->flight[next].at_us : UINT64_MAX;
+        uint64_t timer_at = w->client.timer_us ? w->client.timer_us : UINT64_MAX;
+
+        if (packet_at > deadline && timer_at > deadline) {
+            w->now_us = deadline;
+            return TFTP_IO_TIMEOUT;
+        }
+        if (timer_at < packet_at) {
+            w->now_us = timer_at;
+            client_timeout(w);
+            continue;
+        }
+
+        struct sim_packet pkt = w->flight[next];
+        net_remove(w, next);
+        w->now_us = pkt.at_us;
+        if (!pkt.to_server) {
+            client_receive(w, pkt.data, pkt.len);
+            continue;
+        }
+        size_t n = pkt.len < len ? pkt.len : len;
+        memcpy(buf, pkt.data, n);
+        *from = w->client_addr;
+        *from_len = sizeof(*from);
+        return (ssize_t)n;
+    }
+}
+
+// After the server returns: let the client see what is still in flight and
+// run out its timers. Packets to the server go nowhere (its socket is closed).
+static void sim_drain(struct sim_world *w) {
+    for (;;) {
+        int next = net_next(w);
+        uint64_t packet_at = next >= 0 ? w->flight[next].at_us : UINT64_MAX;
+        uint64_t timer_at = w->client.timer_us ? w->client.timer_us : UINT64_MAX;
+
+        if (packet_at == UINT64_MAX && timer_at == UINT64_MAX) {
+            return;
+        }
+        if (timer_at < packet_at) {
+            w->now_us = timer_at;
+            client_timeout(w);
+            continue;
+        }
+        struct sim_packet pkt = w->flight[next];
+        net_remove(w, next);
+        w->now_us = pkt.at_us;
+        if (!pkt.to_server) {
+            client_receive(w, pkt.data, pkt.len);
+        }
+    }
+}
+
+static uint64_t sim_io_now_us(void *ctx) {
+    return ((struct sim_world *)ctx)->now_us;
+}
+
+// --- SCENARIOS ---
+
+static const struct sim_params builtin_scenarios[] = {
+    // name               op      size    loss  dup   reord  delay jitter reord_ms tmo_ms retries dally clean
+    {"rrq-clean",         OP_RRQ, 65536,  0,    0,    0,     1,    0,     0,       1000,  5,      0,    1},
+    {"wrq-clean",         OP_WRQ, 65536,  0,    0,    0,     1,    0,     0,       1000,  5,      0,    1},
+    {"rrq-exact-blocks",  OP_RRQ, 8192,   0,    0,    0,     1,    0,     0,       1000,  5,      0,    1},
+    {"rrq-empty",         OP_RRQ, 0,      0,    0,    0,     1,    0,     0,       1000,  5,      0,    1},
+    {"wrq-empty",         OP_WRQ, 0,      0,    0,    0,     1,    0,     0,       1000,  5,      0,    1},
+    {"rrq-dup-reorder",   OP_RRQ, 65536,  0,    0.05, 0.05,  1,    2,     5,       1000,  5,      1,    1},
+    {"wrq-dup-reorder",   OP_WRQ, 65536,  0,    0.05, 0.05,  1,    2,     5,       1000,  5,      0,    1},
+    {"rrq-loss-2",        OP_RRQ, 65536,  0.02, 0,    0,     5,    1,     0,       1000,  5,      0,    0},
+    {"wrq-loss-2",        OP_WRQ, 65536,  0.02, 0,    0,     5,    1,     0,       1000,  5,      0,    0},
+    {"rrq-loss-10",       OP_RRQ, 65536,  0.10, 0,    0,     5,    1,     0,       1000,  5,      0,    0},
+    {"wrq-loss-10",       OP_WRQ, 65536,  0.10, 0,    0,     5,    1,     0,       1000,  5,      0,    0},
+    // Strategy comparison: client retransmit timer and dallying on the final ACK
+    {"rrq-loss-5-tmo500",  OP_RRQ, 65536, 0.05, 0,    0,     5,    1,     0,       500,   8,      0,    0},
+    {"rrq-loss-5-tmo3000", OP_RRQ, 65536, 0.05, 0,    0,     5,    1,     0,       3000,  5,      0,    0},
+    {"rrq-loss-5-dally",   OP_RRQ, 65536, 0.05, 0,    0,     5,    1,     0,       1000,  5,      1,    0},
+    {"wrq-wan-jitter",     OP_WRQ, 262144, 0.01, 0.01, 0.02, 40,   20,    30,      1000,  5,      0,    0},
+};
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int make_memfd(const char *name, const char *data, size_t size) {
+    int fd = memfd_create(name, 0);
+    if (fd < 0) {
+        perror("memfd_create failed");
+        return -1;
+    }
+    if (size > 0 && write(fd, data, size) != (ssize_t)size) {
+        perror("memfd write failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Runs one transfer; returns the server's result and fills the world
+static int run_transfer(struct sim_world *w, const struct sim_params *p, uint64_t seed, long index,
+                        const char *path, const char *source, char *received) {
+    struct tftp_io io = {w, sim_io_send, sim_io_recv, sim_io_now_us};
+
+    memset(w, 0, sizeof(*w));
+    w->p = p;
+    w->rng = (seed * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)index + 1) * 0xBF58476D1CE4E5B9ull;
+    if (w->rng == 0) {
+        w->rng = 1;
+    }
+    w->client_addr.sin_family = AF_INET;
+    w->client_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    w->client_addr.sin_port = htons(SIM_CLIENT_PORT);
+    w->server_addr = w->client_addr;
+    w->server_addr.sin_port = htons(SIM_SERVER_PORT);
+    w->source = source;
+    w->client.received = received;
+
+    g_transfer_id = (uint32_t)index;
+    int result;
+    if (p->opcode == OP_RRQ) {
+        w->client.block = 1;
+        client_arm(w);      // Waiting for DATA 1
+        result = tftpReadTransfer(&io, &w->client_addr, sizeof(w->client_addr), path, "octet", NULL);
+    } else {
+        w->client.block = 0; // WRQ sent; waiting for ACK 0
+        client_arm(w);
+        result = tftpWriteTransfer(&io, &w->client_addr, sizeof(w->client_addr), path, "octet", NULL);
+    }
+    w->server_done_us = w->now_us;
+    sim_drain(w);
+    return result;
+}
+
+static int run_scenario(const struct sim_params *p, long transfers, uint64_t seed, long only_index,
+                        struct sim_totals *t) {
+    static struct sim_world world;
+    char path[64];
+    char *source = malloc(p->size + 1);
+    char *received = malloc(p->size + 1);
+    char *stored = malloc(p->size + 1);
+    int src_fd = -1, dst_fd = -1;
+
+    memset(t, 0, sizeof(*t));
+    t->duration_us = calloc((size_t)transfers, sizeof(uint64_t));
+    if (source == NULL || received == NULL || stored == NULL || t->duration_us == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    for (long i = 0; i < transfers; i++) {
+        if (only_index >= 0 && i != only_index) {
+            continue;
+        }
+        // File contents are part of the deterministic input too
+        uint64_t fill = seed ^ ((uint64_t)i << 32) ^ 0x5DEECE66Dull;
+        for (size_t b = 0; b < p->size; b++) {
+            fill = fill * 6364136223846793005ull + 1442695040888963407ull;
+            source[b] = (char)(fill >> 56);
+        }
+
+        if (p->opcode == OP_RRQ) {
+            if (src_fd >= 0) close(src_fd);
+            src_fd = make_memfd("tftp-sim-src", source, p->size);
+            if (src_fd < 0) return -1;
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", src_fd);
+        } else {
+            if (dst_fd < 0 && (dst_fd = make_memfd("tftp-sim-dst", NULL, 0)) < 0) return -1;
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", dst_fd);
+        }
+
+        int result = run_transfer(&world, p, seed, i, path, source, received);
+        uint64_t end_us = world.server_done_us > world.client.done_us ? world.server_done_us : world.client.done_us;
+
+        int server_ok = result == 0;
+        int client_ok = world.client.done && world.client.ok;
+        int corrupt = 0;
+        if (p->opcode == OP_WRQ && server_ok) {
+            ssize_t got = pread(dst_fd, stored, p->size + 1, 0);
+            corrupt = got != (ssize_t)p->size || memcmp(stored, source, p->size) != 0;
+        }
+        if (p->opcode == OP_RRQ && world.client.complete) {
+            corrupt = !world.client.ok; // Finished, but not with the right bytes
+        }
+
+        t->duration_us[t->transfers++] = end_us;
+        t->client_ok += client_ok;
+        t->server_ok += server_ok;
+        t->corrupt += corrupt;
+        t->packets += world.packets;
+        t->dropped += world.dropped;
+        t->server_data_sent += world.server_data_sent;
+        t->client_retransmits += world.client_retransmits;
+
+        if (only_index >= 0 || corrupt || (p->expect_clean && !(server_ok && client_ok))) {
+            fprintf(stderr, "  %s #%ld: server %s, client %s%s, %.3f s virtual, %llu packets\n",
+                    p->name, i, server_ok ? "ok" : "FAILED", client_ok ? "ok" : "FAILED",
+                    corrupt ? ", DATA CORRUPTED" : "", (double)end_us / 1e6,
+                    (unsigned long long)world.packets);
+        }
+    }
+
+    if (src_fd >= 0) close(src_fd);
+    if (dst_fd >= 0) close(dst_fd);
+    free(source);
+    free(received);
+    free(stored);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n transfers   virtual transfers per scenario (1000)\n"
+            "  -S seed        random seed (1)\n"
+            "  -s name        run only scenarios whose name contains this\n"
+            "  -x index       replay a single transfer (with -s), printing its outcome\n"
+            "  -v             server debug logging (use with -x)\n"
+            "Custom scenario instead of the built-in suite:\n"
+            "  -m rrq|wrq  -z bytes  -L loss%%  -U dup%%  -R reorder%%  -D delay_ms\n"
+            "  -J jitter_ms  -T client_timeout_ms  -r client_retries  -d (dally)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct sim_params custom = {"custom", 0, 65536, 0, 0, 0, 1, 0, 10, 1000, 5, 0, 0};
+    const struct sim_params *scenarios[SIM_MAX_SCENARIOS];
+    int scenario_count = 0;
+    long transfers = 1000;
+    long only_index = -1;
+    uint64_t seed = 1;
+    const char *filter = NULL;
+    int opt, failures = 0;
+
+    tftp_log_level = TFTP_LOG_ERROR; // Aborted transfers are expected here
+
+    while ((opt = getopt(argc, argv, "n:S:s:x:vm:z:L:U:R:D:J:T:r:dh")) != -1) {
+        switch (opt) {
+        case 'n': transfers = atol(optarg); break;
+        case 'S': seed = strtoull(optarg, NULL, 10); break;
+        case 's': filter = optarg; break;
+        case 'x': only_index = atol(optarg); break;
+        case 'v': tftp_log_level = TFTP_LOG_DEBUG; break;
+        case 'm':
+            custom.opcode = strcasecmp(optarg, "wrq") == 0 ? OP_WRQ : OP_RRQ;
+            break;
+        case 'z': custom.size = (size_t)atol(optarg); break;
+        case 'L': custom.loss = atof(optarg) / 100.0; break;
+        case 'U': custom.duplicate = atof(optarg) / 100.0; break;
+        case 'R': custom.reorder = atof(optarg) / 100.0; break;
+        case 'D': custom.delay_ms = atof(optarg); break;
+        case 'J': custom.jitter_ms = atof(optarg); break;
+        case 'T': custom.client_timeout_ms = atoi(optarg); break;
+        case 'r': custom.client_retries = atoi(optarg); break;
+        case 'd': custom.dally = 1; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (transfers < 1 || (only_index >= transfers)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (custom.opcode != 0) {
+        scenarios[scenario_count++] = &custom;
+    } else {
+        for (size_t i = 0; i < sizeof(builtin_scenarios) / sizeof(builtin_scenarios[0]); i++) {
+            if (filter == NULL || strstr(builtin_scenarios[i].name, filter) != NULL) {
+                scenarios[scenario_count++] = &builtin_scenarios[i];
+            }
+        }
+    }
+
+    printf("%-20s %7s %8s %8s %7s %9s %9s %9s %8s %8s\n", "scenario", "runs", "client", "server",
+           "corrupt", "p50 s", "p99 s", "max s", "pkts/xfr", "wall ms");
+    for (int s = 0; s < scenario_count; s++) {
+        const struct sim_params *p = scenarios[s];
+        struct sim_totals t;
+        struct timespec t0, t1;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (run_scenario(p, transfers, seed, only_index, &t) < 0) {
+            return 2;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (t.transfers == 0) {
+            continue;
+        }
+
+        qsort(t.duration_us, (size_t)t.transfers, sizeof(uint64_t), cmp_u64);
+        int failed = t.corrupt > 0 || (p->expect_clean && (t.client_ok != t.transfers || t.server_ok != t.transfers));
+        failures += failed;
+
+        printf("%-20s %7ld %7.1f%% %7.1f%% %7ld %9.3f %9.3f %9.3f %8.1f %8.1f%s\n", p->name, t.transfers,
+               100.0 * (double)t.client_ok / (double)t.transfers, 100.0 * (double)t.server_ok / (double)t.transfers,
+               t.corrupt, (double)t.duration_us[t.transfers / 2] / 1e6,
+               (double)t.duration_us[(t.transfers * 99) / 100] / 1e6, (double)t.duration_us[t.transfers - 1] / 1e6,
+               (double)t.packets / (double)t.transfers,
+               (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6,
+               failed ? "  FAIL" : "");
+        free(t.duration_us);
+    }
+
+    if (failures > 0) {
+        printf("%d scenario(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,365 @@
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "tftpTimer.h"
+
+// --- RETRANSMISSION TIMER MICROBENCHMARK ---
+//
+// Costs of the timer wheel (CommonSource/tftpTimer.c) with this many timers
+// armed, next to the binary heap the sessions used before it:
+//
+//   arm     a timer not armed yet, 1-4 s out (a new transfer)
+//   re-arm  an armed timer moved to 3 s from now (an ACK arrived)
+//   expire  handing out timers that fell due, on a clock stepped 1 ms at a time
+//   cancel  an armed timer dropped (a transfer ended)
+//
+// The expire pass checks that every timer fired once, never before its
+// deadline and less than a tick after it; exit status 1 means one did not.
+//
+// Then the wheel runs on the real clock with its timerfd: the timers fall due
+// over two seconds and the loop sleeps in poll() until the descriptor fires.
+// Lateness is how long after its deadline each timer was handed out. The run
+// is repeated while another process sends stray datagrams to a socket in the
+// same poll() set, which must not change it.
+
+#define BENCH_TICK_US 1000
+#define BENCH_MAX_COUNTS 8
+#define ACCURACY_SPREAD_US 2000000u
+#define NOISE_GAP_US 50             // Between stray datagrams
+
+struct item {
+    struct tftp_timer timer;
+    uint64_t deadline;
+    uint32_t heap;                  // Position in the baseline heap
+    uint32_t fired;
+};
+
+static struct item *items;
+static uint32_t *heap, heap_len;
+static uint64_t rng = 1;
+
+static uint32_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static struct item *item_of(struct tftp_timer *t) {
+    return (struct item *)((char *)t - offsetof(struct item, timer));
+}
+
+// --- BASELINE: the deadline heap tftpSessions.c kept before the wheel ---
+
+static void heap_set(uint32_t pos, uint32_t i) {
+    heap[pos] = i;
+    items[i].heap = pos;
+}
+
+static void heap_fix(uint32_t pos) {
+    uint32_t i = heap[pos];
+    uint64_t due = items[i].deadline;
+
+    while (pos > 0 && items[heap[(pos - 1) / 2]].deadline > due) {
+        heap_set(pos, heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    for (;;) {
+        uint32_t child = 2 * pos + 1;
+        if (child >= heap_len) {
+            break;
+        }
+        if (child + 1 < heap_len && items[heap[child + 1]].deadline < items[heap[child]].deadline) {
+            child++;
+        }
+        if (items[heap[child]].deadline >= due) {
+            break;
+        }
+        heap_set(pos, heap[child]);
+        pos = child;
+    }
+    heap_set(pos, i);
+}
+
+static void heap_remove(uint32_t i) {
+    uint32_t pos = items[i].heap;
+    uint32_t last = heap[--heap_len];
+    if (pos < heap_len) {
+        heap_set(pos, last);
+        heap_fix(pos);
+    }
+}
+
+// --- OPERATION COSTS ---
+
+struct costs {
+    double arm, rearm, expire, cancel;  // ns per timer
+};
+
+static void deadlines(uint32_t count, uint64_t base, uint64_t spread) {
+    for (uint32_t i = 0; i < count; i++) {
+        items[i].deadline = base + next_rand() % spread;
+    }
+}
+
+static int run_wheel(uint32_t count, struct costs *c) {
+    struct tftp_timer_wheel w;
+    uint64_t base = 1000000000ull, late = 0;
+    int failures = 0;
+
+    tftp_timer_init(&w, BENCH_TICK_US, base, 0);
+    memset(items, 0, count * sizeof(*items));
+    deadlines(count, base + 1000000, 3000000);
+    double start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        tftp_timer_arm(&w, &items[i].timer, items[i].deadline);
+    }
+    c->arm = (now_sec() - start) * 1e9 / count;
+
+    deadlines(count, base + 3000000, 100000);
+    start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        tftp_timer_arm(&w, &items[i].timer, items[i].deadline);
+    }
+    c->rearm = (now_sec() - start) * 1e9 / count;
+
+    // Fired timers are re-armed no more, so the clock runs until all are out
+    uint32_t fired = 0;
+    start = now_sec();
+    for (uint64_t clock = base; fired < count && clock < base + 10000000; clock += BENCH_TICK_US) {
+        struct tftp_timer *t;
+        while ((t = tftp_timer_expired(&w, clock)) != NULL) {
+            struct item *it = item_of(t);
+            it->fired++;
+            fired++;
+            if (clock < it->deadline || clock - it->deadline >= BENCH_TICK_US) {
+                late++;
+            }
+        }
+    }
+    c->expire = (now_sec() - start) * 1e9 / count;
+    for (uint32_t i = 0; i < count; i++) {
+        failures += items[i].fired != 1;
+    }
+    if (failures > 0 || late > 0 || w.count != 0) {
+        fprintf(stderr, "wheel: %d timers fired other than once, %llu off their tick\n", failures,
+                (unsigned long long)late);
+        return -1;
+    }
+
+    deadlines(count, base + 20000000, 3000000);
+    for (uint32_t i = 0; i < count; i++) {
+        tftp_timer_arm(&w, &items[i].timer, items[i].deadline);
+    }
+    start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        tftp_timer_cancel(&w, &items[i].timer);
+    }
+    c->cancel = (now_sec() - start) * 1e9 / count;
+    return w.count == 0 ? 0 : -1;
+}
+
+static void run_heap(uint32_t count, struct costs *c) {
+    uint64_t base = 1000000000ull;
+
+    heap_len = 0;
+    deadlines(count, base + 1000000, 3000000);
+    double start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        heap_set(heap_len++, i);
+        heap_fix(heap_len - 1);
+    }
+    c->arm = (now_sec() - start) * 1e9 / count;
+
+    start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        items[i].deadline = base + 3000000 + next_rand() % 100000;
+        heap_fix(items[i].heap);
+    }
+    c->rearm = (now_sec() - start) * 1e9 / count;
+
+    start = now_sec();
+    for (uint64_t clock = base; heap_len > 0; clock += BENCH_TICK_US) {
+        while (heap_len > 0 && items[heap[0]].deadline <= clock) {
+            heap_remove(heap[0]);
+        }
+    }
+    c->expire = (now_sec() - start) * 1e9 / count;
+
+    deadlines(count, base + 20000000, 3000000);
+    for (uint32_t i = 0; i < count; i++) {
+        heap_set(heap_len++, i);
+        heap_fix(heap_len - 1);
+    }
+    start = now_sec();
+    for (uint32_t i = 0; i < count; i++) {
+        heap_remove(i);
+    }
+    c->cancel = (now_sec() - start) * 1e9 / count;
+}
+
+// --- ACCURACY ON THE REAL CLOCK ---
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// A child sending stray datagrams to 'port' until killed
+static pid_t start_noise(uint16_t port) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(port);
+    for (;;) {
+        sendto(fd, "\0\4\0\1", 4, 0, (struct sockaddr *)&to, sizeof(to));
+        usleep(NOISE_GAP_US);
+    }
+}
+
+static int run_accuracy(uint32_t count, int noisy, uint64_t *lateness) {
+    struct tftp_timer_wheel w;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    char packet[64];
+    uint64_t strays = 0;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(sock, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("socket");
+        return -1;
+    }
+    pid_t noise = noisy ? start_noise(ntohs(addr.sin_port)) : 0;
+    uint64_t base = now_us() + 100000;
+    if (tftp_timer_init(&w, BENCH_TICK_US, now_us(), 1) < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+    memset(items, 0, count * sizeof(*items));
+    deadlines(count, base, ACCURACY_SPREAD_US);
+    for (uint32_t i = 0; i < count; i++) {
+        tftp_timer_arm(&w, &items[i].timer, items[i].deadline);
+    }
+
+    uint32_t fired = 0;
+    while (fired < count) {
+        struct pollfd fds[2] = { { w.fd, POLLIN, 0 }, { sock, POLLIN, 0 } };
+        if (poll(fds, 2, 5000) <= 0) {
+            break;
+        }
+        while (recv(sock, packet, sizeof(packet), 0) > 0) {
+            strays++;
+        }
+        uint64_t clock = now_us();
+        struct tftp_timer *t;
+        while ((t = tftp_timer_expired(&w, clock)) != NULL) {
+            lateness[fired++] = clock - item_of(t)->deadline;
+        }
+    }
+    if (noise > 0) {
+        kill(noise, SIGKILL);
+        waitpid(noise, NULL, 0);
+    }
+    tftp_timer_close(&w);
+    close(sock);
+    if (fired < count) {
+        fprintf(stderr, "accuracy: only %u of %u timers fired\n", fired, count);
+        return -1;
+    }
+    qsort(lateness, count, sizeof(*lateness), compare_u64);
+    printf("%-7s %8u %10llu %10llu %10llu %10llu %10llu\n", noisy ? "strays" : "quiet", count,
+           (unsigned long long)lateness[count / 2], (unsigned long long)lateness[count * 99ull / 100],
+           (unsigned long long)lateness[count * 999ull / 1000], (unsigned long long)lateness[count - 1],
+           (unsigned long long)strays);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n count]...   (default: -n 100000)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t counts[BENCH_MAX_COUNTS], max = 0;
+    int count_n = 0, opt, failures = 0;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        if (opt == 'n' && count_n < BENCH_MAX_COUNTS && atol(optarg) > 0 && atol(optarg) <= 10000000) {
+            counts[count_n++] = (uint32_t)atol(optarg);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (count_n == 0) {
+        counts[count_n++] = 100000;
+    }
+    for (int i = 0; i < count_n; i++) {
+        max = counts[i] > max ? counts[i] : max;
+    }
+    items = calloc(max, sizeof(*items));
+    heap = calloc(max, sizeof(*heap));
+    uint64_t *lateness = calloc(max, sizeof(*lateness));
+    if (items == NULL || heap == NULL || lateness == NULL) {
+        perror("calloc");
+        return 2;
+    }
+
+    printf("%d levels of %d slots, %d us ticks; ns per timer\n\n", TFTP_TIMER_LEVELS, TFTP_TIMER_SLOTS,
+           BENCH_TICK_US);
+    printf("%-7s %8s %10s %10s %10s %10s\n", "kind", "timers", "arm", "re-arm", "expire", "cancel");
+    for (int i = 0; i < count_n; i++) {
+        struct costs wheel, baseline;
+        if (run_wheel(counts[i], &wheel) < 0) {
+            failures++;
+            continue;
+        }
+        run_heap(counts[i], &baseline);
+        printf("%-7s %8u %10.1f %10.1f %10.1f %10.1f\n", "wheel", counts[i], wheel.arm, wheel.rearm, wheel.expire,
+               wheel.cancel);
+        printf("%-7s %8u %10.1f %10.1f %10.1f %10.1f\n", "heap", counts[i], baseline.arm, baseline.rearm,
+               baseline.expire, baseline.cancel);
+    }
+
+    printf("\nLateness on the real clock, timerfd-driven, deadlines over %u s (us)\n\n",
+           ACCURACY_SPREAD_US / 1000000);
+    printf("%-7s %8s %10s %10s %10s %10s %10s\n", "run", "timers", "p50", "p99", "p99.9", "max", "strays");
+    for (int i = 0; i < count_n; i++) {
+        for (int noisy = 0; noisy < 2; noisy++) {
+            fflush(stdout);
+            failures += run_accuracy(counts[i], noisy, lateness) < 0;
+        }
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -9,12 +9,13 @@
 #include "utils.h"
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <server_ip> <filename>\n", argv[0]);
+    if (argc != 3 && !(argc == 4 && (strcmp(argv[3], "multicast") == 0 || strcmp(argv[3], "netascii") == 0))) {
+        fprintf(stderr, "Usage: %s <server_ip> <filename> [multicast|netascii]\n", argv[0]);
         return 1;
     }
 
     struct sockaddr_in servaddr;
+    tftp_log_init();
      
     char *server_ip = argv[1];
     char *remote_filename = argv[2];
@@ -22,18 +23,21 @@ int main(int argc, char *argv[]) {
 
     // Create local filename (e.g., just the provided name)
     strncpy(local_filename, remote_filename, 255); 
-    int sockfd = SetupSocket(server_ip, &servaddr);
-  
-    if (sockfd < 0) {
-        return -1;
-    }   
 
-    if (ConstructAndSendRRQ(sockfd, &servaddr, remote_filename) < 0) 
+    if (argc == 4 && strcmp(argv[3], "multicast") == 0) 
     {
+        int sockfd = SetupSocket(server_ip, &servaddr);
+        if (sockfd < 0) {
+            return -1;
+        }
+        // RFC 2090: share one multicast transmission with other clients
+        int ans = multicastTransferLogic(sockfd, &servaddr, remote_filename, local_filename);
         close(sockfd);
-        return -2;
-    }   
-   
-   mainTransferLogic(sockfd, local_filename);
-   close(sockfd);
+        return ans < 0 ? 1 : 0;
+    }
+
+   // Opens its own socket, a new one for each attempt
+   int ans = mainTransferLogic(server_ip, remote_filename, local_filename, argc == 4 ? "netascii" : MODE);
+   tftp_log_shutdown();
+   return ans < 0 ? 1 : 0;
 }
\ No newline at end of file
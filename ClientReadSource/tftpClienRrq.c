@@ -1,170 +1,240 @@
-
 #include "utils.h"
+#include <time.h>
+
+// --- UNICAST READ CLIENT ---
+//
+// The shared engine (RECEIVE role) owns the protocol: it repeats the RRQ until
+// DATA 1 arrives, ACKs each block, re-ACKs duplicates and gives up after
+// MAX_RETRIES timeouts. This file only moves packets between it and the socket.
+//
+// The RRQ asks for the largest blksize the path to the server carries without
+// fragmentation (tftpPmtu.h). If the server agrees but its large DATA blocks
+// then never arrive, the path drops them silently: the download starts over
+// from a new port, asking for half the size, down to the plain 512 bytes.
+
+struct rrq_client {
+    int sockfd;
+    int fd;
+    struct sockaddr_in remote;      // Server's request port, then its transfer TID
+    socklen_t remote_len;
+    int tid_locked;
+    int netascii;                   // Translate CR LF / CR NUL back to local line endings
+    struct tftp_netascii decoder;
+    uint32_t crc;                   // CRC32C of the file bytes written (octet mode)
+    uint16_t requested;             // blksize asked for, 0 when the RRQ has no option
+};
+
+static uint64_t nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
 
+static ssize_t clientSend(void *ctx, const void *packet, size_t len)
+{
+    struct rrq_client *c = ctx;
+    ssize_t n = sendto(c->sockfd, packet, len, 0, (const struct sockaddr *)&c->remote, c->remote_len);
+    if (n < 0) {
+        perror("Failed to send packet");
+    }
+    return n;
+}
 
-int packetProcessingLogic(int sockfd, uint16_t *expected_block, int *retries, int *file_transfer_complete, char *recv_buffer, ssize_t numberBytesReceived, struct sockaddr_in *remote_transfer_addr, int remote_len,int fd) 
+static int clientWrite(void *ctx, const char *data, size_t len)
 {
-        uint16_t opcode = ntohs(*(uint16_t *)recv_buffer);
-        uint16_t block_num = ntohs(*(uint16_t *)(recv_buffer + 2));
-        
-        // --- Packet Processing Logic ---
-        if (opcode == OP_DATA) 
-        {
-            // A. INITIAL SETUP: Capture Server's Ephemeral Port (Happens on first DATA only)
-            if ((*expected_block) == 1)
-            {
-                printf("Received first packet from server transfer port %d.\n", 
-                       ntohs(remote_transfer_addr->sin_port));
-            }
-
-            // B. Data received is the expected block
-            if (block_num == *expected_block) {
-                ssize_t data_len = numberBytesReceived - 4;
-                
-                // Write data to file
-                if (write(fd, recv_buffer + 4, data_len) < 0) {
-                    perror("File write failed"); 
-                    return -1;
-                }
-                
-                // Send acknowledgment (ACK)
-                send_ack(sockfd, remote_transfer_addr, remote_len, block_num);
-                printf("Received DATA %d (%zd bytes). Sent ACK %d.\n", block_num, data_len, block_num);
-
-                // Check for termination
-                if (data_len < BLOCK_SIZE) {
-                    (*file_transfer_complete) = 1;
-                }
-
-                (*expected_block)++;
-                (*retries) = 0; // Reset retries on successful receipt
-            } 
-            else if (block_num < (*expected_block))
-            {
-                // Duplicate DATA received: Resend last successful ACK
-                printf("Received duplicate DATA %d. Resending ACK %d.\n", block_num, block_num);
-                send_ack(sockfd, remote_transfer_addr, remote_len, block_num);
-                (*retries) = 0;
-            } 
-            else 
-            {
-                // Block number is too high (Protocol error)
-                fprintf(stderr, "Received unexpected block %d. Expected %d.\n", block_num, (*expected_block));
-                return -1;
-            }
-        } 
-        else if (opcode == OP_ERROR) 
-        {
-            // Server reported error
-            char *error_msg = recv_buffer + 4;
-            fprintf(stderr, "Server Error %d: %s\n", block_num, error_msg);
-            return -1;
-        } 
-        else 
-        {
-            // Unexpected opcode
-            fprintf(stderr, "Received unexpected opcode: %d\n", opcode);
-            return -1;
-        }
-    
+    struct rrq_client *c = ctx;
+    int rc;
+    if (c->netascii) {
+        rc = tftp_netascii_write(&c->decoder, c->fd, data, len);
+    } else {
+        c->crc = tftp_crc32c(c->crc, data, len);
+        rc = write(c->fd, data, len) < 0 ? -1 : 0;
+    }
+    if (rc < 0) {
+        perror("File write failed");
+        return -1;
+    }
+    return 0;
+}
+
+static void clientEvent(void *ctx, int event, uint32_t block, uint64_t arg)
+{
+    (void)ctx;
+    switch (event) {
+    case TFTP_EV_DATA_RECEIVED:
+        TFTP_LOG_BLOCK("Received DATA %u (%llu bytes). Sent ACK %u.\n", block, (unsigned long long)arg, block);
+        break;
+    case TFTP_EV_DATA_DUPLICATE:
+        tftp_log(TFTP_LOG_DEBUG, "Received duplicate DATA %u. Resending ACK %u.\n", block, block);
+        break;
+    case TFTP_EV_ACK_RETRANSMIT:
+        tftp_log(TFTP_LOG_DEBUG, block == 0 ? "Timeout. Resending RRQ (attempt %d)...\n"
+                                            : "Timeout. Resending last ACK (attempt %d)...\n", (int)arg);
+        break;
+    case TFTP_EV_OACK_RECEIVED:
+        tftp_log(TFTP_LOG_INFO, "Server accepted blksize %llu. Sent ACK 0.\n", (unsigned long long)arg);
+        break;
+    }
+}
+
+// RFC 2348: the server may lower the blksize we asked for, never raise it
+static int clientOack(void *ctx, const struct tftp_packet *oack, uint16_t *blksize)
+{
+    struct rrq_client *c = ctx;
+    uint16_t offered = tftp_option_blksize(oack);
+    if (c->requested == 0 || offered == 0 || offered > c->requested) {
+        tftp_log(TFTP_LOG_ERROR, "Server's OACK does not match the options we asked for.\n");
+        return -1;
+    }
+    *blksize = offered;
     return 0;
 }
 
-int mainTransferLogic(int sockfd, const char *local_filename) 
+static const struct tftp_engine_ops client_ops = { clientSend, NULL, clientWrite, clientEvent, clientOack, NULL };
+
+#define RRQ_RETRY 1
+
+// One download over 'sockfd' asking for 'blksize' (512 = no option). Returns
+// 0, -1, or RRQ_RETRY with *blksize lowered when large blocks went missing.
+static int rrqAttempt(int sockfd, const struct sockaddr_in *servaddr, const char *remote_filename,
+                      const char *local_filename, const char *mode, uint16_t *blksize)
 {
-    uint16_t expected_block = 1;
-    int retries = 0;
-    int file_transfer_complete = 0;
-    struct sockaddr_in remote_transfer_addr;
-    socklen_t remote_len = sizeof(remote_transfer_addr);
-    char recv_buffer[PACKET_BUF_SIZE];
-    memset(&remote_transfer_addr, 0, sizeof(remote_transfer_addr));
+    struct rrq_client c;
+    struct tftp_engine engine;
+    char request[PACKET_BUF_SIZE];
+    char ack_packet[MAX_PACKET_SIZE];   // Only holds ACKs, but the engine sizes it for a DATA block
+    char recv_buffer[MAX_PACKET_SIZE];
+    char blksize_value[8];
+    struct tftp_option option = {"blksize", blksize_value};
+
+    snprintf(blksize_value, sizeof(blksize_value), "%u", *blksize);
+    c.requested = *blksize > BLOCK_SIZE ? *blksize : 0;
+    size_t request_len = tftp_encode_request(request, sizeof(request), OP_RRQ, remote_filename, mode,
+                                             &option, c.requested != 0);
+    if (request_len == 0) {
+        tftp_log(TFTP_LOG_ERROR, "Filename too long.\n");
+        return -1;
+    }
+
     // Open local file for writing (O_CREAT | O_TRUNC will create/overwrite)
-    int fd = open(local_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    
-    if (fd < 0) 
+    c.sockfd = sockfd;
+    c.remote = *servaddr;
+    c.remote_len = sizeof(c.remote);
+    c.tid_locked = 0;
+    c.netascii = strcmp(mode, "netascii") == 0;
+    memset(&c.decoder, 0, sizeof(c.decoder));
+    c.crc = 0;
+    c.fd = open(local_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (c.fd < 0) 
     {
         perror("Failed to open local file for writing"); 
-        close(sockfd); 
         return -1;
     }
 
-    while (!file_transfer_complete) 
+    tftp_engine_init(&engine, TFTP_ENGINE_RECEIVE, &client_ops, &c, ack_packet, sizeof(ack_packet), BLOCK_SIZE);
+    engine.timeout_us = TIMEOUT_SEC * 1000000u;
+    engine.max_retries = MAX_RETRIES;
+    tftp_engine_start(&engine, request, request_len, nowUs());
+    tftp_log(TFTP_LOG_INFO, "Sent RRQ for file '%s' (blksize %u). Waiting for DATA 1...\n", remote_filename,
+             *blksize);
+
+    uint32_t spin_us = tftp_latency_from_env(sockfd); // Low-latency profile, off unless TFTP_SPIN_US is set
+    while (engine.status == TFTP_ENGINE_RUNNING) 
     {
-        ssize_t numberBytesReceived;
-        struct timeval tv;
-        fd_set readfds;
-        int rv;
-
-        // --- Timeout Setup ---
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-        tv.tv_sec = TIMEOUT_SEC;
-        tv.tv_usec = 0;
-
-        // Use select() to wait for data with a timeout
-        rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
-
-        if (rv == -1) {
-            perror("select error"); 
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        uint64_t now = nowUs();
+        uint64_t wait_us = engine.deadline_us > now ? engine.deadline_us - now : 0;
+
+        // --- Wait for the next packet until the engine's deadline (tftpLatency.h) ---
+        int rv = tftp_latency_wait(sockfd, wait_us, spin_us);
+        if (rv < 0) {
+            perror("poll error");
             break;
-        } 
-        else if (rv == 0) 
-        {
-            if (expected_block > 1 && retries < MAX_RETRIES) 
-            {
-                // Only re-send ACK if we have received at least one DATA block (expected_block > 1)
-                send_ack(sockfd, &remote_transfer_addr, remote_len, expected_block - 1);
-                retries++;
-                continue;
-            } 
-            else if (expected_block == 1 && retries < MAX_RETRIES) 
-            {
-                // We are waiting for DATA 1. We just wait for the server to retransmit DATA 1
-                // (since it was the server's RRQ that timed out). Do not send an ACK.
-                retries++;
-                continue;
-            } 
-            else 
-            {
-                // Max retries reached or other failure
-                printf("Max retries reached. Aborting download.\n");
-                break;
-            }
         }
-        
-        // --- Receive Packet ---
-        // Note: For the FIRST packet, the source port will be new. 
-        numberBytesReceived = recvfrom(sockfd, recv_buffer, PACKET_BUF_SIZE, 0, 
-                     (struct sockaddr *)&remote_transfer_addr, &remote_len);
-
-        if (numberBytesReceived < 4) {
-            fprintf(stderr, "Received short packet.\n");
-            retries = 0; // Communication happened, reset retries
-            continue; 
+        if (rv == 0) {
+            tftp_engine_timeout(&engine, nowUs());
+            continue;
         }
 
-        int ans = packetProcessingLogic(sockfd, &expected_block, &retries, &file_transfer_complete, recv_buffer, numberBytesReceived, &remote_transfer_addr, remote_len, fd);
+        ssize_t n = recvfrom(sockfd, recv_buffer, sizeof(recv_buffer), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0) {
+            continue;
+        }
 
-        if (ans < 0) 
-        {
-            break;
+        // The first reply from the server's address names its transfer port
+        // (TID); packets from any other address or port are answered with
+        // ERROR 5 and otherwise ignored, so an off-path sender cannot take over.
+        if (!c.tid_locked && from.sin_addr.s_addr == servaddr->sin_addr.s_addr) {
+            c.remote = from;
+            c.remote_len = from_len;
+            c.tid_locked = 1;
+            tftp_log(TFTP_LOG_INFO, "Received first packet from server transfer port %d.\n", ntohs(from.sin_port));
+        } else if (!c.tid_locked || from.sin_port != c.remote.sin_port ||
+                   from.sin_addr.s_addr != c.remote.sin_addr.s_addr) {
+            char error_packet[64];
+            size_t len = tftp_encode_error(error_packet, sizeof(error_packet), 5, "Unknown transfer ID");
+            sendto(sockfd, error_packet, len, 0, (const struct sockaddr *)&from, from_len);
+            continue;
         }
-          
+
+        tftp_engine_receive(&engine, recv_buffer, (size_t)n, nowUs());
     }
- // --- CLEANUP ---
-    close(fd);
-   
 
-    if (file_transfer_complete) 
+    // --- CLEANUP ---
+    if (engine.status == TFTP_ENGINE_DONE && c.netascii && tftp_netascii_write_finish(&c.decoder, c.fd) < 0) {
+        perror("File write failed");
+        engine.status = TFTP_ENGINE_FAILED;
+    }
+    if (engine.status == TFTP_ENGINE_DONE) 
     {
-        printf("File '%s' successfully downloaded.\n", local_filename);
+        // Digest computed as blocks arrived, so the file need not be read back
+        uint32_t crc = c.netascii ? c.decoder.crc : c.crc;
+        tftp_digest_store(c.fd, local_filename, crc);
+        close(c.fd);
+        tftp_log(TFTP_LOG_INFO, "File '%s' successfully downloaded (crc32c %08x).\n", local_filename, crc);
         return 0;
-    } else {
-        // If loop broke without completion, delete the partial file
-        unlink(local_filename); 
-        fprintf(stderr, "Download failed or aborted. Partial file deleted.\n");
-        return -1;
     }
+    close(c.fd);
 
+    // If the loop ended without completion, delete the partial file
+    if (engine.status == TFTP_ENGINE_FAILED) {
+        tftp_log(TFTP_LOG_ERROR, "Transfer failed (error %d): %s\n", engine.error_code, engine.error);
+    }
+    unlink(local_filename); 
+    // The server took the large blksize, then its blocks stopped arriving
+    if (engine.status == TFTP_ENGINE_FAILED && engine.negotiated && engine.blksize > BLOCK_SIZE &&
+        engine.retries >= engine.max_retries)
+    {
+        uint16_t path = tftp_pmtu_blksize(servaddr, TFTP_MAX_BLKSIZE);
+        *blksize = engine.blksize / 2 > BLOCK_SIZE ? engine.blksize / 2 : BLOCK_SIZE;
+        *blksize = path < *blksize && path > BLOCK_SIZE ? path : *blksize;
+        tftp_log(TFTP_LOG_WARN, "Repeated loss at blksize %u. Retrying with %u.\n", engine.blksize, *blksize);
+        return RRQ_RETRY;
+    }
+    tftp_log(TFTP_LOG_ERROR, "Download failed or aborted. Partial file deleted.\n");
+    return -1;
+}
+
+int mainTransferLogic(const char *server_ip, const char *remote_filename, const char *local_filename, const char *mode)
+{
+    struct sockaddr_in servaddr;
+    uint16_t blksize = 0;
+    int rc;
+
+    // Every attempt gets a fresh socket: the server tells transfers apart by the client's port
+    do
+    {
+        int sockfd = SetupSocket(server_ip, &servaddr);
+        if (sockfd < 0) {
+            return -1;
+        }
+        if (blksize == 0) {
+            blksize = tftp_pmtu_blksize(&servaddr, TFTP_MAX_BLKSIZE);
+        }
+        rc = rrqAttempt(sockfd, &servaddr, remote_filename, local_filename, mode, &blksize);
+        close(sockfd);
+    } while (rc == RRQ_RETRY);
+    return rc;
 }
@@ -0,0 +1,413 @@
+#include "utils.h"
+#include <time.h>
+
+// --- MULTICAST READ CLIENT (RFC 2090) ---
+//
+// The client sends an RRQ with the "multicast" option, joins the group named in
+// the server's OACK and stores every DATA block it sees on the group at its file
+// offset. Only while it is the master client does it ACK, always naming the
+// highest block it holds contiguously, so the server resends only what it lacks.
+//
+// Both waits run to an absolute deadline that only the transfer's own progress
+// moves (an OACK, or a block not seen before), so other clients' retransmissions
+// and stray datagrams on the group never postpone our retry.
+
+struct mcast_state {
+    int group_fd;
+    struct sockaddr_in group;
+    struct sockaddr_in session_addr;    // Server's transfer TID
+    socklen_t session_len;
+    uint16_t blksize;
+    int is_master;
+    uint32_t prefix;                    // Highest block held contiguously
+    uint32_t last_block;                // Block number of the short block, 0 if unseen
+    unsigned char have[(MCAST_MAX_BLOCKS + 8) / 8];
+};
+
+static uint64_t nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static uint64_t timeoutDeadline(void)
+{
+    return nowUs() + (uint64_t)TIMEOUT_SEC * 1000000u;
+}
+
+// select() timeout for what is left until 'deadline', zero once it has passed
+static struct timeval timeLeft(uint64_t deadline)
+{
+    struct timeval tv = {0, 0};
+    uint64_t now = nowUs();
+
+    if (deadline > now)
+    {
+        tv.tv_sec = (time_t)((deadline - now) / 1000000u);
+        tv.tv_usec = (suseconds_t)((deadline - now) % 1000000u);
+    }
+    return tv;
+}
+
+static size_t buildMulticastRrq(char *packet, size_t size, const char *filename)
+{
+    char blksize[8];
+
+    snprintf(blksize, sizeof(blksize), "%d", MCAST_BLKSIZE);
+    struct tftp_option options[2] = {{"multicast", ""}, {"blksize", blksize}};
+    return tftp_encode_request(packet, size, OP_RRQ, filename, MODE, options, 2);
+}
+
+// Applies a decoded OACK. Returns 0 on success, -1 if it is malformed.
+// The "multicast" value is "<addr>,<port>,<mc>"; addr and port may be empty
+// when the server only changes the master flag.
+static int parseOack(struct mcast_state *st, const struct tftp_packet *oack)
+{
+    for (int i = 0; i < oack->option_count; i++)
+    {
+        const char *name = oack->options[i].name;
+        const char *value = oack->options[i].value;
+
+        if (strcasecmp(name, "multicast") == 0)
+        {
+            char addr[INET_ADDRSTRLEN] = "";
+            int port = 0;
+            int mc = 0;
+            const char *c1 = strchr(value, ',');
+            const char *c2 = c1 ? strchr(c1 + 1, ',') : NULL;
+            if (c1 == NULL || c2 == NULL)
+            {
+                return -1;
+            }
+            if (c1 > value && (size_t)(c1 - value) < sizeof(addr))
+            {
+                memcpy(addr, value, c1 - value);
+                addr[c1 - value] = '\0';
+                if (inet_pton(AF_INET, addr, &st->group.sin_addr) <= 0)
+                {
+                    return -1;
+                }
+            }
+            port = atoi(c1 + 1);
+            if (port > 0)
+            {
+                st->group.sin_port = htons((uint16_t)port);
+            }
+            mc = atoi(c2 + 1);
+            st->is_master = (mc == 1);
+        }
+        else if (strcasecmp(name, "blksize") == 0)
+        {
+            int blksize = atoi(value);
+            if (blksize < 8 || blksize > MCAST_BLKSIZE)
+            {
+                return -1;
+            }
+            st->blksize = (uint16_t)blksize;
+        }
+    }
+    return 0;
+}
+
+// Joins the group on the interface this host uses to reach the server
+static int joinGroup(struct mcast_state *st, const struct sockaddr_in *servaddr)
+{
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    struct ip_mreq mreq;
+    int reuse = 1;
+
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe < 0 || connect(probe, (const struct sockaddr *)servaddr, sizeof(*servaddr)) < 0 ||
+        getsockname(probe, (struct sockaddr *)&local, &local_len) < 0)
+    {
+        perror("Failed to find local interface");
+        if (probe >= 0) close(probe);
+        return -1;
+    }
+    close(probe);
+
+    if ((st->group_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        perror("group socket creation failed");
+        return -1;
+    }
+    // Several clients on one host share the group port
+    setsockopt(st->group_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in bind_addr = st->group;
+    if (bind(st->group_fd, (const struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0)
+    {
+        perror("group socket bind failed");
+        close(st->group_fd);
+        return -1;
+    }
+
+    mreq.imr_multiaddr = st->group.sin_addr;
+    mreq.imr_interface = local.sin_addr;
+    if (setsockopt(st->group_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        perror("IP_ADD_MEMBERSHIP failed");
+        close(st->group_fd);
+        return -1;
+    }
+
+    char local_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &local.sin_addr, local_ip, sizeof(local_ip));
+    tftp_log(TFTP_LOG_INFO, "Joined multicast group %s:%d on %s.\n", inet_ntoa(st->group.sin_addr),
+           ntohs(st->group.sin_port), local_ip);
+    return 0;
+}
+
+static void sendMulticastAck(int sockfd, struct mcast_state *st)
+{
+    char ack[TFTP_HEADER_SIZE];
+    size_t len = tftp_encode_ack(ack, sizeof(ack), (uint16_t)st->prefix);
+
+    if (sendto(sockfd, ack, len, 0, (const struct sockaddr *)&st->session_addr, st->session_len) < 0)
+    {
+        perror("Failed to send ACK packet");
+    }
+}
+
+static int haveBlock(const struct mcast_state *st, uint16_t block)
+{
+    return (st->have[block / 8] & (1 << (block % 8))) != 0;
+}
+
+// Stores one group DATA block. Returns 1 when the file is complete.
+static int storeBlock(struct mcast_state *st, int fd, const struct tftp_packet *data)
+{
+    uint16_t block = data->block;
+    size_t data_len = data->data_len;
+
+    if (block == 0 || haveBlock(st, block))
+    {
+        return 0; // Already have it (another client's retransmission)
+    }
+    if (pwrite(fd, data->data, data_len, (off_t)(block - 1) * st->blksize) < 0)
+    {
+        perror("File write failed");
+        return -1;
+    }
+    st->have[block / 8] |= (unsigned char)(1 << (block % 8));
+    if (data_len < st->blksize)
+    {
+        st->last_block = block;
+    }
+
+    while (st->prefix < MCAST_MAX_BLOCKS &&
+           (st->have[(st->prefix + 1) / 8] & (1 << ((st->prefix + 1) % 8))))
+    {
+        st->prefix++;
+    }
+    return st->last_block != 0 && st->prefix >= st->last_block;
+}
+
+int multicastTransferLogic(int sockfd, const struct sockaddr_in *servaddr, const char *remote_filename, const char *local_filename)
+{
+    static struct mcast_state st;
+    char packet[4 + MCAST_BLKSIZE];
+    char rrq_packet[PACKET_BUF_SIZE];
+    size_t rrq_len;
+    struct tftp_packet pkt;
+    int retries = 0;
+    uint64_t deadline = 0;
+    int complete = 0;
+    int fd;
+    unsigned long blocks_received = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.group_fd = -1;
+    st.blksize = BLOCK_SIZE;
+    st.group.sin_family = AF_INET;
+
+    rrq_len = buildMulticastRrq(rrq_packet, sizeof(rrq_packet), remote_filename);
+    if (rrq_len == 0)
+    {
+        tftp_log(TFTP_LOG_ERROR, "Filename too long.\n");
+        return -1;
+    }
+
+    // 1. RRQ / OACK handshake (the RRQ is repeated until the session answers)
+    while (1)
+    {
+        struct timeval tv;
+        fd_set readfds;
+
+        if (nowUs() >= deadline)
+        {
+            if (deadline != 0 && ++retries >= MAX_RETRIES)
+            {
+                tftp_log(TFTP_LOG_ERROR, "No answer to multicast RRQ. Aborting.\n");
+                return -1;
+            }
+            if (sendto(sockfd, rrq_packet, rrq_len, 0, (const struct sockaddr *)servaddr, sizeof(*servaddr)) < 0)
+            {
+                perror("Failed to send RRQ");
+                return -1;
+            }
+            tftp_log(TFTP_LOG_INFO, "Sent multicast RRQ for file '%s'. Waiting for OACK...\n", remote_filename);
+            deadline = timeoutDeadline();
+        }
+
+        FD_ZERO(&readfds);
+        FD_SET(sockfd, &readfds);
+        tv = timeLeft(deadline);
+        int rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
+        if (rv < 0 && errno != EINTR)
+        {
+            perror("select error");
+            return -1;
+        }
+        if (rv <= 0)
+        {
+            continue;
+        }
+
+        st.session_len = sizeof(st.session_addr);
+        ssize_t n = recvfrom(sockfd, packet, sizeof(packet), 0, (struct sockaddr *)&st.session_addr, &st.session_len);
+        if (n < 0 || tftp_decode(packet, (size_t)n, &pkt) < 0)
+        {
+            continue;
+        }
+        if (pkt.opcode == OP_ERROR)
+        {
+            tftp_log(TFTP_LOG_ERROR, "Server Error %d: %s\n", pkt.block, pkt.message);
+            return -1;
+        }
+        if (pkt.opcode != OP_OACK || parseOack(&st, &pkt) < 0 || st.group.sin_port == 0)
+        {
+            tftp_log(TFTP_LOG_ERROR, "Server did not accept the multicast option.\n");
+            return -1;
+        }
+        break;
+    }
+
+    if (joinGroup(&st, servaddr) < 0)
+    {
+        return -1;
+    }
+
+    fd = open(local_filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0)
+    {
+        perror("Failed to open local file for writing");
+        close(st.group_fd);
+        return -1;
+    }
+
+    if (st.is_master)
+    {
+        tftp_log(TFTP_LOG_INFO, "Master client: requesting blocks after %u.\n", st.prefix);
+        sendMulticastAck(sockfd, &st);
+    }
+
+    // 2. Receive from the group; ACK on the unicast TID while master
+    retries = 0;
+    deadline = timeoutDeadline();
+    while (!complete)
+    {
+        struct timeval tv;
+        fd_set readfds;
+        int maxfd = sockfd > st.group_fd ? sockfd : st.group_fd;
+
+        if (nowUs() >= deadline)
+        {
+            if (++retries > MAX_RETRIES)
+            {
+                tftp_log(TFTP_LOG_WARN, "Max retries reached. Aborting download.\n");
+                break;
+            }
+            if (st.is_master)
+            {
+                sendMulticastAck(sockfd, &st);
+            }
+            deadline = timeoutDeadline();
+        }
+
+        FD_ZERO(&readfds);
+        FD_SET(sockfd, &readfds);
+        FD_SET(st.group_fd, &readfds);
+        tv = timeLeft(deadline);
+
+        int rv = select(maxfd + 1, &readfds, NULL, NULL, &tv);
+        if (rv < 0 && errno != EINTR)
+        {
+            perror("select error");
+            break;
+        }
+        if (rv <= 0)
+        {
+            continue;
+        }
+
+        if (FD_ISSET(st.group_fd, &readfds))
+        {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(st.group_fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+            if (n >= 0 && tftp_decode(packet, (size_t)n, &pkt) == 0 && pkt.opcode == OP_DATA &&
+                from.sin_port == st.session_addr.sin_port)
+            {
+                int fresh = pkt.block != 0 && !haveBlock(&st, pkt.block);
+                int ans = storeBlock(&st, fd, &pkt);
+                if (ans < 0)
+                {
+                    break;
+                }
+                blocks_received++;
+                if (fresh)
+                {
+                    retries = 0;
+                    deadline = timeoutDeadline();
+                }
+                complete = ans;
+                if (st.is_master || complete)
+                {
+                    // A finished client always reports so the server can forget it
+                    sendMulticastAck(sockfd, &st);
+                }
+            }
+        }
+
+        if (!complete && FD_ISSET(sockfd, &readfds))
+        {
+            ssize_t n = recvfrom(sockfd, packet, sizeof(packet), 0, NULL, NULL);
+            if (n < 0 || tftp_decode(packet, (size_t)n, &pkt) < 0)
+            {
+                continue;
+            }
+            if (pkt.opcode == OP_OACK && parseOack(&st, &pkt) == 0)
+            {
+                retries = 0;
+                deadline = timeoutDeadline();
+                if (st.is_master)
+                {
+                    tftp_log(TFTP_LOG_INFO, "Promoted to master client: requesting blocks after %u.\n", st.prefix);
+                    sendMulticastAck(sockfd, &st);
+                }
+            }
+            else if (pkt.opcode == OP_ERROR)
+            {
+                tftp_log(TFTP_LOG_ERROR, "Server Error %d: %s\n", pkt.block, pkt.message);
+                break;
+            }
+        }
+    }
+
+    // --- CLEANUP ---
+    close(fd);
+    close(st.group_fd);
+
+    if (complete)
+    {
+        tftp_log(TFTP_LOG_INFO, "File '%s' successfully downloaded via multicast (%lu blocks received, %u needed).\n",
+               local_filename, blocks_received, st.last_block);
+        return 0;
+    }
+    unlink(local_filename);
+    tftp_log(TFTP_LOG_ERROR, "Download failed or aborted. Partial file deleted.\n");
+    return -1;
+}
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -13,21 +14,26 @@
 #include <sys/stat.h>
 #include <errno.h>
 
-// --- TFTP Constants (Re-defined for completeness) ---
+#include "tftpCodec.h"
+#include "tftpDigest.h"
+#include "tftpEngine.h"
+#include "tftpLatency.h"
+#include "tftpLog.h"
+#include "tftpNetascii.h"
+#include "tftpPmtu.h"
+
+// --- TFTP Constants (opcodes come from tftpCodec.h) ---
 #define SERVER_PORT 69
-#define OP_RRQ  1
-#define OP_DATA 3
-#define OP_ACK  4
-#define OP_ERROR 5
-#define MODE "octet"
-#define BLOCK_SIZE 512
+#define MODE "octet"            // Default; "netascii" on request
+#define BLOCK_SIZE TFTP_DEFAULT_BLKSIZE
 #define PACKET_BUF_SIZE (4 + BLOCK_SIZE)
+#define MAX_PACKET_SIZE (4 + TFTP_MAX_BLKSIZE)  // DATA at the largest blksize a server may grant
 #define TIMEOUT_SEC 3
 #define MAX_RETRIES 5
+#define MCAST_BLKSIZE 1428      // blksize requested for multicast (fits a 1500-byte MTU)
+#define MCAST_MAX_BLOCKS 65535
 
-void send_ack(int sockfd, const struct sockaddr_in *target_addr, socklen_t len, uint16_t block);
-int mainTransferLogic(int sockfd, const char *local_filename);
-int packetProcessingLogic(int sockfd, uint16_t *expected_block, int *retries, int *file_transfer_complete, char *recv_buffer, ssize_t numberBytesReceived, struct sockaddr_in *remote_transfer_addr, int remote_len,int fd);
-int ConstructAndSendRRQ(int sockfd, const struct sockaddr_in *servaddr, const char *filename);
+int mainTransferLogic(const char *server_ip, const char *remote_filename, const char *local_filename, const char *mode);
 int SetupSocket(const char *server_ip, struct sockaddr_in *servaddr);
+int multicastTransferLogic(int sockfd, const struct sockaddr_in *servaddr, const char *remote_filename, const char *local_filename);
 #endif
\ No newline at end of file
@@ -1,15 +1,17 @@
 #include "utils.h"
 
-void tftpWriteFile (const char *server_ip, const char *local_filename, const char *remote_filename);
+void tftpWriteFile (const char *server_ip, const char *local_filename, const char *remote_filename, const char *mode);
 
 int main(int argc, char *argv[]) 
 {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <server_ip> <local_file_to_send> <remote_filename>\n", argv[0]);
+    if (argc != 4 && !(argc == 5 && strcmp(argv[4], "netascii") == 0)) {
+        fprintf(stderr, "Usage: %s <server_ip> <local_file_to_send> <remote_filename> [netascii]\n", argv[0]);
         return EXIT_FAILURE;
     }
     
-    tftpWriteFile(argv[1], argv[2], argv[3]);
+    tftp_log_init();
+    tftpWriteFile(argv[1], argv[2], argv[3], argc == 5 ? argv[4] : MODE);
+    tftp_log_shutdown();
     
     return EXIT_SUCCESS;    
 }
\ No newline at end of file
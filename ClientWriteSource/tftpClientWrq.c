@@ -1,227 +1,260 @@
 #include "utils.h"
+#include <time.h>
 
-void tftpWriteFile(const char *server_ip, const char *local_filename, const char *remote_filename);
+void tftpWriteFile(const char *server_ip, const char *local_filename, const char *remote_filename, const char *mode);
 
-int InitializeTransfer(int sockfd, struct sockaddr_in *serv_addr, socklen_t addr_len,  int wrq_len, char *send_buffer, char *recv_buffer)
+// --- Engine callbacks ---
+//
+// The shared engine (SEND role) repeats the WRQ until ACK 0, then sends each
+// block once its predecessor is acknowledged, ignores stale ACKs and ends with
+// a short (possibly empty) block, so files that are an exact multiple of 512
+// bytes are terminated correctly.
+//
+// The WRQ asks for the largest blksize the path to the server carries without
+// fragmentation (tftpPmtu.h). When large blocks then go unacknowledged until
+// the retries run out, or the path MTU drops below them mid-transfer, the
+// upload starts over from a new port with a smaller blksize.
+
+struct wrq_client {
+    int sockfd;
+    FILE *fp;
+    struct sockaddr_in serv_addr;   // Port 69 until the first reply, then the server's TID
+    socklen_t addr_len;
+    int netascii;                       // Send local line endings as CR LF / CR NUL
+    struct tftp_netascii_reader encoder;
+    uint32_t crc;                       // CRC32C of the file bytes read (octet mode)
+    uint16_t requested;                 // blksize asked for, 0 when the WRQ has no option
+    int too_big;                        // A DATA packet exceeded the path MTU (EMSGSIZE)
+};
+
+static uint64_t nowUs(void)
 {
-     //  printf("Sending WRQ for file '%s' to server...\n", remote_filename);
-
-    int retries = 0;
-    int n;
-    // WRQ Transmission and ACK 0 Loop
-    do {
-        if (sendto(sockfd, send_buffer, wrq_len, 0, (const struct sockaddr *)serv_addr, addr_len) < 0) {
-            perror("Error sending WRQ");
-            return -1;
-        }
-        
-        // Wait for ACK 0
-        n = recvfrom(sockfd, recv_buffer, MAX_BUFFER_SIZE, 0, (struct sockaddr *)serv_addr, &addr_len);
-        
-        if (n < 0) 
-        {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) 
-            {
-                // Timeout occurred
-                retries++;
-                printf("Timeout on WRQ. Retrying (%d/%d)...\n", retries, MAX_RETRANSMIT);
-            } 
-            else
-             {
-                perror("recvfrom error");
-                return -1;
-            }
-        } 
-        else if (n >= 4) 
-        {
-            uint16_t opcode = ntohs(*(uint16_t *)recv_buffer);
-            uint16_t block = ntohs(*(uint16_t *)(recv_buffer + 2));
-
-            if (opcode == OP_ACK && block == 0) 
-            {
-                printf("Received initial ACK 0. Starting transfer.\n");
-                // The server's address in serv_addr is now its TID (new port)
-                break; // Break the WRQ loop, transfer begins
-            } 
-            else if (opcode == OP_ERROR) 
-            {
-                printf("Server Error (%u): %s\n", block, recv_buffer + 4);
-                 return -1;
-            } else 
-            {
-                fprintf(stderr, "Unexpected packet received (Opcode: %u).\n", opcode);
-                 return -1;
-            }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static ssize_t clientSend(void *ctx, const void *packet, size_t len)
+{
+    struct wrq_client *c = ctx;
+    ssize_t n = sendto(c->sockfd, packet, len, 0, (const struct sockaddr *)&c->serv_addr, c->addr_len);
+    if (n < 0 && errno == EMSGSIZE) {
+        c->too_big = 1;
+        tftp_log(TFTP_LOG_WARN, "%zu-byte packet exceeds the path MTU.\n", len);
+    } else if (n < 0) {
+        perror("Error sending packet");
+    }
+    return n;
+}
+
+static ssize_t clientRead(void *ctx, char *buf, size_t len)
+{
+    struct wrq_client *c = ctx;
+    if (c->netascii) {
+        ssize_t n = tftp_netascii_read(&c->encoder, fileno(c->fp), buf, len);
+        if (n < 0) {
+            perror("File read error");
         }
-    } while (retries < MAX_RETRANSMIT);
-    
-    if (retries == MAX_RETRANSMIT) {
-        fprintf(stderr, "Failed to get ACK 0 after %d retries. Aborting.\n", MAX_RETRANSMIT);
+        return n;
+    }
+    size_t n = fread(buf, 1, len, c->fp);
+    if (ferror(c->fp)) {
+        perror("File read error");
         return -1;
     }
-
- 
-   return 0;
+    c->crc = tftp_crc32c(c->crc, buf, n);
+    return (ssize_t)n;
 }
-// --- Main Client Logic ---
 
-int sendDataPack(int sockfd, struct sockaddr_in *serv_addr, socklen_t addr_len, char *send_buffer, char *recv_buffer, uint16_t current_block, int data_len, int bytes_read, int *total_bytes)
+static void clientEvent(void *ctx, int event, uint32_t block, uint64_t arg)
 {
-    int retries = 0;
-        
-    do 
-    {
-        // Send DATA packet
-        if (sendto(sockfd, send_buffer, data_len, 0, (const struct sockaddr *)serv_addr, addr_len) < 0) 
-        {
-            perror("Error sending DATA packet");
-            return -1;
-        }
-        
-        // Wait for ACK
-        int n = recvfrom(sockfd, recv_buffer, MAX_BUFFER_SIZE, 0, (struct sockaddr *)serv_addr, &addr_len);
-        
-        if (n < 0) 
-        {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) 
-            {
-                // Timeout occurred, retransmit
-                retries++;
-                printf("Timeout on Block %u. Retrying (%d/%d)...\n", current_block, retries, MAX_RETRANSMIT);
-            } 
-            else 
-            {
-                perror("recvfrom error during transfer");
-                return -1;
-            }
-        } 
-        else if (n >= 4) 
-        {
-            uint16_t opcode = ntohs(*(uint16_t *)recv_buffer);
-            uint16_t block = ntohs(*(uint16_t *)(recv_buffer + 2));    
-
-            if (opcode == OP_ACK && block == current_block)
-            {
-                // Correct ACK received, move to next block
-                printf("Received ACK %u. Bytes sent: %d. Total: %d\n", current_block, bytes_read, *total_bytes + bytes_read);
-                *total_bytes += bytes_read;
-                break;
-            } 
-            else if (opcode == OP_ACK && block < current_block) 
-            {
-                // Duplicate ACK (shouldn't happen on client side, but ignore if it does)
-               continue; 
-            } 
-            else if (opcode == OP_ERROR) 
-            {
-                printf("Server Error (%u) on Block %u: %s\n", block, current_block, recv_buffer + 4);
-                return -1;
-            } else 
-            {
-                fprintf(stderr, "Unexpected packet during transfer (Opcode: %u, Block: %u). Terminating.\n", opcode, block);
-                return -1;
-            }
+    (void)ctx;
+    switch (event) {
+    case TFTP_EV_ACK_RECEIVED:
+        if (block == 0) {
+            tftp_log(TFTP_LOG_INFO, "Received initial ACK 0. Starting transfer.\n");
+        } else {
+            TFTP_LOG_BLOCK("Received ACK %u.\n", block);
         }
+        break;
+    case TFTP_EV_DATA_RETRANSMIT:
+        tftp_log(TFTP_LOG_DEBUG, "Timeout on Block %u. Retrying (%d/%d)...\n", block, (int)arg, MAX_RETRANSMIT);
+        break;
+    case TFTP_EV_ACK_RETRANSMIT:
+        tftp_log(TFTP_LOG_DEBUG, "Timeout on WRQ. Retrying (%d/%d)...\n", (int)arg, MAX_RETRANSMIT);
+        break;
+    case TFTP_EV_OACK_RECEIVED:
+        tftp_log(TFTP_LOG_INFO, "Server accepted blksize %llu. Starting transfer.\n", (unsigned long long)arg);
+        break;
+    }
+}
 
-    } while (retries < MAX_RETRANSMIT);
-
-    if (retries == MAX_RETRANSMIT) {
-        fprintf(stderr, "Failed to get ACK %u after %d retries. Aborting.\n", current_block, MAX_RETRANSMIT);
+// RFC 2348: the server may lower the blksize we asked for, never raise it
+static int clientOack(void *ctx, const struct tftp_packet *oack, uint16_t *blksize)
+{
+    struct wrq_client *c = ctx;
+    uint16_t offered = tftp_option_blksize(oack);
+    if (c->requested == 0 || offered == 0 || offered > c->requested) {
+        tftp_log(TFTP_LOG_ERROR, "Server's OACK does not match the options we asked for.\n");
         return -1;
     }
-
-   return 0;
+    *blksize = offered;
+    return 0;
 }
 
+static const struct tftp_engine_ops client_ops = { clientSend, clientRead, NULL, clientEvent, clientOack, NULL };
 
+#define WRQ_RETRY 1
+
+// --- Main Client Logic ---
 
-void tftpWriteFile(const char *server_ip, const char *local_filename, const char *remote_filename) 
+// One upload of c->fp from its start, asking for 'blksize' (512 = no option).
+// Returns 0, -1, or WRQ_RETRY with *blksize lowered when large blocks were lost.
+static int wrqAttempt(struct wrq_client *c, const char *server_ip, const char *local_filename,
+                      const char *remote_filename, const char *mode, uint16_t *blksize)
 {
-    int sockfd;
-    char send_buffer[MAX_BUFFER_SIZE];
+    struct tftp_engine engine;
+    char request[MAX_BUFFER_SIZE];
+    char send_buffer[MAX_PACKET_SIZE];
     char recv_buffer[MAX_BUFFER_SIZE];
+    char blksize_value[8];
+    struct tftp_option option = {"blksize", blksize_value};
+    int tid_locked = 0;
+
+    // 1. Start the file over
+    rewind(c->fp);
+    memset(&c->encoder, 0, sizeof(c->encoder));
+    c->crc = 0;
+    c->too_big = 0;
     
-    FILE *fp;
-    char file_data[TFTP_DATA_SIZE];
-    int bytes_read;
-    uint16_t current_block = 1;
-    int total_bytes = 0;
-    int succeeded = 0;
-    // 1. Open local file for reading
-    fp = fopen(local_filename, "rb");
-    if (!fp) 
+    // 2. Socket setup
+    c->addr_len = sizeof(c->serv_addr);
+    c->sockfd = SetUpSocket(server_ip, &c->serv_addr);
+    if (c->sockfd < 0) 
     {
-        perror("Failed to open local file");
-        return;
+        return -1;
     }
-    
-    // 2. Socket setup
-    struct sockaddr_in serv_addr;
-    socklen_t addr_len = sizeof(serv_addr);
-
-    sockfd = SetUpSocket(server_ip, &serv_addr);
-   
-    if (sockfd < 0) 
+    if (*blksize == 0)
     {
-        fclose(fp);
-        return;
+        *blksize = tftp_pmtu_blksize(&c->serv_addr, TFTP_MAX_BLKSIZE);
     }
- 
 
-    // --- A. Send WRQ Request ---
-    int wrq_len = createWrqPacket(send_buffer, remote_filename);
-    int init_result = InitializeTransfer(sockfd, &serv_addr, addr_len, wrq_len, send_buffer, recv_buffer);
-
-    if (init_result < 0) 
+    snprintf(blksize_value, sizeof(blksize_value), "%u", *blksize);
+    c->requested = *blksize > TFTP_DATA_SIZE ? *blksize : 0;
+    size_t wrq_len = tftp_encode_request(request, sizeof(request), OP_WRQ, remote_filename, mode,
+                                         &option, c->requested != 0);
+    if (wrq_len == 0) 
     {
-        fclose(fp);
-        close(sockfd);
-        return;
+        tftp_log(TFTP_LOG_ERROR, "Filename too long.\n");
+        close(c->sockfd);
+        return -1;
     }
-    // // --- B. Data Transfer Loop (Lock-Step) ---
-    printf("Sending WRQ for file '%s' to server...\n", remote_filename);
-    long int file_size = getFileSizeStat(local_filename);
 
-    while (1) 
+    // --- A. Send WRQ Request, B. Data Transfer Loop (Lock-Step) ---
+    tftp_engine_init(&engine, TFTP_ENGINE_SEND, &client_ops, c, send_buffer, sizeof(send_buffer), TFTP_DATA_SIZE);
+    engine.timeout_us = TIMEOUT_SEC * 1000000u;
+    engine.max_retries = MAX_RETRANSMIT;
+    tftp_log(TFTP_LOG_INFO, "Sending WRQ for file '%s' to server (blksize %u)...\n", remote_filename, *blksize);
+    tftp_engine_start(&engine, request, wrq_len, nowUs());
+
+    uint32_t spin_us = tftp_latency_from_env(c->sockfd); // Low-latency profile, off unless TFTP_SPIN_US is set
+    while (engine.status == TFTP_ENGINE_RUNNING) 
     {
-        // 1. Read data from file
-        bytes_read = fread(file_data, 1, TFTP_DATA_SIZE, fp);
-        if (ferror(fp)) 
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        uint64_t now = nowUs();
+        uint64_t wait_us = engine.deadline_us > now ? engine.deadline_us - now : 0;
+
+        // --- Wait for the next packet until the engine's deadline (tftpLatency.h) ---
+        int rv = tftp_latency_wait(c->sockfd, wait_us, spin_us);
+        if (rv < 0) 
         {
-            perror("File read error");
+            perror("poll error");
             break;
         }
+        if (rv == 0) 
+        {
+            tftp_engine_timeout(&engine, nowUs());
+            continue;
+        }
 
-        // 2. Construct DATA packet
-        int data_len = createDataPacket(send_buffer, current_block, file_data, bytes_read);
-        int ans = sendDataPack(sockfd, &serv_addr, addr_len, send_buffer, recv_buffer, current_block, data_len, bytes_read, &total_bytes);
-
-        if (ans < 0) 
-            break;
+        ssize_t n = recvfrom(c->sockfd, recv_buffer, sizeof(recv_buffer), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0) 
+        {
+            continue;
+        }
 
-        if (bytes_read < TFTP_DATA_SIZE || total_bytes >= file_size) 
+        // The server's first reply, from its own address, comes from its
+        // transfer port (TID); stray packets from any other address or port
+        // get ERROR 5 and are otherwise ignored.
+        if (!tid_locked && from.sin_addr.s_addr == c->serv_addr.sin_addr.s_addr) 
         {
-            succeeded = 1;
-            break;
+            c->serv_addr = from;
+            c->addr_len = from_len;
+            tid_locked = 1;
+        } 
+        else if (!tid_locked || from.sin_port != c->serv_addr.sin_port ||
+                 from.sin_addr.s_addr != c->serv_addr.sin_addr.s_addr) 
+        {
+            char error_packet[64];
+            size_t len = tftp_encode_error(error_packet, sizeof(error_packet), 5, "Unknown transfer ID");
+            sendto(c->sockfd, error_packet, len, 0, (const struct sockaddr *)&from, from_len);
+            continue;
         }
 
-        current_block++;
+        tftp_engine_receive(&engine, recv_buffer, (size_t)n, nowUs());
     }
    
-    if (fp) 
-        fclose(fp);
-    if (sockfd) 
-        close(sockfd);
+    close(c->sockfd);
     
-    if (succeeded)
+    if (engine.status == TFTP_ENGINE_DONE)
     {
-        printf("\nFile transfer of '%s' complete. Total bytes sent: %d\n", local_filename, total_bytes);
+        tftp_log(TFTP_LOG_INFO, "\nFile transfer of '%s' complete. Total bytes sent: %llu (crc32c %08x)\n",
+                 local_filename, (unsigned long long)engine.bytes, c->netascii ? c->encoder.state.crc : c->crc);
+        return 0;
     }
-    else
+    if (engine.status == TFTP_ENGINE_FAILED)
     {
-        printf("\nFile transfer of '%s' failed.\n", local_filename);
+        tftp_log(TFTP_LOG_ERROR, "Transfer failed (error %d): %s\n", engine.error_code, engine.error);
     }
-
- 
+    // The server took the large blksize, then the blocks stopped getting through
+    if (engine.status == TFTP_ENGINE_FAILED && engine.negotiated && engine.blksize > TFTP_DATA_SIZE &&
+        (c->too_big || engine.retries >= engine.max_retries))
+    {
+        uint16_t path = tftp_pmtu_blksize(&c->serv_addr, TFTP_MAX_BLKSIZE);
+        *blksize = engine.blksize / 2 > TFTP_DATA_SIZE ? engine.blksize / 2 : TFTP_DATA_SIZE;
+        *blksize = path < *blksize && path > TFTP_DATA_SIZE ? path : *blksize;
+        tftp_log(TFTP_LOG_WARN, "Repeated loss at blksize %u. Retrying with %u.\n", engine.blksize, *blksize);
+        return WRQ_RETRY;
+    }
+    return -1;
 }
 
+void tftpWriteFile(const char *server_ip, const char *local_filename, const char *remote_filename, const char *mode) 
+{
+    struct wrq_client c;
+    uint16_t blksize = 0;
+    int rc;
+
+    // Open local file for reading
+    memset(&c, 0, sizeof(c));
+    c.netascii = strcmp(mode, "netascii") == 0;
+    c.fp = fopen(local_filename, "rb");
+    if (!c.fp) 
+    {
+        perror("Failed to open local file");
+        return;
+    }
+
+    // Every attempt gets a fresh socket: the server tells transfers apart by the client's port
+    do
+    {
+        rc = wrqAttempt(&c, server_ip, local_filename, remote_filename, mode, &blksize);
+    } while (rc == WRQ_RETRY);
+    fclose(c.fp);
+
+    if (rc < 0)
+    {
+        tftp_log(TFTP_LOG_ERROR, "\nFile transfer of '%s' failed.\n", local_filename);
+    }
+}
@@ -9,24 +9,25 @@
 #include <netinet/in.h>
 #include <errno.h>
 
+#include "tftpCodec.h"
+#include "tftpDigest.h"
+#include "tftpEngine.h"
+#include "tftpLatency.h"
+#include "tftpLog.h"
+#include "tftpNetascii.h"
+#include "tftpPmtu.h"
+
 #define SERVER_PORT 69
 #define MAX_BUFFER_SIZE 516     // 2 (Opcode) + 2 (Block #) + 512 (Data)
-#define TFTP_DATA_SIZE 512      // Max data size per packet
+#define TFTP_DATA_SIZE TFTP_DEFAULT_BLKSIZE // Data per packet unless a larger blksize is negotiated
+#define MAX_PACKET_SIZE (4 + TFTP_MAX_BLKSIZE)  // DATA at the largest blksize a server may grant
 #define MAX_RETRANSMIT 5        // Max retransmissions before giving up
 #define TIMEOUT_SEC 3           // Timeout for socket receive (seconds)
 
-// TFTP Opcodes (Network Byte Order)
-#define OP_RRQ      1
-#define OP_WRQ      2
-#define OP_DATA     3
-#define OP_ACK      4
-#define OP_ERROR    5
+// TFTP Opcodes come from tftpCodec.h
 
 // Transfer Mode
-#define MODE "octet"
+#define MODE "octet"            // Default; "netascii" on request
 
 
-int createDataPacket(char *buffer, uint16_t block_num, const char *data, int data_len);
-int createWrqPacket(char *buffer, const char *filename);
-int SetUpSocket(const char *server_ip, struct sockaddr_in *serv_addr);
-long int getFileSizeStat(const char* filename);
\ No newline at end of file
+int SetUpSocket(const char *server_ip, struct sockaddr_in *serv_addr);
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "tftpArchive.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+uint64_t tftp_archive_hash(const char *name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// True when [offset, offset + len) lies inside an archive of 'size' bytes
+static int in_bounds(uint64_t offset, uint64_t len, uint64_t size) {
+    return offset <= size && len <= size - offset;
+}
+
+static int invalid(char *error, size_t error_len, const char *reason) {
+    snprintf(error, error_len, "%s", reason);
+    return -1;
+}
+
+static int validate(const struct tftp_archive *a, char *error, size_t error_len) {
+    const struct tftp_archive_header *h = a->header;
+    uint32_t count = h->entry_count;
+
+    if (memcmp(h->magic, TFTP_ARCHIVE_MAGIC, sizeof(h->magic)) != 0) {
+        return invalid(error, error_len, "not a tftp archive");
+    }
+    if (h->version != TFTP_ARCHIVE_VERSION) {
+        return invalid(error, error_len, "unsupported archive version");
+    }
+    if (h->size != a->size) {
+        return invalid(error, error_len, "archive truncated");
+    }
+    if (h->bucket_count == 0 || (h->bucket_count & (h->bucket_count - 1)) != 0 ||
+        !in_bounds(h->buckets_offset, (uint64_t)h->bucket_count * sizeof(uint32_t), a->size) ||
+        !in_bounds(h->entries_offset, (uint64_t)count * sizeof(struct tftp_archive_entry), a->size) ||
+        h->buckets_offset % sizeof(uint32_t) != 0 || h->entries_offset % sizeof(uint64_t) != 0 ||
+        h->names_offset > h->data_offset || h->data_offset > a->size) {
+        return invalid(error, error_len, "bad archive layout");
+    }
+    for (uint32_t i = 0; i < h->bucket_count; i++) {
+        if (a->buckets[i] != TFTP_ARCHIVE_NONE && a->buckets[i] >= count) {
+            return invalid(error, error_len, "bad bucket");
+        }
+    }
+
+    // Chains only point forward, so no lookup can loop
+    for (uint32_t i = 0; i < count; i++) {
+        const struct tftp_archive_entry *e = &a->entries[i];
+        if (!in_bounds(e->name_offset, e->name_len, h->data_offset - h->names_offset) ||
+            !in_bounds(e->offset, e->size, a->size) ||
+            (e->next != TFTP_ARCHIVE_NONE && (e->next >= count || e->next <= i))) {
+            return invalid(error, error_len, "bad entry");
+        }
+    }
+    return 0;
+}
+
+int tftp_archive_open(struct tftp_archive *a, const char *path, char *error, size_t error_len) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(a, 0, sizeof(*a));
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(error, error_len, "%s: %m", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if ((uint64_t)st.st_size < sizeof(struct tftp_archive_header)) {
+        close(fd);
+        return invalid(error, error_len, "not a tftp archive");
+    }
+
+    // The mapping outlives the descriptor and, after a rename, the name
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        snprintf(error, error_len, "mmap %s: %m", path);
+        return -1;
+    }
+
+    a->base = base;
+    a->size = (size_t)st.st_size;
+    a->dev = st.st_dev;
+    a->ino = st.st_ino;
+    a->header = base;
+    a->buckets = (const uint32_t *)(a->base + a->header->buckets_offset);
+    a->entries = (const struct tftp_archive_entry *)(a->base + a->header->entries_offset);
+    a->names = (const char *)a->base + a->header->names_offset;
+    if (validate(a, error, error_len) < 0) {
+        tftp_archive_close(a);
+        return -1;
+    }
+    return 0;
+}
+
+void tftp_archive_close(struct tftp_archive *a) {
+    if (a->base != NULL) {
+        munmap((void *)a->base, a->size);
+    }
+    memset(a, 0, sizeof(*a));
+}
+
+const struct tftp_archive_entry *tftp_archive_lookup(const struct tftp_archive *a, const char *name) {
+    if (a->base == NULL) {
+        return NULL;
+    }
+    while (*name == '/') {
+        name++;
+    }
+    size_t len = strlen(name);
+    uint64_t hash = tftp_archive_hash(name, len);
+    uint32_t i = a->buckets[hash & (a->header->bucket_count - 1)];
+
+    while (i != TFTP_ARCHIVE_NONE) {
+        const struct tftp_archive_entry *e = &a->entries[i];
+        if (e->hash == hash && e->name_len == len && memcmp(a->names + e->name_offset, name, len) == 0) {
+            return e;
+        }
+        i = e->next;
+    }
+    return NULL;
+}
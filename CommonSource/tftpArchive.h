@@ -0,0 +1,78 @@
+#ifndef TFTP_ARCHIVE_H
+#define TFTP_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// --- PACKED FILE ARCHIVE ---
+//
+// Many small files in one read-only file, served straight from a read-only
+// mapping: a lookup is a hash probe, with no directory walk and no open().
+// Built by tftp_mkarchive (ToolSource/tftpMkArchive.c), little-endian:
+//
+//   header | buckets[bucket_count] | entries[entry_count] | names | data
+//
+// Each bucket holds the index of the first entry in its chain (or
+// TFTP_ARCHIVE_NONE); entries chain through 'next'. Names are stored without a
+// leading '/' and are not NUL-terminated. Every data region starts on a
+// TFTP_ARCHIVE_ALIGN boundary.
+//
+// tftp_archive_open() checks every offset, length and chain index once, so a
+// lookup on a mapped archive never reads outside it.
+
+#define TFTP_ARCHIVE_MAGIC "TFTPARC1"
+#define TFTP_ARCHIVE_VERSION 1
+#define TFTP_ARCHIVE_NONE UINT32_MAX
+#define TFTP_ARCHIVE_ALIGN 64
+
+struct tftp_archive_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t bucket_count;          // Power of two
+    uint32_t reserved;
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+    uint64_t names_offset;
+    uint64_t data_offset;
+    uint64_t size;                  // Of the whole archive
+};
+
+struct tftp_archive_entry {
+    uint64_t hash;                  // tftp_archive_hash() of the name
+    uint64_t offset;                // Of the file's data, from the start of the archive
+    uint64_t size;
+    int64_t mtime;                  // Of the source file, seconds
+    uint32_t name_offset;           // From names_offset
+    uint32_t name_len;
+    uint32_t next;                  // Next entry in this bucket, or TFTP_ARCHIVE_NONE
+    uint32_t crc32c;                // tftp_crc32c() of the data
+};
+
+struct tftp_archive {
+    const unsigned char *base;      // NULL when no archive is open
+    size_t size;
+    const struct tftp_archive_header *header;
+    const uint32_t *buckets;
+    const struct tftp_archive_entry *entries;
+    const char *names;
+    dev_t dev;                      // Of the mapped file, to tell versions apart
+    ino_t ino;
+};
+
+// FNV-1a, 64-bit
+uint64_t tftp_archive_hash(const char *name, size_t len);
+
+// Maps and validates path. Returns 0, or -1 with a reason in 'error'.
+int tftp_archive_open(struct tftp_archive *a, const char *path, char *error, size_t error_len);
+void tftp_archive_close(struct tftp_archive *a);
+
+// Looks name up, ignoring leading '/' characters. Returns NULL if absent.
+const struct tftp_archive_entry *tftp_archive_lookup(const struct tftp_archive *a, const char *name);
+
+static inline const char *tftp_archive_data(const struct tftp_archive *a, const struct tftp_archive_entry *e) {
+    return (const char *)a->base + e->offset;
+}
+
+#endif
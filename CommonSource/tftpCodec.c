@@ -0,0 +1,189 @@
+#include "tftpCodec.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <strings.h>
+
+// Packet fields are not aligned in the buffer, so go through memcpy
+static inline void put_u16(char *p, uint16_t v) {
+    v = htons(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint16_t get_u16(const char *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+// Appends a NUL-terminated string; returns the new offset or 0 if it does not fit
+static size_t put_string(char *buf, size_t cap, size_t off, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (off == 0 || len > cap - off) {
+        return 0;
+    }
+    memcpy(buf + off, s, len);
+    return off + len;
+}
+
+static size_t put_options(char *buf, size_t cap, size_t off, const struct tftp_option *options, int count) {
+    for (int i = 0; i < count && off != 0; i++) {
+        off = put_string(buf, cap, off, options[i].name);
+        off = put_string(buf, cap, off, options[i].value);
+    }
+    return off;
+}
+
+// --- ENCODERS ---
+
+size_t tftp_encode_request(char *buf, size_t cap, uint16_t opcode, const char *filename, const char *mode,
+                           const struct tftp_option *options, int option_count) {
+    if (cap < 2) {
+        return 0;
+    }
+    put_u16(buf, opcode);
+    size_t off = put_string(buf, cap, 2, filename);
+    off = put_string(buf, cap, off, mode);
+    return put_options(buf, cap, off, options, option_count);
+}
+
+size_t tftp_encode_oack(char *buf, size_t cap, const struct tftp_option *options, int option_count) {
+    if (cap < 2) {
+        return 0;
+    }
+    put_u16(buf, OP_OACK);
+    return option_count == 0 ? 2 : put_options(buf, cap, 2, options, option_count);
+}
+
+size_t tftp_encode_data(char *buf, size_t cap, uint16_t block, const void *data, size_t len) {
+    if (cap < TFTP_HEADER_SIZE || len > cap - TFTP_HEADER_SIZE) {
+        return 0;
+    }
+    put_u16(buf, OP_DATA);
+    put_u16(buf + 2, block);
+    if (data != buf + TFTP_HEADER_SIZE && len > 0) {
+        memcpy(buf + TFTP_HEADER_SIZE, data, len);
+    }
+    return TFTP_HEADER_SIZE + len;
+}
+
+size_t tftp_encode_ack(char *buf, size_t cap, uint16_t block) {
+    if (cap < TFTP_HEADER_SIZE) {
+        return 0;
+    }
+    put_u16(buf, OP_ACK);
+    put_u16(buf + 2, block);
+    return TFTP_HEADER_SIZE;
+}
+
+// The message is truncated rather than dropped when it does not fit
+size_t tftp_encode_error(char *buf, size_t cap, uint16_t code, const char *message) {
+    if (cap < TFTP_HEADER_SIZE + 1) {
+        return 0;
+    }
+    size_t len = strnlen(message, cap - TFTP_HEADER_SIZE - 1);
+    put_u16(buf, OP_ERROR);
+    put_u16(buf + 2, code);
+    memcpy(buf + TFTP_HEADER_SIZE, message, len);
+    buf[TFTP_HEADER_SIZE + len] = '\0';
+    return TFTP_HEADER_SIZE + len + 1;
+}
+
+// --- DECODER ---
+
+// Splits "name\0value\0..." into option pairs, bounded by 'end'. Requests
+// may end with a dangling name and no value, which is ignored.
+static int decode_options(const char *p, const char *end, struct tftp_packet *pkt, int allow_dangling) {
+    while (p < end) {
+        const char *name_end = memchr(p, '\0', (size_t)(end - p));
+        if (name_end == NULL) {
+            return -1; // Unterminated string
+        }
+        const char *value = name_end + 1;
+        if (value >= end) {
+            return allow_dangling ? 0 : -1;
+        }
+        const char *value_end = memchr(value, '\0', (size_t)(end - value));
+        if (value_end == NULL) {
+            return -1;
+        }
+        // Options beyond TFTP_MAX_OPTIONS are ignored, which RFC 2347 allows
+        if (pkt->option_count < TFTP_MAX_OPTIONS) {
+            pkt->options[pkt->option_count].name = p;
+            pkt->options[pkt->option_count].value = value;
+            pkt->option_count++;
+        }
+        p = value_end + 1;
+    }
+    return 0;
+}
+
+int tftp_decode(const char *buf, size_t len, struct tftp_packet *pkt) {
+    const char *end = buf + len;
+
+    if (len < 2) {
+        return -1;
+    }
+    pkt->opcode = get_u16(buf);
+    pkt->option_count = 0;
+
+    switch (pkt->opcode) {
+    case OP_DATA:
+        if (len < TFTP_HEADER_SIZE) {
+            return -1;
+        }
+        pkt->block = get_u16(buf + 2);
+        pkt->data = buf + TFTP_HEADER_SIZE;
+        pkt->data_len = len - TFTP_HEADER_SIZE;
+        return 0;
+
+    case OP_ACK:
+        if (len < TFTP_HEADER_SIZE) {
+            return -1;
+        }
+        pkt->block = get_u16(buf + 2);
+        return 0;
+
+    case OP_ERROR:
+        if (len < TFTP_HEADER_SIZE) {
+            return -1;
+        }
+        pkt->block = get_u16(buf + 2);
+        // An unterminated message is reported as empty rather than read past the end
+        pkt->message = memchr(buf + TFTP_HEADER_SIZE, '\0', len - TFTP_HEADER_SIZE) != NULL
+                           ? buf + TFTP_HEADER_SIZE : "";
+        return 0;
+
+    case OP_RRQ:
+    case OP_WRQ: {
+        const char *p = buf + 2;
+        const char *filename_end = memchr(p, '\0', (size_t)(end - p));
+        if (filename_end == NULL || filename_end == p) {
+            return -1; // Filename is mandatory
+        }
+        const char *mode = filename_end + 1;
+        const char *mode_end = mode < end ? memchr(mode, '\0', (size_t)(end - mode)) : NULL;
+        if (mode_end == NULL) {
+            return -1;
+        }
+        pkt->filename = p;
+        pkt->mode = mode;
+        return decode_options(mode_end + 1, end, pkt, 1);
+    }
+
+    case OP_OACK:
+        return decode_options(buf + 2, end, pkt, 0);
+
+    default:
+        return -1;
+    }
+}
+
+const char *tftp_find_option(const struct tftp_packet *pkt, const char *name) {
+    for (int i = 0; i < pkt->option_count; i++) {
+        if (strcasecmp(pkt->options[i].name, name) == 0) {
+            return pkt->options[i].value;
+        }
+    }
+    return NULL;
+}
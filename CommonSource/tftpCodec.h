@@ -0,0 +1,66 @@
+#ifndef TFTP_CODEC_H
+#define TFTP_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- TFTP PACKET CODEC (RFC 1350, options per RFC 2347) ---
+//
+// Shared by the server and both clients. Nothing here allocates or copies
+// more than it has to:
+//   - encoders write into a caller buffer of 'cap' bytes and return the packet
+//     length, or 0 when the packet would not fit;
+//   - tftp_decode() never reads past 'len' and returns pointers into the
+//     received buffer (filename, mode, options, DATA payload, ERROR message).
+// To send file data without a copy, read it straight into
+// buf + TFTP_HEADER_SIZE and pass that pointer to tftp_encode_data().
+
+#define OP_RRQ   1
+#define OP_WRQ   2
+#define OP_DATA  3
+#define OP_ACK   4
+#define OP_ERROR 5
+#define OP_OACK  6      // Option Acknowledgment (RFC 2347)
+
+#define TFTP_HEADER_SIZE 4              // Opcode + block number / error code
+#define TFTP_DEFAULT_BLKSIZE 512
+#define TFTP_MAX_BLKSIZE 65464          // RFC 2348
+#define TFTP_MAX_OPTIONS 8
+
+struct tftp_option {
+    const char *name;
+    const char *value;
+};
+
+struct tftp_packet {
+    uint16_t opcode;
+    uint16_t block;                 // DATA/ACK block number, ERROR code
+    const char *data;               // DATA payload
+    size_t data_len;
+    const char *message;            // ERROR message (always NUL-terminated)
+    const char *filename;           // RRQ/WRQ
+    const char *mode;               // RRQ/WRQ
+    int option_count;               // RRQ/WRQ/OACK
+    struct tftp_option options[TFTP_MAX_OPTIONS];
+};
+
+size_t tftp_encode_request(char *buf, size_t cap, uint16_t opcode, const char *filename, const char *mode,
+                           const struct tftp_option *options, int option_count);
+size_t tftp_encode_oack(char *buf, size_t cap, const struct tftp_option *options, int option_count);
+size_t tftp_encode_data(char *buf, size_t cap, uint16_t block, const void *data, size_t len);
+size_t tftp_encode_ack(char *buf, size_t cap, uint16_t block);
+size_t tftp_encode_error(char *buf, size_t cap, uint16_t code, const char *message);
+
+// Returns 0 and fills 'pkt', or -1 for a malformed or unknown packet
+int tftp_decode(const char *buf, size_t len, struct tftp_packet *pkt);
+
+// Option names are case-insensitive (RFC 2347). NULL when absent.
+const char *tftp_find_option(const struct tftp_packet *pkt, const char *name);
+
+// Maps a 16-bit block number onto the 32-bit counter nearest to 'ref', so
+// comparisons keep working when block numbers roll over after 65535
+static inline uint32_t tftp_block_extend(uint32_t ref, uint16_t block) {
+    return ref + (uint32_t)(int16_t)(uint16_t)(block - (uint16_t)ref);
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include "tftpDigest.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DIGEST_X86_64 1
+#endif
+
+// --- CRC32C KERNELS ---
+//
+// Both work on the inverted register; tftp_crc32c() applies the pre- and
+// post-inversion so callers can chain calls starting from 0.
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const unsigned char *p, size_t n);
+
+#define CRC32C_POLY 0x82F63B78u     // Castagnoli, reflected
+
+static uint32_t table[8][256];
+
+static void build_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+        }
+    }
+}
+
+// Slicing-by-8: one table lookup per input byte, eight independent per step
+static uint32_t crc_table(uint32_t c, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        uint32_t lo = c ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        c = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+            table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+            table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        c = (c >> 8) ^ table[0][(c ^ *p++) & 0xFF];
+    }
+    return c;
+}
+
+#ifdef DIGEST_X86_64
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t c, const unsigned char *p, size_t n) {
+    uint64_t c64;
+
+    while (n > 0 && ((uintptr_t)p & 7) != 0) {
+        c = _mm_crc32_u8(c, *p++);
+        n--;
+    }
+    c64 = c;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c64 = _mm_crc32_u64(c64, v);
+        p += 8;
+        n -= 8;
+    }
+    c = (uint32_t)c64;
+    while (n-- > 0) {
+        c = _mm_crc32_u8(c, *p++);
+    }
+    return c;
+}
+#endif
+
+static crc_fn crc_impl;
+static const char *impl_name;
+
+int tftp_crc32c_set_impl(const char *name) {
+    if (strcasecmp(name, "table") == 0) {
+        if (table[0][1] == 0) {
+            build_table();
+        }
+        crc_impl = crc_table;
+        impl_name = "table";
+        return 0;
+    }
+#ifdef DIGEST_X86_64
+    __builtin_cpu_init();
+    if (strcasecmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        crc_impl = crc_sse42;
+        impl_name = "sse4.2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *tftp_crc32c_impl(void) {
+    if (crc_impl == NULL && tftp_crc32c_set_impl("sse4.2") < 0) {
+        tftp_crc32c_set_impl("table");
+    }
+    return impl_name;
+}
+
+uint32_t tftp_crc32c(uint32_t crc, const void *data, size_t len) {
+    if (crc_impl == NULL) {
+        tftp_crc32c_impl();
+    }
+    return ~crc_impl(~crc, data, len);
+}
+
+// --- STORED DIGESTS ---
+//
+// Record format, in the xattr and the sidecar alike:
+// "<crc32c hex> <size> <mtime sec>.<mtime nsec>"
+
+static int format_record(int fd, uint32_t crc, char *buf, size_t cap) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    return snprintf(buf, cap, "%08x %llu %lld.%09ld", crc, (unsigned long long)st.st_size,
+                    (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+}
+
+static int sidecar_path(const char *path, char *buf, size_t cap) {
+    int n = snprintf(buf, cap, "%s%s", path, TFTP_DIGEST_SIDECAR_SUFFIX);
+    return n < 0 || (size_t)n >= cap ? -1 : 0;
+}
+
+int tftp_digest_store(int fd, const char *path, uint32_t crc) {
+    char record[64], sidecar[4096];
+    int len = format_record(fd, crc, record, sizeof(record));
+
+    if (len < 0) {
+        return -1;
+    }
+    if (fsetxattr(fd, TFTP_DIGEST_XATTR, record, (size_t)len, 0) == 0) {
+        if (sidecar_path(path, sidecar, sizeof(sidecar)) == 0) {
+            unlink(sidecar); // An older sidecar would now disagree
+        }
+        return 0;
+    }
+
+    // No user xattrs here (ENOTSUP, EPERM on some filesystems): use a sidecar
+    if (sidecar_path(path, sidecar, sizeof(sidecar)) < 0) {
+        return -1;
+    }
+    int sfd = open(sidecar, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (sfd < 0) {
+        return -1;
+    }
+    record[len++] = '\n';
+    int rc = write(sfd, record, (size_t)len) == len ? 0 : -1;
+    close(sfd);
+    return rc;
+}
+
+int tftp_digest_load(int fd, const char *path, uint32_t *crc) {
+    char stored[64], current[64], sidecar[4096];
+    ssize_t n = fgetxattr(fd, TFTP_DIGEST_XATTR, stored, sizeof(stored) - 1);
+
+    if (n < 0 && sidecar_path(path, sidecar, sizeof(sidecar)) == 0) {
+        int sfd = open(sidecar, O_RDONLY);
+        if (sfd >= 0) {
+            n = read(sfd, stored, sizeof(stored) - 1);
+            close(sfd);
+        }
+    }
+    if (n <= 0) {
+        return -1;
+    }
+    stored[n] = '\0';
+    stored[strcspn(stored, "\n")] = '\0';
+
+    // Valid only for the size and mtime it was computed at
+    unsigned int value;
+    if (sscanf(stored, "%8x", &value) != 1 || format_record(fd, value, current, sizeof(current)) < 0 ||
+        strcmp(stored, current) != 0) {
+        return -1;
+    }
+    *crc = value;
+    return 0;
+}
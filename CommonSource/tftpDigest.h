@@ -0,0 +1,36 @@
+#ifndef TFTP_DIGEST_H
+#define TFTP_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- STREAMING CONTENT DIGEST (CRC32C) ---
+//
+// Transfers feed every file byte through tftp_crc32c() as it is read or
+// written, so a file's digest is known the moment the transfer ends without
+// reading it back. Uses the SSE4.2 crc32 instruction when the CPU has it and
+// a slicing-by-8 table otherwise; both give the same (Castagnoli) value.
+//
+// A finished upload's digest is stored with the file, as the extended
+// attribute "user.tftp.crc32c" or, where the filesystem has no user xattrs,
+// in a "<file>.crc32c" sidecar. The record also holds the size and mtime it
+// was computed for, so tftp_digest_load() rejects it once the file changes and
+// the value can serve as a content key.
+
+#define TFTP_DIGEST_XATTR "user.tftp.crc32c"
+#define TFTP_DIGEST_SIDECAR_SUFFIX ".crc32c"
+
+// Start from 0 and pass the previous return value to continue a stream
+uint32_t tftp_crc32c(uint32_t crc, const void *data, size_t len);
+// Implementation: "sse4.2" or "table". Returns -1 if unsupported here.
+int tftp_crc32c_set_impl(const char *name);
+const char *tftp_crc32c_impl(void);
+
+// Records crc for the file's current size and mtime. Returns 0, or -1 if
+// neither the xattr nor the sidecar could be written.
+int tftp_digest_store(int fd, const char *path, uint32_t crc);
+// Returns 0 and fills *crc when a record exists and matches the file's
+// current size and mtime, -1 otherwise
+int tftp_digest_load(int fd, const char *path, uint32_t *crc);
+
+#endif
@@ -0,0 +1,237 @@
+#include "tftpEngine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ENGINE_DEFAULT_TIMEOUT_US 3000000u
+#define ENGINE_DEFAULT_RETRIES 5
+
+static void emit(struct tftp_engine *e, int event, uint32_t block, uint64_t arg) {
+    if (e->ops->event != NULL) {
+        e->ops->event(e->ctx, event, block, arg);
+    }
+}
+
+static int fail(struct tftp_engine *e, uint16_t code, const char *message) {
+    e->error_code = code;
+    snprintf(e->error, sizeof(e->error), "%s", message);
+    e->status = TFTP_ENGINE_FAILED;
+    return e->status;
+}
+
+// Tells the peer why we give up, then fails
+static int abort_transfer(struct tftp_engine *e, uint16_t code, const char *message) {
+    char packet[TFTP_HEADER_SIZE + sizeof(e->error)];
+    size_t len = tftp_encode_error(packet, sizeof(packet), code, message);
+
+    e->ops->send(e->ctx, packet, len);
+    emit(e, TFTP_EV_ERROR_SENT, e->block, code);
+    return fail(e, code, message);
+}
+
+// Sends the stored packet (first transmission or retransmission)
+static int transmit(struct tftp_engine *e, uint64_t now_us) {
+    if (e->ops->send(e->ctx, e->ready != NULL ? e->ready : e->packet, e->packet_len) < 0) {
+        return fail(e, 0, "send failed");
+    }
+    e->deadline_us = now_us + e->timeout_us;
+    return TFTP_ENGINE_RUNNING;
+}
+
+// SEND role: takes the next DATA packet ready-made from ops->data, or reads
+// the payload straight into the packet buffer; then sends it
+static int send_next_block(struct tftp_engine *e, uint64_t now_us) {
+    char *payload = NULL;
+    size_t len = 0;
+    ssize_t n;
+
+    e->ready = e->ops->data != NULL && (e->block == 0 || e->ready != NULL)
+                   ? e->ops->data(e->ctx, e->block + 1, &len) : NULL;
+    if (e->ready != NULL) {
+        n = (ssize_t)(len - TFTP_HEADER_SIZE);
+    } else if (e->packet_cap < (size_t)TFTP_HEADER_SIZE + e->blksize) {
+        return fail(e, 0, "packet buffer too small");
+    } else if ((n = e->ops->read(e->ctx, payload = e->packet + TFTP_HEADER_SIZE, e->blksize)) < 0) {
+        return abort_transfer(e, 3, "I/O error during read");
+    }
+    e->block++;
+    e->retries = 0;
+    e->last_payload = (size_t)n;
+    e->packet_len = e->ready != NULL ? len
+                                     : tftp_encode_data(e->packet, e->packet_cap, (uint16_t)e->block, payload, (size_t)n);
+    if (transmit(e, now_us) < 0) {
+        return e->status;
+    }
+    e->bytes += (uint64_t)n;
+    emit(e, TFTP_EV_DATA_SENT, e->block, (uint64_t)n);
+    return TFTP_ENGINE_RUNNING;
+}
+
+// RECEIVE role: (re)builds the stored ACK for the last block received
+static int send_ack(struct tftp_engine *e, uint64_t now_us) {
+    e->ready = e->ack;
+    e->packet_len = tftp_encode_ack(e->ack, sizeof(e->ack), (uint16_t)e->block);
+    return transmit(e, now_us);
+}
+
+void tftp_engine_init(struct tftp_engine *e, int role, const struct tftp_engine_ops *ops, void *ctx,
+                      char *packet, size_t packet_cap, uint16_t blksize) {
+    memset(e, 0, sizeof(*e));
+    e->ops = ops;
+    e->ctx = ctx;
+    e->role = role;
+    e->status = TFTP_ENGINE_RUNNING;
+    e->blksize = blksize;
+    e->max_retries = ENGINE_DEFAULT_RETRIES;
+    e->timeout_us = ENGINE_DEFAULT_TIMEOUT_US;
+    e->packet = packet;
+    e->packet_cap = packet_cap;
+}
+
+int tftp_engine_start(struct tftp_engine *e, const void *request, size_t request_len, uint64_t now_us) {
+    int reads = e->role == TFTP_ENGINE_SEND && e->ops->data == NULL; // Else checked per block
+    if ((reads && e->packet_cap < (size_t)TFTP_HEADER_SIZE + e->blksize) || request_len > e->packet_cap) {
+        return fail(e, 0, "packet buffer too small");
+    }
+    e->block = 0;
+    if (request != NULL) {
+        memcpy(e->packet, request, request_len);
+        e->packet_len = request_len;
+        return transmit(e, now_us);
+    }
+    return e->role == TFTP_ENGINE_SEND ? send_next_block(e, now_us) : send_ack(e, now_us);
+}
+
+static int receive_as_sender(struct tftp_engine *e, const struct tftp_packet *pkt, uint64_t now_us) {
+    if (pkt->opcode != OP_ACK) {
+        return abort_transfer(e, 4, "Illegal TFTP operation (unexpected opcode)");
+    }
+    uint32_t block = tftp_block_extend(e->block, pkt->block);
+
+    if (block == e->block) {
+        emit(e, TFTP_EV_ACK_RECEIVED, block, 0);
+        // The block just acknowledged was the short final one
+        if (block > 0 && e->last_payload < e->blksize) {
+            e->status = TFTP_ENGINE_DONE;
+            return e->status;
+        }
+        return send_next_block(e, now_us);
+    }
+    if (block < e->block) {
+        // Old ACK: the current block is still outstanding, keep waiting
+        emit(e, TFTP_EV_ACK_STALE, block, 0);
+        return TFTP_ENGINE_RUNNING;
+    }
+    return abort_transfer(e, 4, "Illegal TFTP operation (unexpected ACK)");
+}
+
+static int receive_as_receiver(struct tftp_engine *e, const struct tftp_packet *pkt, uint64_t now_us) {
+    if (pkt->opcode != OP_DATA) {
+        return abort_transfer(e, 4, "Illegal TFTP operation (unexpected opcode)");
+    }
+    uint32_t block = tftp_block_extend(e->block + 1, pkt->block);
+
+    if (block == e->block + 1) {
+        if (pkt->data_len > e->blksize) {
+            return abort_transfer(e, 4, "Illegal TFTP operation (oversized block)");
+        }
+        if (e->ops->write(e->ctx, pkt->data, pkt->data_len) < 0) {
+            return abort_transfer(e, 3, "Disk full or I/O error");
+        }
+        e->block = block;
+        e->retries = 0;
+        e->bytes += pkt->data_len;
+        if (send_ack(e, now_us) < 0) {
+            return e->status;
+        }
+        emit(e, TFTP_EV_DATA_RECEIVED, block, pkt->data_len);
+        if (pkt->data_len < e->blksize) {
+            e->status = TFTP_ENGINE_DONE;
+        }
+        return e->status;
+    }
+    if (block <= e->block) {
+        // Duplicate DATA (our ACK was lost): acknowledge that block again
+        char ack[TFTP_HEADER_SIZE];
+        e->ops->send(e->ctx, ack, tftp_encode_ack(ack, sizeof(ack), pkt->block));
+        e->retries = 0;
+        e->deadline_us = now_us + e->timeout_us;
+        emit(e, TFTP_EV_DATA_DUPLICATE, block, 0);
+        return TFTP_ENGINE_RUNNING;
+    }
+    return abort_transfer(e, 4, "Illegal TFTP operation (unexpected block)");
+}
+
+// Client: the server's OACK answers our request. The first one fixes the
+// blksize; a repeat means our ACK 0 was lost (RECEIVE role) or is stale.
+static int receive_oack(struct tftp_engine *e, const struct tftp_packet *pkt, uint64_t now_us) {
+    uint16_t blksize = e->blksize;
+
+    if (e->ops->oack == NULL) {
+        return abort_transfer(e, 8, "Option negotiation refused");
+    }
+    if (e->negotiated || e->block > 0) {
+        if (e->role == TFTP_ENGINE_RECEIVE && e->block == 0) {
+            e->deadline_us = now_us + e->timeout_us;
+            e->ops->send(e->ctx, e->ready != NULL ? e->ready : e->packet, e->packet_len);
+        }
+        return TFTP_ENGINE_RUNNING;
+    }
+    if (e->ops->oack(e->ctx, pkt, &blksize) < 0 || blksize < 8 ||
+        (e->role == TFTP_ENGINE_SEND && e->packet_cap < (size_t)TFTP_HEADER_SIZE + blksize)) {
+        return abort_transfer(e, 8, "Option negotiation refused");
+    }
+    e->blksize = blksize;
+    e->negotiated = 1;
+    e->retries = 0;
+    emit(e, TFTP_EV_OACK_RECEIVED, 0, blksize);
+    return e->role == TFTP_ENGINE_SEND ? send_next_block(e, now_us) : send_ack(e, now_us);
+}
+
+int tftp_engine_receive(struct tftp_engine *e, const char *packet, size_t len, uint64_t now_us) {
+    struct tftp_packet pkt;
+
+    if (e->status != TFTP_ENGINE_RUNNING) {
+        return e->status;
+    }
+    if (tftp_decode(packet, len, &pkt) < 0) {
+        return TFTP_ENGINE_RUNNING; // Malformed: let the timer recover
+    }
+    if (pkt.opcode == OP_ERROR) {
+        emit(e, TFTP_EV_ERROR_RECEIVED, e->block, pkt.block);
+        return fail(e, pkt.block, pkt.message);
+    }
+    if (pkt.opcode == OP_OACK) {
+        return receive_oack(e, &pkt, now_us);
+    }
+    return e->role == TFTP_ENGINE_SEND ? receive_as_sender(e, &pkt, now_us)
+                                       : receive_as_receiver(e, &pkt, now_us);
+}
+
+int tftp_engine_timeout(struct tftp_engine *e, uint64_t now_us) {
+    if (e->status != TFTP_ENGINE_RUNNING) {
+        return e->status;
+    }
+    emit(e, TFTP_EV_TIMEOUT, e->block, (uint64_t)e->retries);
+    if (e->retries >= e->max_retries) {
+        return abort_transfer(e, 0, "Max retries reached, transfer aborted");
+    }
+    e->retries++;
+    if (transmit(e, now_us) < 0) {
+        return e->status;
+    }
+    emit(e, e->role == TFTP_ENGINE_SEND && e->block > 0 ? TFTP_EV_DATA_RETRANSMIT : TFTP_EV_ACK_RETRANSMIT,
+         e->block, (uint64_t)e->retries);
+    return TFTP_ENGINE_RUNNING;
+}
+
+char *tftp_engine_release_packet(struct tftp_engine *e) {
+    char *packet = e->packet;
+
+    if (e->ready == NULL || packet == NULL) {
+        return NULL;
+    }
+    e->packet = NULL;
+    e->packet_cap = 0;
+    return packet;
+}
@@ -0,0 +1,110 @@
+#ifndef TFTP_ENGINE_H
+#define TFTP_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tftpCodec.h"
+
+// --- NON-BLOCKING TRANSFER ENGINE ---
+//
+// The lock-step DATA/ACK state machine shared by the server transfers and
+// both clients. The engine owns no socket, file or timer: the caller feeds it
+// received packets and expired deadlines and it answers through callbacks,
+// so it runs equally well under select(), epoll or the simulator.
+//
+//   SEND role     (server RRQ, client WRQ): reads the file, sends DATA, waits for ACKs
+//   RECEIVE role  (server WRQ, client RRQ): ACKs DATA and hands the payload to write()
+//
+// tftp_engine_start() may be given the request packet (client side); it is
+// retransmitted on timeout until the first reply arrives. Without one the
+// SEND role opens with DATA 1 and the RECEIVE role with ACK 0 (server side).
+//
+// Options (RFC 2347): a server passes its OACK to tftp_engine_start() as the
+// request. A client that asked for options sets ops->oack; when the OACK
+// arrives the callback checks it and may change the blksize, and the engine
+// goes on with ACK 0 (RECEIVE role) or DATA 1 (SEND role). Without the
+// callback an OACK is refused with ERROR 8. A server that ignores the options
+// answers with DATA 1 or ACK 0 and the transfer keeps the blksize it started with.
+//
+// Protocol errors, I/O errors and running out of retries send an ERROR packet
+// to the peer. A stale ACK never triggers a retransmission (no Sorcerer's
+// Apprentice), and never pushes the retransmission deadline back.
+
+enum tftp_engine_role {
+    TFTP_ENGINE_SEND,
+    TFTP_ENGINE_RECEIVE
+};
+
+enum tftp_engine_status {
+    TFTP_ENGINE_FAILED = -1,
+    TFTP_ENGINE_RUNNING = 0,
+    TFTP_ENGINE_DONE = 1
+};
+
+// Reported through ops->event for logging, metrics and tracing
+enum tftp_engine_event {
+    TFTP_EV_DATA_SENT,              // block, payload bytes
+    TFTP_EV_DATA_RETRANSMIT,        // block, attempt
+    TFTP_EV_DATA_RECEIVED,          // block, payload bytes
+    TFTP_EV_DATA_DUPLICATE,         // block (re-ACKed)
+    TFTP_EV_ACK_RECEIVED,           // block
+    TFTP_EV_ACK_STALE,              // block (ignored)
+    TFTP_EV_ACK_RETRANSMIT,         // block, attempt (RECEIVE role, or the request)
+    TFTP_EV_TIMEOUT,                // block, retries so far
+    TFTP_EV_ERROR_SENT,             // -, error code
+    TFTP_EV_ERROR_RECEIVED,         // -, error code
+    TFTP_EV_OACK_RECEIVED           // -, blksize in effect
+};
+
+struct tftp_engine_ops {
+    ssize_t (*send)(void *ctx, const void *packet, size_t len);
+    ssize_t (*read)(void *ctx, char *buf, size_t len);              // SEND role: next payload, 0 at EOF
+    int (*write)(void *ctx, const char *data, size_t len);          // RECEIVE role: 0 on success
+    void (*event)(void *ctx, int event, uint32_t block, uint64_t arg); // Optional
+    // Client: 0 accepts the OACK and may lower *blksize, -1 refuses it (ERROR 8)
+    int (*oack)(void *ctx, const struct tftp_packet *oack, uint16_t *blksize);
+    // SEND role, optional: DATA 'block' at the blksize in effect, already
+    // encoded, or NULL to read() it. Sent as it is, so it must stay unchanged
+    // until the transfer ends. Once it returned NULL it is not asked again.
+    const char *(*data)(void *ctx, uint32_t block, size_t *len);
+};
+
+struct tftp_engine {
+    const struct tftp_engine_ops *ops;
+    void *ctx;
+    int role;
+    int status;
+    uint16_t blksize;
+    uint32_t block;                 // SEND: block in flight (0 = request awaiting ACK 0). RECEIVE: last block stored
+    int negotiated;                 // An OACK was accepted
+    int retries;
+    int max_retries;
+    uint64_t timeout_us;
+    uint64_t deadline_us;           // Call tftp_engine_timeout() once the clock passes this
+    uint64_t bytes;                 // Payload bytes sent or stored
+    size_t last_payload;            // SEND: payload length of the block in flight
+    char *packet;                   // Last packet sent, kept for retransmission
+    const char *ready;              // Or what is sent instead: DATA from ops->data, or 'ack'
+    char ack[TFTP_HEADER_SIZE];     // RECEIVE: the last ACK
+    size_t packet_cap;              // At least TFTP_HEADER_SIZE + blksize
+    size_t packet_len;
+    uint16_t error_code;            // Why the transfer failed
+    char error[64];
+};
+
+// 'packet' is caller storage, so an engine is a small fixed-size struct. It
+// must hold the request, and a DATA block when the SEND role reads one into it.
+// Defaults: 3 s timeout, 5 retries; set timeout_us/max_retries before start.
+void tftp_engine_init(struct tftp_engine *e, int role, const struct tftp_engine_ops *ops, void *ctx,
+                      char *packet, size_t packet_cap, uint16_t blksize);
+int tftp_engine_start(struct tftp_engine *e, const void *request, size_t request_len, uint64_t now_us);
+int tftp_engine_receive(struct tftp_engine *e, const char *packet, size_t len, uint64_t now_us);
+int tftp_engine_timeout(struct tftp_engine *e, uint64_t now_us);
+// Takes 'packet' back once nothing in it will be sent again: the RECEIVE role
+// past the request, or a SEND role fed by ops->data. Returns it, or NULL while
+// it is still needed. Lets a loop serving many engines lend few buffers.
+char *tftp_engine_release_packet(struct tftp_engine *e);
+
+#endif
@@ -0,0 +1,83 @@
+#include "tftpLatency.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint32_t tftp_latency_spin(uint32_t spin_us) {
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        return 0;
+    }
+    return spin_us < TFTP_SPIN_US_MAX ? spin_us : TFTP_SPIN_US_MAX;
+}
+
+int tftp_latency_socket(int sockfd, uint32_t spin_us) {
+#ifdef SO_BUSY_POLL
+    int value = (int)spin_us;
+    return setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value));
+#else
+    (void)sockfd; (void)spin_us;
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
+int tftp_latency_wait(int sockfd, uint64_t timeout_us, uint32_t spin_us) {
+    struct pollfd pfd = { sockfd, POLLIN, 0 };
+    uint64_t start = now_us();
+    int rv;
+
+    if (spin_us > 0) {
+        uint64_t spin_end = start + (spin_us < timeout_us ? spin_us : timeout_us);
+        do {
+            rv = poll(&pfd, 1, 0);
+            if (rv != 0) {
+                return rv < 0 ? -1 : 1;
+            }
+        } while (now_us() < spin_end);
+    }
+    uint64_t elapsed = now_us() - start;
+    uint64_t left = timeout_us > elapsed ? timeout_us - elapsed : 0;
+    struct timespec ts = { (time_t)(left / 1000000u), (long)(left % 1000000u) * 1000 };
+    rv = ppoll(&pfd, 1, &ts, NULL);
+    return rv < 0 ? -1 : rv > 0;
+}
+
+int tftp_latency_realtime(int priority) {
+    struct sched_param param = { .sched_priority = priority };
+
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+        return -1;
+    }
+    // A page fault in the middle of a round trip costs more than the spin saves
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall failed");
+    }
+    return 0;
+}
+
+uint32_t tftp_latency_from_env(int sockfd) {
+    const char *spin = getenv("TFTP_SPIN_US");
+    const char *priority = getenv("TFTP_RT_PRIORITY");
+    uint32_t spin_us = tftp_latency_spin(spin != NULL ? (uint32_t)strtoul(spin, NULL, 10) : 0);
+
+    if (spin_us > 0 && tftp_latency_socket(sockfd, spin_us) < 0) {
+        perror("SO_BUSY_POLL failed");
+    }
+    if (priority != NULL && atoi(priority) > 0 && tftp_latency_realtime(atoi(priority)) < 0) {
+        perror("SCHED_FIFO failed");
+    }
+    return spin_us;
+}
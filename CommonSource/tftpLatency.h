@@ -0,0 +1,41 @@
+#ifndef TFTP_LATENCY_H
+#define TFTP_LATENCY_H
+
+#include <stdint.h>
+
+// --- LOW-LATENCY WAITING ---
+//
+// Lock-step TFTP moves one packet per round trip, so a small file costs a
+// handful of waits, and each one is a sleep and a wakeup: the scheduler puts
+// the process back on a CPU only some time after the packet arrived. For
+// back-to-back fetches of tiny files those wakeups are most of the latency.
+//
+// In the low-latency profile a wait first spins for up to spin_us, polling
+// the socket without sleeping, and only then sleeps in ppoll() until the
+// deadline, which is kept to the microsecond. SO_BUSY_POLL additionally lets
+// the kernel poll the device queue while a receive waits, on drivers that
+// support it. A real-time priority (SCHED_FIFO) keeps other work from
+// delaying the wakeups that remain. The spin is bounded, so an idle process
+// still sleeps; it costs CPU only while packets keep arriving.
+//
+// Spinning needs a spare CPU: on a single CPU the spinner only keeps the peer
+// process it waits for from running, so tftp_latency_spin() turns it off.
+//
+// The server takes -L spin_us and -F priority. The clients read the same
+// settings from TFTP_SPIN_US and TFTP_RT_PRIORITY.
+
+#define TFTP_SPIN_US_MAX 10000
+
+// The spin to use: spin_us capped at TFTP_SPIN_US_MAX, 0 with one CPU online
+uint32_t tftp_latency_spin(uint32_t spin_us);
+// Sets SO_BUSY_POLL; 0 or -1 (errno set, e.g. EPERM without CAP_NET_ADMIN)
+int tftp_latency_socket(int sockfd, uint32_t spin_us);
+// Waits until sockfd is readable, spinning for up to spin_us of timeout_us
+// first. Returns 1 when readable, 0 on timeout, -1 on error.
+int tftp_latency_wait(int sockfd, uint64_t timeout_us, uint32_t spin_us);
+// SCHED_FIFO at 'priority' and memory locked; 0 or -1 (errno set)
+int tftp_latency_realtime(int priority);
+// Applies TFTP_SPIN_US and TFTP_RT_PRIORITY for a client; returns the spin
+uint32_t tftp_latency_from_env(int sockfd);
+
+#endif
@@ -0,0 +1,374 @@
+#include "tftpLog.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// --- RING BUFFER RECORDS ---
+#define LOG_RING_SIZE 1024          // Records per process (power of two)
+#define LOG_RECORD_ARGS 6
+#define LOG_RECORD_TEXT 640         // Inline copy of %s arguments: a request's filename and an address
+#define LOG_FLUSH_INTERVAL_MS 50
+#define LOG_OUT_BUF_SIZE 65536
+
+union log_arg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+};
+
+struct log_record {
+    const char *fmt;                // Must be a string literal (formatted later)
+    int level;
+    int nargs;
+    union log_arg args[LOG_RECORD_ARGS];
+    char text[LOG_RECORD_TEXT];
+};
+
+int tftp_log_level = TFTP_LOG_INFO;
+unsigned int tftp_log_sample = 0;
+
+static struct log_record *ring;
+static unsigned int ring_head;      // Next slot written by the producer
+static unsigned int ring_tail;      // Next slot read by the flusher
+static unsigned long dropped;
+static unsigned int sample_counter;
+static int configured;
+static int running;
+static pthread_t flusher;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+
+static void log_configure(void) {
+    const char *level = getenv("TFTP_LOG_LEVEL");
+    const char *sample = getenv("TFTP_LOG_SAMPLE");
+
+    configured = 1;
+    if (level != NULL) {
+        if (strcasecmp(level, "error") == 0) tftp_log_level = TFTP_LOG_ERROR;
+        else if (strcasecmp(level, "warn") == 0) tftp_log_level = TFTP_LOG_WARN;
+        else if (strcasecmp(level, "info") == 0) tftp_log_level = TFTP_LOG_INFO;
+        else if (strcasecmp(level, "debug") == 0) tftp_log_level = TFTP_LOG_DEBUG;
+    }
+    if (sample != NULL) {
+        tftp_log_sample = (unsigned int)strtoul(sample, NULL, 10);
+    }
+}
+
+int tftp_log_sample_hit(void) {
+    return (++sample_counter % tftp_log_sample) == 0;
+}
+
+// --- FORMAT SPEC HELPERS ---
+
+// Splits one conversion spec starting at '%'. Returns a pointer past it and
+// fills the conversion character and length modifier ("", "h", "l", "ll", ...).
+static const char *parse_spec(const char *p, char *conv, char length[3], int *star_count) {
+    p++; // Skip '%'
+    *star_count = 0;
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') { (*star_count)++; p++; }
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') { (*star_count)++; p++; }
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    length[0] = length[1] = length[2] = '\0';
+    if (*p && strchr("hlzjtL", *p)) {
+        length[0] = *p++;
+        if ((length[0] == 'h' || length[0] == 'l') && *p == length[0]) {
+            length[1] = *p++;
+        }
+    }
+    *conv = *p ? *p++ : '\0';
+    return p;
+}
+
+// Captures the arguments described by fmt into the record (cheap: no formatting)
+static void capture_args(struct log_record *rec, const char *fmt, va_list ap) {
+    size_t text_used = 0;
+    const char *p = fmt;
+
+    rec->nargs = 0;
+    while ((p = strchr(p, '%')) != NULL) {
+        char conv;
+        char length[3];
+        int stars;
+        p = parse_spec(p, &conv, length, &stars);
+
+        for (int s = 0; s < stars && rec->nargs < LOG_RECORD_ARGS; s++) {
+            rec->args[rec->nargs++].i = va_arg(ap, int);
+        }
+        if (conv == '%' || conv == '\0' || rec->nargs >= LOG_RECORD_ARGS) {
+            continue;
+        }
+
+        union log_arg *arg = &rec->args[rec->nargs++];
+        switch (conv) {
+        case 'd': case 'i': case 'c':
+            if (length[0] == 'l' && length[1] == 'l') arg->i = va_arg(ap, long long);
+            else if (length[0] == 'l') arg->i = va_arg(ap, long);
+            else if (length[0] == 'z' || length[0] == 't') arg->i = va_arg(ap, ssize_t);
+            else if (length[0] == 'j') arg->i = va_arg(ap, long long);
+            else arg->i = va_arg(ap, int);
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            if (length[0] == 'l' && length[1] == 'l') arg->u = va_arg(ap, unsigned long long);
+            else if (length[0] == 'l') arg->u = va_arg(ap, unsigned long);
+            else if (length[0] == 'z' || length[0] == 't') arg->u = va_arg(ap, size_t);
+            else if (length[0] == 'j') arg->u = va_arg(ap, unsigned long long);
+            else arg->u = va_arg(ap, unsigned int);
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            arg->d = va_arg(ap, double);
+            break;
+        case 's': {
+            // Strings may not outlive the call: copy them into the record
+            const char *str = va_arg(ap, const char *);
+            size_t room = LOG_RECORD_TEXT - text_used;
+            size_t len;
+            if (str == NULL) str = "(null)";
+            len = strlen(str);
+            int cut = len >= room && room > 3; // Marked with "...", never cut silently
+            if (len >= room) len = cut ? room - 4 : room - 1;
+            memcpy(rec->text + text_used, str, len);
+            if (cut) {
+                memcpy(rec->text + text_used + len, "...", 3);
+                len += 3;
+            }
+            rec->text[text_used + len] = '\0';
+            arg->u = text_used;
+            text_used = text_used + len + 1 < LOG_RECORD_TEXT ? text_used + len + 1 : LOG_RECORD_TEXT - 1;
+            break;
+        }
+        default: // 'p' and anything unusual
+            arg->p = va_arg(ap, void *);
+            break;
+        }
+    }
+}
+
+// Formats a captured record into out. Returns the number of bytes written.
+static size_t format_record(const struct log_record *rec, char *out, size_t size) {
+    const char *p = rec->fmt;
+    size_t used = 0;
+    int argi = 0;
+
+    while (*p && used + 1 < size) {
+        const char *pct = strchr(p, '%');
+        size_t lit = pct ? (size_t)(pct - p) : strlen(p);
+        if (lit > size - used - 1) lit = size - used - 1;
+        memcpy(out + used, p, lit);
+        used += lit;
+        if (pct == NULL || used + 1 >= size) break;
+
+        char conv;
+        char length[3];
+        int stars;
+        const char *next = parse_spec(pct, &conv, length, &stars);
+        char spec[32];
+        size_t spec_len = (size_t)(next - pct);
+        int n = 0;
+
+        if (conv == '%') {
+            out[used++] = '%';
+            p = next;
+            continue;
+        }
+        if (conv == '\0' || spec_len + 3 >= sizeof(spec) || argi + stars >= rec->nargs) {
+            break;
+        }
+        memcpy(spec, pct, spec_len);
+        spec[spec_len] = '\0';
+
+        int w1 = stars > 0 ? (int)rec->args[argi].i : 0;
+        int w2 = stars > 1 ? (int)rec->args[argi + 1].i : 0;
+        argi += stars;
+        const union log_arg *arg = &rec->args[argi++];
+        char *dst = out + used;
+        size_t room = size - used;
+
+#define EMIT(value) \
+        (stars == 2 ? snprintf(dst, room, spec, w1, w2, value) : \
+         stars == 1 ? snprintf(dst, room, spec, w1, value) : snprintf(dst, room, spec, value))
+
+        switch (conv) {
+        case 'c':
+            n = EMIT((int)arg->i);
+            break;
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+            // Re-issue the conversion as "ll" so it matches the stored 64-bit value
+            size_t base = spec_len - 1 - strlen(length);
+            spec[base] = 'l';
+            spec[base + 1] = 'l';
+            spec[base + 2] = conv;
+            spec[base + 3] = '\0';
+            if (conv == 'd' || conv == 'i') n = EMIT(arg->i);
+            else n = EMIT(arg->u);
+            break;
+        }
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            n = EMIT(arg->d);
+            break;
+        case 's':
+            n = EMIT(rec->text + arg->u);
+            break;
+        default:
+            n = EMIT(arg->p);
+            break;
+        }
+#undef EMIT
+        if (n > 0) {
+            used += (size_t)n < room ? (size_t)n : room - 1;
+        }
+        p = next;
+    }
+    out[used] = '\0';
+    return used;
+}
+
+// --- FLUSHER THREAD ---
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void drain_ring(void) {
+    static char out[2][LOG_OUT_BUF_SIZE]; // [0] stdout, [1] stderr
+    size_t used[2] = {0, 0};
+    unsigned int head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+    while (ring_tail != head) {
+        const struct log_record *rec = &ring[ring_tail & (LOG_RING_SIZE - 1)];
+        int err = rec->level <= TFTP_LOG_WARN;
+        if (used[err] + 1024 > LOG_OUT_BUF_SIZE) {
+            write_all(err ? 2 : 1, out[err], used[err]);
+            used[err] = 0;
+        }
+        used[err] += format_record(rec, out[err] + used[err], 1024);
+        __atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+        if (ring_tail == head) {
+            head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+        }
+    }
+    write_all(1, out[0], used[0]);
+    write_all(2, out[1], used[1]);
+}
+
+static void *flusher_main(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&flush_lock);
+    while (running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&flush_cond, &flush_lock, &deadline);
+        pthread_mutex_unlock(&flush_lock);
+        drain_ring();
+        pthread_mutex_lock(&flush_lock);
+    }
+    pthread_mutex_unlock(&flush_lock);
+    drain_ring();
+    return NULL;
+}
+
+// --- PUBLIC API ---
+
+void tftp_log_init(void) {
+    if (running) {
+        return;
+    }
+    log_configure();
+    ring = calloc(LOG_RING_SIZE, sizeof(*ring));
+    if (ring == NULL) {
+        return; // Stay in synchronous mode
+    }
+    ring_head = ring_tail = 0;
+    dropped = 0;
+    running = 1;
+    if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+        running = 0;
+        free(ring);
+        ring = NULL;
+        return;
+    }
+    atexit(tftp_log_shutdown);
+}
+
+void tftp_log_shutdown(void) {
+    if (!running) {
+        return;
+    }
+    pthread_mutex_lock(&flush_lock);
+    running = 0;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&flush_lock);
+    pthread_join(flusher, NULL);
+
+    if (dropped > 0) {
+        char msg[80];
+        int n = snprintf(msg, sizeof(msg), "[log] %lu records dropped (ring full).\n", dropped);
+        write_all(2, msg, (size_t)n);
+    }
+    free(ring);
+    ring = NULL;
+}
+
+void tftp_log(int level, const char *fmt, ...) {
+    va_list ap;
+
+    if (!configured) {
+        log_configure();
+    }
+    if (level > tftp_log_level) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    if (!running) {
+        // Synchronous path: one write() per line, never buffered across fork()
+        char line[1024];
+        int n = vsnprintf(line, sizeof(line), fmt, ap);
+        va_end(ap);
+        if (n > 0) {
+            write_all(level <= TFTP_LOG_WARN ? 2 : 1, line,
+                      (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+        }
+        return;
+    }
+
+    unsigned int head = ring_head;
+    if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+        dropped++; // Never block the transfer on logging
+        va_end(ap);
+        return;
+    }
+    struct log_record *rec = &ring[head & (LOG_RING_SIZE - 1)];
+    rec->fmt = fmt;
+    rec->level = level;
+    capture_args(rec, fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+
+    if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == LOG_RING_SIZE / 2) {
+        pthread_cond_signal(&flush_cond);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TFTP_LOG_H
+#define TFTP_LOG_H
+
+// --- LEVELED, DEFERRED LOGGING ---
+//
+// tftp_log() has printf semantics but does not format on the caller's thread:
+// the arguments are captured into a fixed-size binary record in a per-process
+// ring buffer and a background flusher thread formats and writes them in
+// batches. Until tftp_log_init() is called (e.g. in the listening parent, which
+// must stay single-threaded because it forks) records are written synchronously.
+//
+// Environment:
+//   TFTP_LOG_LEVEL   error | warn | info | debug     (default: info)
+//   TFTP_LOG_SAMPLE  N: emit every Nth per-block event (default: 0 = none)
+//
+// Per-block events go through TFTP_LOG_BLOCK(), which costs one branch when
+// sampling is off and nothing at all when built with -DTFTP_LOG_NO_BLOCKS.
+
+enum tftp_log_level {
+    TFTP_LOG_ERROR = 0,
+    TFTP_LOG_WARN,
+    TFTP_LOG_INFO,
+    TFTP_LOG_DEBUG
+};
+
+extern int tftp_log_level;
+extern unsigned int tftp_log_sample;
+
+void tftp_log_init(void);
+void tftp_log_shutdown(void);
+void tftp_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int tftp_log_sample_hit(void);
+
+#define TFTP_LOG_ENABLED(level) ((level) <= tftp_log_level)
+
+#ifdef TFTP_LOG_NO_BLOCKS
+#define TFTP_LOG_BLOCK(...) ((void)0)
+#else
+#define TFTP_LOG_BLOCK(...) \
+    do { \
+        if (tftp_log_sample != 0 && tftp_log_sample_hit()) { \
+            tftp_log(TFTP_LOG_INFO, __VA_ARGS__); \
+        } \
+    } while (0)
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+#include "tftpNetascii.h"
+#include "tftpDigest.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NETASCII_X86 1
+#endif
+
+// --- COPY KERNELS ---
+//
+// Each copies src to dst until the first CR (or LF when stop_at_lf is set) or
+// n bytes, and returns the number of bytes copied. The vector versions store
+// whole vectors before looking at the mask, which is safe because both
+// buffers hold at least n bytes.
+
+typedef size_t (*copy_run_fn)(char *dst, const char *src, size_t n, int stop_at_lf);
+
+static size_t copy_run_scalar(char *dst, const char *src, size_t n, int stop_at_lf) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        char c = src[i];
+        if (c == '\r' || (stop_at_lf && c == '\n')) {
+            break;
+        }
+        dst[i] = c;
+    }
+    return i;
+}
+
+#ifdef NETASCII_X86
+__attribute__((target("sse2")))
+static size_t copy_run_sse2(char *dst, const char *src, size_t n, int stop_at_lf) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8(stop_at_lf ? '\n' : '\r');
+    size_t i = 0;
+
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+        i += 16;
+    }
+    return i + copy_run_scalar(dst + i, src + i, n - i, stop_at_lf);
+}
+
+// Clears the upper halves before returning to SSE code, which would
+// otherwise pay an AVX/SSE transition penalty on every call
+__attribute__((target("avx2")))
+static size_t copy_run_avx2(char *dst, const char *src, size_t n, int stop_at_lf) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8(stop_at_lf ? '\n' : '\r');
+    size_t i = 0;
+
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask != 0) {
+            _mm256_zeroupper();
+            return i + (size_t)__builtin_ctz(mask);
+        }
+        i += 32;
+    }
+    _mm256_zeroupper();
+    return i + copy_run_sse2(dst + i, src + i, n - i, stop_at_lf);
+}
+#endif
+
+static copy_run_fn copy_run;
+static const char *kernel_name;
+
+int tftp_netascii_set_kernel(const char *name) {
+    if (strcasecmp(name, "scalar") == 0) {
+        copy_run = copy_run_scalar;
+        kernel_name = "scalar";
+        return 0;
+    }
+#ifdef NETASCII_X86
+    __builtin_cpu_init();
+    if (strcasecmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        copy_run = copy_run_avx2;
+        kernel_name = "avx2";
+        return 0;
+    }
+    if (strcasecmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        copy_run = copy_run_sse2;
+        kernel_name = "sse2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+// Best kernel this CPU supports, chosen on first use
+static void select_kernel(void) {
+    if (tftp_netascii_set_kernel("avx2") < 0 && tftp_netascii_set_kernel("sse2") < 0) {
+        tftp_netascii_set_kernel("scalar");
+    }
+}
+
+const char *tftp_netascii_kernel(void) {
+    if (copy_run == NULL) {
+        select_kernel();
+    }
+    return kernel_name;
+}
+
+// --- TRANSLATION ---
+
+size_t tftp_netascii_encode(struct tftp_netascii *st, const char *src, size_t src_len, size_t *consumed,
+                            char *dst, size_t dst_cap) {
+    size_t in = 0, out = 0;
+
+    if (copy_run == NULL) {
+        select_kernel();
+    }
+    if (st->pending && dst_cap > 0) {
+        dst[out++] = st->byte;
+        st->pending = 0;
+    }
+    while (!st->pending && in < src_len && out < dst_cap) {
+        size_t room = dst_cap - out < src_len - in ? dst_cap - out : src_len - in;
+        size_t run = copy_run(dst + out, src + in, room, 1);
+        in += run;
+        out += run;
+        if (run == room) {
+            break; // Input or output exhausted
+        }
+
+        // LF -> CR LF, CR -> CR NUL
+        char second = src[in++] == '\n' ? '\n' : '\0';
+        dst[out++] = '\r';
+        if (out < dst_cap) {
+            dst[out++] = second;
+        } else {
+            st->pending = 1;
+            st->byte = second;
+        }
+    }
+    *consumed = in;
+    return out;
+}
+
+size_t tftp_netascii_decode(struct tftp_netascii *st, const char *src, size_t src_len, char *dst) {
+    size_t in = 0, out = 0;
+
+    if (copy_run == NULL) {
+        select_kernel();
+    }
+    while (in < src_len) {
+        if (st->pending) {
+            // CR LF -> LF, CR NUL -> CR; any other CR is kept as it is
+            st->pending = 0;
+            if (src[in] == '\n') {
+                dst[out++] = '\n';
+                in++;
+            } else if (src[in] == '\0') {
+                dst[out++] = '\r';
+                in++;
+            } else {
+                dst[out++] = '\r';
+            }
+            continue;
+        }
+        size_t run = copy_run(dst + out, src + in, src_len - in, 0);
+        in += run;
+        out += run;
+        if (in < src_len) {
+            st->pending = 1; // src[in] is a CR; its meaning depends on the next byte
+            in++;
+        }
+    }
+    return out;
+}
+
+// --- FILE HELPERS ---
+
+ssize_t tftp_netascii_read(struct tftp_netascii_reader *r, int fd, char *buf, size_t len) {
+    size_t out = 0;
+
+    while (out < len) {
+        if (r->off == r->len && !r->state.pending) {
+            ssize_t n = read(fd, r->raw, sizeof(r->raw));
+            if (n < 0) {
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            r->len = (size_t)n;
+            r->off = 0;
+            r->state.crc = tftp_crc32c(r->state.crc, r->raw, r->len);
+        }
+        size_t consumed;
+        out += tftp_netascii_encode(&r->state, r->raw + r->off, r->len - r->off, &consumed, buf + out, len - out);
+        r->off += consumed;
+    }
+    return (ssize_t)out;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int tftp_netascii_write(struct tftp_netascii *st, int fd, const char *data, size_t len) {
+    char out[TFTP_NETASCII_CHUNK + 1];
+
+    while (len > 0) {
+        size_t chunk = len < TFTP_NETASCII_CHUNK ? len : TFTP_NETASCII_CHUNK;
+        size_t n = tftp_netascii_decode(st, data, chunk, out);
+        st->crc = tftp_crc32c(st->crc, out, n);
+        if (write_all(fd, out, n) < 0) {
+            return -1;
+        }
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+int tftp_netascii_write_finish(struct tftp_netascii *st, int fd) {
+    if (!st->pending) {
+        return 0;
+    }
+    st->pending = 0;
+    st->crc = tftp_crc32c(st->crc, "\r", 1);
+    return write_all(fd, "\r", 1);
+}
@@ -0,0 +1,55 @@
+#ifndef TFTP_NETASCII_H
+#define TFTP_NETASCII_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// --- NETASCII TRANSLATION (RFC 764 line endings, as used by RFC 1350) ---
+//
+// On the wire a line ends in CR LF and a bare CR is sent as CR NUL; the local
+// file uses LF. Translation changes lengths, so block boundaries do not line
+// up with file offsets, and a CR LF / CR NUL pair may be split across two
+// DATA packets. Both directions therefore carry a little state between calls.
+//
+// The byte-copying kernel is vectorized (AVX2 or SSE2, picked at run time)
+// with a scalar fallback; the special bytes themselves are handled one at a
+// time, so all kernels produce identical output.
+
+struct tftp_netascii {
+    int pending;        // Encoder: 'byte' is still owed. Decoder: last input byte was a CR
+    char byte;
+    uint32_t crc;       // File helpers: CRC32C (tftpDigest.h) of the file bytes so far
+};
+
+// Encodes file bytes into at most dst_cap wire bytes. Sets *consumed to the
+// input used and returns the output length. A pair that does not fit is
+// finished on the next call, which may pass src_len 0 to flush it.
+size_t tftp_netascii_encode(struct tftp_netascii *st, const char *src, size_t src_len, size_t *consumed,
+                            char *dst, size_t dst_cap);
+
+// Decodes wire bytes; dst must hold src_len + 1 bytes. Returns the output length.
+size_t tftp_netascii_decode(struct tftp_netascii *st, const char *src, size_t src_len, char *dst);
+
+// --- File helpers used by the transfers ---
+
+#define TFTP_NETASCII_CHUNK 4096
+
+struct tftp_netascii_reader {
+    struct tftp_netascii state;
+    size_t len, off;                // Unencoded bytes left in raw[]
+    char raw[TFTP_NETASCII_CHUNK];
+};
+
+// Fills buf with up to len encoded bytes from fd; short only at end of file
+ssize_t tftp_netascii_read(struct tftp_netascii_reader *r, int fd, char *buf, size_t len);
+// Decodes one DATA payload and writes it to fd. Returns 0 or -1 (errno set).
+int tftp_netascii_write(struct tftp_netascii *st, int fd, const char *data, size_t len);
+// Writes a CR left dangling at the end of the transfer
+int tftp_netascii_write_finish(struct tftp_netascii *st, int fd);
+
+// Kernel selection: "avx2", "sse2" or "scalar". Returns -1 if unsupported here.
+int tftp_netascii_set_kernel(const char *name);
+const char *tftp_netascii_kernel(void);
+
+#endif
@@ -0,0 +1,55 @@
+#include "tftpPmtu.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+int tftp_pmtu_enable(int sockfd) {
+    int value = IP_PMTUDISC_DO;
+    return setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value));
+}
+
+int tftp_pmtu_query(const struct sockaddr_in *peer) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    int mtu = 0;
+    socklen_t len = sizeof(mtu);
+
+    if (sockfd < 0) {
+        return 0;
+    }
+    // connect() on a UDP socket sends nothing; it only picks the route
+    if (connect(sockfd, (const struct sockaddr *)peer, sizeof(*peer)) < 0 ||
+        getsockopt(sockfd, IPPROTO_IP, IP_MTU, &mtu, &len) < 0) {
+        mtu = 0;
+    }
+    close(sockfd);
+    return mtu;
+}
+
+uint16_t tftp_pmtu_blksize(const struct sockaddr_in *peer, uint16_t limit) {
+    int mtu = tftp_pmtu_query(peer);
+    int blksize = mtu - TFTP_PMTU_OVERHEAD;
+
+    if (mtu == 0) {
+        blksize = TFTP_DEFAULT_BLKSIZE;
+    }
+    if (blksize > TFTP_MAX_BLKSIZE) {
+        blksize = TFTP_MAX_BLKSIZE;
+    }
+    if (blksize > limit) {
+        blksize = limit;
+    }
+    return (uint16_t)(blksize < 8 ? 8 : blksize);
+}
+
+uint16_t tftp_option_blksize(const struct tftp_packet *pkt) {
+    const char *value = tftp_find_option(pkt, "blksize");
+    if (value == NULL) {
+        return 0;
+    }
+    long v = strtol(value, NULL, 10);
+    if (v < 8 || v > TFTP_MAX_BLKSIZE) {
+        return 0;
+    }
+    return (uint16_t)v;
+}
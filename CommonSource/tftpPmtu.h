@@ -0,0 +1,38 @@
+#ifndef TFTP_PMTU_H
+#define TFTP_PMTU_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "tftpCodec.h"
+
+// --- PATH MTU AND BLOCK SIZE (RFC 2348) ---
+//
+// A DATA packet of blksize bytes is blksize + 32 bytes on the wire (IPv4 20,
+// UDP 8, TFTP 4). The largest blksize that is never fragmented is therefore
+// the path MTU minus 32: 1468 over Ethernet, far more over loopback.
+//
+// The kernel keeps the path MTU per destination: the route's MTU, lowered
+// whenever a router answers a DF packet with ICMP "fragmentation needed".
+// tftp_pmtu_query() reads it through IP_MTU on a connected scratch socket,
+// since transfer sockets talk to more than one port and stay unconnected.
+// Transfer sockets set IP_MTU_DISCOVER to IP_PMTUDISC_DO, so DATA goes out
+// with DF and is never fragmented: a datagram too big for the (newly
+// lowered) path MTU fails with EMSGSIZE instead.
+//
+// The blksize is fixed once negotiated. Where the path silently drops large
+// packets, the transfer times out and the next attempt asks for less.
+
+#define TFTP_PMTU_OVERHEAD 32           // IPv4 + UDP + TFTP headers of a DATA packet
+
+// Sets IP_PMTUDISC_DO on a transfer socket. Returns 0, or -1 (errno set).
+int tftp_pmtu_enable(int sockfd);
+// Path MTU towards 'peer' as the kernel knows it now; 0 when unknown
+int tftp_pmtu_query(const struct sockaddr_in *peer);
+// Largest unfragmented blksize towards 'peer', at most 'limit';
+// TFTP_DEFAULT_BLKSIZE when the path MTU is unknown
+uint16_t tftp_pmtu_blksize(const struct sockaddr_in *peer, uint16_t limit);
+// Value of a request's or OACK's "blksize" option; 0 when absent or invalid
+uint16_t tftp_option_blksize(const struct tftp_packet *pkt);
+
+#endif
@@ -0,0 +1,208 @@
+#include "tftpTimer.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#define SLOT_MASK (TFTP_TIMER_SLOTS - 1)
+#define SPAN(level) ((uint64_t)1 << (TFTP_TIMER_BITS * (level))) // Ticks per slot at 'level'
+
+static void mark(struct tftp_timer_wheel *w, unsigned level, unsigned slot) {
+    w->occupied[level][slot / 64] |= 1ull << (slot % 64);
+}
+
+static void unmark(struct tftp_timer_wheel *w, unsigned level, unsigned slot) {
+    w->occupied[level][slot / 64] &= ~(1ull << (slot % 64));
+}
+
+// First occupied slot at or after 'from', TFTP_TIMER_SLOTS when there is none
+static unsigned first_occupied(const uint64_t *map, unsigned from) {
+    for (unsigned word = from / 64; word < TFTP_TIMER_SLOTS / 64; word++) {
+        uint64_t bits = map[word];
+        if (word == from / 64) {
+            bits &= ~0ull << (from % 64);
+        }
+        if (bits != 0) {
+            return word * 64 + (unsigned)__builtin_ctzll(bits);
+        }
+    }
+    return TFTP_TIMER_SLOTS;
+}
+
+static void link_timer(struct tftp_timer_wheel *w, struct tftp_timer *t) {
+    uint64_t at = t->expires > w->now ? t->expires : w->now; // Overdue: the next tick processed
+    unsigned level = 0;
+
+    while (level < TFTP_TIMER_LEVELS - 1 && at - w->now >= SPAN(level + 1)) {
+        level++;
+    }
+    if (at - w->now >= SPAN(TFTP_TIMER_LEVELS)) {
+        at = w->now + SPAN(TFTP_TIMER_LEVELS) - 1; // Beyond the wheel: relinked from the top until in range
+    }
+    unsigned slot = (unsigned)(at >> (TFTP_TIMER_BITS * level)) & SLOT_MASK;
+    struct tftp_timer **head = &w->slots[level][slot];
+    t->next = *head;
+    if (t->next != NULL) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+    mark(w, level, slot);
+}
+
+static void unlink_timer(struct tftp_timer_wheel *w, struct tftp_timer *t) {
+    struct tftp_timer **first = &w->slots[0][0];
+
+    *t->pprev = t->next;
+    if (t->next != NULL) {
+        t->next->pprev = t->pprev;
+    }
+    // The last timer of a slot clears its bit; pprev is then the slot itself
+    if (*t->pprev == NULL && t->pprev >= first && t->pprev < first + TFTP_TIMER_LEVELS * TFTP_TIMER_SLOTS) {
+        size_t i = (size_t)(t->pprev - first);
+        unmark(w, (unsigned)(i / TFTP_TIMER_SLOTS), (unsigned)(i % TFTP_TIMER_SLOTS));
+    }
+    t->pprev = NULL;
+}
+
+// Level 0 wrapped at tick 't': spread the next slot of level 1 over it, and
+// so on up while each level wraps too
+static void cascade(struct tftp_timer_wheel *w, uint64_t t) {
+    for (unsigned level = 1; level < TFTP_TIMER_LEVELS; level++) {
+        unsigned slot = (unsigned)(t >> (TFTP_TIMER_BITS * level)) & SLOT_MASK;
+        struct tftp_timer *list = w->slots[level][slot];
+        w->slots[level][slot] = NULL;
+        unmark(w, level, slot);
+        while (list != NULL) {
+            struct tftp_timer *next = list->next;
+            link_timer(w, list);
+            list = next;
+        }
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+// The tick tftp_timer_expired() next has work on: a level 0 slot's own tick,
+// or the cascade of a higher level's slot, which comes before its timers
+static uint64_t next_tick(const struct tftp_timer_wheel *w) {
+    uint64_t best = TFTP_TIMER_NEVER;
+
+    if (w->expired != NULL) {
+        return w->now;
+    }
+    if (w->count == 0) {
+        return best;
+    }
+    for (unsigned level = 0; level < TFTP_TIMER_LEVELS; level++) {
+        uint64_t span = SPAN(level);
+        uint64_t base = (w->now + span - 1) & ~(span - 1); // Level 0: now. Above: its next cascade.
+        unsigned cur = (unsigned)(base >> (TFTP_TIMER_BITS * level)) & SLOT_MASK;
+        unsigned slot = first_occupied(w->occupied[level], cur);
+        uint64_t steps = slot - cur;
+        if (slot == TFTP_TIMER_SLOTS) {
+            slot = first_occupied(w->occupied[level], 0);
+            steps = TFTP_TIMER_SLOTS + slot - cur;
+        }
+        if (slot < TFTP_TIMER_SLOTS && base + steps * span < best) {
+            best = base + steps * span;
+        }
+    }
+    return best;
+}
+
+static void set_fd(struct tftp_timer_wheel *w, uint64_t tick) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (tick != TFTP_TIMER_NEVER) {
+        uint64_t us = tick * w->tick_us;
+        its.it_value.tv_sec = (time_t)(us / 1000000u);
+        its.it_value.tv_nsec = (long)(us % 1000000u) * 1000;
+    }
+    // Also drops an expiration still pending, so the descriptor reads empty
+    timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &its, NULL);
+    w->fd_tick = tick;
+}
+
+int tftp_timer_init(struct tftp_timer_wheel *w, uint64_t tick_us, uint64_t now_us, int with_fd) {
+    memset(w, 0, sizeof(*w));
+    w->tick_us = tick_us > 0 ? tick_us : 1;
+    w->now = now_us / w->tick_us;
+    w->fd_tick = TFTP_TIMER_NEVER;
+    w->fd = with_fd ? timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) : -1;
+    return with_fd && w->fd < 0 ? -1 : 0;
+}
+
+void tftp_timer_close(struct tftp_timer_wheel *w) {
+    if (w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
+    }
+}
+
+void tftp_timer_arm(struct tftp_timer_wheel *w, struct tftp_timer *t, uint64_t deadline_us) {
+    uint64_t tick = deadline_us / w->tick_us + (deadline_us % w->tick_us != 0);
+
+    if (t->pprev != NULL) {
+        if (t->expires == tick) {
+            return;
+        }
+        unlink_timer(w, t);
+    } else {
+        w->count++;
+    }
+    t->expires = tick;
+    link_timer(w, t);
+    if (w->fd >= 0 && tick < w->fd_tick) {
+        set_fd(w, tick);
+    }
+}
+
+void tftp_timer_cancel(struct tftp_timer_wheel *w, struct tftp_timer *t) {
+    if (t->pprev != NULL) {
+        unlink_timer(w, t);
+        w->count--;
+    }
+}
+
+struct tftp_timer *tftp_timer_expired(struct tftp_timer_wheel *w, uint64_t now_us) {
+    uint64_t target = now_us / w->tick_us;
+
+    while (w->expired == NULL && w->now <= target) {
+        uint64_t t = w->now;
+        unsigned slot = (unsigned)t & SLOT_MASK;
+        if (slot == 0) {
+            cascade(w, t);
+        }
+        if (w->slots[0][slot] != NULL) {
+            w->expired = w->slots[0][slot];
+            w->expired->pprev = &w->expired;
+            w->slots[0][slot] = NULL;
+            unmark(w, 0, slot);
+        }
+        // Empty ticks are skipped, up to the next cascade
+        w->now = w->count == 0 ? target + 1 : t - slot + first_occupied(w->occupied[0], slot + 1);
+        if (w->now > target + 1) {
+            w->now = target + 1;
+        }
+    }
+
+    struct tftp_timer *t = w->expired;
+    if (t != NULL) {
+        unlink_timer(w, t);
+        w->count--;
+        return t;
+    }
+    // Everything due is handed out: once the descriptor fired, it moves on
+    if (w->fd >= 0 && w->fd_tick < w->now) {
+        set_fd(w, next_tick(w));
+    }
+    return NULL;
+}
+
+uint64_t tftp_timer_next_us(const struct tftp_timer_wheel *w) {
+    uint64_t tick = next_tick(w);
+    return tick == TFTP_TIMER_NEVER ? tick : tick * w->tick_us;
+}
@@ -0,0 +1,70 @@
+#ifndef TFTP_TIMER_H
+#define TFTP_TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- RETRANSMISSION TIMER WHEEL ---
+//
+// A loop serving many engines needs the next deadline among all of them, and
+// arms a new one after nearly every packet. A heap makes each of those
+// O(log n), and a scan O(n). A hierarchical timing wheel makes arm, re-arm
+// and cancel O(1): a timer is linked into one slot of one of four levels of
+// 256 slots each. Level 0 holds timers due within 256 ticks, one tick per
+// slot. Level 1 holds those due within 256^2 ticks, 256 ticks per slot, and
+// so on. Whenever level 0 wraps, the next slot of level 1 is spread over
+// level 0, and so on up. With 1 ms ticks the wheel spans 49 days.
+//
+// Timers never fire early. A timer fires on the first tick at or after its
+// deadline, so it is late by less than a tick plus the wakeup. Deadlines are
+// absolute times on the caller's clock, which must be CLOCK_MONOTONIC in
+// microseconds when the wheel has a timerfd. Packets arriving for other
+// timers, or stray ones, never move a deadline.
+//
+// With a timerfd the wheel wakes its owner itself: poll the descriptor (or
+// put it in an epoll set) and call tftp_timer_expired() when it is readable.
+// The descriptor is set to the earliest deadline when a timer is armed ahead
+// of it, and reset once it fired. A cancelled or re-armed earliest timer
+// costs one early wakeup, not a system call per packet.
+//
+// Timers are intrusive: a struct tftp_timer lives in the caller's record.
+
+#define TFTP_TIMER_LEVELS 4
+#define TFTP_TIMER_BITS 8
+#define TFTP_TIMER_SLOTS (1 << TFTP_TIMER_BITS)
+#define TFTP_TIMER_NEVER UINT64_MAX
+
+struct tftp_timer {
+    struct tftp_timer *next;
+    struct tftp_timer **pprev;      // NULL when not armed
+    uint64_t expires;               // Tick it fires on
+};
+
+struct tftp_timer_wheel {
+    struct tftp_timer *slots[TFTP_TIMER_LEVELS][TFTP_TIMER_SLOTS];
+    uint64_t occupied[TFTP_TIMER_LEVELS][TFTP_TIMER_SLOTS / 64];
+    struct tftp_timer *expired;     // Due, not yet handed out
+    uint64_t tick_us;
+    uint64_t now;                   // Next tick to process
+    uint64_t fd_tick;               // The timerfd fires on this tick, TFTP_TIMER_NEVER = disarmed
+    uint32_t count;                 // Armed timers
+    int fd;                         // timerfd, -1 for none
+};
+
+// 'now_us' starts the wheel; with_fd adds a timerfd. 0, or -1 (errno set).
+int tftp_timer_init(struct tftp_timer_wheel *w, uint64_t tick_us, uint64_t now_us, int with_fd);
+void tftp_timer_close(struct tftp_timer_wheel *w);
+// Arms, or re-arms, 't' to fire once the clock reaches deadline_us
+void tftp_timer_arm(struct tftp_timer_wheel *w, struct tftp_timer *t, uint64_t deadline_us);
+void tftp_timer_cancel(struct tftp_timer_wheel *w, struct tftp_timer *t);
+// The next timer due by now_us, disarmed, or NULL once there is none. Its
+// owner may arm or cancel any timer before asking for the next one.
+struct tftp_timer *tftp_timer_expired(struct tftp_timer_wheel *w, uint64_t now_us);
+// When tftp_timer_expired() next has work, TFTP_TIMER_NEVER when nothing is armed
+uint64_t tftp_timer_next_us(const struct tftp_timer_wheel *w);
+
+static inline int tftp_timer_armed(const struct tftp_timer *t) {
+    return t->pprev != NULL;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "tftpTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tftpEngine.h"
+
+#define TRACE_BUFFER_SIZE 65536
+
+int g_trace_fd = -1;
+
+static char trace_buffer[TRACE_BUFFER_SIZE];
+static size_t trace_len;
+
+uint64_t tftp_trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+int tftp_trace_open(const char *path) {
+    struct stat st;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size == 0) {
+        struct tftp_trace_header header;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        header.magic = TFTP_TRACE_MAGIC;
+        header.version = TFTP_TRACE_VERSION;
+        header.realtime_us = (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+        header.monotonic_us = tftp_trace_now_us();
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            close(fd);
+            return -1;
+        }
+    }
+    g_trace_fd = fd;
+    return 0;
+}
+
+void tftp_trace_flush(void) {
+    size_t done = 0;
+
+    // One write keeps the records whole next to other processes' appends
+    while (g_trace_fd >= 0 && done < trace_len) {
+        ssize_t n = write(g_trace_fd, trace_buffer + done, trace_len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    trace_len = 0;
+}
+
+void tftp_trace_record(uint32_t transfer_id, int type, uint32_t block, uint32_t arg,
+                       const void *payload, size_t length) {
+    struct tftp_trace_record r;
+
+    if (g_trace_fd < 0) {
+        return;
+    }
+    if (length > TFTP_TRACE_MAX_PAYLOAD) {
+        length = TFTP_TRACE_MAX_PAYLOAD;
+    }
+    if (trace_len + sizeof(r) + length > sizeof(trace_buffer)) {
+        tftp_trace_flush();
+    }
+    r.time_us = tftp_trace_now_us();
+    r.transfer_id = transfer_id;
+    r.type = (uint16_t)type;
+    r.length = (uint16_t)length;
+    r.block = block;
+    r.arg = arg;
+    memcpy(trace_buffer + trace_len, &r, sizeof(r));
+    if (length > 0) {
+        memcpy(trace_buffer + trace_len + sizeof(r), payload, length);
+    }
+    trace_len += sizeof(r) + length;
+}
+
+int tftp_trace_read_header(FILE *f, struct tftp_trace_header *header) {
+    if (fread(header, sizeof(*header), 1, f) != 1 || header->magic != TFTP_TRACE_MAGIC ||
+        header->version != TFTP_TRACE_VERSION) {
+        return -1;
+    }
+    return 0;
+}
+
+int tftp_trace_read(FILE *f, struct tftp_trace_record *record, void *payload) {
+    size_t n = fread(record, 1, sizeof(*record), f);
+
+    if (n == 0 && feof(f)) {
+        return 0;
+    }
+    if (n != sizeof(*record) || record->length > TFTP_TRACE_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (record->length > 0 && fread(payload, record->length, 1, f) != 1) {
+        return -1;
+    }
+    return 1;
+}
+
+const char *tftp_trace_type_name(int type) {
+    static const char *const engine_names[] = {
+        [TFTP_EV_DATA_SENT] = "data_sent",
+        [TFTP_EV_DATA_RETRANSMIT] = "data_retransmit",
+        [TFTP_EV_DATA_RECEIVED] = "data_received",
+        [TFTP_EV_DATA_DUPLICATE] = "data_duplicate",
+        [TFTP_EV_ACK_RECEIVED] = "ack_received",
+        [TFTP_EV_ACK_STALE] = "ack_stale",
+        [TFTP_EV_ACK_RETRANSMIT] = "ack_retransmit",
+        [TFTP_EV_TIMEOUT] = "timeout",
+        [TFTP_EV_ERROR_SENT] = "error_sent",
+        [TFTP_EV_ERROR_RECEIVED] = "error_received",
+        [TFTP_EV_OACK_RECEIVED] = "oack_received",
+    };
+
+    switch (type) {
+    case TFTP_TRACE_REQUEST: return "request";
+    case TFTP_TRACE_START: return "start";
+    case TFTP_TRACE_END: return "end";
+    case TFTP_TRACE_FILE_READ: return "file_read";
+    case TFTP_TRACE_FILE_WRITE: return "file_write";
+    case TFTP_TRACE_PACE: return "pace";
+    }
+    if (type >= 0 && (size_t)type < sizeof(engine_names) / sizeof(engine_names[0]) && engine_names[type] != NULL) {
+        return engine_names[type];
+    }
+    return "unknown";
+}
@@ -0,0 +1,72 @@
+#ifndef TFTP_TRACE_H
+#define TFTP_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// --- TRANSFER TRACE FILE ---
+//
+// An opt-in record of what every transfer did and when: the request, each
+// packet sent and received, timeouts and retransmissions, and how long the
+// file I/O and any pacing took. Written by the server (-T), read by
+// ToolSource/tftpTraceTool.c, which prints timelines, attributes stalls and
+// replays the requests against a test server.
+//
+// The file is a header followed by fixed 24-byte records, each followed by
+// 'length' payload bytes (only requests carry one). Every process buffers its
+// records and appends whole records at once with O_APPEND, so the forked
+// transfers share one file; a transfer's own records are always in order.
+// Times are CLOCK_MONOTONIC microseconds; the header ties them to wall time.
+
+#define TFTP_TRACE_MAGIC 0x52544654u   // "TFTR"
+#define TFTP_TRACE_VERSION 1
+#define TFTP_TRACE_MAX_PAYLOAD 1024
+
+// Types 0-10 are the engine's events (enum tftp_engine_event), same numbers
+// and block/arg meaning. Sent and retransmitted DATA, received DATA and ACKs,
+// ERROR packets and timeouts therefore need no translation.
+enum tftp_trace_type {
+    TFTP_TRACE_REQUEST = 32,        // block: opcode; payload: client address, port (network order), packet
+    TFTP_TRACE_START,               // block: opcode, arg: pid serving it
+    TFTP_TRACE_END,                 // block: 1 completed / 0 failed, arg: TFTP error code
+    TFTP_TRACE_FILE_READ,           // block: block being filled, arg: microseconds
+    TFTP_TRACE_FILE_WRITE,          // block: block being stored, arg: microseconds
+    TFTP_TRACE_PACE                 // block: block held back, arg: microseconds slept (tftpSched.h)
+};
+
+struct tftp_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t realtime_us;           // Wall clock ...
+    uint64_t monotonic_us;          // ... at this monotonic time
+};
+
+struct tftp_trace_record {
+    uint64_t time_us;
+    uint32_t transfer_id;
+    uint16_t type;
+    uint16_t length;                // Payload bytes that follow
+    uint32_t block;
+    uint32_t arg;
+};
+
+extern int g_trace_fd;              // -1 when tracing is off
+
+// Opens (appends to) the trace file, writing the header if it is new
+int tftp_trace_open(const char *path);
+// Buffers one record; full buffers are appended to the file
+void tftp_trace_record(uint32_t transfer_id, int type, uint32_t block, uint32_t arg,
+                       const void *payload, size_t length);
+// Appends whatever is buffered. Call before fork() and before exiting.
+void tftp_trace_flush(void);
+uint64_t tftp_trace_now_us(void);
+
+// Reading: 0 and the header, -1 if the file is not a trace
+int tftp_trace_read_header(FILE *f, struct tftp_trace_header *header);
+// 1 and the next record (payload of at most TFTP_TRACE_MAX_PAYLOAD bytes),
+// 0 at the end, -1 when the file is truncated or corrupt
+int tftp_trace_read(FILE *f, struct tftp_trace_record *record, void *payload);
+const char *tftp_trace_type_name(int type);
+
+#endif
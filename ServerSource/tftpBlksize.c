@@ -0,0 +1,69 @@
+#include "tftpServer.h"
+#include "tftpBlksize.h"
+
+#include <sys/mman.h>
+
+// One word per entry, so readers never see half an update:
+// client address (32 bits) | cap (16) | expiry, seconds mod 2^16 (16)
+static uint64_t *g_caps;
+
+int blksize_init(void) {
+    void *mem = mmap(NULL, BLKSIZE_CAPS * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("blksize mmap failed");
+        return -1;
+    }
+    g_caps = mem;
+    return 0;
+}
+
+static uint64_t *cap_entry(uint32_t addr) {
+    return &g_caps[(addr * 2654435761u) >> (32 - BLKSIZE_CAP_BITS)];
+}
+
+static uint16_t now_seconds(void) {
+    return (uint16_t)(stats_now_us() / 1000000u);
+}
+
+// The learned cap for 'addr', 0 when there is none
+static uint16_t cap_lookup(uint32_t addr) {
+    if (g_caps == NULL) {
+        return 0;
+    }
+    uint64_t word = __atomic_load_n(cap_entry(addr), __ATOMIC_RELAXED);
+    if (word == 0 || (uint32_t)(word >> 32) != addr || (int16_t)((uint16_t)word - now_seconds()) <= 0) {
+        return 0;
+    }
+    return (uint16_t)(word >> 16);
+}
+
+uint16_t blksize_choose(const struct sockaddr_in *peer, uint16_t requested, size_t packet_cap) {
+    uint16_t limit = requested, cap = cap_lookup(ntohl(peer->sin_addr.s_addr));
+
+    if (packet_cap - TFTP_HEADER_SIZE < limit) {
+        limit = (uint16_t)(packet_cap - TFTP_HEADER_SIZE);
+    }
+    if (cap != 0 && cap < limit) {
+        limit = cap;
+    }
+    return tftp_pmtu_blksize(peer, limit);
+}
+
+void blksize_transfer_end(const struct sockaddr_in *peer, uint16_t blksize, uint32_t timeouts) {
+    uint32_t addr = ntohl(peer->sin_addr.s_addr);
+
+    if (g_caps == NULL || blksize <= TFTP_DEFAULT_BLKSIZE || timeouts < BLKSIZE_LOSS_TIMEOUTS) {
+        return;
+    }
+    uint16_t cap = blksize / 2 > TFTP_DEFAULT_BLKSIZE ? blksize / 2 : TFTP_DEFAULT_BLKSIZE;
+    uint16_t current = cap_lookup(addr);
+    if (current != 0 && current <= cap) {
+        return; // Another transfer already lowered it further
+    }
+    uint16_t expiry = (uint16_t)(now_seconds() + BLKSIZE_CAP_SECONDS);
+    __atomic_store_n(cap_entry(addr), (uint64_t)addr << 32 | (uint64_t)cap << 16 | expiry, __ATOMIC_RELAXED);
+    STATS_INC(blksize_lowered);
+    tftp_log(TFTP_LOG_WARN, "[Child PID %d] %d timeouts at blksize %u: offering %s at most %u for %d s.\n",
+             getpid(), (int)timeouts, blksize, inet_ntoa(peer->sin_addr), cap, BLKSIZE_CAP_SECONDS);
+}
@@ -0,0 +1,34 @@
+#ifndef TFTP_BLKSIZE_H
+#define TFTP_BLKSIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+// --- BLKSIZE NEGOTIATION (RFC 2348) ---
+//
+// A client asking for "blksize" gets the smallest of: what it asked for,
+// what the transfer's packet buffer holds, the largest unfragmented size on
+// the path to it (CommonSource/tftpPmtu.h), and a cap learned from earlier
+// transfers to the same address.
+//
+// A transfer at more than 512 bytes per block that keeps timing out halves
+// that cap, down to 512: the path most likely drops large datagrams without
+// an ICMP error, so the path MTU never learns about it. Caps expire after
+// BLKSIZE_CAP_SECONDS, so a repaired path gets its large blocks back. They
+// live in a direct-mapped MAP_SHARED table made before the first fork, so
+// every transfer learns from the ones before it.
+
+#define BLKSIZE_CAP_BITS 10
+#define BLKSIZE_CAPS (1 << BLKSIZE_CAP_BITS) // Client addresses remembered
+#define BLKSIZE_CAP_SECONDS 600
+#define BLKSIZE_LOSS_TIMEOUTS 3     // Timeouts in one transfer that count as repeated loss
+
+// Maps the cap table; must run before the first fork. Without it no caps are kept.
+int blksize_init(void);
+// The blksize to answer 'requested' with, for a DATA buffer of 'packet_cap' bytes
+uint16_t blksize_choose(const struct sockaddr_in *peer, uint16_t requested, size_t packet_cap);
+// Called once a transfer at 'blksize' ends; learns from its timeouts
+void blksize_transfer_end(const struct sockaddr_in *peer, uint16_t blksize, uint32_t timeouts);
+
+#endif
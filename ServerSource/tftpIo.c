@@ -0,0 +1,266 @@
+#include "tftpServer.h"
+#include <time.h>
+
+// --- SOCKET BACKEND (ctx points at the transfer socket descriptor) ---
+
+static ssize_t socket_send(void *ctx, const void *buf, size_t len,
+                           const struct sockaddr_in *to, socklen_t to_len) {
+    return sendto(*(int *)ctx, buf, len, 0, (const struct sockaddr *)to, to_len);
+}
+
+static ssize_t socket_recv(void *ctx, void *buf, size_t len,
+                           struct sockaddr_in *from, socklen_t *from_len, uint64_t timeout_us) {
+    int sockfd = *(int *)ctx;
+
+    // Spins first in the low-latency profile (-L), then sleeps until the deadline
+    int rv = tftp_latency_wait(sockfd, timeout_us, g_config.spin_us);
+    if (rv < 0) {
+        return -1;
+    }
+    if (rv == 0) {
+        return TFTP_IO_TIMEOUT;
+    }
+    return recvfrom(sockfd, buf, len, 0, (struct sockaddr *)from, from_len);
+}
+
+static uint64_t socket_now_us(void *ctx) {
+    (void)ctx;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void tftp_io_socket(struct tftp_io *io, int *sockfd) {
+    io->ctx = sockfd;
+    io->send = socket_send;
+    io->recv = socket_recv;
+    io->now_us = socket_now_us;
+}
+
+// Same packet as send_error(), through a transfer's I/O backend
+void tftp_io_send_error(const struct tftp_io *io, const struct sockaddr_in *to, socklen_t to_len,
+                        int code, const char *message) {
+    char error_packet[PACKET_BUF_SIZE];
+    size_t packet_len = tftp_encode_error(error_packet, sizeof(error_packet), (uint16_t)code, message);
+
+    stats_error_sent(code);
+    TFTP_TRACE(TFTP_EV_ERROR_SENT, 0, (uint32_t)code);
+    if (io->send(io->ctx, error_packet, packet_len, to, to_len) < 0) {
+        perror("Error sending error packet");
+    }
+}
+
+// --- ENGINE GLUE (ctx points at the struct tftp_io_transfer) ---
+
+static ssize_t transfer_send(void *ctx, const void *packet, size_t len) {
+    struct tftp_io_transfer *t = ctx;
+    ssize_t n = t->io->send(t->io->ctx, packet, len, &t->peer, t->peer_len);
+    if (n < 0 && errno == EMSGSIZE) {
+        // DF is set (tftp_pmtu_enable) and the path MTU dropped below the blksize
+        tftp_log(TFTP_LOG_WARN, "[Child PID %d] %zu-byte packet exceeds the path MTU (now %d).\n",
+                 getpid(), len, tftp_pmtu_query(&t->peer));
+    } else if (n < 0) {
+        perror("Failed to send packet");
+    }
+    return n;
+}
+
+// Traces a block's wait for the rate limits, or for file I/O slower than
+// the page cache (TRACE_IO_MIN_US), to keep traces of healthy transfers small
+#define TRACE_IO_MIN_US 20
+
+static void trace_wait(int type, const struct tftp_io_transfer *t, uint64_t us) {
+    if (us > 0) {
+        TFTP_TRACE(type, t->engine.block + 1, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    }
+}
+
+static void trace_io(int type, const struct tftp_io_transfer *t, uint64_t start_us) {
+    uint64_t us = start_us != 0 ? tftp_trace_now_us() - start_us : 0;
+    if (us >= TRACE_IO_MIN_US) {
+        trace_wait(type, t, us);
+    }
+}
+
+static ssize_t transfer_read(void *ctx, char *buf, size_t len) {
+    struct tftp_io_transfer *t = ctx;
+    ssize_t n;
+    trace_wait(TFTP_TRACE_PACE, t, sched_pace(&t->peer, len));
+    uint64_t start_us = g_trace_fd >= 0 ? tftp_trace_now_us() : 0;
+    if (t->netascii) {
+        n = t->source != NULL ? tftp_source_read_netascii(t->source, &t->encoder, buf, len)
+                              : tftp_netascii_read(&t->encoder, t->fd, buf, len);
+        trace_io(TFTP_TRACE_FILE_READ, t, start_us);
+        if (n < 0) {
+            perror("File read failed");
+        }
+        return n;
+    }
+    n = t->source != NULL ? tftp_source_read(t->source, buf, len) : read(t->fd, buf, len);
+    trace_io(TFTP_TRACE_FILE_READ, t, start_us);
+    if (n < 0) {
+        perror("File read failed");
+        return n;
+    }
+    t->crc = tftp_crc32c(t->crc, buf, (size_t)n);
+    return n;
+}
+
+// Hot files: the DATA packet as the parent encoded it (tftpPacketCache.h)
+static const char *transfer_data(void *ctx, uint32_t block, size_t *len) {
+    struct tftp_io_transfer *t = ctx;
+    const char *packet = t->packets != NULL ? pcache_packet(t->packets, block, len) : NULL;
+
+    if (packet == NULL) {
+        return NULL;
+    }
+    trace_wait(TFTP_TRACE_PACE, t, sched_pace(&t->peer, *len - TFTP_HEADER_SIZE));
+    if (*len - TFTP_HEADER_SIZE < t->engine.blksize) {
+        t->crc = t->packets->crc; // The short block ends the file
+    }
+    STATS_INC(pcache_blocks);
+    return packet;
+}
+
+static int transfer_write(void *ctx, const char *data, size_t len) {
+    struct tftp_io_transfer *t = ctx;
+    int rc;
+    // Holds back the ACK, and with it the next DATA
+    trace_wait(TFTP_TRACE_PACE, t, sched_pace(&t->peer, len));
+    uint64_t start_us = g_trace_fd >= 0 ? tftp_trace_now_us() : 0;
+    if (t->netascii) {
+        rc = tftp_netascii_write(&t->decoder, t->fd, data, len);
+    } else {
+        t->crc = tftp_crc32c(t->crc, data, len);
+        rc = write(t->fd, data, len) < 0 ? -1 : 0;
+    }
+    trace_io(TFTP_TRACE_FILE_WRITE, t, start_us);
+    if (rc < 0) {
+        perror("File write failed");
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t tftp_io_digest(const struct tftp_io_transfer *t) {
+    if (!t->netascii) {
+        return t->crc;
+    }
+    return t->engine.role == TFTP_ENGINE_SEND ? t->encoder.state.crc : t->decoder.crc;
+}
+
+// Maps engine events onto the server's metrics, probes and log lines
+static void transfer_event(void *ctx, int event, uint32_t block, uint64_t arg) {
+    struct tftp_io_transfer *t = ctx;
+
+    TFTP_TRACE(event, block, (uint32_t)arg);
+    switch (event) {
+    case TFTP_EV_DATA_SENT:
+        stats_first_data();
+        stats_data_sent(arg);
+        TFTP_PROBE4(data__send, g_transfer_id, block, arg, t->engine.bytes);
+        TFTP_LOG_BLOCK("[Child PID %d] Sent DATA %u (%llu bytes).\n", getpid(), block, (unsigned long long)arg);
+        if (arg < t->engine.blksize) {
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Sent last block. Waiting for final ACK...\n", getpid());
+        }
+        break;
+    case TFTP_EV_DATA_RETRANSMIT:
+        stats_retransmit();
+        TFTP_PROBE3(data__retransmit, g_transfer_id, block, arg);
+        tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Retransmitting DATA %u. Attempt %d/%d.\n",
+                 getpid(), block, (int)arg, t->engine.max_retries);
+        break;
+    case TFTP_EV_DATA_RECEIVED:
+        stats_first_data();
+        stats_data_received(arg);
+        TFTP_PROBE4(data__receive, g_transfer_id, block, arg, t->engine.bytes);
+        TFTP_LOG_BLOCK("[Child PID %d] Received DATA %u (%llu bytes). Sent ACK %u.\n",
+                       getpid(), block, (unsigned long long)arg, block);
+        if (arg < t->engine.blksize) {
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Last block received. Transfer finished.\n", getpid());
+        }
+        break;
+    case TFTP_EV_DATA_DUPLICATE:
+        stats_retransmit();
+        TFTP_PROBE3(ack__retransmit, g_transfer_id, block, 0);
+        tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Received duplicate DATA %u. Resending ACK %u.\n",
+                 getpid(), block, block);
+        break;
+    case TFTP_EV_ACK_RECEIVED:
+        TFTP_PROBE2(ack__receive, g_transfer_id, block);
+        TFTP_LOG_BLOCK("[Child PID %d] Received ACK %u.\n", getpid(), block);
+        if (block > 0 && t->engine.last_payload < t->engine.blksize) {
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Final ACK received. Transfer finished.\n", getpid());
+        }
+        break;
+    case TFTP_EV_ACK_STALE:
+        TFTP_PROBE2(ack__receive, g_transfer_id, block);
+        tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Received old ACK %u. Ignoring.\n", getpid(), block);
+        break;
+    case TFTP_EV_ACK_RETRANSMIT:
+        stats_retransmit();
+        TFTP_PROBE3(ack__retransmit, g_transfer_id, block, arg);
+        if (t->engine.role == TFTP_ENGINE_SEND) {
+            tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Timeout. Resending OACK...\n", getpid());
+        } else {
+            tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Timeout. Retrying ACK %u...\n", getpid(), block);
+        }
+        break;
+    case TFTP_EV_TIMEOUT:
+        t->timeouts++;
+        STATS_INC(timeouts);
+        TFTP_PROBE3(timeout, g_transfer_id, block, arg);
+        break;
+    case TFTP_EV_ERROR_SENT:
+        stats_error_sent((int)arg);
+        break;
+    case TFTP_EV_ERROR_RECEIVED:
+        tftp_log(TFTP_LOG_INFO, "[Child PID %d] Client reported error %d. Aborting.\n", getpid(), (int)arg);
+        break;
+    }
+}
+
+const struct tftp_engine_ops tftp_io_engine_ops = {
+    transfer_send, transfer_read, transfer_write, transfer_event, NULL, transfer_data
+};
+
+int tftp_io_run_engine(struct tftp_io_transfer *t) {
+    const struct tftp_io *io = t->io;
+    struct tftp_engine *e = &t->engine;
+    char recv_buffer[MAX_PACKET_SIZE];
+
+    while (e->status == TFTP_ENGINE_RUNNING) {
+        uint64_t now_us = io->now_us(io->ctx);
+        uint64_t wait_us = e->deadline_us > now_us ? e->deadline_us - now_us : 0;
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = io->recv(io->ctx, recv_buffer, sizeof(recv_buffer), &from, &from_len, wait_us);
+
+        if (n == -1) {
+            perror("poll error");
+            tftp_io_send_error(io, &t->peer, t->peer_len, 0, "Server poll error");
+            return -1;
+        }
+        if (n == TFTP_IO_TIMEOUT) {
+            tftp_engine_timeout(e, io->now_us(io->ctx));
+        } else if (from.sin_addr.s_addr != t->peer.sin_addr.s_addr || from.sin_port != t->peer.sin_port) {
+            // RFC 1350: the wrong TID gets an ERROR and leaves the transfer alone.
+            // On a pooled socket it is most likely the previous transfer's client.
+            STATS_INC(unknown_tid);
+            tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Packet from unknown TID %s:%d ignored.\n", getpid(),
+                     inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+            tftp_io_send_error(io, &from, from_len, 5, "Unknown transfer ID");
+        } else {
+            tftp_engine_receive(e, recv_buffer, (size_t)n, io->now_us(io->ctx));
+        }
+    }
+    return tftp_io_result(t);
+}
+
+int tftp_io_result(const struct tftp_io_transfer *t) {
+    if (t->engine.status == TFTP_ENGINE_FAILED) {
+        tftp_log(TFTP_LOG_WARN, "[Child PID %d] Transfer aborted: %s\n", getpid(), t->engine.error);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef TFTP_IO_H
+#define TFTP_IO_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "tftpDigest.h"
+#include "tftpEngine.h"
+#include "tftpNetascii.h"
+#include "tftpPacketCache.h"
+#include "tftpSource.h"
+
+// --- TRANSFER I/O AND CLOCK INTERFACE ---
+//
+// The read/write transfer state machines never touch a socket or the wall
+// clock directly; they go through this table. Forked transfers use the socket
+// backend below (sendto/poll/recvfrom on the transfer socket and
+// CLOCK_MONOTONIC). BenchSource/tftpSim.c plugs in a simulated network and a
+// virtual clock instead, so timeouts cost no real time.
+
+#define TFTP_IO_TIMEOUT (-2)        // recv(): no packet before the timeout
+
+struct tftp_io {
+    void *ctx;
+    ssize_t (*send)(void *ctx, const void *buf, size_t len,
+                    const struct sockaddr_in *to, socklen_t to_len);
+    // Waits up to timeout_us for one datagram. Returns its length,
+    // TFTP_IO_TIMEOUT, or -1 on error (errno set).
+    ssize_t (*recv)(void *ctx, void *buf, size_t len,
+                    struct sockaddr_in *from, socklen_t *from_len, uint64_t timeout_us);
+    uint64_t (*now_us)(void *ctx);  // Monotonic microseconds
+};
+
+// One unicast transfer: the engine plus the file and peer it talks to.
+// The engine's send callback goes to 'peer'. Packets from any other address
+// or port are answered with ERROR 5 and never reach the engine.
+struct tftp_io_transfer {
+    const struct tftp_io *io;
+    struct sockaddr_in peer;
+    socklen_t peer_len;
+    int fd;
+    struct tftp_source *source;             // RRQ: file data is read through this, not fd
+    const struct pcache_file *packets;      // RRQ: or sent ready-made from these, NULL = none
+    int netascii;                           // Translate line endings (mode "netascii")
+    struct tftp_netascii_reader encoder;    // RRQ: file -> wire
+    struct tftp_netascii decoder;           // WRQ: wire -> file
+    uint32_t crc;                           // CRC32C of the file bytes moved (octet mode)
+    uint32_t timeouts;                      // Deadlines that passed without a reply
+    struct tftp_engine engine;
+};
+
+void tftp_io_socket(struct tftp_io *io, int *sockfd);
+// Runs an engine set up with tftp_io_engine_ops until it finishes.
+// Returns 0 when the transfer completed, -1 otherwise.
+int tftp_io_run_engine(struct tftp_io_transfer *t);
+// The same result for an engine driven elsewhere, once it stopped running
+int tftp_io_result(const struct tftp_io_transfer *t);
+extern const struct tftp_engine_ops tftp_io_engine_ops;
+// CRC32C of the file bytes read or written so far, in either mode
+uint32_t tftp_io_digest(const struct tftp_io_transfer *t);
+void tftp_io_send_error(const struct tftp_io *io, const struct sockaddr_in *to, socklen_t to_len,
+                        int code, const char *message);
+
+#endif
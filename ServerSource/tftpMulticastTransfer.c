@@ -0,0 +1,601 @@
+#include "tftpServer.h"
+
+#include <poll.h>
+#include <sys/mman.h>
+
+// --- MULTICAST RRQ (RFC 2090) ---
+//
+// One forked session process serves every multicast client of a given file.
+// The first client becomes the "master client": it ACKs blocks and the session
+// answers each ACK with the next block, sent to the multicast group so that all
+// attached clients receive it. A client's ACK always names the highest block it
+// holds contiguously, so a late joiner that is promoted to master (after the
+// previous master finished) only pulls the blocks it is missing.
+//
+// The parent keeps a small table of running sessions and forwards late joiners
+// to the owning session through a pipe. A session runs at the block size its
+// first client asked for (512 without the option), and every client of it must
+// accept that size, so a joiner that wants smaller blocks, or sends no blksize
+// option, starts a session of its own on the next group port.
+//
+// Files come from the archive or the filesystem as for a unicast RRQ
+// (tftpSource.h). Repairs need any block at any time, so a .zst/.gz image is
+// decompressed once, when the session starts, into a memfd the session reads
+// blocks from.
+
+#define MCAST_MAX_BLKSIZE 1428  // Keeps a DATA packet inside a 1500-byte MTU
+#define MCAST_MAX_BLOCKS 65535  // Block numbers are not extended past 16 bits
+
+struct mcast_join {
+    struct sockaddr_in addr;
+    uint16_t blksize;           // Requested blksize, 0 if the option was absent
+};
+
+// --- PARENT-SIDE SESSION TABLE ---
+struct mcast_session_entry {
+    pid_t pid;                  // 0 when the slot is free
+    int pipe_fd;                // Write end, used to forward late joiners
+    uint16_t blksize;           // Session's block size
+    char filename[256];
+};
+
+static struct mcast_session_entry sessions[MCAST_MAX_SESSIONS];
+
+// --- SESSION-SIDE STATE ---
+struct mcast_client {
+    struct sockaddr_in addr;
+    uint32_t acked;             // Highest block held contiguously by the client
+    int wants_blksize;          // Client asked for the blksize option
+    int active;
+};
+
+struct mcast_session {
+    int sockfd;
+    int join_fd;
+    int fd;                     // Plain file or decompressed copy, -1 for an archive entry
+    const char *data;           // Archive entry's bytes, NULL otherwise
+    uint64_t size;
+    struct sockaddr_in group;
+    uint16_t blksize;
+    uint32_t total_blocks;      // Last block number (the short one)
+    struct mcast_client clients[MCAST_MAX_CLIENTS];
+    int client_count;
+    int master;                 // Index into clients, -1 when no master
+    uint32_t last_sent;         // Block last sent to the group, 0 = none yet
+    int retries;
+    uint64_t deadline_us;       // Retransmit to the master at this monotonic time
+    unsigned long long egress_bytes;
+    unsigned int completed;
+};
+
+static void mcast_session_run(int join_fd, int slot, const char *filename,
+                              const struct mcast_join *first);
+
+// Block size of a session opened by a client requesting 'requested' (0 = no option)
+static uint16_t mcast_blksize(uint16_t requested) {
+    if (requested == 0) {
+        return BLOCK_SIZE;
+    }
+    return requested < MCAST_MAX_BLKSIZE ? requested : MCAST_MAX_BLKSIZE;
+}
+
+void mcast_dispatch_request(int master_sockfd, const struct tftp_packet *req,
+                            const struct sockaddr_in *cliaddr, socklen_t len) {
+    struct mcast_join join;
+    int free_slot = -1;
+
+    memset(&join, 0, sizeof(join));
+    join.addr = *cliaddr;
+    join.blksize = tftp_option_blksize(req);
+    uint16_t accepts = join.blksize != 0 ? join.blksize : BLOCK_SIZE;
+
+    // 1. Late joiner: hand it to a session of this file whose blocks it accepts
+    for (int i = 0; i < MCAST_MAX_SESSIONS; i++) {
+        if (sessions[i].pid == 0) {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+            continue;
+        }
+        if (strcmp(sessions[i].filename, req->filename) == 0 && sessions[i].blksize <= accepts) {
+            if (write(sessions[i].pipe_fd, &join, sizeof(join)) == sizeof(join)) {
+                tftp_log(TFTP_LOG_INFO, "Multicast client %s:%d joined running session for '%s'.\n",
+                       inet_ntoa(cliaddr->sin_addr), ntohs(cliaddr->sin_port), req->filename);
+                return;
+            }
+            // The session is exiting; start a fresh one below
+        }
+    }
+
+    if (free_slot < 0) {
+        send_error(master_sockfd, cliaddr, len, 0, "Too many multicast sessions");
+        return;
+    }
+    if (strlen(req->filename) >= sizeof(sessions[free_slot].filename)) {
+        send_error(master_sockfd, cliaddr, len, 0, "Filename too long");
+        return;
+    }
+
+    // 2. First client for this file: fork a new session
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        perror("pipe failed");
+        send_error(master_sockfd, cliaddr, len, 0, "Server error: could not create session");
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        send_error(master_sockfd, cliaddr, len, 0, "Server error: could not fork");
+        return;
+    }
+
+    if (pid == 0) {
+        // --- SESSION CHILD ---
+        close(master_sockfd);
+        close(pipefd[1]);
+        session_forked();
+        stats_forked();
+        tftp_log_init();
+        for (int i = 0; i < MCAST_MAX_SESSIONS; i++) {
+            if (sessions[i].pid != 0) {
+                close(sessions[i].pipe_fd);
+            }
+        }
+        mcast_session_run(pipefd[0], free_slot, req->filename, &join);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Parent: remember the session so late joiners can be forwarded
+    close(pipefd[0]);
+    fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+    sessions[free_slot].pid = pid;
+    sessions[free_slot].pipe_fd = pipefd[1];
+    sessions[free_slot].blksize = mcast_blksize(join.blksize);
+    strcpy(sessions[free_slot].filename, req->filename);
+}
+
+void mcast_session_reaped(pid_t pid) {
+    for (int i = 0; i < MCAST_MAX_SESSIONS; i++) {
+        if (sessions[i].pid == pid) {
+            close(sessions[i].pipe_fd);
+            sessions[i].pid = 0;
+            sessions[i].filename[0] = '\0';
+            return;
+        }
+    }
+}
+
+// --- SESSION HELPERS ---
+
+static void mcast_send(struct mcast_session *s, const void *packet, size_t size,
+                       const struct sockaddr_in *to) {
+    ssize_t sent = sendto(s->sockfd, packet, size, 0,
+                          (const struct sockaddr *)to, sizeof(*to));
+    if (sent < 0) {
+        perror("Multicast session sendto failed");
+        return;
+    }
+    s->egress_bytes += (unsigned long long)sent;
+}
+
+// Only what is sent to the master moves its retransmit deadline: joiners and
+// the other clients' ACKs must not postpone it.
+static void mcast_arm(struct mcast_session *s) {
+    s->deadline_us = stats_now_us() + (uint64_t)TIMEOUT_SEC * 1000000u;
+}
+
+static int mcast_wait_ms(const struct mcast_session *s) {
+    uint64_t now = stats_now_us();
+
+    return now >= s->deadline_us ? 0 : (int)((s->deadline_us - now + 999) / 1000);
+}
+
+// OACK: "multicast" = "<group>,<port>,<mc>" and, if asked for, "blksize" = "<n>"
+static void mcast_send_oack(struct mcast_session *s, int idx, int is_master) {
+    char packet[128];
+    char value[48];
+    char blksize[8];
+    struct tftp_option options[2] = {{"multicast", value}, {"blksize", blksize}};
+
+    snprintf(value, sizeof(value), "%s,%d,%d", inet_ntoa(s->group.sin_addr),
+             ntohs(s->group.sin_port), is_master);
+    snprintf(blksize, sizeof(blksize), "%u", s->blksize);
+
+    size_t len = tftp_encode_oack(packet, sizeof(packet), options, s->clients[idx].wants_blksize ? 2 : 1);
+    mcast_send(s, packet, len, &s->clients[idx].addr);
+    if (is_master) {
+        mcast_arm(s);
+    }
+}
+
+static int mcast_send_block(struct mcast_session *s, uint32_t block) {
+    char packet[4 + MCAST_MAX_BLKSIZE];
+    uint64_t offset = (uint64_t)(block - 1) * s->blksize;
+    ssize_t bytes_read;
+
+    if (s->data != NULL) {
+        bytes_read = offset < s->size ? (ssize_t)(s->size - offset < s->blksize ? s->size - offset : s->blksize) : 0;
+        memcpy(packet + 4, s->data + offset, (size_t)bytes_read);
+    } else {
+        bytes_read = pread(s->fd, packet + 4, s->blksize, (off_t)offset);
+    }
+    if (bytes_read < 0) {
+        perror("File read failed");
+        return -1;
+    }
+    size_t len = tftp_encode_data(packet, sizeof(packet), (uint16_t)block, packet + 4, (size_t)bytes_read);
+    mcast_send(s, packet, len, &s->group);
+    if (block == s->last_sent) {
+        stats_retransmit();
+        TFTP_PROBE3(data__retransmit, g_transfer_id, block, s->retries);
+    } else {
+        stats_first_data();
+        stats_data_sent((uint64_t)bytes_read);
+        TFTP_PROBE4(data__send, g_transfer_id, block, bytes_read, s->egress_bytes);
+    }
+    s->last_sent = block;
+    mcast_arm(s);
+    return 0;
+}
+
+static int mcast_find_client(struct mcast_session *s, const struct sockaddr_in *addr) {
+    for (int i = 0; i < s->client_count; i++) {
+        if (s->clients[i].active &&
+            s->clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            s->clients[i].addr.sin_port == addr->sin_port) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The parent only forwards joiners that accept the session's block size
+static void mcast_add_client(struct mcast_session *s, const struct mcast_join *join) {
+    int idx = mcast_find_client(s, &join->addr);
+
+    if (idx < 0) {
+        // Reuse a finished slot before growing the table
+        for (idx = 0; idx < s->client_count && s->clients[idx].active; idx++) {
+        }
+        if (idx == MCAST_MAX_CLIENTS) {
+            send_error(s->sockfd, &join->addr, sizeof(join->addr), 0,
+                       "Multicast session full");
+            return;
+        }
+        if (idx == s->client_count) {
+            s->client_count++;
+        }
+        memset(&s->clients[idx], 0, sizeof(s->clients[idx]));
+        s->clients[idx].addr = join->addr;
+        s->clients[idx].wants_blksize = (join->blksize != 0);
+        s->clients[idx].active = 1;
+    }
+    if (s->master < 0) {
+        s->master = idx;
+        s->last_sent = 0;
+        s->retries = 0;
+    }
+    // A repeated RRQ simply gets its OACK again
+    mcast_send_oack(s, idx, idx == s->master);
+}
+
+static void mcast_drop_client(struct mcast_session *s, int idx) {
+    s->clients[idx].active = 0;
+    if (idx == s->master) {
+        s->master = -1;
+    }
+}
+
+// Returns 1 if a client is now master, 0 if nobody is left
+static int mcast_promote_master(struct mcast_session *s) {
+    for (int i = 0; i < s->client_count; i++) {
+        if (s->clients[i].active) {
+            s->master = i;
+            s->last_sent = 0;
+            s->retries = 0;
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Client %s:%d is now master client.\n", getpid(),
+                   inet_ntoa(s->clients[i].addr.sin_addr), ntohs(s->clients[i].addr.sin_port));
+            mcast_send_oack(s, i, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void mcast_drain_joins(struct mcast_session *s) {
+    struct mcast_join join;
+    ssize_t n;
+
+    if (s->join_fd < 0) {
+        return;
+    }
+    while ((n = read(s->join_fd, &join, sizeof(join))) == sizeof(join)) {
+        mcast_add_client(s, &join);
+    }
+    if (n == 0) {
+        // Parent went away: keep serving the clients we already have
+        close(s->join_fd);
+        s->join_fd = -1;
+    }
+}
+
+static void mcast_handle_packet(struct mcast_session *s, const char *buffer, ssize_t n,
+                                const struct sockaddr_in *from) {
+    int idx = mcast_find_client(s, from);
+
+    if (idx < 0) {
+        send_error(s->sockfd, from, sizeof(*from), 5, "Unknown transfer ID");
+        return;
+    }
+    struct tftp_packet pkt;
+    if (tftp_decode(buffer, (size_t)n, &pkt) < 0) {
+        return;
+    }
+
+    uint16_t opcode = pkt.opcode;
+    uint16_t block_num = pkt.block;
+    struct mcast_client *c = &s->clients[idx];
+
+    if (opcode == OP_ERROR) {
+        tftp_log(TFTP_LOG_INFO, "[Child PID %d] Multicast client reported error. Dropping it.\n", getpid());
+        mcast_drop_client(s, idx);
+        return;
+    }
+    if (opcode == OP_ACK) {
+        TFTP_PROBE2(ack__receive, g_transfer_id, block_num);
+    }
+    if (opcode != OP_ACK) {
+        send_error(s->sockfd, from, sizeof(*from), 4, "Illegal TFTP operation (unexpected opcode)");
+        mcast_drop_client(s, idx);
+        return;
+    }
+
+    uint32_t previous = c->acked;
+    if (block_num > s->total_blocks) {
+        send_error(s->sockfd, from, sizeof(*from), 4, "Illegal TFTP operation (unexpected ACK)");
+        mcast_drop_client(s, idx);
+        return;
+    }
+    if (block_num > c->acked) {
+        c->acked = block_num;
+    }
+
+    // Any client ACKing the last block holds the whole file
+    if (c->acked == s->total_blocks) {
+        tftp_log(TFTP_LOG_INFO, "[Child PID %d] Client %s:%d completed.\n", getpid(),
+               inet_ntoa(from->sin_addr), ntohs(from->sin_port));
+        s->completed++;
+        mcast_drop_client(s, idx);
+        return;
+    }
+
+    if (idx != s->master) {
+        return; // Only the master client drives the transmission
+    }
+
+    // Duplicate ACK while its successor is already in flight: let the timeout handle it
+    if (c->acked == previous && s->last_sent == c->acked + 1) {
+        return;
+    }
+
+    s->retries = 0;
+    if (mcast_send_block(s, c->acked + 1) < 0) {
+        send_error(s->sockfd, from, sizeof(*from), 3, "I/O error during read");
+        mcast_drop_client(s, idx);
+    }
+}
+
+// Opens filename as tftp_read_begin() does and sizes it. A compressed image
+// is decompressed into a memfd, through the cache directory when one is set.
+// Returns 0, or -1 with errno set.
+static int mcast_open(struct mcast_session *s, const char *filename) {
+    const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, filename);
+    struct tftp_source source;
+    struct stat st;
+
+    s->fd = -1;
+    if (entry != NULL) {
+        s->data = tftp_archive_data(&g_archive, entry);
+        s->size = entry->size;
+        return 0;
+    }
+    if (tftp_source_open(&source, filename, 1, g_config.cache_dir) < 0) {
+        return -1;
+    }
+    if (source.codec == TFTP_SOURCE_PLAIN) {
+        // Keep the descriptor; closing the source would close it
+        if (fstat(source.fd, &st) < 0) {
+            tftp_source_close(&source);
+            return -1;
+        }
+        s->fd = source.fd;
+        s->size = (uint64_t)st.st_size;
+        return 0;
+    }
+
+    char buf[TFTP_SOURCE_CHUNK];
+    uint32_t crc = 0;
+    ssize_t n;
+    int fd = memfd_create("tftp-mcast", 0);
+    if (fd < 0) {
+        tftp_source_close(&source);
+        return -1;
+    }
+    s->size = 0;
+    while ((n = tftp_source_read(&source, buf, sizeof(buf))) > 0) {
+        if (write(fd, buf, (size_t)n) != n) {
+            n = -1;
+            break;
+        }
+        crc = tftp_crc32c(crc, buf, (size_t)n);
+        s->size += (uint64_t)n;
+    }
+    if (n < 0) {
+        int saved = errno;
+        close(fd);
+        tftp_source_close(&source);
+        errno = saved;
+        return -1;
+    }
+    tftp_source_finish(&source, crc);
+    tftp_source_close(&source);
+    s->fd = fd;
+    return 0;
+}
+
+// --- SESSION MAIN LOOP ---
+static void mcast_session_run(int join_fd, int slot, const char *filename,
+                              const struct mcast_join *first) {
+    static struct mcast_session s; // Large client table: keep it off the stack
+    char recv_buffer[PACKET_BUF_SIZE];
+
+    memset(&s, 0, sizeof(s));
+    s.join_fd = join_fd;
+    s.master = -1;
+    s.blksize = mcast_blksize(first->blksize);
+    fcntl(join_fd, F_SETFL, O_NONBLOCK);
+
+    // 1. Transfer socket (unicast TID) which also sends to the group
+    if ((s.sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("multicast session socket creation failed");
+        return;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = INADDR_ANY;
+    if (bind(s.sockfd, (const struct sockaddr *)&local, sizeof(local)) < 0) {
+        perror("multicast session bind failed");
+        close(s.sockfd);
+        return;
+    }
+
+    unsigned char ttl = 1;
+    unsigned char loop = 1;
+    setsockopt(s.sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(s.sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    if (g_config.mcast_interface.s_addr != htonl(INADDR_ANY) &&
+        setsockopt(s.sockfd, IPPROTO_IP, IP_MULTICAST_IF, &g_config.mcast_interface,
+                   sizeof(g_config.mcast_interface)) < 0) {
+        perror("IP_MULTICAST_IF failed");
+    }
+
+    memset(&s.group, 0, sizeof(s.group));
+    s.group.sin_family = AF_INET;
+    s.group.sin_addr = g_config.mcast_group;
+    s.group.sin_port = htons(MCAST_PORT_BASE + slot);
+
+    // 2. Open the file and size the transfer
+    if (mcast_open(&s, filename) < 0) {
+        if (errno == ENOENT) {
+            send_error(s.sockfd, &first->addr, sizeof(first->addr), 1, "File not found");
+        } else if (errno == EACCES) {
+            send_error(s.sockfd, &first->addr, sizeof(first->addr), 2, "Access violation (cannot read file)");
+        } else {
+            send_error(s.sockfd, &first->addr, sizeof(first->addr), 0, "Not defined error on file open");
+        }
+        close(s.sockfd);
+        return;
+    }
+    if (s.size / s.blksize + 1 > MCAST_MAX_BLOCKS) {
+        send_error(s.sockfd, &first->addr, sizeof(first->addr), 0,
+                   "File too large for multicast at this blksize");
+        if (s.fd >= 0) {
+            close(s.fd);
+        }
+        close(s.sockfd);
+        return;
+    }
+    s.total_blocks = (uint32_t)(s.size / s.blksize) + 1;
+
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Multicast session for '%s' on %s:%d (blksize %u, %u blocks).\n",
+           getpid(), filename, inet_ntoa(s.group.sin_addr), ntohs(s.group.sin_port),
+           s.blksize, s.total_blocks);
+
+    stats_transfer_begin(OP_RRQ, filename, &first->addr);
+    mcast_add_client(&s, first);
+
+    // --- MAIN SESSION LOOP ---
+    while (1) {
+        // Not select(): with -E raising the descriptor limit, these may be past FD_SETSIZE.
+        // A join_fd of -1 is ignored.
+        struct pollfd fds[2] = {{s.sockfd, POLLIN, 0}, {s.join_fd, POLLIN, 0}};
+        int rv;
+
+        // Hand the master role on when the previous one finished or vanished
+        if (s.master < 0 && !mcast_promote_master(&s)) {
+            // Nobody left: pick up joiners that raced with our shutdown
+            mcast_drain_joins(&s);
+            if (!mcast_promote_master(&s)) {
+                break;
+            }
+        }
+
+        // The wait runs to the master's deadline, not a fresh timeout per datagram
+        rv = poll(fds, 2, mcast_wait_ms(&s));
+
+        if (rv == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll error");
+            break;
+        }
+
+        if (rv > 0 && s.join_fd >= 0 && (fds[1].revents & (POLLIN | POLLHUP))) {
+            mcast_drain_joins(&s);
+        }
+
+        if (rv > 0 && (fds[0].revents & POLLIN)) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(s.sockfd, recv_buffer, sizeof(recv_buffer), 0,
+                                 (struct sockaddr *)&from, &from_len);
+            if (n > 0) {
+                mcast_handle_packet(&s, recv_buffer, n, &from);
+            }
+        }
+
+        if (s.master < 0 || stats_now_us() < s.deadline_us) {
+            continue;
+        }
+
+        // Deadline passed: repeat whatever the master is waiting on
+        STATS_INC(timeouts);
+        TFTP_PROBE3(timeout, g_transfer_id, s.last_sent, s.retries);
+        if (s.retries >= MAX_RETRIES) {
+            tftp_log(TFTP_LOG_WARN, "[Child PID %d] Master client timed out. Dropping it.\n", getpid());
+            mcast_drop_client(&s, s.master);
+            continue;
+        }
+        s.retries++;
+        if (s.last_sent == 0) {
+            mcast_send_oack(&s, s.master, 1);
+        } else if (mcast_send_block(&s, s.last_sent) < 0) {
+            break;
+        }
+        tftp_log(TFTP_LOG_DEBUG, "[Child PID %d] Retransmitting to master client. Attempt %d/%d.\n",
+               getpid(), s.retries, MAX_RETRIES);
+    }
+
+    // --- SESSION SUMMARY ---
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Multicast session for '%s' finished: %u clients booted, "
+           "%llu bytes egress, %llu bytes per client (file %lld bytes).\n",
+           getpid(), filename, s.completed, s.egress_bytes,
+           s.completed ? s.egress_bytes / s.completed : s.egress_bytes,
+           (long long)s.size);
+
+    stats_transfer_end(s.completed > 0);
+    TFTP_PROBE3(transfer__done, g_transfer_id, s.completed > 0 ? 0 : -1, s.egress_bytes);
+    if (s.join_fd >= 0) {
+        close(s.join_fd);
+    }
+    if (s.fd >= 0) {
+        close(s.fd);
+    }
+    close(s.sockfd);
+}
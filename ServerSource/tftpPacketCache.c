@@ -0,0 +1,366 @@
+#include "tftpServer.h"
+#include "tftpPacketCache.h"
+
+#include <sys/mman.h>
+
+// A miss recorded by a transfer. 'tag' is written last and cleared first, so
+// the parent can tell a name that changed under it; a torn one only costs
+// a build that finds no such file.
+struct pcache_demand {
+    uint64_t tag;                   // Of the name and blksize, 0 = free
+    uint32_t misses;
+    uint16_t blksize;
+    char name[PCACHE_NAME_MAX];
+};
+
+struct pcache_shared {
+    uint64_t hits[PCACHE_MAX_FILES];        // Transfers served from files[i]
+    struct pcache_demand demand[PCACHE_DEMAND_SLOTS];
+};
+
+// Parent-built; children see the table as it was when they were forked
+static struct pcache_file files[PCACHE_MAX_FILES];
+static struct pcache_shared *g_shared;
+static uint64_t g_budget, g_used, g_last_scan_us;
+
+int pcache_init(uint64_t budget) {
+    if (budget == 0) {
+        return 0;
+    }
+    void *mem = mmap(NULL, sizeof(struct pcache_shared), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("packet cache mmap failed");
+        return -1;
+    }
+    g_shared = mem;
+    g_budget = budget;
+    return 0;
+}
+
+static uint32_t packet_count(uint64_t size, uint16_t blksize) {
+    return (uint32_t)(size / blksize + 1); // A multiple of blksize ends with an empty block
+}
+
+static uint64_t set_bytes(uint64_t size, uint16_t blksize) {
+    return size + (uint64_t)packet_count(size, blksize) * TFTP_HEADER_SIZE;
+}
+
+// What identifies the data in 'fd' or 'entry'; -1 when it is not cached
+static int source_key(int fd, const struct tftp_archive_entry *entry, uint16_t blksize, struct pcache_key *key) {
+    struct stat st;
+
+    memset(key, 0, sizeof(*key));
+    key->blksize = blksize;
+    if (entry != NULL) {
+        key->dev = (uint64_t)g_archive.dev;
+        key->ino = (uint64_t)g_archive.ino;
+        key->offset = entry->offset;
+        key->size = entry->size;
+        key->mtime_ns = entry->mtime * 1000000000;
+    } else {
+        if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        key->dev = (uint64_t)st.st_dev;
+        key->ino = (uint64_t)st.st_ino;
+        key->size = (uint64_t)st.st_size;
+        key->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+    // One set may take a quarter of the budget, so a few hot files fit
+    return set_bytes(key->size, blksize) <= g_budget / 4 ? 0 : -1;
+}
+
+static int key_equal(const struct pcache_key *a, const struct pcache_key *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->offset == b->offset && a->size == b->size &&
+           a->mtime_ns == b->mtime_ns && a->blksize == b->blksize;
+}
+
+static uint64_t demand_tag(const char *name, uint16_t blksize) {
+    return (tftp_archive_hash(name, strlen(name)) ^ (uint64_t)blksize * 0x9e3779b97f4a7c15ull) | 1;
+}
+
+// Counts a miss. Another file's count in the slot goes down by one instead,
+// and the slot changes hands once it reaches zero, so hot files keep theirs.
+static void demand_miss(const char *name, uint16_t blksize) {
+    uint64_t tag = demand_tag(name, blksize);
+    struct pcache_demand *d = &g_shared->demand[tag % PCACHE_DEMAND_SLOTS];
+
+    if (strlen(name) >= PCACHE_NAME_MAX) {
+        return;
+    }
+    if (__atomic_load_n(&d->tag, __ATOMIC_ACQUIRE) == tag) {
+        __atomic_fetch_add(&d->misses, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint32_t misses = __atomic_load_n(&d->misses, __ATOMIC_RELAXED);
+    if (misses > 0 && __atomic_sub_fetch(&d->misses, 1, __ATOMIC_RELAXED) > 0) {
+        return;
+    }
+    __atomic_store_n(&d->tag, 0, __ATOMIC_RELEASE);
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    d->blksize = blksize;
+    __atomic_store_n(&d->misses, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->tag, tag, __ATOMIC_RELEASE);
+}
+
+// --- TRANSFERS ---
+
+const struct pcache_file *pcache_find(const char *filename, int fd, const struct tftp_archive_entry *entry,
+                                      uint16_t blksize) {
+    struct pcache_key key;
+
+    if (g_shared == NULL || source_key(fd, entry, blksize, &key) < 0) {
+        return NULL;
+    }
+    for (int i = 0; i < PCACHE_MAX_FILES; i++) {
+        if (files[i].packets != NULL && key_equal(&files[i].key, &key)) {
+            files[i].users++;
+            __atomic_fetch_add(&g_shared->hits[i], 1, __ATOMIC_RELAXED);
+            STATS_INC(pcache_hits);
+            return &files[i];
+        }
+    }
+    STATS_INC(pcache_misses);
+    demand_miss(filename, blksize);
+    return NULL;
+}
+
+void pcache_put(const struct pcache_file *f) {
+    if (f != NULL) {
+        files[f - files].users--;
+    }
+}
+
+const char *pcache_packet(const struct pcache_file *f, uint32_t block, size_t *len) {
+    size_t stride = (size_t)TFTP_HEADER_SIZE + f->key.blksize;
+
+    if (block == 0 || block > f->count) {
+        return NULL;
+    }
+    *len = block < f->count ? stride
+                            : TFTP_HEADER_SIZE + (size_t)(f->key.size - (uint64_t)(f->count - 1) * f->key.blksize);
+    return f->packets + (size_t)(block - 1) * stride;
+}
+
+// --- PARENT ---
+
+static void drop(int i) {
+    tftp_log(TFTP_LOG_DEBUG, "Packet cache: dropped a %u-packet set (blksize %u).\n",
+             files[i].count, files[i].key.blksize);
+    munmap((void *)files[i].packets, files[i].bytes);
+    g_used -= files[i].bytes;
+    STATS_ADD(pcache_bytes, -(int64_t)files[i].bytes);
+    STATS_ADD(pcache_files, -1);
+    STATS_INC(pcache_evictions);
+    files[i].packets = NULL;
+}
+
+// Frees room for 'bytes' and a table entry, dropping sets colder than
+// 'misses'; the free entry, or -1 when the file is not worth it
+static int make_room(uint64_t bytes, uint32_t misses) {
+    for (;;) {
+        int free_index = -1, coldest = -1;
+        for (int i = 0; i < PCACHE_MAX_FILES; i++) {
+            if (files[i].packets == NULL) {
+                free_index = free_index < 0 ? i : free_index;
+            } else if (files[i].users == 0 && (coldest < 0 || files[i].score < files[coldest].score)) {
+                coldest = i;
+            }
+        }
+        if (free_index >= 0 && g_used + bytes <= g_budget) {
+            return free_index;
+        }
+        if (coldest < 0 || files[coldest].score >= misses) {
+            return -1;
+        }
+        drop(coldest);
+    }
+}
+
+// The set being built. The parent reads the file into it a slice per main
+// loop iteration, straight into each packet's payload, so a large set never
+// holds up requests; one that changes meanwhile is thrown away.
+static struct {
+    int index;                      // Entry it goes to, -1 when idle
+    int fd;
+    uint64_t base;                  // File offset of the data
+    off_t file_size;                // Of 'fd' at the start, checked at the end
+    struct timespec file_mtime;
+    struct pcache_key key;
+    char *packets;
+    size_t bytes;
+    uint32_t count;
+    uint32_t next;                  // Next block to read
+    uint32_t crc;
+    char name[PCACHE_NAME_MAX];
+} g_build = {.index = -1};
+
+static void build_end(int built) {
+    if (built) {
+        mprotect(g_build.packets, g_build.bytes, PROT_READ);
+        madvise(g_build.packets, g_build.bytes, MADV_DOFORK); // Transfers forked from now on share it
+        int i = g_build.index;
+        files[i].key = g_build.key;
+        files[i].packets = g_build.packets;
+        files[i].bytes = g_build.bytes;
+        files[i].count = g_build.count;
+        files[i].crc = g_build.crc;
+        files[i].users = 0;
+        files[i].score = 0;
+        files[i].hits_seen = __atomic_load_n(&g_shared->hits[i], __ATOMIC_RELAXED);
+        STATS_ADD(pcache_bytes, (int64_t)g_build.bytes);
+        STATS_ADD(pcache_files, 1);
+        STATS_INC(pcache_builds);
+        tftp_log(TFTP_LOG_INFO, "Packet cache: '%s' at blksize %u, %u packets (%llu of %llu bytes in use).\n",
+                 g_build.name, g_build.key.blksize, g_build.count, (unsigned long long)g_used,
+                 (unsigned long long)g_budget);
+    } else {
+        tftp_log(TFTP_LOG_DEBUG, "Packet cache: '%s' changed or failed to read; set not built.\n", g_build.name);
+        munmap(g_build.packets, g_build.bytes);
+        g_used -= g_build.bytes;
+    }
+    close(g_build.fd);
+    g_build.index = -1;
+}
+
+// Reads up to PCACHE_BUILD_STEP bytes of the set, and seals it after the last
+// block if the file still has the size and mtime it had at the start
+static void build_step(void) {
+    size_t stride = (size_t)TFTP_HEADER_SIZE + g_build.key.blksize;
+    uint64_t done = 0;
+    struct stat st;
+
+    while (g_build.next <= g_build.count && done < PCACHE_BUILD_STEP) {
+        uint32_t block = g_build.next;
+        uint64_t offset = (uint64_t)(block - 1) * g_build.key.blksize;
+        size_t n = block < g_build.count ? g_build.key.blksize : (size_t)(g_build.key.size - offset);
+        char *packet = g_build.packets + (size_t)(block - 1) * stride;
+
+        if (n > 0 && pread(g_build.fd, packet + TFTP_HEADER_SIZE, n, (off_t)(g_build.base + offset)) != (ssize_t)n) {
+            build_end(0); // Shorter than it was: truncated under us
+            return;
+        }
+        tftp_encode_data(packet, stride, (uint16_t)block, packet + TFTP_HEADER_SIZE, n);
+        g_build.crc = tftp_crc32c(g_build.crc, packet + TFTP_HEADER_SIZE, n);
+        g_build.next++;
+        done += n + TFTP_HEADER_SIZE;
+    }
+    if (g_build.next > g_build.count) {
+        build_end(fstat(g_build.fd, &st) == 0 && st.st_size == g_build.file_size &&
+                  st.st_mtim.tv_sec == g_build.file_mtime.tv_sec &&
+                  st.st_mtim.tv_nsec == g_build.file_mtime.tv_nsec);
+    }
+}
+
+// Opens 'name' the way a transfer would and, when a set is worth it, starts
+// building one
+static void build_start(const char *name, uint16_t blksize, uint32_t misses) {
+    const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, name);
+    struct tftp_source source;
+    struct pcache_key key;
+    struct stat st;
+    int fd = -1;
+
+    // Archive entries are read from the archive file, like in-process sessions do
+    if (entry != NULL) {
+        fd = open(g_config.archive_path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && (fstat(fd, &st) < 0 || st.st_dev != g_archive.dev || st.st_ino != g_archive.ino ||
+                        source_key(-1, entry, blksize, &key) < 0)) {
+            close(fd); // Replaced and not mapped yet, or too big
+            fd = -1;
+        }
+    } else if (tftp_source_open(&source, name, 1, g_config.cache_dir) == 0) {
+        if (source.codec == TFTP_SOURCE_PLAIN && source_key(source.fd, NULL, blksize, &key) == 0) {
+            fd = fcntl(source.fd, F_DUPFD_CLOEXEC, 0);
+        }
+        tftp_source_close(&source);
+        if (fd >= 0 && fstat(fd, &st) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        return;
+    }
+    for (int i = 0; i < PCACHE_MAX_FILES; i++) {
+        if (files[i].packets != NULL && key_equal(&files[i].key, &key)) {
+            close(fd); // Already built
+            return;
+        }
+    }
+    int index = make_room(set_bytes(key.size, blksize), misses);
+    size_t bytes = (size_t)set_bytes(key.size, blksize);
+    char *packets = index >= 0 ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                               : MAP_FAILED;
+    if (packets == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    // Transfers forked while it is written would keep copies of the pages it touches
+    madvise(packets, bytes, MADV_DONTFORK);
+    g_used += bytes; // Held for it from now on
+
+    g_build.index = index;
+    g_build.fd = fd;
+    g_build.base = entry != NULL ? entry->offset : 0;
+    g_build.file_size = st.st_size;
+    g_build.file_mtime = st.st_mtim;
+    g_build.key = key;
+    g_build.packets = packets;
+    g_build.bytes = bytes;
+    g_build.count = packet_count(key.size, blksize);
+    g_build.next = 1;
+    g_build.crc = 0;
+    snprintf(g_build.name, sizeof(g_build.name), "%s", name);
+}
+
+int pcache_timeout_ms(void) {
+    return g_build.index >= 0 ? 0 : -1;
+}
+
+void pcache_refresh(uint64_t now_us) {
+    if (g_shared == NULL) {
+        return;
+    }
+    if (g_build.index >= 0) {
+        build_step();
+    }
+    if (now_us - g_last_scan_us < PCACHE_SCAN_US) {
+        return;
+    }
+    g_last_scan_us = now_us;
+
+    // Hits since the last scan, with older scans fading
+    for (int i = 0; i < PCACHE_MAX_FILES; i++) {
+        if (files[i].packets != NULL) {
+            uint64_t hits = __atomic_load_n(&g_shared->hits[i], __ATOMIC_RELAXED);
+            files[i].score = files[i].score / 2 + (hits - files[i].hits_seen);
+            files[i].hits_seen = hits;
+        }
+    }
+
+    for (int i = 0; i < PCACHE_DEMAND_SLOTS; i++) {
+        struct pcache_demand *d = &g_shared->demand[i];
+        uint64_t tag = __atomic_load_n(&d->tag, __ATOMIC_ACQUIRE);
+        uint32_t misses = __atomic_load_n(&d->misses, __ATOMIC_RELAXED);
+        char name[PCACHE_NAME_MAX];
+
+        if (g_build.index >= 0) {
+            break; // One set at a time; the rest keep their misses for later scans
+        }
+        if (tag == 0 || misses < PCACHE_HOT_MISSES) {
+            continue;
+        }
+        uint16_t blksize = d->blksize;
+        memcpy(name, d->name, sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        // Counted again from zero whether or not the set gets built
+        if (!__atomic_compare_exchange_n(&d->tag, &tag, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) ||
+            demand_tag(name, blksize) != tag) {
+            continue;
+        }
+        __atomic_store_n(&d->misses, 0, __ATOMIC_RELAXED);
+        build_start(name, blksize, misses);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef TFTP_PACKET_CACHE_H
+#define TFTP_PACKET_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tftpArchive.h"
+
+// --- PRE-ENCODED DATA PACKETS FOR HOT FILES ---
+//
+// A read transfer normally reads every block into its packet buffer and
+// encodes the header in front of it. For the few files that draw most of the
+// requests, the parent keeps the file split into finished DATA packets, one
+// set per blksize it is asked for, and transfers send those as they are: no
+// read, no copy, no encoding. Block i always goes out numbered i mod 2^16, so
+// even the block numbers are written once, when the set is built. A
+// retransmission resends the same buffer.
+//
+// The parent builds a set and makes it read-only. Transfers forked after that
+// inherit it, and since nobody writes to it, all of them share its pages with
+// the parent. A set dropped from the cache stays valid in the transfers that
+// still use it; its memory is freed when the last of them exits.
+//
+// Transfers that find no set for their file and blksize count a miss in a
+// MAP_SHARED demand table, where a file's misses wear down those of others
+// hashed to the same slot. A few times a second the parent picks a file with
+// PCACHE_HOT_MISSES misses, up to the memory budget (-C), of which one set
+// may take a quarter. It reads the file into the set with pread(), a slice
+// per main loop iteration, and keeps the set only if the file's size and
+// mtime did not change meanwhile. When the budget is full, a file replaces the
+// set with the fewest recent hits (hits per scan, each older scan counting
+// half as much), but only when it has more misses than that set's score.
+//
+// Plain files, decompressed copies from the cache directory and archive
+// entries are cached; octet mode only. A file is known by device, inode,
+// size and mtime (archive entries by the archive's and their offset in it),
+// so a replaced file is never served from an old set.
+
+#define PCACHE_BUDGET_DEFAULT (64u << 20)
+#define PCACHE_MAX_FILES 64         // Sets kept at once
+#define PCACHE_HOT_MISSES 4         // Misses before a file gets a set
+#define PCACHE_SCAN_US 100000       // Demand table checked at most this often
+#define PCACHE_BUILD_STEP (256u << 10) // Bytes of a set read per main loop iteration
+#define PCACHE_DEMAND_SLOTS 256
+#define PCACHE_NAME_MAX 128
+
+struct pcache_key {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t offset;                // Archive entries: of their data; 0 for files
+    uint64_t size;
+    int64_t mtime_ns;
+    uint16_t blksize;
+};
+
+// One file at one blksize: 'count' packets of TFTP_HEADER_SIZE + blksize
+// bytes back to back, the last one short
+struct pcache_file {
+    struct pcache_key key;
+    const char *packets;            // NULL when the entry is free
+    size_t bytes;                   // Of the mapping
+    uint32_t count;
+    uint32_t crc;                   // CRC32C of the file
+    uint32_t users;                 // Transfers in this process using it (XDP)
+    uint64_t score;                 // Parent: decayed hits per scan
+    uint64_t hits_seen;             // Parent: shared hit count at the last scan
+};
+
+// Maps the demand table; must run before the first fork. 0 disables the cache.
+int pcache_init(uint64_t budget);
+
+// --- Transfers ---
+// The set for 'filename', read from 'fd' (a plain file; -1 for others) or
+// from the archive when 'entry' is set, or NULL, counting a miss for the
+// parent. Hold it until the transfer ends.
+const struct pcache_file *pcache_find(const char *filename, int fd, const struct tftp_archive_entry *entry,
+                                      uint16_t blksize);
+void pcache_put(const struct pcache_file *f);
+// DATA 'block' (1-based) and its length; NULL past the end
+const char *pcache_packet(const struct pcache_file *f, uint32_t block, size_t *len);
+
+// --- Parent ---
+// Builds sets for files in demand, a step at a time; call from the main loop
+void pcache_refresh(uint64_t now_us);
+int pcache_timeout_ms(void);        // 0 while a set is being built, else -1
+
+#endif
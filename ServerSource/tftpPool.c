@@ -0,0 +1,176 @@
+#include "tftpServer.h"
+#include "tftpPool.h"
+
+struct pool_socket {
+    int fd;
+    pid_t pid;                      // Transfer holding it, 0 when free
+};
+
+// Parent only; children just use the descriptor they were given
+static struct pool_socket sockets[POOL_MAX_SOCKETS];
+static uint32_t socket_count;
+static uint32_t free_fifo[POOL_MAX_SOCKETS]; // Oldest return first
+static uint32_t free_head, free_count;
+static int fixed_range;
+
+int pool_parse(const char *text, struct pool_config *config) {
+    char *end;
+    unsigned long first = strtoul(text, &end, 10);
+
+    if (end == text) {
+        return -1;
+    }
+    if (*end == '\0') {
+        if (first > POOL_MAX_SOCKETS) {
+            return -1;
+        }
+        config->size = (uint32_t)first;
+        config->first_port = config->last_port = 0;
+        return 0;
+    }
+    if (*end != '-') {
+        return -1;
+    }
+    const char *last_text = end + 1;
+    unsigned long last = strtoul(last_text, &end, 10);
+    if (end == last_text || *end != '\0' || first == 0 || last > 65535 || first > last ||
+        last - first + 1 > POOL_MAX_SOCKETS) {
+        return -1;
+    }
+    config->first_port = (uint16_t)first;
+    config->last_port = (uint16_t)last;
+    config->size = (uint32_t)(last - first + 1);
+    return 0;
+}
+
+// A UDP socket bound to 'port' (0: any), with DF set for negotiated blksizes
+static int open_transfer_socket(uint16_t port) {
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (tftp_pmtu_enable(fd) < 0) {
+        perror("IP_MTU_DISCOVER failed");
+    }
+    if (g_config.spin_us > 0 && tftp_latency_socket(fd, g_config.spin_us) < 0) {
+        perror("SO_BUSY_POLL failed");
+    }
+    return fd;
+}
+
+int pool_init(const struct pool_config *config) {
+    fixed_range = config->last_port != 0;
+    for (uint32_t i = 0; i < config->size; i++) {
+        uint16_t port = fixed_range ? (uint16_t)(config->first_port + i) : 0;
+        int fd = open_transfer_socket(port);
+        if (fd < 0) {
+            tftp_log(TFTP_LOG_WARN, "Cannot bind transfer port %u: %s\n", port, strerror(errno));
+            continue;
+        }
+        sockets[socket_count].fd = fd;
+        free_fifo[free_count++] = socket_count++;
+    }
+    if (fixed_range && socket_count == 0) {
+        tftp_log(TFTP_LOG_ERROR, "No transfer port in %u-%u could be bound.\n", config->first_port,
+                 config->last_port);
+        return -1;
+    }
+    if (socket_count > 0) {
+        tftp_log(TFTP_LOG_INFO, "Transfer socket pool: %u sockets%s.\n", socket_count,
+                 fixed_range ? " on the configured ports" : "");
+    }
+    return 0;
+}
+
+int pool_available(void) {
+    return !fixed_range || free_count > 0;
+}
+
+// Datagrams that reached a returned socket after its transfer ended
+static void drain(int fd) {
+    char buf[MAX_PACKET_SIZE];
+
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {
+        STATS_INC(pool_stale);
+    }
+}
+
+void pool_wait(void) {
+    STATS_INC(pool_waits);
+}
+
+int pool_lease(int *index, uint64_t waiting_since_us) {
+    uint64_t since_us = waiting_since_us != 0 ? waiting_since_us : stats_now_us();
+    int fd = -1;
+
+    *index = -1;
+    if (free_count > 0) {
+        uint32_t i = free_fifo[free_head];
+        free_head = (free_head + 1) % POOL_MAX_SOCKETS;
+        free_count--;
+        drain(sockets[i].fd);
+        STATS_INC(pool_hits);
+        *index = (int)i;
+        fd = sockets[i].fd;
+    } else if (!fixed_range) {
+        STATS_INC(pool_misses);
+        fd = open_transfer_socket(0);
+    }
+    if (fd >= 0) {
+        stats_socket_wait(stats_now_us() - since_us);
+    }
+    return fd;
+}
+
+int pool_reserve(int *fds, int max) {
+    int n = 0;
+
+    if (!fixed_range) {
+        return 0;
+    }
+    if (free_count < 2) {
+        return -1;
+    }
+    // The half taken is never lent again; the other half stays for forked transfers
+    uint32_t keep = free_count - free_count / 2;
+    while (n < max && free_count > keep) {
+        uint32_t i = free_fifo[free_head];
+        free_head = (free_head + 1) % POOL_MAX_SOCKETS;
+        free_count--;
+        sockets[i].pid = getpid();
+        fds[n++] = sockets[i].fd;
+    }
+    return n;
+}
+
+void pool_bind(int index, pid_t pid) {
+    if (index >= 0) {
+        sockets[index].pid = pid;
+    }
+}
+
+void pool_release(int index) {
+    if (index >= 0) {
+        sockets[index].pid = 0;
+        free_fifo[(free_head + free_count++) % POOL_MAX_SOCKETS] = (uint32_t)index;
+    }
+}
+
+void pool_reaped(pid_t pid) {
+    for (uint32_t i = 0; i < socket_count; i++) {
+        if (sockets[i].pid == pid) {
+            pool_release((int)i);
+            return;
+        }
+    }
+}
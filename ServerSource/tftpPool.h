@@ -0,0 +1,55 @@
+#ifndef TFTP_POOL_H
+#define TFTP_POOL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// --- TRANSFER SOCKET POOL ---
+//
+// Every transfer answers from its own UDP port, its TID (RFC 1350). Rather
+// than opening and binding a socket per request, the parent binds a pool of
+// them at startup and lends one to each forked transfer. It takes the socket
+// back when it reaps the child. Returned sockets queue behind the free ones,
+// so a port rests as long as the pool allows before it is lent again.
+//
+// A reused port may still receive packets meant for the transfer before: a
+// late ACK, or a retransmitted DATA. Whatever is queued on the socket is
+// discarded when it is lent. Anything arriving later comes from the wrong
+// TID, and the transfer answers it with ERROR 5 and ignores it (tftpIo.c).
+//
+// With a port range (-P first-last, e.g. for a firewall rule), transfers use
+// those ports and no others: while all are lent, requests wait in the
+// admission queue (tftpSched.h). Otherwise a transfer that finds the pool
+// empty gets a fresh socket on an ephemeral port, closed when it exits.
+
+#define POOL_SIZE_DEFAULT 64
+#define POOL_MAX_SOCKETS 4096
+
+struct pool_config {
+    uint32_t size;                  // Sockets bound up front, 0 = none
+    uint16_t first_port;            // With last_port: exactly these ports
+    uint16_t last_port;
+};
+
+// "<n>" sockets on ephemeral ports, or "<first>-<last>"; -1 on error
+int pool_parse(const char *text, struct pool_config *config);
+// Binds the pool; -1 (logged) when a port range cannot be bound at all
+int pool_init(const struct pool_config *config);
+
+// --- Parent ---
+int pool_available(void);           // A transfer can get a socket now
+void pool_wait(void);               // The request just queued because none could
+// With a port range, takes up to 'max' of its sockets, and at most half of
+// them, out of the pool for good, for transfers served in this process
+// (tftpSessions.h). Their count, 0 without a range, -1 when the range has
+// too few ports to share.
+int pool_reserve(int *fds, int max);
+// A socket for the next transfer, or -1. *index is its pool entry, -1 for
+// a fresh socket the caller closes once the child has it. 'waiting_since_us'
+// is when a request that queued for a port arrived, 0 for one that did not.
+int pool_lease(int *index, uint64_t waiting_since_us);
+void pool_bind(int index, pid_t pid);
+void pool_release(int index);       // Its transfer could not be started
+void pool_reaped(pid_t pid);        // pid's socket goes back into the pool
+
+#endif
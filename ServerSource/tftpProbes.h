@@ -0,0 +1,36 @@
+#ifndef TFTP_PROBES_H
+#define TFTP_PROBES_H
+
+// --- STATIC TRACEPOINTS (USDT, provider "tftpd") ---
+//
+// Built in when <sys/sdt.h> is available (the Makefile adds -DTFTP_USDT; on
+// Debian/Ubuntu it comes with systemtap-sdt-dev). A disabled probe is a single
+// nop in the instruction stream, so these stay compiled into production builds.
+// Without the header the macros expand to nothing. See TraceScripts/ for
+// bpftrace scripts that use them.
+//
+//   request__receive   (transfer_id, opcode, client_addr, client_port)
+//   transfer__fork     (transfer_id, child_pid)
+//   transfer__start    (transfer_id, opcode)
+//   data__send         (transfer_id, block, bytes, total_bytes)
+//   data__retransmit   (transfer_id, block, attempt)
+//   data__receive      (transfer_id, block, bytes, total_bytes)
+//   ack__receive       (transfer_id, block)
+//   ack__retransmit    (transfer_id, block, attempt)
+//   timeout            (transfer_id, block, retries)
+//   transfer__done     (transfer_id, result, total_bytes)
+
+#ifdef TFTP_USDT
+#include <sys/sdt.h>
+#define TFTP_PROBE1(name, a)                DTRACE_PROBE1(tftpd, name, a)
+#define TFTP_PROBE2(name, a, b)             DTRACE_PROBE2(tftpd, name, a, b)
+#define TFTP_PROBE3(name, a, b, c)          DTRACE_PROBE3(tftpd, name, a, b, c)
+#define TFTP_PROBE4(name, a, b, c, d)       DTRACE_PROBE4(tftpd, name, a, b, c, d)
+#else
+#define TFTP_PROBE1(name, a)                ((void)0)
+#define TFTP_PROBE2(name, a, b)             ((void)0)
+#define TFTP_PROBE3(name, a, b, c)          ((void)0)
+#define TFTP_PROBE4(name, a, b, c, d)       ((void)0)
+#endif
+
+#endif
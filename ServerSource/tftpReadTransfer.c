@@ -1,203 +1,129 @@
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <errno.h>
-#include <sys/select.h> // For select() and timeouts
+#include "tftpServer.h"
 
-// --- DEFINITIONS (Assuming these are defined globally or included from the main file) ---
-#define OP_RRQ  1
-#define OP_DATA 3
-#define OP_ACK  4
-#define OP_ERROR 5
-#define BLOCK_SIZE 512
-#define PACKET_BUF_SIZE (4 + BLOCK_SIZE)
-#define TIMEOUT_SEC 3  // Timeout in seconds
-#define MAX_RETRIES 5  // Maximum retransmissions
-
-// --- EXTERNAL HELPER FUNCTION PROTOTYPES ---
-// void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, int code, const char *message);
-void tftpReadTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                        socklen_t len, const char *filename);
-void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, 
-                int code, const char *message);
-                
-// Helper to construct and send a DATA packet
-ssize_t send_data(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, 
-                  uint16_t block, const char *data, ssize_t data_len, char *packet_buffer) {
+// --- CORE READ TRANSFER FUNCTION ---
+// The DATA/ACK state machine lives in the shared engine (CommonSource/tftpEngine.c);
+// this opens the file and drives the engine over the transfer's I/O backend.
+int tftpReadTransfer(const struct tftp_io *io, const struct sockaddr_in *cliaddr, 
+                     socklen_t len, const char *filename, const char *mode,
+                     const struct tftp_packet *req) {
     
-    // Construct the packet in the provided buffer
-    uint16_t *p = (uint16_t *)packet_buffer;
+    struct tftp_io_transfer t;
+    struct tftp_source source;
+    int result;
+    // Holds the DATA packet in flight; file data is read straight into it
+    char data_packet[MAX_PACKET_SIZE];
 
-    // Opcode: DATA (3)
-    *p++ = htons(OP_DATA);
-    // Block Number
-    *p++ = htons(block);
-    
-    // Copy data payload
-    memcpy(packet_buffer + 4, data, data_len);
-    ssize_t total_size = 4 + data_len;
-    
-    // Send the packet
-    return sendto(sockfd, packet_buffer, total_size, 0, 
-                  (const struct sockaddr *)cliaddr, len);
+    if (tftp_read_begin(&t, &source, data_packet, sizeof(data_packet), io, cliaddr, len,
+                        filename, mode, req) < 0) {
+        return -1;
+    }
+    result = tftp_io_run_engine(&t);
+    tftp_read_end(&t, &source, filename, result);
+    return result;
 }
 
+int tftp_read_begin(struct tftp_io_transfer *t, struct tftp_source *source, char *packet, size_t packet_cap,
+                    const struct tftp_io *io, const struct sockaddr_in *cliaddr, socklen_t len,
+                    const char *filename, const char *mode, const struct tftp_packet *req) {
+    char oack[PACKET_BUF_SIZE];
+    size_t oack_len = 0;
+    struct tftp_option options[2];
+    int option_count = 0;
+    char tsize_value[24], blksize_value[8];
+    uint16_t blksize = BLOCK_SIZE;
 
-// --- CORE READ TRANSFER FUNCTION ---
-void tftpReadTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                        socklen_t len, const char *filename) {
-    
-    int fd;
-    // Two buffers: one for reading file data, one for holding the last sent packet
-    char file_buffer[BLOCK_SIZE];
-    char last_data_packet[PACKET_BUF_SIZE];
-    char recv_buffer[PACKET_BUF_SIZE]; 
-    
-    uint16_t current_block = 1;
-    int retries = 0;
-    ssize_t last_data_size = 0; // Size of the last data payload sent
-    ssize_t last_packet_size = 0; // Total size of the last packet sent
-    
-    // 1. Open the file for reading
-    fd = open(filename, O_RDONLY);
-    if (fd < 0) {
+    // 1. Take the file from the archive when it has it; otherwise open it,
+    // or its compressed variant (octet only: netascii is not decompressed)
+    const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, filename);
+    t->io = io;
+    t->peer = *cliaddr; // Fixed for the whole transfer: packets from elsewhere get ERROR 5
+    t->peer_len = len;
+    t->netascii = strcasecmp(mode, "netascii") == 0;
+    memset(&t->encoder, 0, sizeof(t->encoder));
+    memset(&t->decoder, 0, sizeof(t->decoder));
+    t->crc = 0;
+    t->timeouts = 0;
+    t->packets = NULL;
+    TFTP_TRACE(TFTP_TRACE_START, OP_RRQ, (uint32_t)getpid());
+    if (entry != NULL) {
+        tftp_source_open_memory(source, filename, tftp_archive_data(&g_archive, entry), entry->size);
+        source->recorded = 1;
+        source->recorded_crc = entry->crc32c; // Computed by tftp_mkarchive
+    } else if (tftp_source_open(source, filename, !t->netascii, g_config.cache_dir) < 0) {
+        int open_errno = errno;
         if (errno == ENOENT) {
-            send_error(sockfd, cliaddr, len, 1, "File not found");
+            tftp_io_send_error(io, &t->peer, len, 1, "File not found");
         } else if (errno == EACCES) {
-            send_error(sockfd, cliaddr, len, 2, "Access violation (cannot read file)");
+            tftp_io_send_error(io, &t->peer, len, 2, "Access violation (cannot read file)");
         } else {
-            send_error(sockfd, cliaddr, len, 0, "Not defined error on file open");
+            tftp_io_send_error(io, &t->peer, len, 0, "Not defined error on file open");
         }
-        return;
+        TFTP_TRACE(TFTP_TRACE_END, 0, open_errno == ENOENT ? 1 : open_errno == EACCES ? 2 : 0);
+        return -1;
     }
+    t->fd = source->fd;
+    t->source = source;
 
-    printf("[Child PID %d] Starting RRQ transfer for file: %s\n", getpid(), filename);
-
-    // --- MAIN READ LOOP ---
-    while (1) {
-        ssize_t n;
-        struct timeval tv;
-        fd_set readfds;
-        int rv;
-        
-        // --- State: Send Data Block or Retransmit ---
-        if (retries == 0) { 
-            // New Block: Read file data and send it (only on the first attempt)
-            ssize_t bytes_read = read(fd, file_buffer, BLOCK_SIZE);
-            if (bytes_read < 0) {
-                perror("File read failed");
-                send_error(sockfd, cliaddr, len, 3, "I/O error during read");
-                break;
-            }
-            
-            // Construct and send the DATA packet. Store packet details for retransmission.
-            last_packet_size = send_data(sockfd, cliaddr, len, current_block, 
-                                         file_buffer, bytes_read, last_data_packet);
-            
-            if (last_packet_size < 0) {
-                perror("Failed to send DATA packet");
-                break;
-            }
-            last_data_size = bytes_read; // Keep track of the payload size
-
-            printf("[Child PID %d] Sent DATA %d (%zd bytes).\n", getpid(), current_block, bytes_read);
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Starting RRQ transfer for file: %s (%s)\n", getpid(), filename,
+             t->netascii ? "netascii" : "octet");
 
-            // Termination Check 1: If it was the last block, send it, then wait for final ACK.
-            if (bytes_read < BLOCK_SIZE) {
-                printf("[Child PID %d] Sent last block. Waiting for final ACK...\n", getpid());
-            }
-        } else {
-            // Retransmit: Resend the last packet stored in last_data_packet
-            if (sendto(sockfd, last_data_packet, last_packet_size, 0, 
-                       (const struct sockaddr *)cliaddr, len) < 0) {
-                perror("Failed to retransmit DATA packet");
-                break;
-            }
-            printf("[Child PID %d] Retransmitting DATA %d. Attempt %d/%d.\n", 
-                   getpid(), current_block, retries + 1, MAX_RETRIES);
-        }
-
-        // --- Timeout Setup (Wait for ACK) ---
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-        tv.tv_sec = TIMEOUT_SEC;
-        tv.tv_usec = 0;
+    // 2. RFC 2349: answer "tsize" with the size being sent. Netascii changes
+    // the length, so it is left unacknowledged there, as is an unknown size.
+    const char *tsize = req != NULL ? tftp_find_option(req, "tsize") : NULL;
+    if (tsize != NULL && !t->netascii && source->size != TFTP_SOURCE_SIZE_UNKNOWN) {
+        snprintf(tsize_value, sizeof(tsize_value), "%llu", (unsigned long long)source->size);
+        options[option_count++] = (struct tftp_option){"tsize", tsize_value};
+    }
+    // RFC 2348: as large a block as the path carries unfragmented
+    uint16_t requested = req != NULL ? tftp_option_blksize(req) : 0;
+    if (requested != 0) {
+        blksize = blksize_choose(&t->peer, requested, packet_cap);
+        snprintf(blksize_value, sizeof(blksize_value), "%u", blksize);
+        options[option_count++] = (struct tftp_option){"blksize", blksize_value};
+        STATS_INC(blksize_negotiated);
+        tftp_log(TFTP_LOG_INFO, "[Child PID %d] blksize %u (requested %u).\n", getpid(), blksize, requested);
+    }
+    if (option_count > 0) {
+        oack_len = tftp_encode_oack(oack, sizeof(oack), options, option_count);
+    }
 
-        // Use select() to wait for data with a timeout
-        rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
+    // 3. A hot file goes out as packets the parent already encoded
+    if (!t->netascii) {
+        t->packets = pcache_find(filename, source->codec == TFTP_SOURCE_PLAIN ? source->fd : -1, entry, blksize);
+    }
 
-        if (rv == -1) {
-            perror("select error");
-            send_error(sockfd, cliaddr, len, 0, "Server select error");
-            break;
-        } else if (rv == 0) {
-            // Timeout occurred
-            if (retries < MAX_RETRIES) {
-                retries++;
-                continue; // Loop again to retransmit
-            } else {
-                printf("[Child PID %d] Max retries reached. Aborting transfer.\n", getpid());
-                send_error(sockfd, cliaddr, len, 0, "Max retries reached, transfer aborted");
-                break;
-            }
-        }
-        
-        // --- Receive ACK packet ---
-        n = recvfrom(sockfd, recv_buffer, PACKET_BUF_SIZE, 0, 
-                     (struct sockaddr *)cliaddr, &len);
+    // 4. Send DATA 1 (or the OACK, then DATA 1 on ACK 0); the caller answers
+    // ACKs until the short final block is acknowledged
+    tftp_engine_init(&t->engine, TFTP_ENGINE_SEND, &tftp_io_engine_ops, t,
+                     packet, packet_cap, blksize);
+    t->engine.timeout_us = TIMEOUT_SEC * 1000000u;
+    t->engine.max_retries = MAX_RETRIES;
+    tftp_engine_start(&t->engine, oack_len > 0 ? oack : NULL, oack_len, io->now_us(io->ctx));
+    return 0;
+}
 
-        if (n < 4) {
-            fprintf(stderr, "[Child PID %d] Received short ACK/Error packet.\n", getpid());
-            // Treat as bad packet, let timeout handle retransmission
-            continue; 
+void tftp_read_end(struct tftp_io_transfer *t, struct tftp_source *source, const char *filename, int result) {
+    // 5. Every byte of the file went out; check it against a recorded digest
+    if (result == 0) {
+        uint32_t crc = tftp_io_digest(t), stored = source->recorded_crc;
+        int recorded = source->recorded;
+        tftp_source_finish(source, crc);
+        if (!recorded && source->codec == TFTP_SOURCE_PLAIN) {
+            recorded = tftp_digest_load(t->fd, source->path, &stored) == 0;
         }
-
-        uint16_t opcode = ntohs(*(uint16_t *)recv_buffer);
-        uint16_t block_num = ntohs(*(uint16_t *)(recv_buffer + 2));
-        
-        // --- ACK Protocol Logic ---
-        if (opcode == OP_ACK) {
-            if (block_num == current_block) {
-                // 3. Expected ACK Received: Prepare for next block
-                printf("[Child PID %d] Received ACK %d.\n", getpid(), block_num);
-                
-                // Termination Check 2: If the block we just ACKed was the last block (data < 512)
-                if (last_data_size < BLOCK_SIZE) {
-                    printf("[Child PID %d] Final ACK received. Transfer finished.\n", getpid());
-                    break;
-                }
-                
-                // Advance to the next block
-                current_block++;
-                retries = 0; // Reset retries on successful ACK
-                // Loop will now read the next block from the file
-            } else if (block_num < current_block) {
-                // Received an old ACK (Client might have received duplicate DATA)
-                printf("[Child PID %d] Received old ACK %d. Ignoring.\n", getpid(), block_num);
-                retries = 0; // Reset retries, as communication is fine
-            } else {
-                // ACK number is too high (Protocol error)
-                send_error(sockfd, cliaddr, len, 4, "Illegal TFTP operation (unexpected ACK)");
-                break;
-            }
-        } else if (opcode == OP_ERROR) {
-            // Client sent an ERROR packet, aborting transfer
-            printf("[Child PID %d] Client reported error. Aborting.\n", getpid());
-            break;
+        if (recorded && stored != crc) {
+            tftp_log(TFTP_LOG_WARN, "[Child PID %d] Sent '%s' with crc32c %08x, but %08x was recorded for it.\n",
+                     getpid(), filename, crc, stored);
         } else {
-            // Received something other than ACK or ERROR
-            send_error(sockfd, cliaddr, len, 4, "Illegal TFTP operation (unexpected opcode)");
-            break;
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Sent '%s': crc32c %08x.\n", getpid(), filename, crc);
         }
     }
 
     // --- CLEANUP ---
-    close(fd);
-}
\ No newline at end of file
+    blksize_transfer_end(&t->peer, t->engine.blksize, t->timeouts);
+    TFTP_TRACE(TFTP_TRACE_END, result == 0, t->engine.error_code);
+    tftp_trace_flush();
+    tftp_source_close(source);
+    pcache_put(t->packets);
+    TFTP_PROBE3(transfer__done, g_transfer_id, result, t->engine.bytes);
+}
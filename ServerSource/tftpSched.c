@@ -0,0 +1,328 @@
+#include "tftpServer.h"
+#include "tftpSched.h"
+
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+struct sched_bucket {
+    uint32_t key;                   // Client address or subnet, host order
+    uint32_t used;
+    int64_t tokens;                 // Bytes; negative after a block overdrew it
+    uint64_t last_us;
+};
+
+struct sched_flow {
+    int32_t pid;                    // Transfer holding the slot, 0 when free
+    int32_t backlogged;             // Waiting in sched_pace() for its turn
+    int64_t deficit;                // DRR credit, bytes
+    int64_t want;                   // Bytes it is waiting to move
+};
+
+struct sched_shared {
+    int32_t lock;                   // pid of the holder, 0 when free
+    struct sched_config config;
+    int64_t tokens;                 // total_rate bucket
+    uint64_t last_us;
+    uint32_t next;                  // DRR: next slot to get a turn
+    struct sched_flow flows[SCHED_MAX_TRANSFERS];
+    struct sched_bucket clients[SCHED_BUCKETS];
+    struct sched_bucket subnets[SCHED_BUCKETS];
+};
+
+static struct sched_shared *g_sched;
+int g_sched_slot = -1;
+
+// Parent only: free slots, the client each slot serves, and waiting requests
+static uint32_t free_slots[SCHED_MAX_TRANSFERS];
+static struct sockaddr_in slot_client[SCHED_MAX_TRANSFERS];
+static uint32_t free_count;
+static struct sched_request queue[SCHED_QUEUE_LEN];
+static size_t queue_head, queue_count;
+
+int sched_init(const struct sched_config *config) {
+    void *mem = mmap(NULL, sizeof(struct sched_shared), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("sched mmap failed");
+        return -1;
+    }
+    g_sched = mem;
+    g_sched->config = *config;
+    if (g_sched->config.max_transfers > SCHED_MAX_TRANSFERS) {
+        g_sched->config.max_transfers = SCHED_MAX_TRANSFERS;
+    }
+    if (g_sched->config.subnet_prefix > 32) {
+        g_sched->config.subnet_prefix = 32;
+    }
+    for (uint32_t i = 0; i < g_sched->config.max_transfers; i++) {
+        free_slots[free_count++] = g_sched->config.max_transfers - 1 - i;
+    }
+    return 0;
+}
+
+int sched_parse_rate(const char *text, uint64_t *rate) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text) {
+        return -1;
+    }
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *rate = value;
+    return 0;
+}
+
+// --- PARENT: SLOTS AND THE ADMISSION QUEUE ---
+
+int sched_slot_acquire(void) {
+    if (g_sched == NULL || free_count == 0) {
+        return -1;
+    }
+    return (int)free_slots[--free_count];
+}
+
+void sched_slot_release(int slot) {
+    struct sched_flow *f = &g_sched->flows[slot];
+
+    __atomic_store_n(&f->pid, 0, __ATOMIC_RELEASE);
+    memset(&slot_client[slot], 0, sizeof(slot_client[slot]));
+    f->backlogged = 0;
+    f->deficit = 0;
+    free_slots[free_count++] = (uint32_t)slot;
+}
+
+void sched_slot_bind(int slot, pid_t pid, const struct sockaddr_in *cliaddr) {
+    slot_client[slot] = *cliaddr;
+    __atomic_store_n(&g_sched->flows[slot].pid, (int32_t)pid, __ATOMIC_RELEASE);
+}
+
+int sched_reaped(pid_t pid) {
+    if (g_sched == NULL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < g_sched->config.max_transfers; i++) {
+        if (g_sched->flows[i].pid == (int32_t)pid) {
+            sched_slot_release((int)i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int sched_waiting(void) {
+    return queue_count > 0;
+}
+
+static int same_client(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+int sched_known(const struct sockaddr_in *cliaddr) {
+    for (size_t i = 0; i < queue_count; i++) {
+        if (same_client(&queue[(queue_head + i) % SCHED_QUEUE_LEN].cliaddr, cliaddr)) {
+            return 1;
+        }
+    }
+    // A late retransmission of a request that already has its transfer
+    for (uint32_t i = 0; g_sched != NULL && i < g_sched->config.max_transfers; i++) {
+        if (g_sched->flows[i].pid != 0 && same_client(&slot_client[i], cliaddr)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int sched_enqueue(const char *buffer, size_t len, const struct sockaddr_in *cliaddr, socklen_t cliaddr_len,
+                  uint32_t transfer_id, uint64_t received_us, int port_wait) {
+    if (queue_count == SCHED_QUEUE_LEN || len > SCHED_MAX_REQUEST) {
+        STATS_INC(requests_shed);
+        return -1;
+    }
+    struct sched_request *r = &queue[(queue_head + queue_count++) % SCHED_QUEUE_LEN];
+    memcpy(r->buffer, buffer, len);
+    r->len = len;
+    r->cliaddr = *cliaddr;
+    r->cliaddr_len = cliaddr_len;
+    r->transfer_id = transfer_id;
+    r->received_us = received_us;
+    r->port_wait = port_wait;
+    STATS_INC(requests_queued);
+    STATS_ADD(queue_depth, 1);
+    return 0;
+}
+
+int sched_dequeue(struct sched_request *out, uint64_t now_us) {
+    while (queue_count > 0) {
+        *out = queue[queue_head];
+        queue_head = (queue_head + 1) % SCHED_QUEUE_LEN;
+        queue_count--;
+        STATS_ADD(queue_depth, -1);
+        // The client stopped retrying long ago; it would not take DATA 1
+        if (now_us - out->received_us <= g_sched->config.queue_timeout_us) {
+            return 0;
+        }
+        STATS_INC(requests_shed);
+    }
+    return -1;
+}
+
+// --- TRANSFER: PACING ---
+
+static void sched_lock(void) {
+    int32_t self = (int32_t)getpid();
+
+    for (int spins = 0;; spins++) {
+        int32_t holder = 0;
+        if (__atomic_compare_exchange_n(&g_sched->lock, &holder, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        // A transfer killed while holding the lock must not stall the rest
+        if (spins >= 1000 && kill(holder, 0) < 0 && errno == ESRCH) {
+            __atomic_compare_exchange_n(&g_sched->lock, &holder, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            spins = 0;
+        }
+        sched_yield();
+    }
+}
+
+static void sched_unlock(void) {
+    __atomic_store_n(&g_sched->lock, 0, __ATOMIC_RELEASE);
+}
+
+// Burst allowance: a tenth of a second at the rate, at least a few blocks
+static int64_t burst(uint64_t rate) {
+    return rate / 10 > 4 * SCHED_QUANTUM ? (int64_t)(rate / 10) : 4 * SCHED_QUANTUM;
+}
+
+static void refill(int64_t *tokens, uint64_t *last_us, uint64_t rate, uint64_t now_us) {
+    if (now_us <= *last_us) {
+        return;
+    }
+    uint64_t elapsed = now_us - *last_us < 10000000u ? now_us - *last_us : 10000000u;
+    uint64_t earned = elapsed * rate / 1000000u;
+    *tokens += (int64_t)earned;
+    *last_us += earned * 1000000u / rate; // The fraction of a token not yet earned carries over
+    if (*tokens >= burst(rate) || elapsed == 10000000u) {
+        *tokens = *tokens < burst(rate) ? *tokens : burst(rate);
+        *last_us = now_us;
+    }
+}
+
+// Microseconds until 'tokens' is back to 'need' at 'rate'
+static uint64_t wait_for(int64_t tokens, int64_t need, uint64_t rate) {
+    return tokens >= need ? 0 : (uint64_t)(need - tokens) * 1000000u / rate + 1;
+}
+
+// Direct-mapped: a colliding key takes the bucket over with a full allowance
+static struct sched_bucket *bucket(struct sched_bucket *table, uint32_t key, uint64_t rate, uint64_t now_us) {
+    struct sched_bucket *b = &table[(key * 2654435761u) >> (32 - SCHED_BUCKET_BITS)];
+
+    if (!b->used || b->key != key) {
+        b->used = 1;
+        b->key = key;
+        b->tokens = burst(rate);
+        b->last_us = now_us;
+    } else {
+        refill(&b->tokens, &b->last_us, rate, now_us);
+    }
+    return b;
+}
+
+// Deficit round robin on the total_rate bucket. Whoever holds the lock hands
+// out whole quanta, in slot order, to every transfer that is waiting; a
+// transfer proceeds once its own deficit covers its block. 0 = go ahead.
+static uint64_t drr_turn(size_t bytes, uint64_t now_us) {
+    const struct sched_config *c = &g_sched->config;
+    struct sched_flow *me = &g_sched->flows[g_sched_slot];
+
+    refill(&g_sched->tokens, &g_sched->last_us, c->total_rate, now_us);
+    if (me->deficit < (int64_t)bytes) {
+        me->backlogged = 1;
+        me->want = (int64_t)bytes;
+    }
+    while (g_sched->tokens >= SCHED_QUANTUM) {
+        struct sched_flow *f = NULL;
+        for (uint32_t n = 0; n < c->max_transfers && f == NULL; n++) {
+            uint32_t i = g_sched->next;
+            g_sched->next = (i + 1) % c->max_transfers;
+            if (g_sched->flows[i].backlogged) {
+                f = &g_sched->flows[i];
+            }
+        }
+        if (f == NULL) {
+            break;
+        }
+        f->deficit += SCHED_QUANTUM;
+        g_sched->tokens -= SCHED_QUANTUM;
+        if (f->deficit >= f->want) {
+            f->backlogged = 0;
+        }
+    }
+    if (me->deficit >= (int64_t)bytes) {
+        me->deficit -= (int64_t)bytes;
+        me->backlogged = 0;
+        return 0;
+    }
+    return wait_for(g_sched->tokens, SCHED_QUANTUM, c->total_rate);
+}
+
+uint64_t sched_pace(const struct sockaddr_in *peer, size_t bytes) {
+    uint64_t slept_us = 0;
+
+    if (g_sched == NULL || g_sched_slot < 0) {
+        return 0;
+    }
+    const struct sched_config *c = &g_sched->config;
+    if (c->client_rate == 0 && c->subnet_rate == 0 && c->total_rate == 0) {
+        return 0;
+    }
+    uint32_t addr = ntohl(peer->sin_addr.s_addr);
+    uint32_t subnet = c->subnet_prefix == 0 ? 0 : addr & ~(uint32_t)((1ull << (32 - c->subnet_prefix)) - 1);
+
+    while (1) {
+        uint64_t now_us = stats_now_us(), wait_us = 0, w;
+        struct sched_bucket *cb = NULL, *sb = NULL;
+
+        sched_lock();
+        if (c->client_rate != 0) {
+            cb = bucket(g_sched->clients, addr, c->client_rate, now_us);
+            wait_us = wait_for(cb->tokens, 0, c->client_rate);
+        }
+        if (c->subnet_rate != 0) {
+            sb = bucket(g_sched->subnets, subnet, c->subnet_rate, now_us);
+            w = wait_for(sb->tokens, 0, c->subnet_rate);
+            wait_us = w > wait_us ? w : wait_us;
+        }
+        if (wait_us == 0 && c->total_rate != 0) {
+            wait_us = drr_turn(bytes, now_us);
+        }
+        if (wait_us == 0) {
+            // Paid after the fact: the next block waits for this one
+            if (cb != NULL) {
+                cb->tokens -= (int64_t)bytes;
+            }
+            if (sb != NULL) {
+                sb->tokens -= (int64_t)bytes;
+            }
+        }
+        sched_unlock();
+        if (wait_us == 0) {
+            return slept_us;
+        }
+
+        struct timespec ts = { (time_t)(wait_us / 1000000u), (long)(wait_us % 1000000u) * 1000 };
+        STATS_INC(pacing_waits);
+        STATS_ADD(paced_us, wait_us);
+        nanosleep(&ts, NULL);
+        slept_us += wait_us;
+    }
+}
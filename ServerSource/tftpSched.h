@@ -0,0 +1,86 @@
+#ifndef TFTP_SCHED_H
+#define TFTP_SCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// --- ADMISSION CONTROL AND BANDWIDTH SHARING ---
+//
+// The parent admits at most sched_config.max_transfers forked transfers at
+// once. Requests beyond that wait, unanswered, in a bounded FIFO and start
+// as transfers finish. A client retransmitting its request while it waits,
+// or once its transfer runs, gets no second transfer; a request older than a
+// client's retry budget is dropped rather than started. Nothing is answered
+// with an error, so a client under load simply backs off and retries.
+//
+// Inside a transfer, sched_pace() runs before every DATA block is sent (RRQ)
+// or acknowledged (WRQ), and sleeps as long as the budgets require:
+//
+//   per client   one token bucket per client address       (client_rate)
+//   per subnet   one token bucket per /subnet_prefix        (subnet_rate)
+//   overall      deficit round robin over the transfers     (total_rate)
+//                waiting to send, one quantum per turn
+//
+// With DRR, a transfer that moves a block every RTT and one that could fill
+// the link get equal turns, so a few large uploads cannot crowd out many
+// small boot-file fetches. Rates are bytes per second; 0 disables a limit.
+// All of this state is shared between the forked transfers. It lives in a
+// MAP_SHARED mapping made before the first fork, guarded by one lock that
+// each holder takes for a few hundred instructions.
+
+#define SCHED_MAX_TRANSFERS 4096    // Upper bound for max_transfers
+#define SCHED_QUEUE_LEN 1024        // Requests waiting for admission
+#define SCHED_BUCKET_BITS 12
+#define SCHED_BUCKETS (1 << SCHED_BUCKET_BITS) // Client and subnet buckets (direct-mapped)
+#define SCHED_QUANTUM 1024          // DRR bytes per turn; one DATA block fits
+#define SCHED_MAX_REQUEST 516       // Longest request kept in the queue
+
+struct sched_config {
+    uint32_t max_transfers;         // Concurrent forked transfers
+    uint64_t client_rate;
+    uint64_t subnet_rate;
+    uint32_t subnet_prefix;         // Bits of the address naming a subnet
+    uint64_t total_rate;
+    uint64_t queue_timeout_us;      // Queued requests older than this are dropped
+};
+
+// A request the parent queued, to be started once a transfer slot frees up
+struct sched_request {
+    char buffer[SCHED_MAX_REQUEST];
+    size_t len;
+    struct sockaddr_in cliaddr;
+    socklen_t cliaddr_len;
+    uint32_t transfer_id;           // g_transfer_id it was given on arrival
+    uint64_t received_us;
+    int port_wait;                  // Queued because every transfer port was lent out
+};
+
+extern int g_sched_slot;            // Slot of this transfer child, -1 in the parent
+
+// Maps the shared state; must run before the first fork
+int sched_init(const struct sched_config *config);
+
+// --- Parent ---
+int sched_slot_acquire(void);       // A free transfer slot, or -1 at the cap
+void sched_slot_release(int slot);  // The slot's transfer could not be started
+void sched_slot_bind(int slot, pid_t pid, const struct sockaddr_in *cliaddr);
+int sched_reaped(pid_t pid);        // 1 if pid held a transfer slot, now free
+int sched_waiting(void);            // Requests are queued
+int sched_known(const struct sockaddr_in *cliaddr); // The client waits or is being served
+int sched_enqueue(const char *buffer, size_t len, const struct sockaddr_in *cliaddr, socklen_t cliaddr_len,
+                  uint32_t transfer_id, uint64_t received_us, int port_wait);   // -1 when full
+// Oldest queued request that is still worth starting (0), or -1 when none is
+int sched_dequeue(struct sched_request *out, uint64_t now_us);
+
+// --- Transfer child ---
+// Waits until 'bytes' more of DATA may move to or from 'peer'; returns the
+// microseconds it slept
+uint64_t sched_pace(const struct sockaddr_in *peer, size_t bytes);
+
+// Parses "<n>[k|m|g]" bytes per second (binary multiples); -1 on error
+int sched_parse_rate(const char *text, uint64_t *rate);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef TFTP_SERVER_H
+#define TFTP_SERVER_H
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <sys/select.h> // For select() and timeouts
+
+#include "tftpArchive.h"
+#include "tftpCodec.h"
+#include "tftpEngine.h"
+#include "tftpLatency.h"
+#include "tftpLog.h"
+#include "tftpPmtu.h"
+#include "tftpTimer.h"
+#include "tftpStats.h"
+#include "tftpTrace.h"
+#include "tftpProbes.h"
+#include "tftpSched.h"
+#include "tftpBlksize.h"
+#include "tftpPool.h"
+#include "tftpPacketCache.h"
+#include "tftpIo.h"
+#include "tftpSessions.h"
+#include "tftpWarm.h"
+
+// --- TFTP Constants (Shared by all server modules) ---
+// Opcodes, header size and the packet/option structs come from tftpCodec.h
+#define TFTP_PORT 69
+#define BLOCK_SIZE TFTP_DEFAULT_BLKSIZE
+#define PACKET_BUF_SIZE (4 + BLOCK_SIZE) // Opcode(2) + Block#(2) + Data(512)
+#define MAX_PACKET_SIZE (4 + TFTP_MAX_BLKSIZE) // DATA at the largest blksize a client may negotiate
+#define TIMEOUT_SEC 3  // Timeout in seconds
+#define MAX_RETRIES 5  // Maximum retransmissions
+#define MAX_TRANSFERS_DEFAULT 256 // Concurrent forked transfers before requests queue
+
+// --- Multicast (RFC 2090) Defaults ---
+#define MCAST_GROUP_DEFAULT "239.255.0.69"
+#define MCAST_PORT_BASE 1758    // First group port, one port per active session
+#define MCAST_MAX_SESSIONS 32   // Concurrent multicast files
+#define MCAST_MAX_CLIENTS 1024  // Clients attached to one multicast session
+
+// --- AF_XDP read path (tftpXdp.c) ---
+#define XDP_PORT_BASE 61000     // Transfer i answers from port XDP_PORT_BASE + i
+#define XDP_MAX_TRANSFERS 1024  // Concurrent RRQs served from the XDP socket
+
+// --- Server configuration (filled from the command line in main) ---
+struct server_config {
+    uint16_t port;                  // Listening port (default 69)
+    struct in_addr mcast_group;     // Multicast group handed out in OACKs
+    struct in_addr mcast_interface; // Local interface used to send multicast DATA
+    char stats_path[108];           // Unix socket serving metrics, "" = disabled
+    char cache_dir[256];            // Decompressed copies of .zst/.gz images, "" = disabled
+    char archive_path[256];         // Packed archive answering RRQs first, "" = none
+    char trace_path[256];           // Transfer trace file (tftpTrace.h), "" = off
+    char warm_manifest[256];        // Hot-set manifest (tftpWarm.h), "" = off
+    char xdp_interface[16];         // Serve RRQs over AF_XDP on this interface, "" = sockets only
+    int xdp_queue;                  // Its RX queue
+    int xdp_generic;                // Skip native mode, attach in generic (SKB) mode
+    struct sched_config sched;      // Transfer cap and rate limits (tftpSched.h)
+    struct pool_config pool;        // Pre-bound transfer sockets (tftpPool.h)
+    uint64_t pcache_budget;         // Bytes of pre-encoded DATA packets (tftpPacketCache.h), 0 = off
+    uint32_t max_sessions;          // Octet transfers served in the main process (tftpSessions.h), 0 = fork all
+    uint32_t spin_us;               // Low-latency profile: busy-poll this long per wait, 0 = off
+    int rt_priority;                // SCHED_FIFO priority, 0 = normal scheduling
+};
+
+extern struct server_config g_config;
+extern struct tftp_archive g_archive; // Mapped at startup and on SIGHUP; children keep their copy
+// Transfers served in the main process (XDP) that read g_archive's mapping
+// hold it, so a SIGHUP reload unmaps the old version only after they end
+const void *archive_hold(void);
+void archive_put(const void *held);
+extern uint32_t g_transfer_id;      // Id of the request being handled (inherited by the child)
+
+// Appends a trace record for the current transfer; nothing when tracing is off
+#define TFTP_TRACE(type, block, arg) \
+    do { if (g_trace_fd >= 0) tftp_trace_record(g_transfer_id, (type), (block), (arg), NULL, 0); } while (0)
+
+// --- FUNCTION PROTOTYPES ---
+void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len,
+                int code, const char *message);
+// Traces a request as received, for tftp_trace's timelines and replay
+void trace_request(const char *packet, size_t len, const struct sockaddr_in *cliaddr);
+
+// Transfers return 0 when the whole file was moved, -1 otherwise
+// 'mode' is "octet" or "netascii" (already validated); 'req' carries the
+// request's options (blksize, and tsize for an RRQ, are answered with an
+// OACK) and may be NULL
+int tftpWriteTransfer(const struct tftp_io *io, const struct sockaddr_in *cliaddr,
+                      socklen_t len, const char *filename, const char *mode,
+                      const struct tftp_packet *req);
+int tftpReadTransfer(const struct tftp_io *io, const struct sockaddr_in *cliaddr,
+                     socklen_t len, const char *filename, const char *mode,
+                     const struct tftp_packet *req);
+// tftpReadTransfer() in two halves, for loops that drive many engines at once:
+// begin opens the file and starts the engine on 'packet' (-1: an ERROR was
+// sent instead); end, once the engine stopped, checks the digest and closes
+int tftp_read_begin(struct tftp_io_transfer *t, struct tftp_source *source, char *packet, size_t packet_cap,
+                    const struct tftp_io *io, const struct sockaddr_in *cliaddr, socklen_t len,
+                    const char *filename, const char *mode, const struct tftp_packet *req);
+void tftp_read_end(struct tftp_io_transfer *t, struct tftp_source *source, const char *filename, int result);
+
+// Multicast RRQ (tftpMulticastTransfer.c)
+void mcast_dispatch_request(int master_sockfd, const struct tftp_packet *req,
+                            const struct sockaddr_in *cliaddr, socklen_t len);
+void mcast_session_reaped(pid_t pid);
+
+// AF_XDP read path (tftpXdp.c). xdp_start() returns -1 (logged) when the
+// interface, kernel or build cannot do it; the server then uses sockets only.
+int xdp_start(const char *ifname, int queue, int generic);
+int xdp_fd(void);                   // For select(); -1 when not running
+int xdp_timeout_ms(void);           // Until the next retransmission deadline, -1 = none
+void xdp_poll(void);                // Handles received frames and expired deadlines
+
+#endif
@@ -1,40 +1,325 @@
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include "tftpServer.h"
 #include <sys/wait.h>
-#include <errno.h>
-
-#define TFTP_PORT 69
-#define OP_RRQ  1
-#define OP_WRQ  2
-#define OP_DATA 3
-#define OP_ACK  4
-#define OP_ERROR 5
-#define BLOCK_SIZE 512
-#define PACKET_BUF_SIZE (4 + BLOCK_SIZE) // Opcode(2) + Block#(2) + Data(512)
-
-// --- FUNCTION PROTOTYPES ---
-void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, 
-                int code, const char *message);
+#include <signal.h>
+
+struct server_config g_config;
+struct tftp_archive g_archive;
+uint32_t g_transfer_id;
+
+static volatile sig_atomic_t reload_requested;
+#define ARCHIVE_RETIRED_MAX 8
+
+// Replaced archive mappings still read by transfers in this process
+static struct {
+    struct tftp_archive archive;
+    uint32_t users;
+} retired[ARCHIVE_RETIRED_MAX];
+static uint32_t archive_users;  // Of g_archive
+
 void handle_tftp_request(int master_sockfd, const char *buffer, ssize_t n, 
                          const struct sockaddr_in *cliaddr, socklen_t len);
+static void start_transfer(int master_sockfd, const char *buffer, ssize_t n,
+                           const struct sockaddr_in *cliaddr, socklen_t len, int slot, int port_wait);
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-g mcast_group] [-i mcast_interface_ip] "
+                    "[-s stats_socket_path|-s ''] [-c cache_dir] [-a archive]\n"
+                    "       [-x ifname[:queue]] [-G] [-m max_transfers] [-r client_rate] [-T trace_file]\n"
+                    "       [-R subnet_rate[/prefix]] [-B total_rate]   (rates in bytes/s, k/m/g suffixes)\n"
+                    "       [-P pool_size|first_port-last_port] [-L spin_us] [-F rt_priority] [-C packet_cache_bytes]\n"
+                    "       [-E max_sessions] [-W hot_set_manifest]\n"
+                    "       -x serves up to %d RRQs at once in this process, outside -m and the -r/-R/-B rates\n",
+            prog, XDP_MAX_TRANSFERS);
+}
+
+// Only wakes select() so a finished transfer can admit a queued request
+static void on_sigchld(int sig) {
+    (void)sig;
+}
 
-void tftpWriteTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                         socklen_t len, const char *filename);
-void tftpReadTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                        socklen_t len, const char *filename);
+// Starts queued requests while transfer slots are free
+static void admit_waiting(int master_sockfd) {
+    struct sched_request r;
+    int slot;
+
+    while (sched_waiting() && pool_available() && (slot = sched_slot_acquire()) >= 0) {
+        if (sched_dequeue(&r, stats_now_us()) < 0) {
+            sched_slot_release(slot);
+            break;
+        }
+        uint32_t latest = g_transfer_id;
+        g_transfer_id = r.transfer_id;
+        g_request_us = r.received_us; // Time spent queued counts towards the transfer
+        start_transfer(master_sockfd, r.buffer, (ssize_t)r.len, &r.cliaddr, r.cliaddr_len, slot, r.port_wait);
+        g_transfer_id = latest;
+    }
+}
+
+static void on_sighup(int sig) {
+    (void)sig;
+    reload_requested = 1;
+}
+
+const void *archive_hold(void) {
+    archive_users++;
+    return g_archive.base;
+}
+
+void archive_put(const void *held) {
+    if (held == g_archive.base) {
+        archive_users--;
+        return;
+    }
+    for (int i = 0; i < ARCHIVE_RETIRED_MAX; i++) {
+        if (retired[i].users > 0 && held == retired[i].archive.base && --retired[i].users == 0) {
+            tftp_archive_close(&retired[i].archive);
+        }
+    }
+}
+
+// Maps the archive (again). Transfers already forked keep the version they
+// started with, and those served here keep theirs mapped until they end; a
+// bad new archive leaves the current one in service.
+static int load_archive(void) {
+    struct tftp_archive next;
+    char error[256];
+    int slot = -1;
+
+    for (int i = 0; i < ARCHIVE_RETIRED_MAX && archive_users > 0; i++) {
+        if (retired[i].users == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (archive_users > 0 && slot < 0) {
+        tftp_log(TFTP_LOG_ERROR, "Cannot load archive %s: too many older versions still in use\n",
+                 g_config.archive_path);
+        return -1;
+    }
+    if (tftp_archive_open(&next, g_config.archive_path, error, sizeof(error)) < 0) {
+        tftp_log(TFTP_LOG_ERROR, "Cannot load archive %s: %s\n", g_config.archive_path, error);
+        return -1;
+    }
+    if (slot >= 0) {
+        retired[slot].archive = g_archive;
+        retired[slot].users = archive_users;
+        archive_users = 0;
+    } else {
+        tftp_archive_close(&g_archive);
+    }
+    g_archive = next;
+    tftp_log(TFTP_LOG_INFO, "Serving archive %s (%u files, %llu bytes).\n", g_config.archive_path,
+             g_archive.header->entry_count, (unsigned long long)g_archive.size);
+    return 0;
+}
 
 // --- MAIN FUNCTION ---
-int main() {
+int main(int argc, char *argv[]) {
     int sockfd;
     struct sockaddr_in servaddr, cliaddr;
     socklen_t len = sizeof(cliaddr);
     char buffer[PACKET_BUF_SIZE];
+    int opt;
+
+    // 0. Parse command line options
+    g_config.port = TFTP_PORT;
+    inet_pton(AF_INET, MCAST_GROUP_DEFAULT, &g_config.mcast_group);
+    g_config.mcast_interface.s_addr = htonl(INADDR_ANY);
+    g_config.stats_path[0] = '\0';
+    g_config.cache_dir[0] = '\0';
+    g_config.archive_path[0] = '\0';
+    g_config.sched.max_transfers = MAX_TRANSFERS_DEFAULT;
+    g_config.sched.subnet_prefix = 24;
+    g_config.sched.queue_timeout_us = (uint64_t)TIMEOUT_SEC * MAX_RETRIES * 1000000u;
+    g_config.pool.size = POOL_SIZE_DEFAULT;
+    g_config.pcache_budget = PCACHE_BUDGET_DEFAULT;
+    int stats_path_set = 0;
+    char *prefix;
+
+    while ((opt = getopt(argc, argv, "p:g:i:s:c:a:x:Gm:r:R:B:T:P:L:F:C:E:W:")) != -1) {
+        switch (opt) {
+        case 'p':
+            g_config.port = (uint16_t)atoi(optarg);
+            break;
+        case 'g':
+            if (inet_pton(AF_INET, optarg, &g_config.mcast_group) <= 0) {
+                fprintf(stderr, "Invalid multicast group '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            if (inet_pton(AF_INET, optarg, &g_config.mcast_interface) <= 0) {
+                fprintf(stderr, "Invalid multicast interface '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            snprintf(g_config.stats_path, sizeof(g_config.stats_path), "%s", optarg);
+            stats_path_set = 1;
+            break;
+        case 'c':
+            snprintf(g_config.cache_dir, sizeof(g_config.cache_dir), "%s", optarg);
+            if (mkdir(g_config.cache_dir, 0755) < 0 && errno != EEXIST) {
+                perror("Cannot create cache directory");
+                return 1;
+            }
+            break;
+        case 'a':
+            snprintf(g_config.archive_path, sizeof(g_config.archive_path), "%s", optarg);
+            break;
+        case 'x': {
+            char *queue = strchr(optarg, ':');
+            if (queue != NULL) {
+                *queue++ = '\0';
+                g_config.xdp_queue = atoi(queue);
+            }
+            snprintf(g_config.xdp_interface, sizeof(g_config.xdp_interface), "%s", optarg);
+            break;
+        }
+        case 'G':
+            g_config.xdp_generic = 1;
+            break;
+        case 'W':
+            snprintf(g_config.warm_manifest, sizeof(g_config.warm_manifest), "%s", optarg);
+            break;
+        case 'T':
+            snprintf(g_config.trace_path, sizeof(g_config.trace_path), "%s", optarg);
+            break;
+        case 'P':
+            if (pool_parse(optarg, &g_config.pool) < 0) {
+                fprintf(stderr, "Invalid socket pool '%s' (a size up to %d, or first-last ports)\n", optarg,
+                        POOL_MAX_SOCKETS);
+                return 1;
+            }
+            break;
+        case 'L':
+            g_config.spin_us = (uint32_t)atoi(optarg);
+            if (g_config.spin_us > TFTP_SPIN_US_MAX) {
+                fprintf(stderr, "spin_us must be 0..%d\n", TFTP_SPIN_US_MAX);
+                return 1;
+            }
+            break;
+        case 'F':
+            g_config.rt_priority = atoi(optarg);
+            break;
+        case 'C':
+            // Same k/m/g suffixes as the rates
+            if (sched_parse_rate(optarg, &g_config.pcache_budget) < 0) {
+                fprintf(stderr, "Invalid packet cache size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'E':
+            g_config.max_sessions = (uint32_t)atoi(optarg);
+            if (g_config.max_sessions > SESSION_MAX) {
+                fprintf(stderr, "max_sessions must be 0..%d\n", SESSION_MAX);
+                return 1;
+            }
+            break;
+        case 'm':
+            g_config.sched.max_transfers = (uint32_t)atoi(optarg);
+            if (g_config.sched.max_transfers < 1 || g_config.sched.max_transfers > SCHED_MAX_TRANSFERS) {
+                fprintf(stderr, "max_transfers must be 1..%d\n", SCHED_MAX_TRANSFERS);
+                return 1;
+            }
+            break;
+        case 'R':
+            if ((prefix = strchr(optarg, '/')) != NULL) {
+                *prefix++ = '\0';
+                g_config.sched.subnet_prefix = (uint32_t)atoi(prefix);
+            }
+            /* fall through */
+        case 'r':
+        case 'B':
+            if (sched_parse_rate(optarg, opt == 'r' ? &g_config.sched.client_rate :
+                                         opt == 'R' ? &g_config.sched.subnet_rate : &g_config.sched.total_rate) < 0) {
+                fprintf(stderr, "Invalid rate '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!stats_path_set) {
+        snprintf(g_config.stats_path, sizeof(g_config.stats_path),
+                 "/tmp/tftpd.%u.stats.sock", g_config.port);
+    }
+
+    // A multicast session child may exit while we hand it a late joiner
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGHUP maps the archive again, e.g. after tftp_mkarchive replaced it.
+    // No SA_RESTART, so a pending select() returns and sees the request.
+    if (g_config.archive_path[0] != '\0') {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sighup;
+        sigaction(SIGHUP, &sa, NULL);
+        if (load_archive() < 0) {
+            return 1;
+        }
+    }
+
+    // Every transfer appends to the same trace file
+    if (g_config.trace_path[0] != '\0') {
+        if (tftp_trace_open(g_config.trace_path) < 0) {
+            perror("Cannot open trace file");
+            return 1;
+        }
+        tftp_log(TFTP_LOG_INFO, "Tracing transfers to %s.\n", g_config.trace_path);
+    }
+
+    if (g_config.spin_us > 0) {
+        g_config.spin_us = tftp_latency_spin(g_config.spin_us);
+        if (g_config.spin_us == 0) {
+            tftp_log(TFTP_LOG_WARN, "Only one CPU online; -L will not busy-poll.\n");
+        }
+    }
+    // Transfers inherit the scheduling class
+    if (g_config.rt_priority > 0) {
+        if (tftp_latency_realtime(g_config.rt_priority) < 0) {
+            perror("Cannot switch to SCHED_FIFO");
+            return 1;
+        }
+        tftp_log(TFTP_LOG_INFO, "Running at SCHED_FIFO priority %d.\n", g_config.rt_priority);
+    }
+
+    // Shared counters must exist before the first fork
+    int metrics_fd = -1;
+    if (stats_init() == 0 && g_config.stats_path[0] != '\0') {
+        metrics_fd = stats_listen(g_config.stats_path);
+    }
+    if (metrics_fd >= 0 && stats_serve(metrics_fd) < 0) {
+        perror("stats exporter failed");
+        close(metrics_fd);
+        metrics_fd = -1;
+    }
+    if (sched_init(&g_config.sched) < 0) {
+        return 1;
+    }
+    blksize_init(); // Without it, blksize is still fitted to the path MTU
+    pcache_init(g_config.pcache_budget); // Without it, every block is read and encoded
+    // Forks the prewarming child, so before any transfer socket exists
+    if (warm_init(g_config.warm_manifest) < 0) {
+        return 1;
+    }
+    if (pool_init(&g_config.pool) < 0) {
+        return 1;
+    }
+    if (session_init(g_config.max_sessions) < 0) {
+        return 1;
+    }
+
+    // A transfer exiting interrupts select(), so the queue moves at once.
+    // select() is never restarted; SA_RESTART covers every other call.
+    struct sigaction chld;
+    memset(&chld, 0, sizeof(chld));
+    chld.sa_handler = on_sigchld;
+    chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &chld, NULL);
     
     // 1. Create UDP socket
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
@@ -48,29 +333,121 @@ int main() {
     // Server information
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = INADDR_ANY;
-    servaddr.sin_port = htons(TFTP_PORT);
+    servaddr.sin_port = htons(g_config.port);
     
-    // 2. Bind the socket to port 69
+    // 2. Bind the socket to the TFTP port (69 by default)
     if (bind(sockfd, (const struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
         perror("bind failed");
         close(sockfd);
         return 1;
     }
 
-    printf("TFTP Server listening on UDP port %d. Ready for multiple clients.\n", TFTP_PORT);
+    if (g_config.spin_us > 0 && tftp_latency_socket(sockfd, g_config.spin_us) < 0) {
+        perror("SO_BUSY_POLL failed");
+    }
+
+    tftp_log(TFTP_LOG_INFO, "TFTP Server listening on UDP port %d. Ready for multiple clients.\n", g_config.port);
+
+    if (metrics_fd >= 0) {
+        tftp_log(TFTP_LOG_INFO, "Serving metrics on unix socket %s.\n", g_config.stats_path);
+    }
+
+    // RRQs arriving on this interface are served in this process; WRQs and
+    // anything the XDP socket cannot take still reach sockfd
+    if (g_config.xdp_interface[0] != '\0') {
+        xdp_start(g_config.xdp_interface, g_config.xdp_queue, g_config.xdp_generic);
+    }
 
     while (1) {
-        // 3. Wait for an initial client request (RRQ or WRQ)
-        ssize_t n = recvfrom(sockfd, buffer, PACKET_BUF_SIZE, 0, 
-                             (struct sockaddr *)&cliaddr, &len);
-        
-        if (n > 0) {
-            // 4. Delegate the request handling to a new process
-            handle_tftp_request(sockfd, buffer, n, &cliaddr, len);
+        fd_set readfds;
+
+        // 3. Wait for an initial client request (RRQ or WRQ) or a metrics reader
+        FD_ZERO(&readfds);
+        FD_SET(sockfd, &readfds);
+        int max_fd = sockfd;
+        int exporter_fd = stats_fd();
+        if (exporter_fd >= 0) {
+            FD_SET(exporter_fd, &readfds);
+            max_fd = exporter_fd > max_fd ? exporter_fd : max_fd;
+        }
+        // Transfers served here (XDP, sessions) wake select() for their packets and deadlines
+        int xsk_fd = xdp_fd(), sessions_fd = session_fd();
+        int wait_ms = xdp_timeout_ms();
+        struct timeval tv, *timeout = NULL;
+        if (xsk_fd >= 0) {
+            FD_SET(xsk_fd, &readfds);
+            max_fd = xsk_fd > max_fd ? xsk_fd : max_fd;
+        }
+        if (sessions_fd >= 0) {
+            FD_SET(sessions_fd, &readfds);
+            max_fd = sessions_fd > max_fd ? sessions_fd : max_fd;
+        }
+        int warm_ms = warm_timeout_ms(); // The next manifest save
+        if (warm_ms >= 0 && (wait_ms < 0 || warm_ms < wait_ms)) {
+            wait_ms = warm_ms;
+        }
+        int stats_ms = stats_timeout_ms(); // A stalled metrics reader
+        if (stats_ms >= 0 && (wait_ms < 0 || stats_ms < wait_ms)) {
+            wait_ms = stats_ms;
+        }
+        if (pcache_timeout_ms() == 0) {
+            wait_ms = 0; // A packet cache set is being built: only poll
+        }
+        if (wait_ms >= 0) {
+            tv.tv_sec = wait_ms / 1000;
+            tv.tv_usec = (wait_ms % 1000) * 1000;
+            timeout = &tv;
+        }
+        // Low-latency profile: a request arriving within the spin skips the sleep in select()
+        if (g_config.spin_us > 0) {
+            tftp_latency_wait(sockfd, g_config.spin_us, g_config.spin_us);
+        }
+        int ready = select(max_fd + 1, &readfds, NULL, NULL, timeout);
+
+        // Before serving anything that arrived after the signal
+        if (reload_requested) {
+            reload_requested = 0;
+            load_archive();
+        }
+        if (ready < 0) {
+            if (errno != EINTR) {
+                perror("select error");
+            }
+            FD_ZERO(&readfds); // Nothing to read, but still reap and admit below
+        }
+
+        // Received frames and retransmission deadlines of the XDP transfers,
+        // then the same for the sessions
+        xdp_poll();
+        session_poll();
+        stats_poll();
+
+        if (FD_ISSET(sockfd, &readfds)) {
+            len = sizeof(cliaddr);
+            ssize_t n = recvfrom(sockfd, buffer, PACKET_BUF_SIZE, 0, 
+                                 (struct sockaddr *)&cliaddr, &len);
+            
+            if (n > 0) {
+                // 4. Delegate the request handling to a new process
+                g_request_us = stats_now_us();
+                handle_tftp_request(sockfd, buffer, n, &cliaddr, len);
+            }
         }
 
-        // 5. Clean up finished child processes (Zombies) without blocking
-        waitpid(-1, NULL, WNOHANG); 
+        // 5. Clean up finished child processes (Zombies) without blocking;
+        // each finished transfer lets a queued request start
+        pid_t done;
+        while ((done = waitpid(-1, NULL, WNOHANG)) > 0) {
+            if (sched_reaped(done)) {
+                pool_reaped(done);
+            } else if (!warm_reaped(done)) {
+                mcast_session_reaped(done);
+            }
+        }
+        admit_waiting(sockfd);
+        pcache_refresh(stats_now_us());
+        warm_refresh(stats_now_us());
+        tftp_trace_flush(); // Requests, and transfers served in this process
     }
     
     // This part is unreachable, but good practice for cleanup
@@ -82,67 +459,150 @@ int main() {
 void handle_tftp_request(int master_sockfd, const char *buffer, ssize_t n, 
                          const struct sockaddr_in *cliaddr, socklen_t len) {
     
-    uint16_t opcode = ntohs(*(uint16_t *)buffer);
-    const char *filename = buffer + 2;
-    ssize_t filename_len = strlen(filename);
+    struct tftp_packet req;
     
-    if (filename_len + 2 >= n || (opcode != OP_RRQ && opcode != OP_WRQ)) {
-        fprintf(stderr, "Malformed or invalid TFTP request received.\n");
+    // Only RRQ/WRQ may open a transfer; the codec never reads past the n bytes received
+    if (tftp_decode(buffer, (size_t)n, &req) < 0 || (req.opcode != OP_RRQ && req.opcode != OP_WRQ)) {
+        tftp_log(TFTP_LOG_ERROR, "Malformed or invalid TFTP request received.\n");
+        STATS_INC(requests_malformed);
+        return;
+    }
+    uint16_t opcode = req.opcode;
+    const char *mode = req.mode;
+
+    // "mail" is obsolete (RFC 1350); anything else is not a TFTP mode
+    if (strcasecmp(mode, "octet") != 0 && strcasecmp(mode, "netascii") != 0) {
+        tftp_log(TFTP_LOG_ERROR, "Unsupported transfer mode '%s' requested.\n", mode);
+        STATS_INC(requests_malformed);
+        send_error(master_sockfd, cliaddr, len, 4, "Illegal TFTP operation (unsupported mode)");
+        return;
+    }
+
+    // A retransmission from a client that is already waiting or being served
+    if (sched_known(cliaddr) || session_socket(cliaddr) >= 0) {
+        return;
+    }
+
+    g_transfer_id++;
+    TFTP_PROBE4(request__receive, g_transfer_id, opcode,
+                ntohl(cliaddr->sin_addr.s_addr), ntohs(cliaddr->sin_port));
+    trace_request(buffer, (size_t)n, cliaddr);
+    if (opcode == OP_RRQ) {
+        warm_request(req.filename);
+    }
+
+    // Multicast RRQs are served by one shared session per file. Sessions send
+    // blocks at fixed file offsets, so netascii requests get a unicast transfer.
+    if (opcode == OP_RRQ && strcasecmp(mode, "octet") == 0 && tftp_find_option(&req, "multicast") != NULL) {
+        STATS_INC(requests_multicast);
+        mcast_dispatch_request(master_sockfd, &req, cliaddr, len);
+        return;
+    }
+
+    if (opcode == OP_RRQ) {
+        STATS_INC(requests_rrq);
+    } else {
+        STATS_INC(requests_wrq);
+    }
+
+    // Most octet transfers run here as sessions when -E allows; the rest are forked
+    if (session_start(&req, cliaddr) == 0) {
+        return;
+    }
+
+    // At the cap, or with every port of a -P range in use, the request waits,
+    // unanswered: the client's own retries cover the wait, and are recognised above
+    int port_free = pool_available();
+    int slot = port_free ? sched_slot_acquire() : -1;
+    if (slot < 0) {
+        if (sched_enqueue(buffer, (size_t)n, cliaddr, len, g_transfer_id, g_request_us, !port_free) < 0) {
+            tftp_log(TFTP_LOG_WARN, "Admission queue full; dropping request from %s:%d.\n",
+                     inet_ntoa(cliaddr->sin_addr), ntohs(cliaddr->sin_port));
+        } else if (!port_free) {
+            pool_wait();
+            tftp_log(TFTP_LOG_DEBUG, "All transfer ports in use; queued request from %s:%d.\n",
+                     inet_ntoa(cliaddr->sin_addr), ntohs(cliaddr->sin_port));
+        } else {
+            tftp_log(TFTP_LOG_DEBUG, "Transfer limit reached; queued request from %s:%d.\n",
+                     inet_ntoa(cliaddr->sin_addr), ntohs(cliaddr->sin_port));
+        }
+        return;
+    }
+    start_transfer(master_sockfd, buffer, n, cliaddr, len, slot, 0);
+}
+
+// Forks the transfer for a validated RRQ/WRQ, which holds transfer slot 'slot'.
+// 'port_wait': it was queued until a transfer port came back.
+static void start_transfer(int master_sockfd, const char *buffer, ssize_t n,
+                           const struct sockaddr_in *cliaddr, socklen_t len, int slot, int port_wait) {
+    struct tftp_packet req;
+
+    tftp_decode(buffer, (size_t)n, &req); // Checked by handle_tftp_request()
+    uint16_t opcode = req.opcode;
+    const char *filename = req.filename;
+    const char *mode = req.mode;
+
+    // The transfer's socket (its TID) comes bound from the pool
+    int pool_index;
+    int transfer_sockfd = pool_lease(&pool_index, port_wait ? g_request_us : 0);
+    if (transfer_sockfd < 0) {
+        perror("transfer socket creation failed");
+        sched_slot_release(slot);
+        send_error(master_sockfd, cliaddr, len, 0, "Server error: no transfer socket");
         return;
     }
 
     // --- FORK: Create a new child process for this transfer ---
+    tftp_trace_flush(); // Or the child would write the parent's records again
     pid_t pid = fork();
 
     if (pid < 0) {
         perror("fork failed");
+        sched_slot_release(slot);
+        pool_release(pool_index);
         send_error(master_sockfd, cliaddr, len, 0, "Server error: could not fork");
-        return;
-    } 
-    
+    }
+
     // Parent Process: returns to the main loop to listen on port 69
-    if (pid > 0) {
+    if (pid != 0) {
+        if (pool_index < 0) {
+            close(transfer_sockfd); // Not pooled: the child's copy is the only one needed
+        }
+        if (pid > 0) {
+            sched_slot_bind(slot, pid, cliaddr);
+            pool_bind(pool_index, pid);
+            TFTP_PROBE2(transfer__fork, g_transfer_id, pid);
+        }
         return;
     }
+    TFTP_PROBE2(transfer__start, g_transfer_id, opcode);
 
     // --- CHILD PROCESS starts here ---
+    g_sched_slot = slot;
     close(master_sockfd); // Child closes the master listener socket
-    
-    // 1. Create a NEW socket for the transfer
-    int transfer_sockfd;
-    if ((transfer_sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("transfer socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // 2. Bind to any available ephemeral port
-    struct sockaddr_in serv_transfer_addr;
-    memset(&serv_transfer_addr, 0, sizeof(serv_transfer_addr));
-    serv_transfer_addr.sin_family = AF_INET;
-    serv_transfer_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_transfer_addr.sin_port = 0; // OS chooses port
-    
-    if (bind(transfer_sockfd, (const struct sockaddr *)&serv_transfer_addr, 
-             sizeof(serv_transfer_addr)) < 0) {
-        perror("transfer socket bind failed");
-        close(transfer_sockfd);
-        exit(EXIT_FAILURE);
-    }
+    session_forked();     // And the in-process sessions' sockets and files
+    stats_forked();       // And the metrics readers
+    tftp_log_init();      // Per-transfer log ring and flusher thread
 
-    printf("[Child PID %d] Starting transfer for '%s' from %s:%d...\n", 
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Starting transfer for '%s' from %s:%d...\n", 
            getpid(), filename, inet_ntoa(cliaddr->sin_addr), ntohs(cliaddr->sin_port));
 
-    // 3. Delegate to the appropriate transfer logic
+    // 3. Delegate to the appropriate transfer logic over the socket I/O backend
+    int result;
+    struct tftp_io io;
+    tftp_io_socket(&io, &transfer_sockfd);
+    stats_transfer_begin(opcode, filename, cliaddr);
     if (opcode == OP_RRQ) {
-        tftpReadTransfer(transfer_sockfd, cliaddr, len, filename);
+        result = tftpReadTransfer(&io, cliaddr, len, filename, mode, &req);
     } else { // Must be OP_WRQ
-        tftpWriteTransfer(transfer_sockfd, cliaddr, len, filename);
+        result = tftpWriteTransfer(&io, cliaddr, len, filename, mode, &req);
     }
+    stats_transfer_end(result == 0);
 
     // 4. Cleanup and exit the child process
-    printf("[Child PID %d] Transfer complete. Exiting.\n", getpid());
-    close(transfer_sockfd);
-    exit(EXIT_SUCCESS);
+    tftp_trace_flush();
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Transfer complete. Exiting.\n", getpid());
+    exit(EXIT_SUCCESS); // A pooled socket stays open in the parent for the next transfer
 }
 
 // --- TFTP TRANSFER LOGIC STUBS (Requires full implementation) ---
@@ -150,19 +610,26 @@ void handle_tftp_request(int master_sockfd, const char *buffer, ssize_t n,
 // Helper function to send an ERROR packet
 void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, 
                 int code, const char *message) {
-    // ... (Implementation as shown previously)
     char error_packet[PACKET_BUF_SIZE];
-    uint16_t *p = (uint16_t *)error_packet;
-    
-    *p++ = htons(OP_ERROR);
-    *p++ = htons(code);
-    
-    strcpy((char *)p, message);
-    size_t packet_size = 4 + strlen(message) + 1;
+    size_t packet_size = tftp_encode_error(error_packet, sizeof(error_packet), (uint16_t)code, message);
 
+    stats_error_sent(code);
     if (sendto(sockfd, error_packet, packet_size, 0, 
                (const struct sockaddr *)cliaddr, len) < 0) {
         perror("Error sending error packet");
     }
 }
 
+void trace_request(const char *packet, size_t len, const struct sockaddr_in *cliaddr) {
+    char payload[TFTP_TRACE_MAX_PAYLOAD];
+
+    if (g_trace_fd < 0) {
+        return;
+    }
+    len = len < sizeof(payload) - 6 ? len : sizeof(payload) - 6;
+    memcpy(payload, &cliaddr->sin_addr.s_addr, 4);
+    memcpy(payload + 4, &cliaddr->sin_port, 2);
+    memcpy(payload + 6, packet, len);
+    tftp_trace_record(g_transfer_id, TFTP_TRACE_REQUEST, (uint16_t)((uint8_t)packet[0] << 8 | (uint8_t)packet[1]), 0,
+                      payload, 6 + len);
+}
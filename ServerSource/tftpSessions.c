@@ -0,0 +1,675 @@
+#include "tftpServer.h"
+#include "tftpSessions.h"
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#define SESSION_FILE_BUCKETS 256
+#define SESSION_NONE UINT32_MAX
+
+// An open file and the sessions reading it, found by device and inode
+struct session_file {
+    uint64_t dev, ino;
+    int fd;
+    uint32_t users;
+    struct session_file *next;
+};
+
+// One transfer. Everything else it needs is lent for as long as it needs it.
+struct session {
+    struct tftp_engine engine;
+    struct sockaddr_in peer;
+    uint64_t request_us;
+    uint64_t offset;                // RRQ: next byte to read from the file
+    uint64_t end;                   // RRQ: where the data ends in it
+    const struct pcache_file *packets; // RRQ: DATA sent from these, NULL = read
+    struct tftp_timer timer;        // Armed at the engine's deadline
+    struct session_file *file;      // RRQ: NULL when sent from packets
+    uint32_t index;                 // Of this record
+    uint32_t id;                    // g_transfer_id of its request
+    uint32_t next;                  // Next in its hash chain, or on the free list
+    uint32_t crc;                   // CRC32C of the file bytes moved
+    uint32_t recorded_crc;          // RRQ: archive entries carry their digest
+    uint16_t timeouts;
+    uint8_t sock;                   // Index of its transfer socket
+    uint8_t recorded;
+    int fd;                         // WRQ: the file being written, else -1
+};
+
+static struct {
+    int epoll_fd;                   // -1 when not running
+    int socks[SESSION_SOCKETS];
+    int sock_count;
+    uint32_t max, count, carved, next_sock;
+    struct session **slabs;         // SESSION_SLAB records each
+    uint32_t free_list;
+    uint32_t *buckets;              // Peer hash; chains through session.next
+    uint32_t bucket_mask;
+    struct tftp_timer_wheel timers; // Its timerfd is in the epoll set
+    char *free_buffers;             // Each starts with a pointer to the next
+    struct session_file *files[SESSION_FILE_BUCKETS];
+    uint64_t *held;                 // Bit per file descriptor sessions keep open
+    size_t held_words;
+} ss = { .epoll_fd = -1, .free_list = SESSION_NONE };
+
+static struct session *session_at(uint32_t i) {
+    return &ss.slabs[i / SESSION_SLAB][i % SESSION_SLAB];
+}
+
+// Files are marked while open, so session_forked() can close them without
+// the records, which forked children do not have
+static void fd_hold(int fd) {
+    size_t word = (size_t)fd / 64;
+
+    if (word >= ss.held_words) {
+        size_t words = word + 1 > ss.held_words * 2 ? word + 1 : ss.held_words * 2;
+        uint64_t *held = realloc(ss.held, words * sizeof(*held));
+        if (held == NULL) {
+            return; // A forked child keeps a copy open until it exits
+        }
+        memset(held + ss.held_words, 0, (words - ss.held_words) * sizeof(*held));
+        ss.held = held;
+        ss.held_words = words;
+    }
+    ss.held[word] |= 1ull << (fd % 64);
+}
+
+static void fd_close(int fd) {
+    if ((size_t)fd / 64 < ss.held_words) {
+        ss.held[fd / 64] &= ~(1ull << (fd % 64));
+    }
+    close(fd);
+}
+
+// --- RECORDS AND BUFFERS ---
+// Both come from slabs mapped as they are first needed and are never given
+// back: a server that once had 100k transfers will likely have them again.
+
+static struct session *record_get(void) {
+    if (ss.free_list == SESSION_NONE) {
+        if (ss.carved >= ss.max) {
+            return NULL;
+        }
+        struct session *slab = mmap(NULL, SESSION_SLAB * sizeof(struct session), PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            return NULL;
+        }
+        madvise(slab, SESSION_SLAB * sizeof(struct session), MADV_DONTFORK); // Transfers never touch them
+        ss.slabs[ss.carved / SESSION_SLAB] = slab;
+        for (uint32_t i = SESSION_SLAB; i-- > 0;) {
+            slab[i].index = ss.carved + i;
+            slab[i].next = ss.free_list;
+            ss.free_list = ss.carved + i;
+        }
+        ss.carved += SESSION_SLAB;
+    }
+    struct session *s = session_at(ss.free_list);
+    ss.free_list = s->next;
+    return s;
+}
+
+static void record_put(struct session *s) {
+    s->next = ss.free_list;
+    ss.free_list = s->index;
+}
+
+static char *buffer_get(void) {
+    if (ss.free_buffers == NULL) {
+        char *slab = mmap(NULL, (size_t)SESSION_SLAB * SESSION_PACKET_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            return NULL;
+        }
+        madvise(slab, (size_t)SESSION_SLAB * SESSION_PACKET_SIZE, MADV_DONTFORK);
+        for (size_t i = SESSION_SLAB; i-- > 0;) {
+            char *buffer = slab + i * SESSION_PACKET_SIZE;
+            memcpy(buffer, &ss.free_buffers, sizeof(char *));
+            ss.free_buffers = buffer;
+        }
+    }
+    char *buffer = ss.free_buffers;
+    memcpy(&ss.free_buffers, buffer, sizeof(char *));
+    STATS_ADD(session_buffers, 1);
+    return buffer;
+}
+
+static void buffer_put(char *buffer) {
+    memcpy(buffer, &ss.free_buffers, sizeof(char *));
+    ss.free_buffers = buffer;
+    STATS_ADD(session_buffers, -1);
+}
+
+// Hands the engine's buffer back as soon as nothing in it will be resent
+static void release_buffer(struct session *s) {
+    char *buffer = tftp_engine_release_packet(&s->engine);
+    if (buffer != NULL) {
+        buffer_put(buffer);
+    }
+}
+
+// --- SHARED FILES ---
+
+// Takes over 'fd': returns the entry for its file, closing fd when the file
+// was already open
+static struct session_file *file_get(int fd, const struct stat *st) {
+    struct session_file **bucket = &ss.files[st->st_ino % SESSION_FILE_BUCKETS];
+
+    for (struct session_file *f = *bucket; f != NULL; f = f->next) {
+        if (f->ino == (uint64_t)st->st_ino && f->dev == (uint64_t)st->st_dev) {
+            close(fd);
+            f->users++;
+            return f;
+        }
+    }
+    struct session_file *f = malloc(sizeof(*f));
+    if (f == NULL) {
+        close(fd);
+        return NULL;
+    }
+    f->dev = (uint64_t)st->st_dev;
+    f->ino = (uint64_t)st->st_ino;
+    f->fd = fd;
+    f->users = 1;
+    f->next = *bucket;
+    fd_hold(fd);
+    *bucket = f;
+    return f;
+}
+
+static void file_put(struct session_file *f) {
+    if (f == NULL || --f->users > 0) {
+        return;
+    }
+    struct session_file **p = &ss.files[f->ino % SESSION_FILE_BUCKETS];
+    while (*p != f) {
+        p = &(*p)->next;
+    }
+    *p = f->next;
+    fd_close(f->fd);
+    free(f);
+}
+
+// The digest helpers want a path for their sidecar fallback; the session
+// only kept the descriptor
+static const char *fd_path(int fd, char *buf, size_t cap) {
+    char link[32];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(link, buf, cap - 1);
+    buf[n > 0 ? n : 0] = '\0';
+    return buf;
+}
+
+// --- PEER HASH ---
+
+static uint32_t *bucket_of(const struct sockaddr_in *peer) {
+    uint64_t key = (uint64_t)peer->sin_addr.s_addr << 16 | peer->sin_port;
+    return &ss.buckets[(key * 0x9e3779b97f4a7c15ull >> 32) & ss.bucket_mask];
+}
+
+static struct session *lookup(const struct sockaddr_in *peer) {
+    for (uint32_t i = *bucket_of(peer); i != SESSION_NONE;) {
+        struct session *s = session_at(i);
+        if (s->peer.sin_addr.s_addr == peer->sin_addr.s_addr && s->peer.sin_port == peer->sin_port) {
+            return s;
+        }
+        i = s->next;
+    }
+    return NULL;
+}
+
+static void hash_remove(struct session *s) {
+    uint32_t *p = bucket_of(&s->peer);
+    while (*p != s->index) {
+        p = &session_at(*p)->next;
+    }
+    *p = s->next;
+}
+
+// --- ENGINE GLUE (ctx points at the session) ---
+
+static ssize_t session_send(void *ctx, const void *packet, size_t len) {
+    struct session *s = ctx;
+    ssize_t n = sendto(ss.socks[s->sock], packet, len, 0, (const struct sockaddr *)&s->peer, sizeof(s->peer));
+    // A full socket buffer drops the packet like the network would; the
+    // retransmission covers it, so the engine is not told
+    if (n < 0 && errno == EAGAIN) {
+        return (ssize_t)len;
+    }
+    if (n < 0) {
+        perror("Failed to send packet");
+    }
+    return n;
+}
+
+static ssize_t session_read(void *ctx, char *buf, size_t len) {
+    struct session *s = ctx;
+    uint64_t left = s->end - s->offset;
+    ssize_t n = pread(s->file->fd, buf, len < left ? len : (size_t)left, (off_t)s->offset);
+
+    if (n < 0) {
+        perror("File read failed");
+        return n;
+    }
+    s->offset += (uint64_t)n;
+    s->crc = tftp_crc32c(s->crc, buf, (size_t)n);
+    return n;
+}
+
+static const char *session_data(void *ctx, uint32_t block, size_t *len) {
+    struct session *s = ctx;
+    const char *packet = s->packets != NULL ? pcache_packet(s->packets, block, len) : NULL;
+
+    if (packet == NULL) {
+        return NULL;
+    }
+    if (*len - TFTP_HEADER_SIZE < s->engine.blksize) {
+        s->crc = s->packets->crc; // The short block ends the file
+    }
+    STATS_INC(pcache_blocks);
+    return packet;
+}
+
+static int session_write(void *ctx, const char *data, size_t len) {
+    struct session *s = ctx;
+
+    s->crc = tftp_crc32c(s->crc, data, len);
+    if (write(s->fd, data, len) < 0) {
+        perror("File write failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Metrics, probes and traces as for forked transfers; the log stays quiet
+// about single blocks, with this many transfers in one process
+static void session_event(void *ctx, int event, uint32_t block, uint64_t arg) {
+    struct session *s = ctx;
+
+    TFTP_TRACE(event, block, (uint32_t)arg);
+    switch (event) {
+    case TFTP_EV_DATA_SENT:
+        if (block == 1) {
+            stats_first_data_since(s->request_us);
+        }
+        stats_data_sent(arg);
+        TFTP_PROBE4(data__send, s->id, block, arg, s->engine.bytes);
+        break;
+    case TFTP_EV_DATA_RECEIVED:
+        if (block == 1) {
+            stats_first_data_since(s->request_us);
+        }
+        stats_data_received(arg);
+        TFTP_PROBE4(data__receive, s->id, block, arg, s->engine.bytes);
+        break;
+    case TFTP_EV_DATA_RETRANSMIT:
+    case TFTP_EV_DATA_DUPLICATE:
+    case TFTP_EV_ACK_RETRANSMIT:
+        stats_retransmit();
+        break;
+    case TFTP_EV_ACK_RECEIVED:
+    case TFTP_EV_ACK_STALE:
+        TFTP_PROBE2(ack__receive, s->id, block);
+        break;
+    case TFTP_EV_TIMEOUT:
+        s->timeouts++;
+        STATS_INC(timeouts);
+        TFTP_PROBE3(timeout, s->id, block, arg);
+        break;
+    case TFTP_EV_ERROR_SENT:
+        stats_error_sent((int)arg);
+        break;
+    case TFTP_EV_ERROR_RECEIVED:
+        tftp_log(TFTP_LOG_INFO, "[Session %u] Client reported error %d. Aborting.\n", s->id, (int)arg);
+        break;
+    }
+}
+
+static const struct tftp_engine_ops session_ops = {
+    session_send, session_read, session_write, session_event, NULL, session_data
+};
+
+// --- LIFETIME ---
+
+static void finish(struct session *s) {
+    int result = s->engine.status == TFTP_ENGINE_DONE ? 0 : -1;
+    char path[PATH_MAX];
+
+    g_transfer_id = s->id;
+    if (result < 0) {
+        tftp_log(TFTP_LOG_WARN, "[Session %u] Transfer aborted: %s\n", s->id, s->engine.error);
+    } else if (s->engine.role == TFTP_ENGINE_RECEIVE) {
+        tftp_log(TFTP_LOG_INFO, "[Session %u] Received file: crc32c %08x.\n", s->id, s->crc);
+        if (tftp_digest_store(s->fd, fd_path(s->fd, path, sizeof(path)), s->crc) < 0) {
+            tftp_log(TFTP_LOG_WARN, "[Session %u] Could not record digest.\n", s->id);
+        }
+    } else {
+        uint32_t stored = s->recorded_crc;
+        int recorded = s->recorded;
+        if (!recorded && s->packets == NULL) {
+            recorded = tftp_digest_load(s->file->fd, fd_path(s->file->fd, path, sizeof(path)), &stored) == 0;
+        }
+        if (recorded && stored != s->crc) {
+            tftp_log(TFTP_LOG_WARN, "[Session %u] Sent crc32c %08x, but %08x was recorded for the file.\n",
+                     s->id, s->crc, stored);
+        } else {
+            tftp_log(TFTP_LOG_INFO, "[Session %u] Sent file: crc32c %08x.\n", s->id, s->crc);
+        }
+    }
+
+    blksize_transfer_end(&s->peer, s->engine.blksize, s->timeouts);
+    TFTP_TRACE(TFTP_TRACE_END, result == 0, s->engine.error_code);
+    TFTP_PROBE3(transfer__done, s->id, result, s->engine.bytes);
+    if (s->engine.packet != NULL) {
+        buffer_put(s->engine.packet);
+    }
+    pcache_put(s->packets);
+    file_put(s->file);
+    if (s->fd >= 0) {
+        fd_close(s->fd);
+    }
+    hash_remove(s);
+    tftp_timer_cancel(&ss.timers, &s->timer);
+    record_put(s);
+    ss.count--;
+    STATS_ADD(sessions, -1);
+    g_request_us = s->request_us;
+    stats_transfer_end(result == 0);
+}
+
+// After every engine call: done, or keep only what the next step needs
+static void settle(struct session *s) {
+    if (s->engine.status != TFTP_ENGINE_RUNNING) {
+        finish(s);
+        return;
+    }
+    release_buffer(s);
+    tftp_timer_arm(&ss.timers, &s->timer, s->engine.deadline_us);
+}
+
+// Opens what an RRQ reads: a plain file, or the archive holding the entry.
+// -1 leaves the request to a forked transfer (compressed images, errors).
+static int open_source(struct session *s, const char *filename, const struct tftp_archive_entry *entry) {
+    struct stat st;
+    int fd = open(entry != NULL ? g_config.archive_path : filename, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        (entry != NULL && (st.st_dev != g_archive.dev || st.st_ino != g_archive.ino))) {
+        if (fd >= 0) {
+            close(fd); // Not a file, or an archive replaced and not mapped yet
+        }
+        return -1;
+    }
+    s->offset = entry != NULL ? entry->offset : 0;
+    s->end = entry != NULL ? entry->offset + entry->size : (uint64_t)st.st_size;
+    s->recorded = entry != NULL;
+    s->recorded_crc = entry != NULL ? entry->crc32c : 0;
+    s->file = file_get(fd, &st);
+    return s->file != NULL ? 0 : -1;
+}
+
+// The OACK for an RRQ's options, as tftp_read_begin() answers them
+static size_t read_options(struct session *s, const struct tftp_packet *req, char *oack, size_t cap,
+                           uint16_t *blksize) {
+    struct tftp_option options[2];
+    int option_count = 0;
+    char tsize_value[24], blksize_value[8];
+
+    if (tftp_find_option(req, "tsize") != NULL) {
+        snprintf(tsize_value, sizeof(tsize_value), "%llu", (unsigned long long)(s->end - s->offset));
+        options[option_count++] = (struct tftp_option){"tsize", tsize_value};
+    }
+    uint16_t requested = tftp_option_blksize(req);
+    if (requested != 0) {
+        *blksize = blksize_choose(&s->peer, requested, SESSION_PACKET_SIZE);
+        snprintf(blksize_value, sizeof(blksize_value), "%u", *blksize);
+        options[option_count++] = (struct tftp_option){"blksize", blksize_value};
+        STATS_INC(blksize_negotiated);
+    }
+    return option_count > 0 ? tftp_encode_oack(oack, cap, options, option_count) : 0;
+}
+
+int session_start(const struct tftp_packet *req, const struct sockaddr_in *peer) {
+    char oack[PACKET_BUF_SIZE];
+    size_t oack_len = 0;
+    uint16_t blksize = BLOCK_SIZE;
+    struct session *s;
+
+    if (ss.epoll_fd < 0 || strcasecmp(req->mode, "octet") != 0 || ss.count >= ss.max ||
+        (s = record_get()) == NULL) {
+        return -1;
+    }
+    s->peer = *peer;
+    s->packets = NULL;
+    s->timer.pprev = NULL;
+    s->file = NULL;
+    s->fd = -1;
+    s->crc = 0;
+    s->timeouts = 0;
+    if (req->opcode == OP_RRQ) {
+        const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, req->filename);
+        if (open_source(s, req->filename, entry) < 0) {
+            record_put(s);
+            return -1;
+        }
+        oack_len = read_options(s, req, oack, sizeof(oack), &blksize);
+        s->packets = pcache_find(req->filename, entry != NULL ? -1 : s->file->fd, entry, blksize);
+        if (s->packets != NULL) {
+            file_put(s->file); // Every byte is in the packets
+            s->file = NULL;
+        }
+    } else {
+        s->fd = open(req->filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (s->fd < 0) {
+            record_put(s);
+            return -1;
+        }
+        fd_hold(s->fd);
+        uint16_t requested = tftp_option_blksize(req);
+        if (requested != 0) {
+            char value[8];
+            blksize = blksize_choose(&s->peer, requested, SESSION_PACKET_SIZE);
+            snprintf(value, sizeof(value), "%u", blksize);
+            struct tftp_option option = {"blksize", value};
+            oack_len = tftp_encode_oack(oack, sizeof(oack), &option, 1);
+            STATS_INC(blksize_negotiated);
+        }
+    }
+    char *buffer = buffer_get();
+    if (buffer == NULL) {
+        pcache_put(s->packets);
+        file_put(s->file);
+        if (s->fd >= 0) {
+            fd_close(s->fd);
+        }
+        record_put(s);
+        return -1;
+    }
+
+    s->id = g_transfer_id;
+    s->request_us = g_request_us;
+    s->sock = (uint8_t)(ss.next_sock++ % (uint32_t)ss.sock_count);
+    uint32_t *bucket = bucket_of(peer);
+    s->next = *bucket;
+    *bucket = s->index;
+    ss.count++;
+    STATS_INC(sessions_started);
+    STATS_ADD(sessions, 1);
+    STATS_INC(transfers_started);
+    STATS_INC(active_transfers);
+    TFTP_TRACE(TFTP_TRACE_START, req->opcode, (uint32_t)getpid());
+    TFTP_PROBE2(transfer__start, s->id, req->opcode);
+    tftp_log(TFTP_LOG_INFO, "[Session %u] %s '%s' for %s:%d (blksize %u%s).\n", s->id,
+             req->opcode == OP_RRQ ? "Sending" : "Receiving", req->filename, inet_ntoa(peer->sin_addr),
+             ntohs(peer->sin_port), blksize, s->packets != NULL ? ", cached" : "");
+
+    tftp_engine_init(&s->engine, req->opcode == OP_RRQ ? TFTP_ENGINE_SEND : TFTP_ENGINE_RECEIVE, &session_ops, s,
+                     buffer, SESSION_PACKET_SIZE, blksize);
+    s->engine.timeout_us = TIMEOUT_SEC * 1000000u;
+    s->engine.max_retries = MAX_RETRIES;
+    tftp_engine_start(&s->engine, oack_len > 0 ? oack : NULL, oack_len, stats_now_us());
+    settle(s);
+    return 0;
+}
+
+int session_socket(const struct sockaddr_in *peer) {
+    struct session *s = ss.epoll_fd >= 0 ? lookup(peer) : NULL;
+    return s != NULL ? ss.socks[s->sock] : -1;
+}
+
+void session_receive(int sock, const char *packet, size_t len, const struct sockaddr_in *from) {
+    struct session *s = lookup(from);
+
+    // RFC 1350: the wrong TID gets an ERROR and leaves the transfer alone
+    if (s == NULL || ss.socks[s->sock] != sock) {
+        char error[PACKET_BUF_SIZE];
+        size_t error_len = tftp_encode_error(error, sizeof(error), 5, "Unknown transfer ID");
+        STATS_INC(unknown_tid);
+        stats_error_sent(5);
+        sendto(sock, error, error_len, 0, (const struct sockaddr *)from, sizeof(*from));
+        return;
+    }
+    g_transfer_id = s->id;
+    tftp_engine_receive(&s->engine, packet, len, stats_now_us());
+    settle(s);
+}
+
+// --- SETUP AND MAIN LOOP ---
+
+int session_init(uint32_t max_sessions) {
+    struct rlimit rl;
+
+    if (max_sessions == 0) {
+        return 0;
+    }
+    max_sessions = max_sessions < SESSION_MAX ? max_sessions : SESSION_MAX;
+    // Sessions share descriptors, but WRQs and distinct files still need one each
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    uint32_t buckets = 1;
+    while (buckets < max_sessions) {
+        buckets <<= 1;
+    }
+    // Untouched pages of these cost nothing until the sessions are there
+    ss.slabs = calloc((max_sessions + SESSION_SLAB - 1) / SESSION_SLAB, sizeof(*ss.slabs));
+    ss.buckets = malloc(buckets * sizeof(*ss.buckets));
+    if (ss.slabs == NULL || ss.buckets == NULL) {
+        perror("session tables");
+        return -1;
+    }
+    memset(ss.buckets, 0xff, buckets * sizeof(*ss.buckets));
+    ss.bucket_mask = buckets - 1;
+    ss.max = max_sessions;
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    // Retransmission deadlines wake the main loop through the epoll descriptor too
+    struct epoll_event timer_ev = { .events = EPOLLIN, .data.u32 = SESSION_SOCKETS };
+    if (tftp_timer_init(&ss.timers, SESSION_TICK_US, stats_now_us(), 1) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ss.timers.fd, &timer_ev) < 0) {
+        perror("session timer failed");
+        close(epoll_fd);
+        return -1;
+    }
+    // With -P, sessions answer from ports of that range too, taken from the pool
+    ss.sock_count = pool_reserve(ss.socks, SESSION_SOCKETS);
+    if (ss.sock_count < 0) {
+        tftp_log(TFTP_LOG_ERROR, "The transfer port range is too small to share with -E (2 ports at least).\n");
+        close(epoll_fd);
+        return -1;
+    }
+    for (int i = 0; i < ss.sock_count; i++) {
+        fcntl(ss.socks[i], F_SETFL, fcntl(ss.socks[i], F_GETFL) | O_NONBLOCK);
+        fcntl(ss.socks[i], F_SETFD, FD_CLOEXEC);
+    }
+    if (ss.sock_count == 0) {
+        for (int i = 0; i < SESSION_SOCKETS; i++) {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            ss.socks[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (ss.socks[i] < 0 || bind(ss.socks[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                perror("session socket failed");
+                close(epoll_fd);
+                return -1;
+            }
+            if (tftp_pmtu_enable(ss.socks[i]) < 0) {
+                perror("IP_MTU_DISCOVER failed");
+            }
+        }
+        ss.sock_count = SESSION_SOCKETS;
+    }
+    for (int i = 0; i < ss.sock_count; i++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ss.socks[i], &ev);
+    }
+    ss.epoll_fd = epoll_fd;
+    tftp_log(TFTP_LOG_INFO, "Serving up to %u octet transfers in this process (%zu-byte records, %d sockets).\n",
+             ss.max, sizeof(struct session), ss.sock_count);
+    return 0;
+}
+
+void session_forked(void) {
+    if (ss.epoll_fd < 0) {
+        return;
+    }
+    close(ss.epoll_fd);
+    ss.epoll_fd = -1;
+    tftp_timer_close(&ss.timers);
+    for (int i = 0; i < ss.sock_count; i++) {
+        close(ss.socks[i]);
+    }
+    for (size_t word = 0; word < ss.held_words; word++) {
+        for (uint64_t bits = ss.held[word]; bits != 0; bits &= bits - 1) {
+            close((int)(word * 64 + (size_t)__builtin_ctzll(bits)));
+        }
+    }
+}
+
+int session_fd(void) {
+    return ss.epoll_fd;
+}
+
+void session_poll(void) {
+    struct epoll_event events[SESSION_SOCKETS + 1];
+    char packet[SESSION_PACKET_SIZE];
+
+    if (ss.epoll_fd < 0) {
+        return;
+    }
+    // 1. Datagrams on the transfer sockets, a batch per socket
+    int n = epoll_wait(ss.epoll_fd, events, SESSION_SOCKETS + 1, 0);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u32 == SESSION_SOCKETS) {
+            continue; // The timerfd: deadlines are checked below either way
+        }
+        int sock = ss.socks[events[i].data.u32];
+        for (int j = 0; j < SESSION_BATCH; j++) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t len = recvfrom(sock, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+            if (len < 0) {
+                break;
+            }
+            session_receive(sock, packet, (size_t)len, &from);
+        }
+    }
+    // 2. Expired retransmission deadlines
+    uint64_t now_us = stats_now_us();
+    struct tftp_timer *t;
+    while ((t = tftp_timer_expired(&ss.timers, now_us)) != NULL) {
+        struct session *s = (struct session *)((char *)t - offsetof(struct session, timer));
+        g_transfer_id = s->id;
+        tftp_engine_timeout(&s->engine, now_us);
+        settle(s);
+    }
+}
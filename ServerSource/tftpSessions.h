@@ -0,0 +1,62 @@
+#ifndef TFTP_SESSIONS_H
+#define TFTP_SESSIONS_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "tftpCodec.h"
+
+// --- IN-PROCESS TRANSFER SESSIONS ---
+//
+// A forked transfer costs a process: page tables, a kernel stack, a log
+// thread and every page it dirties, even while it only waits for an ACK.
+// With -E, the main process serves octet transfers itself instead, each as a
+// fixed-size session record (the engine, the peer, a file offset) carved from
+// slabs, like the AF_XDP path does for its transfers.
+//
+// Sessions answer from SESSION_SOCKETS shared transfer sockets, not a socket
+// each, and are found by the client's address and port: the port of the
+// socket a session was put on is the server's TID for that client. A packet
+// from a client without a session on that socket gets ERROR 5. With a -P
+// port range, the sockets are taken from the pool instead: up to half of the
+// range, the rest staying for forked transfers (tftpPool.h).
+//
+// Packet buffers come from a pool, and a session holds one only while the
+// engine's buffer has something to resend: the OACK, or a DATA block read
+// into it. ACKs are kept in the engine and cached DATA is sent from the
+// packet cache (tftpPacketCache.h), so a session receiving a file, or sending
+// a cached one, holds no buffer. Sessions reading one file share its
+// descriptor.
+//
+// Octet RRQs for plain files and archive entries, and octet WRQs, become
+// sessions. Everything else (netascii, multicast, compressed images) and
+// requests beyond the -E limit are forked as before. Rate limits (-r/-R/-B)
+// pace forked transfers only.
+//
+// Retransmission deadlines live in a timing wheel (tftpTimer.h) whose timerfd
+// sits in the sessions' epoll set, so session_fd() turns readable when one is
+// due, however busy or quiet the sockets are.
+
+#define SESSION_MAX 1000000
+#define SESSION_SOCKETS 64
+#define SESSION_BLKSIZE_MAX 1468    // Largest blksize offered: an Ethernet frame
+#define SESSION_PACKET_SIZE (TFTP_HEADER_SIZE + SESSION_BLKSIZE_MAX)
+#define SESSION_SLAB 1024           // Records, or buffers, carved at a time
+#define SESSION_BATCH 64            // Datagrams read from one socket per poll
+#define SESSION_TICK_US 1000        // Retransmission timer resolution (tftpTimer.h)
+
+// Binds the transfer sockets and raises the descriptor limit; -1 (logged) on failure
+int session_init(uint32_t max_sessions);
+// 0 when a session took the request; -1 when it should be forked
+int session_start(const struct tftp_packet *req, const struct sockaddr_in *peer);
+// The transfer socket of peer's session, -1 when it has none
+int session_socket(const struct sockaddr_in *peer);
+// One datagram received on transfer socket 'sock'
+void session_receive(int sock, const char *packet, size_t len, const struct sockaddr_in *from);
+
+// In a process forked from the one running the sessions: closes their sockets and files
+void session_forked(void);
+int session_fd(void);               // For select(), also readable at deadlines; -1 when not running
+void session_poll(void);            // Reads the transfer sockets, handles expired deadlines
+
+#endif
@@ -0,0 +1,390 @@
+#include "tftpServer.h"
+#include <sys/xattr.h>
+
+#ifdef TFTP_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TFTP_ZSTD
+#include <zstd.h>
+#endif
+
+// Compressed variants tried, in order, when the plain file does not exist
+static const struct {
+    const char *suffix;
+    int codec;
+} variants[] = {
+#ifdef TFTP_ZSTD
+    {".zst", TFTP_SOURCE_ZSTD},
+#endif
+#ifdef TFTP_ZLIB
+    {".gz", TFTP_SOURCE_GZIP},
+#endif
+    {NULL, TFTP_SOURCE_PLAIN}
+};
+
+// --- UNCOMPRESSED SIZE ---
+
+// "<size> <mtime sec>.<mtime nsec>": valid only while the compressed file is unchanged
+static void size_record(const struct stat *st, uint64_t size, char *buf, size_t cap) {
+    snprintf(buf, cap, "%llu %lld.%09ld", (unsigned long long)size,
+             (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec);
+}
+
+static uint64_t recorded_size(int fd, const struct stat *st) {
+    char stored[64], expected[64];
+    unsigned long long size;
+    ssize_t n = fgetxattr(fd, TFTP_SOURCE_SIZE_XATTR, stored, sizeof(stored) - 1);
+
+    if (n <= 0) {
+        return TFTP_SOURCE_SIZE_UNKNOWN;
+    }
+    stored[n] = '\0';
+    if (sscanf(stored, "%llu", &size) != 1) {
+        return TFTP_SOURCE_SIZE_UNKNOWN;
+    }
+    size_record(st, size, expected, sizeof(expected));
+    return strcmp(stored, expected) == 0 ? size : TFTP_SOURCE_SIZE_UNKNOWN;
+}
+
+// Size stated by a zstd frame header. The gzip trailer is not used: its ISIZE
+// is the size modulo 2^32 of the last member only, so it cannot be trusted.
+static uint64_t header_size(int fd, int codec) {
+#ifdef TFTP_ZSTD
+    unsigned char buf[18];
+
+    if (codec == TFTP_SOURCE_ZSTD) {
+        ssize_t n = pread(fd, buf, sizeof(buf), 0); // Longest zstd frame header
+        if (n > 0) {
+            unsigned long long size = ZSTD_getFrameContentSize(buf, (size_t)n);
+            if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR) {
+                return size;
+            }
+        }
+    }
+#else
+    (void)fd;
+    (void)codec;
+#endif
+    return TFTP_SOURCE_SIZE_UNKNOWN;
+}
+
+// --- DECOMPRESSION ---
+
+static int stream_init(struct tftp_source *s) {
+#ifdef TFTP_ZLIB
+    if (s->codec == TFTP_SOURCE_GZIP) {
+        z_stream *z = calloc(1, sizeof(*z));
+        if (z == NULL || inflateInit2(z, 15 + 16) != Z_OK) { // 15-bit window, gzip wrapper
+            free(z);
+            return -1;
+        }
+        s->stream = z;
+    }
+#endif
+#ifdef TFTP_ZSTD
+    if (s->codec == TFTP_SOURCE_ZSTD) {
+        s->stream = ZSTD_createDStream();
+        if (s->stream == NULL) {
+            return -1;
+        }
+    }
+#endif
+    s->in = malloc(TFTP_SOURCE_CHUNK);
+    s->out = malloc(TFTP_SOURCE_CHUNK);
+    return s->stream != NULL && s->in != NULL && s->out != NULL ? 0 : -1;
+}
+
+static void stream_free(struct tftp_source *s) {
+#ifdef TFTP_ZLIB
+    if (s->codec == TFTP_SOURCE_GZIP && s->stream != NULL) {
+        inflateEnd(s->stream);
+        free(s->stream);
+    }
+#endif
+#ifdef TFTP_ZSTD
+    if (s->codec == TFTP_SOURCE_ZSTD) {
+        ZSTD_freeDStream(s->stream);
+    }
+#endif
+    s->stream = NULL;
+    free(s->in);
+    free(s->out);
+    s->in = s->out = NULL;
+}
+
+// Decompresses from in[in_off..in_len) into out[out_len..CHUNK). Returns 0 or -1 on corrupt input.
+static int decompress(struct tftp_source *s) {
+#ifdef TFTP_ZLIB
+    if (s->codec == TFTP_SOURCE_GZIP) {
+        z_stream *z = s->stream;
+        z->next_in = (Bytef *)s->in + s->in_off;
+        z->avail_in = (uInt)(s->in_len - s->in_off);
+        z->next_out = (Bytef *)s->out + s->out_len;
+        z->avail_out = (uInt)(TFTP_SOURCE_CHUNK - s->out_len);
+        int rc = inflate(z, Z_NO_FLUSH);
+        s->in_off = s->in_len - z->avail_in;
+        s->out_len = TFTP_SOURCE_CHUNK - z->avail_out;
+        if (rc == Z_STREAM_END) {
+            s->frame_done = 1;
+            inflateReset(z); // Concatenated members continue the stream
+            return 0;
+        }
+        s->frame_done = 0;
+        return rc == Z_OK || rc == Z_BUF_ERROR ? 0 : -1;
+    }
+#endif
+#ifdef TFTP_ZSTD
+    if (s->codec == TFTP_SOURCE_ZSTD) {
+        ZSTD_inBuffer in = {s->in, s->in_len, s->in_off};
+        ZSTD_outBuffer out = {s->out, TFTP_SOURCE_CHUNK, s->out_len};
+        size_t rc = ZSTD_decompressStream(s->stream, &out, &in);
+        if (ZSTD_isError(rc)) {
+            return -1;
+        }
+        s->in_off = in.pos;
+        s->out_len = out.pos;
+        s->frame_done = rc == 0;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+static void drop_cache(struct tftp_source *s) {
+    if (s->cache_fd >= 0) {
+        close(s->cache_fd);
+        unlink(s->cache_tmp);
+        s->cache_fd = -1;
+    }
+}
+
+// Decompresses the next chunk into out[] and copies it to the cache file
+static int refill(struct tftp_source *s) {
+    s->out_len = s->out_off = 0;
+    while (s->out_len < TFTP_SOURCE_CHUNK && !s->stream_end) {
+        if (s->in_off == s->in_len) {
+            ssize_t n = read(s->fd, s->in, TFTP_SOURCE_CHUNK);
+            if (n < 0) {
+                return -1;
+            }
+            s->in_len = (size_t)n;
+            s->in_off = 0;
+            if (n == 0) {
+                // Out of input; the decoder may still hold output that did not fit before
+                size_t before = s->out_len;
+                if (!s->frame_done && decompress(s) == 0 && s->out_len > before) {
+                    continue;
+                }
+                if (!s->frame_done) {
+                    errno = EIO; // Truncated
+                    return -1;
+                }
+                s->stream_end = 1;
+                break;
+            }
+        }
+        if (decompress(s) < 0) {
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    if (s->cache_fd >= 0 && s->out_len > 0) {
+        size_t off = 0;
+        while (off < s->out_len) {
+            ssize_t n = write(s->cache_fd, s->out + off, s->out_len - off);
+            if (n < 0) {
+                tftp_log(TFTP_LOG_WARN, "[Child PID %d] Cache write failed for %s: %s\n",
+                         getpid(), s->cache_tmp, strerror(errno));
+                drop_cache(s);
+                break;
+            }
+            off += (size_t)n;
+        }
+    }
+    return 0;
+}
+
+// --- OPEN / READ / FINISH ---
+
+// "<cache_dir>/<basename>.<dev>-<ino>-<size>-<mtime>" for the compressed file
+static int cache_name(const char *cache_dir, const char *path, const struct stat *st, char *buf, size_t cap) {
+    const char *base = strrchr(path, '/');
+    int n = snprintf(buf, cap, "%s/%s.%llx-%llx-%llx-%lld.%09ld", cache_dir, base != NULL ? base + 1 : path,
+                     (unsigned long long)st->st_dev, (unsigned long long)st->st_ino,
+                     (unsigned long long)st->st_size, (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec);
+    return n < 0 || (size_t)n >= cap ? -1 : 0;
+}
+
+int tftp_source_open(struct tftp_source *s, const char *filename, int allow_compressed, const char *cache_dir) {
+    struct stat st;
+
+    memset(s, 0, sizeof(*s));
+    s->cache_fd = -1;
+    s->size = TFTP_SOURCE_SIZE_UNKNOWN;
+    snprintf(s->path, sizeof(s->path), "%s", filename);
+    s->fd = open(filename, O_RDONLY);
+    if (s->fd >= 0 || errno != ENOENT || !allow_compressed) {
+        if (s->fd >= 0 && fstat(s->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            s->size = (uint64_t)st.st_size;
+        }
+        return s->fd >= 0 ? 0 : -1;
+    }
+
+    // 1. No plain file: look for a compressed one
+    for (int i = 0; variants[i].suffix != NULL && s->fd < 0; i++) {
+        if (snprintf(s->path, sizeof(s->path), "%s%s", filename, variants[i].suffix) >= (int)sizeof(s->path)) {
+            continue;
+        }
+        s->fd = open(s->path, O_RDONLY);
+        if (s->fd < 0 && errno != ENOENT) {
+            return -1;
+        }
+        s->codec = variants[i].codec;
+    }
+    if (s->fd < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (fstat(s->fd, &st) < 0) {
+        close(s->fd);
+        return -1;
+    }
+
+    // 2. A decompressed copy from an earlier transfer is served as a plain file
+    int cached = cache_dir != NULL && cache_dir[0] != '\0' &&
+                 cache_name(cache_dir, s->path, &st, s->cache_path, sizeof(s->cache_path)) == 0;
+    if (cached) {
+        int fd = open(s->cache_path, O_RDONLY);
+        struct stat cst;
+        if (fd >= 0 && fstat(fd, &cst) == 0) {
+            close(s->fd);
+            s->fd = fd;
+            s->codec = TFTP_SOURCE_PLAIN;
+            s->from_cache = 1;
+            s->size = (uint64_t)cst.st_size;
+            snprintf(s->path, sizeof(s->path), "%s", s->cache_path);
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Serving '%s' from cache %s\n", getpid(), filename, s->path);
+            return 0;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // 3. Decompress as the transfer goes, filling the cache on the way
+    s->size = recorded_size(s->fd, &st);
+    if (s->size == TFTP_SOURCE_SIZE_UNKNOWN) {
+        s->size = header_size(s->fd, s->codec);
+    }
+    if (stream_init(s) < 0) {
+        tftp_source_close(s);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (cached && snprintf(s->cache_tmp, sizeof(s->cache_tmp), "%s.tmp.%d", s->cache_path, (int)getpid()) <
+                      (int)sizeof(s->cache_tmp)) {
+        s->cache_fd = open(s->cache_tmp, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (s->cache_fd < 0) {
+            tftp_log(TFTP_LOG_WARN, "[Child PID %d] Cannot create %s: %s\n", getpid(), s->cache_tmp, strerror(errno));
+        }
+    }
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Serving '%s' from %s (decompressing)\n", getpid(), filename, s->path);
+    return 0;
+}
+
+void tftp_source_open_memory(struct tftp_source *s, const char *name, const char *data, uint64_t size) {
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->cache_fd = -1;
+    s->codec = TFTP_SOURCE_MEMORY;
+    s->data = data;
+    s->size = size;
+    snprintf(s->path, sizeof(s->path), "%s", name);
+}
+
+ssize_t tftp_source_read(struct tftp_source *s, char *buf, size_t len) {
+    size_t done = 0;
+
+    if (s->codec == TFTP_SOURCE_PLAIN) {
+        return read(s->fd, buf, len);
+    }
+    if (s->codec == TFTP_SOURCE_MEMORY) {
+        done = s->size - s->offset < len ? (size_t)(s->size - s->offset) : len;
+        memcpy(buf, s->data + s->offset, done);
+        s->offset += done;
+        return (ssize_t)done;
+    }
+    while (done < len) {
+        if (s->out_off == s->out_len) {
+            if (s->stream_end) {
+                break;
+            }
+            if (refill(s) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        size_t n = s->out_len - s->out_off < len - done ? s->out_len - s->out_off : len - done;
+        memcpy(buf + done, s->out + s->out_off, n);
+        s->out_off += n;
+        done += n;
+    }
+    s->produced += done;
+    return (ssize_t)done;
+}
+
+ssize_t tftp_source_read_netascii(struct tftp_source *s, struct tftp_netascii_reader *r, char *buf, size_t len) {
+    if (s->codec != TFTP_SOURCE_MEMORY) {
+        return tftp_netascii_read(r, s->fd, buf, len);
+    }
+    size_t consumed;
+    size_t n = tftp_netascii_encode(&r->state, s->data + s->offset, (size_t)(s->size - s->offset), &consumed, buf, len);
+    r->state.crc = tftp_crc32c(r->state.crc, s->data + s->offset, consumed);
+    s->offset += consumed;
+    return (ssize_t)n;
+}
+
+void tftp_source_finish(struct tftp_source *s, uint32_t crc) {
+    struct stat st;
+
+    if (s->codec == TFTP_SOURCE_PLAIN || s->codec == TFTP_SOURCE_MEMORY || !s->stream_end) {
+        return;
+    }
+
+    // Record the true size for the next tsize, correcting a wrong header guess
+    if (s->size != s->produced) {
+        if (s->size != TFTP_SOURCE_SIZE_UNKNOWN) {
+            tftp_log(TFTP_LOG_WARN, "[Child PID %d] %s decompressed to %llu bytes, not the %llu its header states\n",
+                     getpid(), s->path, (unsigned long long)s->produced, (unsigned long long)s->size);
+        }
+        if (fstat(s->fd, &st) == 0) {
+            char record[64];
+            size_record(&st, s->produced, record, sizeof(record));
+            fsetxattr(s->fd, TFTP_SOURCE_SIZE_XATTR, record, strlen(record), 0);
+        }
+    }
+
+    if (s->cache_fd >= 0) {
+        if (rename(s->cache_tmp, s->cache_path) == 0) {
+            tftp_digest_store(s->cache_fd, s->cache_path, crc);
+            tftp_log(TFTP_LOG_INFO, "[Child PID %d] Cached %llu decompressed bytes as %s\n",
+                     getpid(), (unsigned long long)s->produced, s->cache_path);
+            close(s->cache_fd);
+            s->cache_fd = -1;
+        } else {
+            drop_cache(s);
+        }
+    }
+}
+
+void tftp_source_close(struct tftp_source *s) {
+    drop_cache(s);
+    if (s->codec == TFTP_SOURCE_GZIP || s->codec == TFTP_SOURCE_ZSTD) {
+        stream_free(s);
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+}
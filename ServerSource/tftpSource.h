@@ -0,0 +1,84 @@
+#ifndef TFTP_SOURCE_H
+#define TFTP_SOURCE_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "tftpNetascii.h"
+
+// --- RRQ FILE SOURCES ---
+//
+// A read request for "foo" is served from "foo" when it exists, otherwise
+// from "foo.zst" or "foo.gz" (when the server was built with libzstd / zlib),
+// decompressed as the transfer goes. Decompression runs in large chunks ahead
+// of the block being sent, so most engine reads are a memcpy.
+//
+// With a cache directory, the decompressed stream is also written there and,
+// once complete, renamed into place under a name derived from the compressed
+// file's device, inode, size and mtime; later requests read that plain copy.
+// A replaced or touched image gets a new name, so stale copies are never used.
+//
+// Files found in the server's archive (-a, CommonSource/tftpArchive.h) are
+// served from its mapping instead and never touch the filesystem.
+//
+// The uncompressed size (for tsize) comes from the "user.tftp.size" xattr on
+// the compressed file, recorded after its first full decompression, else from
+// the zstd frame header (which assumes a single frame; a wrong guess is
+// corrected in the xattr once a transfer finishes). A gzip file has no size
+// until it was decompressed once: its trailer holds only the last member's
+// size modulo 4 GiB.
+
+#define TFTP_SOURCE_SIZE_UNKNOWN UINT64_MAX
+#define TFTP_SOURCE_SIZE_XATTR "user.tftp.size"
+#define TFTP_SOURCE_CHUNK (64 * 1024)
+
+enum {
+    TFTP_SOURCE_PLAIN,
+    TFTP_SOURCE_GZIP,
+    TFTP_SOURCE_ZSTD,
+    TFTP_SOURCE_MEMORY,
+};
+
+struct tftp_source {
+    int fd;                         // File being read: plain, cached copy or compressed; -1 for memory
+    int codec;                      // TFTP_SOURCE_*
+    int from_cache;                 // fd is a decompressed copy from the cache
+    uint64_t size;                  // Bytes the transfer will send, or TFTP_SOURCE_SIZE_UNKNOWN
+    char path[PATH_MAX];            // Path of fd
+    const char *data;               // TFTP_SOURCE_MEMORY: the file's bytes
+    uint64_t offset;                // TFTP_SOURCE_MEMORY: next byte to send
+    int recorded;                   // recorded_crc is the data's known CRC32C (set by the opener)
+    uint32_t recorded_crc;
+
+    // Streaming decompression (codec != TFTP_SOURCE_PLAIN)
+    void *stream;                   // z_stream or ZSTD_DStream
+    char *in, *out;
+    size_t in_len, in_off;          // Compressed bytes not yet consumed
+    size_t out_len, out_off;        // Decompressed bytes not yet handed out
+    int frame_done;                 // Input so far ends on a frame/member boundary
+    int stream_end;                 // Every input byte decompressed
+    uint64_t produced;
+    int cache_fd;                   // Decompressed copy being written, or -1
+    char cache_path[PATH_MAX];
+    char cache_tmp[PATH_MAX];
+};
+
+// Opens the source for filename. Compressed variants are only tried when
+// allow_compressed is set; cache_dir may be NULL or "". Returns 0, or -1 with
+// errno set (ENOENT when no variant exists).
+int tftp_source_open(struct tftp_source *s, const char *filename, int allow_compressed, const char *cache_dir);
+// Serves a file that is already in memory (an archive entry)
+void tftp_source_open_memory(struct tftp_source *s, const char *name, const char *data, uint64_t size);
+// Same contract as read(2): short only at the end of the data
+ssize_t tftp_source_read(struct tftp_source *s, char *buf, size_t len);
+// Netascii-encoded read (plain and memory sources), as tftp_netascii_read()
+ssize_t tftp_source_read_netascii(struct tftp_source *s, struct tftp_netascii_reader *r, char *buf, size_t len);
+// Call once every byte was sent: publishes the cached copy (recording crc, the
+// CRC32C of the decompressed data) and the uncompressed size
+void tftp_source_finish(struct tftp_source *s, uint32_t crc);
+// Releases everything; an unpublished cached copy is discarded
+void tftp_source_close(struct tftp_source *s);
+
+#endif
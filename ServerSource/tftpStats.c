@@ -0,0 +1,600 @@
+#include "tftpServer.h"
+#include "tftpStats.h"
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <stdarg.h>
+#include <time.h>
+
+struct tftp_stats *g_stats;
+uint64_t g_request_us;
+
+static uint64_t start_us;
+static int my_slot = -1;            // Slot claimed by this transfer child
+static int first_data_seen;
+
+uint64_t stats_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// Must run before the first fork so children share the mapping
+int stats_init(void) {
+    void *mem = mmap(NULL, sizeof(struct tftp_stats), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("stats mmap failed");
+        return -1;
+    }
+    g_stats = mem; // Anonymous mappings start zeroed
+    start_us = stats_now_us();
+    return 0;
+}
+
+static void histogram_add(struct tftp_histogram *h, uint64_t us) {
+    int bucket = 0;
+    while (bucket < STATS_HIST_BUCKETS - 1 && us >= (1ull << bucket)) {
+        bucket++;
+    }
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_us, us, __ATOMIC_RELAXED);
+}
+
+// --- TRANSFER LIFECYCLE (called from the transfer child) ---
+
+void stats_transfer_begin(uint16_t opcode, const char *filename, const struct sockaddr_in *cliaddr) {
+    if (g_stats == NULL) {
+        return;
+    }
+    STATS_INC(transfers_started);
+    STATS_INC(active_transfers);
+    first_data_seen = 0;
+
+    for (int i = 0; i < STATS_MAX_TRANSFERS; i++) {
+        int32_t expected = 0;
+        struct tftp_transfer_slot *slot = &g_stats->transfers[i];
+        if (__atomic_compare_exchange_n(&slot->pid, &expected, (int32_t)getpid(), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            slot->opcode = opcode;
+            slot->client_addr = cliaddr->sin_addr.s_addr;
+            slot->client_port = ntohs(cliaddr->sin_port);
+            slot->start_us = stats_now_us();
+            slot->bytes = slot->blocks = slot->retransmits = 0;
+            strncpy(slot->filename, filename, STATS_FILENAME_LEN - 1);
+            slot->filename[STATS_FILENAME_LEN - 1] = '\0';
+            my_slot = i;
+            return;
+        }
+    }
+    // Table full: the transfer still counts in the totals
+}
+
+void stats_transfer_end(int success) {
+    if (g_stats == NULL) {
+        return;
+    }
+    if (success) {
+        STATS_INC(transfers_completed);
+    } else {
+        STATS_INC(transfers_failed);
+    }
+    STATS_ADD(active_transfers, -1);
+    histogram_add(&g_stats->transfer_time, stats_now_us() - g_request_us);
+
+    if (my_slot >= 0) {
+        __atomic_store_n(&g_stats->transfers[my_slot].pid, 0, __ATOMIC_RELEASE);
+        my_slot = -1;
+    }
+}
+
+void stats_first_data(void) {
+    if (g_stats == NULL || first_data_seen) {
+        return;
+    }
+    first_data_seen = 1;
+    histogram_add(&g_stats->first_data, stats_now_us() - g_request_us);
+}
+
+void stats_first_data_since(uint64_t request_us) {
+    if (g_stats != NULL) {
+        histogram_add(&g_stats->first_data, stats_now_us() - request_us);
+    }
+}
+
+void stats_socket_wait(uint64_t us) {
+    if (g_stats != NULL) {
+        histogram_add(&g_stats->socket_wait, us);
+    }
+}
+
+void stats_data_sent(uint64_t bytes) {
+    STATS_INC(blocks_sent);
+    STATS_ADD(bytes_sent, bytes);
+    if (g_stats && my_slot >= 0) {
+        g_stats->transfers[my_slot].blocks++;
+        g_stats->transfers[my_slot].bytes += bytes;
+    }
+}
+
+void stats_data_received(uint64_t bytes) {
+    STATS_INC(blocks_received);
+    STATS_ADD(bytes_received, bytes);
+    if (g_stats && my_slot >= 0) {
+        g_stats->transfers[my_slot].blocks++;
+        g_stats->transfers[my_slot].bytes += bytes;
+    }
+}
+
+void stats_retransmit(void) {
+    STATS_INC(retransmits);
+    if (g_stats && my_slot >= 0) {
+        g_stats->transfers[my_slot].retransmits++;
+    }
+}
+
+void stats_error_sent(int code) {
+    if (code >= 0 && code < STATS_ERROR_CODES) {
+        STATS_INC(errors_sent[code]);
+    }
+}
+
+// --- UNIX SOCKET EXPORTER (called from the parent's main loop) ---
+
+int stats_listen(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        tftp_log(TFTP_LOG_ERROR, "Stats socket path too long: %s\n", path);
+        return -1;
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("stats socket creation failed");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path); // Stale socket from a previous run
+
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("stats socket bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct out_buf {
+    char *data;
+    size_t used;
+    size_t size;
+};
+
+static void out_printf(struct out_buf *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out_printf(struct out_buf *out, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    while (1) {
+        va_start(ap, fmt);
+        n = vsnprintf(out->data + out->used, out->size - out->used, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < out->size - out->used) {
+            out->used += (size_t)n;
+            return;
+        }
+        char *bigger = realloc(out->data, out->size * 2);
+        if (bigger == NULL) {
+            return;
+        }
+        out->data = bigger;
+        out->size *= 2;
+    }
+}
+
+// Prometheus label values escape backslash, double quote and newline
+static void escape_label(char *dst, size_t size, const char *src) {
+    size_t used = 0;
+    for (; *src && used + 3 < size; src++) {
+        if (*src == '\\' || *src == '"') {
+            dst[used++] = '\\';
+            dst[used++] = *src;
+        } else if (*src == '\n') {
+            dst[used++] = '\\';
+            dst[used++] = 'n';
+        } else {
+            dst[used++] = *src;
+        }
+    }
+    dst[used] = '\0';
+}
+
+static void prom_counter(struct out_buf *out, const char *name, const char *help,
+                         const char *type, uint64_t value) {
+    out_printf(out, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type,
+               name, (unsigned long long)value);
+}
+
+static void prom_histogram(struct out_buf *out, const char *name, const char *help,
+                           const struct tftp_histogram *h) {
+    uint64_t cumulative = 0;
+
+    out_printf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int i = 0; i < STATS_HIST_BUCKETS - 1; i++) {
+        cumulative += h->buckets[i];
+        out_printf(out, "%s_bucket{le=\"%g\"} %llu\n", name, (double)(1ull << i) / 1e6,
+                   (unsigned long long)cumulative);
+    }
+    out_printf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h->count);
+    out_printf(out, "%s_sum %.6f\n%s_count %llu\n", name, (double)h->sum_us / 1e6,
+               name, (unsigned long long)h->count);
+}
+
+static void render_prometheus(struct out_buf *out, const struct tftp_stats *s) {
+    uint64_t now = stats_now_us();
+
+    out_printf(out, "# HELP tftp_requests_total Requests received on the listening port.\n"
+                    "# TYPE tftp_requests_total counter\n");
+    out_printf(out, "tftp_requests_total{type=\"rrq\"} %llu\n", (unsigned long long)s->requests_rrq);
+    out_printf(out, "tftp_requests_total{type=\"wrq\"} %llu\n", (unsigned long long)s->requests_wrq);
+    out_printf(out, "tftp_requests_total{type=\"multicast\"} %llu\n", (unsigned long long)s->requests_multicast);
+    out_printf(out, "tftp_requests_total{type=\"malformed\"} %llu\n", (unsigned long long)s->requests_malformed);
+
+    prom_counter(out, "tftp_active_transfers", "Transfers in progress.", "gauge",
+                 s->active_transfers > 0 ? (uint64_t)s->active_transfers : 0);
+    prom_counter(out, "tftp_transfers_started_total", "Transfers started.", "counter", s->transfers_started);
+    prom_counter(out, "tftp_transfers_completed_total", "Transfers completed.", "counter", s->transfers_completed);
+    prom_counter(out, "tftp_transfers_failed_total", "Transfers aborted or failed.", "counter", s->transfers_failed);
+    prom_counter(out, "tftp_bytes_sent_total", "DATA payload bytes sent.", "counter", s->bytes_sent);
+    prom_counter(out, "tftp_bytes_received_total", "DATA payload bytes received.", "counter", s->bytes_received);
+    prom_counter(out, "tftp_blocks_sent_total", "DATA blocks sent (first transmissions).", "counter", s->blocks_sent);
+    prom_counter(out, "tftp_blocks_received_total", "DATA blocks received and written.", "counter", s->blocks_received);
+    prom_counter(out, "tftp_retransmits_total", "Retransmitted DATA/ACK packets.", "counter", s->retransmits);
+    prom_counter(out, "tftp_timeouts_total", "Receive timeouts inside transfers.", "counter", s->timeouts);
+    prom_counter(out, "tftp_requests_queued_total", "Requests held back by the transfer cap.", "counter",
+                 s->requests_queued);
+    prom_counter(out, "tftp_requests_shed_total", "Queued requests dropped (queue full or expired).", "counter",
+                 s->requests_shed);
+    prom_counter(out, "tftp_queue_depth", "Requests waiting for a transfer slot.", "gauge",
+                 s->queue_depth > 0 ? (uint64_t)s->queue_depth : 0);
+    prom_counter(out, "tftp_pacing_waits_total", "Sleeps for a rate limit or a DRR turn.", "counter",
+                 s->pacing_waits);
+    out_printf(out, "# HELP tftp_paced_seconds_total Time transfers slept for pacing.\n"
+                    "# TYPE tftp_paced_seconds_total counter\ntftp_paced_seconds_total %.6f\n",
+               (double)s->paced_us / 1e6);
+    prom_counter(out, "tftp_blksize_negotiated_total", "Transfers that negotiated a blksize.", "counter",
+                 s->blksize_negotiated);
+    prom_counter(out, "tftp_blksize_lowered_total", "Client blksize caps lowered after repeated loss.", "counter",
+                 s->blksize_lowered);
+    prom_counter(out, "tftp_socket_pool_hits_total", "Transfers given a pre-bound socket.", "counter",
+                 s->pool_hits);
+    prom_counter(out, "tftp_socket_pool_misses_total", "Transfers that bound a socket of their own.", "counter",
+                 s->pool_misses);
+    prom_counter(out, "tftp_socket_pool_waits_total", "Requests queued until a transfer port was free.", "counter",
+                 s->pool_waits);
+    prom_counter(out, "tftp_socket_pool_stale_total", "Late packets discarded from returned sockets.", "counter",
+                 s->pool_stale);
+    prom_counter(out, "tftp_unknown_tid_total", "Packets from the wrong address or port inside a transfer.",
+                 "counter", s->unknown_tid);
+    prom_counter(out, "tftp_packet_cache_hits_total", "Read transfers sent from pre-encoded DATA packets.",
+                 "counter", s->pcache_hits);
+    prom_counter(out, "tftp_packet_cache_misses_total", "Cacheable read transfers that found no packets.",
+                 "counter", s->pcache_misses);
+    prom_counter(out, "tftp_packet_cache_blocks_total", "DATA blocks sent from the packet cache.", "counter",
+                 s->pcache_blocks);
+    prom_counter(out, "tftp_packet_cache_builds_total", "Files split into packets for the cache.", "counter",
+                 s->pcache_builds);
+    prom_counter(out, "tftp_packet_cache_evictions_total", "Packet sets dropped to make room.", "counter",
+                 s->pcache_evictions);
+    prom_counter(out, "tftp_packet_cache_bytes", "Memory held by the packet cache.", "gauge",
+                 s->pcache_bytes > 0 ? (uint64_t)s->pcache_bytes : 0);
+    prom_counter(out, "tftp_packet_cache_files", "Packet sets in the cache.", "gauge",
+                 s->pcache_files > 0 ? (uint64_t)s->pcache_files : 0);
+    prom_counter(out, "tftp_sessions_started_total", "Transfers served in the main process.", "counter",
+                 s->sessions_started);
+    prom_counter(out, "tftp_sessions", "Transfers served in the main process now.", "gauge",
+                 s->sessions > 0 ? (uint64_t)s->sessions : 0);
+    prom_counter(out, "tftp_session_buffers", "Packet buffers lent to those transfers now.", "gauge",
+                 s->session_buffers > 0 ? (uint64_t)s->session_buffers : 0);
+    prom_counter(out, "tftp_warm_files_total", "Hot files prewarmed at startup.", "counter", s->warm_files);
+    prom_counter(out, "tftp_warm_bytes_total", "Bytes read to prewarm them.", "counter", s->warm_bytes);
+    prom_counter(out, "tftp_warm_milliseconds", "Time to prewarm the hot files, 0 until done.", "gauge",
+                 s->warm_us > 0 ? (uint64_t)s->warm_us / 1000 : 0);
+    prom_counter(out, "tftp_first_minute_rrqs_total", "Read requests in the first minute after startup.",
+                 "counter", s->first_minute_rrqs);
+    prom_counter(out, "tftp_first_minute_warm_total", "Those for files already prewarmed.", "counter",
+                 s->first_minute_warm);
+
+    out_printf(out, "# HELP tftp_errors_sent_total ERROR packets sent, by TFTP error code.\n"
+                    "# TYPE tftp_errors_sent_total counter\n");
+    for (int code = 0; code < STATS_ERROR_CODES; code++) {
+        out_printf(out, "tftp_errors_sent_total{code=\"%d\"} %llu\n", code,
+                   (unsigned long long)s->errors_sent[code]);
+    }
+
+    prom_histogram(out, "tftp_first_data_seconds",
+                   "Time from request receipt to the first DATA packet.", &s->first_data);
+    prom_histogram(out, "tftp_transfer_seconds", "Total transfer time.", &s->transfer_time);
+    prom_histogram(out, "tftp_socket_wait_seconds",
+                   "Time to get a transfer socket, including time queued for a free port.", &s->socket_wait);
+
+    // Live per-transfer table
+    out_printf(out, "# HELP tftp_transfer_bytes Bytes moved by an active transfer.\n"
+                    "# TYPE tftp_transfer_bytes gauge\n"
+                    "# HELP tftp_transfer_throughput_bytes_per_second Average throughput of an active transfer.\n"
+                    "# TYPE tftp_transfer_throughput_bytes_per_second gauge\n"
+                    "# HELP tftp_transfer_retransmits Retransmissions of an active transfer.\n"
+                    "# TYPE tftp_transfer_retransmits gauge\n");
+    for (int i = 0; i < STATS_MAX_TRANSFERS; i++) {
+        const struct tftp_transfer_slot *t = &s->transfers[i];
+        char file[2 * STATS_FILENAME_LEN + 1];
+        char labels[256];
+        struct in_addr addr;
+
+        if (t->pid == 0) {
+            continue;
+        }
+        addr.s_addr = t->client_addr;
+        escape_label(file, sizeof(file), t->filename);
+        snprintf(labels, sizeof(labels), "pid=\"%d\",type=\"%s\",file=\"%s\",client=\"%s:%u\"",
+                 t->pid, t->opcode == OP_RRQ ? "rrq" : "wrq", file, inet_ntoa(addr), t->client_port);
+
+        double elapsed = (double)(now - t->start_us) / 1e6;
+        out_printf(out, "tftp_transfer_bytes{%s} %llu\n", labels, (unsigned long long)t->bytes);
+        out_printf(out, "tftp_transfer_throughput_bytes_per_second{%s} %.0f\n", labels,
+                   elapsed > 0 ? (double)t->bytes / elapsed : 0.0);
+        out_printf(out, "tftp_transfer_retransmits{%s} %llu\n", labels, (unsigned long long)t->retransmits);
+    }
+}
+
+// Readers are served from the parent's main loop, which must stay
+// single-threaded because it forks (tftpLog.h). Their sockets are
+// non-blocking, and a reader gets STATS_READER_US to send its request and
+// again to take the answer, so one that connects and then stalls never holds
+// up requests, transfers or the other readers.
+#define STATS_MAX_READERS 8
+#define STATS_READER_US 200000
+
+struct stats_reader {
+    int fd;                         // -1 when the slot is free
+    uint64_t deadline_us;
+    size_t request_len;
+    char request[16];
+    struct out_buf out;             // The answer; data is NULL while the request is read
+    size_t sent;
+};
+
+static int exporter_epoll = -1;
+static int exporter_listen = -1;
+static int listen_paused;           // Every slot busy: new readers wait in the backlog
+static struct stats_reader readers[STATS_MAX_READERS];
+
+static void listen_watch(int watch) {
+    struct epoll_event ev;
+
+    ev.events = watch ? EPOLLIN : 0;
+    ev.data.ptr = NULL; // The listener
+    epoll_ctl(exporter_epoll, EPOLL_CTL_MOD, exporter_listen, &ev);
+    listen_paused = !watch;
+}
+
+static void out_append(struct out_buf *out, const void *data, size_t len) {
+    while (out->size - out->used < len) {
+        char *bigger = realloc(out->data, out->size * 2);
+        if (bigger == NULL) {
+            return;
+        }
+        out->data = bigger;
+        out->size *= 2;
+    }
+    memcpy(out->data + out->used, data, len);
+    out->used += len;
+}
+
+static void reader_close(struct stats_reader *r) {
+    // Explicitly: a child forked a moment ago may still share the socket
+    epoll_ctl(exporter_epoll, EPOLL_CTL_DEL, r->fd, NULL);
+    close(r->fd);
+    free(r->out.data);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    if (listen_paused) {
+        listen_watch(1);
+    }
+}
+
+// Returns 1 once the whole answer went out or the reader is gone
+static int reader_write(struct stats_reader *r) {
+    while (r->sent < r->out.used) {
+        ssize_t n = write(r->fd, r->out.data + r->sent, r->out.used - r->sent);
+        if (n < 0) {
+            return errno != EAGAIN && errno != EINTR;
+        }
+        r->sent += (size_t)n;
+    }
+    return 1;
+}
+
+// Renders the answer to what was read of the request and starts sending it
+static void reader_answer(struct stats_reader *r) {
+    struct tftp_stats snapshot;
+    struct epoll_event ev;
+
+    memcpy(&snapshot, g_stats, sizeof(snapshot));
+    r->out.size = 16384;
+    r->out.used = 0;
+    r->out.data = malloc(r->out.size);
+    if (r->out.data == NULL) {
+        reader_close(r);
+        return;
+    }
+
+    if (strncmp(r->request, "binary", 6) == 0) {
+        struct tftp_stats_binary_header hdr;
+        hdr.magic = STATS_BINARY_MAGIC;
+        hdr.version = STATS_BINARY_VERSION;
+        hdr.size = sizeof(snapshot);
+        hdr.reserved = 0;
+        hdr.uptime_us = stats_now_us() - start_us;
+        out_append(&r->out, &hdr, sizeof(hdr));
+        out_append(&r->out, &snapshot, sizeof(snapshot));
+    } else {
+        render_prometheus(&r->out, &snapshot);
+    }
+
+    if (reader_write(r)) {
+        reader_close(r);
+        return;
+    }
+    ev.events = EPOLLOUT;
+    ev.data.ptr = r;
+    epoll_ctl(exporter_epoll, EPOLL_CTL_MOD, r->fd, &ev);
+    r->deadline_us = stats_now_us() + STATS_READER_US;
+}
+
+// Returns 1 once the request is complete: a line, a full buffer, or EOF
+static int reader_read(struct stats_reader *r) {
+    ssize_t n = read(r->fd, r->request + r->request_len, sizeof(r->request) - 1 - r->request_len);
+
+    if (n < 0) {
+        return errno != EAGAIN && errno != EINTR;
+    }
+    r->request_len += (size_t)n;
+    return n == 0 || r->request_len == sizeof(r->request) - 1 ||
+           memchr(r->request, '\n', r->request_len) != NULL;
+}
+
+static void exporter_accept(void) {
+    while (1) {
+        struct stats_reader *r = NULL;
+        struct epoll_event ev;
+
+        for (int i = 0; i < STATS_MAX_READERS && r == NULL; i++) {
+            if (readers[i].fd < 0) {
+                r = &readers[i];
+            }
+        }
+        if (r == NULL) {
+            listen_watch(0); // Until reader_close() frees a slot
+            return;
+        }
+        int fd = accept4(exporter_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        r->fd = fd;
+        r->deadline_us = stats_now_us() + STATS_READER_US;
+        ev.events = EPOLLIN;
+        ev.data.ptr = r;
+        if (epoll_ctl(exporter_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            reader_close(r);
+        }
+    }
+    if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+        perror("stats accept failed");
+    }
+}
+
+int stats_serve(int listen_fd) {
+    struct epoll_event ev;
+
+    if (g_stats == NULL || (exporter_epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        return -1;
+    }
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // The listener
+    if (epoll_ctl(exporter_epoll, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        close(exporter_epoll);
+        exporter_epoll = -1;
+        return -1;
+    }
+    exporter_listen = listen_fd;
+    for (int i = 0; i < STATS_MAX_READERS; i++) {
+        readers[i].fd = -1;
+    }
+    return 0;
+}
+
+int stats_fd(void) {
+    return exporter_epoll;
+}
+
+int stats_timeout_ms(void) {
+    uint64_t now = stats_now_us();
+    int wait_ms = -1;
+
+    for (int i = 0; i < STATS_MAX_READERS && exporter_epoll >= 0; i++) {
+        if (readers[i].fd < 0) {
+            continue;
+        }
+        int ms = readers[i].deadline_us > now ? (int)((readers[i].deadline_us - now + 999) / 1000) : 0;
+        if (wait_ms < 0 || ms < wait_ms) {
+            wait_ms = ms;
+        }
+    }
+    return wait_ms;
+}
+
+void stats_poll(void) {
+    struct epoll_event events[STATS_MAX_READERS + 1];
+
+    if (exporter_epoll < 0) {
+        return;
+    }
+    int n = epoll_wait(exporter_epoll, events, STATS_MAX_READERS + 1, 0);
+    for (int i = 0; i < n; i++) {
+        struct stats_reader *r = events[i].data.ptr;
+
+        if (r == NULL) {
+            exporter_accept();
+        } else if (r->fd < 0) {
+            continue; // Closed earlier in this batch
+        } else if (r->out.data == NULL) {
+            if (reader_read(r)) {
+                reader_answer(r);
+            }
+        } else if (reader_write(r)) {
+            reader_close(r);
+        }
+    }
+
+    // A reader that sent no request in time gets the Prometheus text; one
+    // that stopped taking its answer is dropped
+    uint64_t now = stats_now_us();
+    for (int i = 0; i < STATS_MAX_READERS; i++) {
+        if (readers[i].fd < 0 || now < readers[i].deadline_us) {
+            continue;
+        }
+        if (readers[i].out.data == NULL) {
+            reader_answer(&readers[i]);
+        } else {
+            reader_close(&readers[i]);
+        }
+    }
+}
+
+// Only closes: the epoll set is shared with the parent and must not change
+void stats_forked(void) {
+    if (exporter_epoll < 0) {
+        return;
+    }
+    for (int i = 0; i < STATS_MAX_READERS; i++) {
+        if (readers[i].fd >= 0) {
+            close(readers[i].fd);
+            free(readers[i].out.data);
+            readers[i].fd = -1;
+        }
+    }
+    close(exporter_epoll);
+    close(exporter_listen);
+    exporter_epoll = -1;
+    exporter_listen = -1;
+}
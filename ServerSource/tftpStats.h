@@ -0,0 +1,126 @@
+#ifndef TFTP_STATS_H
+#define TFTP_STATS_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+
+// --- SERVER METRICS ---
+//
+// Counters live in one MAP_SHARED anonymous mapping created by main() before
+// the first fork, so every transfer child updates the same numbers with atomic
+// adds. The parent serves snapshots on a Unix stream socket: a client connects,
+// writes "prom\n" (Prometheus text exposition) or "binary\n" (the raw
+// struct tftp_stats_binary below) and reads until EOF.
+
+#define STATS_HIST_BUCKETS 32       // Bucket i counts samples < 2^i microseconds
+#define STATS_MAX_TRANSFERS 256     // Per-transfer slots shown in the live table
+#define STATS_FILENAME_LEN 64
+#define STATS_ERROR_CODES 9         // TFTP error codes 0..8
+#define STATS_BINARY_MAGIC 0x54465354u // "TFST"
+#define STATS_BINARY_VERSION 7
+
+struct tftp_histogram {
+    uint64_t buckets[STATS_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+};
+
+struct tftp_transfer_slot {
+    int32_t pid;                    // 0 when free
+    uint16_t opcode;                // OP_RRQ / OP_WRQ
+    uint16_t client_port;
+    uint32_t client_addr;           // Network byte order
+    uint64_t start_us;              // CLOCK_MONOTONIC
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t retransmits;
+    char filename[STATS_FILENAME_LEN];
+};
+
+struct tftp_stats {
+    uint64_t requests_rrq;
+    uint64_t requests_wrq;
+    uint64_t requests_multicast;
+    uint64_t requests_malformed;
+    int64_t active_transfers;
+    uint64_t transfers_started;
+    uint64_t transfers_completed;
+    uint64_t transfers_failed;
+    uint64_t bytes_sent;            // DATA payload bytes
+    uint64_t bytes_received;
+    uint64_t blocks_sent;
+    uint64_t blocks_received;
+    uint64_t retransmits;
+    uint64_t timeouts;
+    uint64_t requests_queued;       // Held back by the transfer cap (tftpSched.c)
+    uint64_t requests_shed;         // Dropped: queue full, or waited past the client's retries
+    int64_t queue_depth;
+    uint64_t pacing_waits;          // Times a transfer slept for a rate limit or its DRR turn
+    uint64_t paced_us;
+    uint64_t blksize_negotiated;    // Transfers that answered a blksize option (tftpBlksize.c)
+    uint64_t blksize_lowered;       // Per-client blksize caps lowered after repeated loss
+    uint64_t pool_hits;             // Transfers given a pre-bound socket (tftpPool.c)
+    uint64_t pool_misses;           // Pool empty: a socket was bound for the transfer
+    uint64_t pool_waits;            // Requests queued until a port of the range was free
+    uint64_t pool_stale;            // Late packets discarded from a returned socket
+    uint64_t unknown_tid;           // Packets from another address or port inside a transfer
+    uint64_t pcache_hits;           // RRQs sent from pre-encoded packets (tftpPacketCache.c)
+    uint64_t pcache_misses;         // Cacheable RRQs that found no packets for their blksize
+    uint64_t pcache_blocks;         // DATA packets sent from the cache, first transmissions
+    uint64_t pcache_builds;
+    uint64_t pcache_evictions;
+    int64_t pcache_bytes;           // Held by the cache now
+    int64_t pcache_files;
+    uint64_t sessions_started;      // Transfers served in the main process (tftpSessions.c)
+    int64_t sessions;               // Running now
+    int64_t session_buffers;        // Packet buffers lent to them now
+    uint64_t warm_files;            // Hot files read back into the page cache at startup (tftpWarm.c)
+    uint64_t warm_bytes;
+    int64_t warm_us;                // How long that took, 0 until done
+    uint64_t first_minute_rrqs;     // RRQs in the server's first minute (with -W)
+    uint64_t first_minute_warm;     // Those for files already prewarmed
+    uint64_t errors_sent[STATS_ERROR_CODES];
+    struct tftp_histogram first_data;   // Request receipt to first DATA sent (RRQ) or received (WRQ)
+    struct tftp_histogram transfer_time;
+    struct tftp_histogram socket_wait;  // Getting the transfer socket, queued time included
+    struct tftp_transfer_slot transfers[STATS_MAX_TRANSFERS];
+};
+
+// Layout of the "binary" reply: this header followed by struct tftp_stats
+struct tftp_stats_binary_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                  // sizeof(struct tftp_stats)
+    uint32_t reserved;
+    uint64_t uptime_us;
+};
+
+extern struct tftp_stats *g_stats;
+extern uint64_t g_request_us;       // When the current request was received (set in main)
+
+#define STATS_ADD(field, n) \
+    do { if (g_stats) __atomic_fetch_add(&g_stats->field, (n), __ATOMIC_RELAXED); } while (0)
+#define STATS_INC(field) STATS_ADD(field, 1)
+
+uint64_t stats_now_us(void);
+int stats_init(void);
+int stats_listen(const char *path);
+int stats_serve(int listen_fd);     // Readers are then answered by stats_poll(); 0 or -1
+int stats_fd(void);                 // For select(); -1 when not serving
+int stats_timeout_ms(void);         // Until the next reader deadline, -1 when no reader is connected
+void stats_poll(void);              // Accepts, reads and answers readers without blocking
+void stats_forked(void);            // Closes the exporter's descriptors in a forked child
+
+void stats_transfer_begin(uint16_t opcode, const char *filename, const struct sockaddr_in *cliaddr);
+void stats_transfer_end(int success);
+void stats_data_sent(uint64_t bytes);
+void stats_data_received(uint64_t bytes);
+void stats_retransmit(void);
+void stats_first_data(void);
+// For transfers that share a process: the first DATA of one received at request_us
+void stats_first_data_since(uint64_t request_us);
+void stats_error_sent(int code);
+void stats_socket_wait(uint64_t us);
+
+#endif
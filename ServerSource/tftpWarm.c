@@ -0,0 +1,330 @@
+#include "tftpServer.h"
+#include "tftpWarm.h"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_BEST_EFFORT_LOWEST (2 << 13 | 7)
+
+// Requests for one name. A name hashed to a taken slot wears its count down
+// instead, and takes the slot once that reaches zero, as the packet cache's
+// demand table does (tftpPacketCache.c).
+struct warm_count {
+    uint64_t tag;                   // Of the name, 0 = free
+    uint64_t requests;
+    char name[WARM_NAME_MAX];
+};
+
+// A line of the manifest loaded at startup
+struct warm_entry {
+    uint64_t tag;
+    uint64_t requests;
+    uint64_t size;
+    char name[WARM_NAME_MAX];
+};
+
+static struct warm_count counts[WARM_SLOTS];
+static struct warm_entry manifest[WARM_MANIFEST_MAX]; // Busiest first
+static uint32_t manifest_count;
+static uint8_t *g_warmed;           // MAP_SHARED: manifest[i] was read by the child
+static char g_path[256];            // "" = off
+static uint64_t g_start_us, g_last_save_us;
+static pid_t g_warmer;
+static int g_reported;
+
+static uint64_t name_tag(const char *name) {
+    return tftp_archive_hash(name, strlen(name)) | 1;
+}
+
+static void count_name(const char *name, uint64_t n) {
+    if (strlen(name) >= WARM_NAME_MAX || strchr(name, '\n') != NULL) {
+        return;
+    }
+    uint64_t tag = name_tag(name);
+    struct warm_count *c = &counts[tag % WARM_SLOTS];
+
+    if (c->tag == tag && strcmp(c->name, name) == 0) {
+        c->requests += n;
+    } else if (c->requests > n) {
+        c->requests -= n;
+    } else {
+        c->tag = tag;
+        c->requests = n - c->requests;
+        snprintf(c->name, sizeof(c->name), "%s", name);
+    }
+}
+
+// Bytes a transfer of 'name' reads from disk; -1 when nothing would be served
+static int source_size(const char *name, uint64_t *size) {
+    const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, name);
+    const char *suffixes[] = { "", ".zst", ".gz" };
+    char path[WARM_NAME_MAX + 8];
+    struct stat st;
+
+    if (entry != NULL) {
+        *size = entry->size;
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(path, sizeof(path), "%s%s", name, suffixes[i]);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            *size = (uint64_t)st.st_size;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --- MANIFEST ---
+
+static int busiest_first(const void *a, const void *b) {
+    const struct warm_count *x = *(const struct warm_count *const *)a;
+    const struct warm_count *y = *(const struct warm_count *const *)b;
+    return x->requests < y->requests ? 1 : x->requests > y->requests ? -1 : 0;
+}
+
+static void save(void) {
+    static const struct warm_count *order[WARM_SLOTS];
+    char tmp[sizeof(g_path) + 8];
+    uint32_t n = 0, saved = 0;
+
+    for (int i = 0; i < WARM_SLOTS; i++) {
+        if (counts[i].tag != 0 && counts[i].requests > 0) {
+            order[n++] = &counts[i];
+        }
+    }
+    qsort(order, n, sizeof(order[0]), busiest_first);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        tftp_log(TFTP_LOG_WARN, "Cannot write hot-set manifest %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+    fprintf(f, "# requests size name\n");
+    for (uint32_t i = 0; i < n && saved < WARM_MANIFEST_MAX; i++) {
+        uint64_t size;
+        if (source_size(order[i]->name, &size) == 0) {
+            fprintf(f, "%llu %llu %s\n", (unsigned long long)order[i]->requests, (unsigned long long)size,
+                    order[i]->name);
+            saved++;
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp, g_path) < 0) {
+        tftp_log(TFTP_LOG_WARN, "Cannot write hot-set manifest %s: %s\n", g_path, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    tftp_log(TFTP_LOG_DEBUG, "Saved %u hot files to %s.\n", saved, g_path);
+}
+
+static void load(void) {
+    char line[WARM_NAME_MAX + 64];
+    FILE *f = fopen(g_path, "r");
+
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            tftp_log(TFTP_LOG_WARN, "Cannot read hot-set manifest %s: %s\n", g_path, strerror(errno));
+        }
+        return;
+    }
+    while (manifest_count < WARM_MANIFEST_MAX && fgets(line, sizeof(line), f) != NULL) {
+        struct warm_entry *e = &manifest[manifest_count];
+        unsigned long long requests, size;
+        int name_at = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || sscanf(line, "%llu %llu %n", &requests, &size, &name_at) != 2 || name_at == 0 ||
+            line[name_at] == '\0' || strlen(line + name_at) >= WARM_NAME_MAX) {
+            continue;
+        }
+        snprintf(e->name, sizeof(e->name), "%s", line + name_at);
+        e->tag = name_tag(e->name);
+        e->requests = requests;
+        e->size = size;
+        count_name(e->name, requests);
+        manifest_count++;
+    }
+    fclose(f);
+}
+
+// --- PREWARMING CHILD ---
+
+// Reads [offset, offset + size) of fd, or all of it when size is 0
+static uint64_t read_range(int fd, uint64_t offset, uint64_t size, char *buf) {
+    uint64_t done = 0;
+    ssize_t n;
+
+    posix_fadvise(fd, (off_t)offset, (off_t)size, POSIX_FADV_WILLNEED); // Queue it all at once
+    while ((size == 0 || done < size) &&
+           (n = pread(fd, buf, size == 0 || size - done > WARM_CHUNK ? WARM_CHUNK : (size_t)(size - done),
+                      (off_t)(offset + done))) > 0) {
+        done += (uint64_t)n;
+    }
+    return done;
+}
+
+static uint64_t warm_file(const char *name, int archive_fd, char *buf) {
+    const struct tftp_archive_entry *entry = tftp_archive_lookup(&g_archive, name);
+    struct tftp_source source;
+    uint64_t bytes;
+
+    if (entry != NULL) {
+        return archive_fd >= 0 && entry->size > 0 ? read_range(archive_fd, entry->offset, entry->size, buf) : 0;
+    }
+    // The plain file, else what a transfer would read: the decompressed copy,
+    // or the image, decompressed into the cache directory on the way
+    if (tftp_source_open(&source, name, 1, g_config.cache_dir) < 0) {
+        return 0;
+    }
+    if (source.codec == TFTP_SOURCE_PLAIN) {
+        bytes = read_range(source.fd, 0, 0, buf);
+    } else {
+        uint32_t crc = 0;
+        ssize_t n;
+        bytes = 0;
+        while ((n = tftp_source_read(&source, buf, WARM_CHUNK)) > 0) {
+            crc = tftp_crc32c(crc, buf, (size_t)n);
+            bytes += (uint64_t)n;
+        }
+        if (n == 0) {
+            tftp_source_finish(&source, crc);
+        }
+    }
+    tftp_source_close(&source);
+    return bytes;
+}
+
+static void prewarm(void) {
+    char *buf = malloc(WARM_CHUNK);
+    int archive_fd = g_config.archive_path[0] != '\0' ? open(g_config.archive_path, O_RDONLY) : -1;
+    uint32_t files = 0;
+    uint64_t bytes = 0;
+
+    // Behind the transfers, for the CPU and the disk
+    setpriority(PRIO_PROCESS, 0, 19);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_BEST_EFFORT_LOWEST);
+    for (uint32_t i = 0; i < manifest_count && buf != NULL; i++) {
+        uint64_t n = warm_file(manifest[i].name, archive_fd, buf);
+        if (n > 0 || manifest[i].size == 0) {
+            files++;
+            bytes += n;
+            STATS_INC(warm_files);
+            STATS_ADD(warm_bytes, n);
+        }
+        __atomic_store_n(&g_warmed[i], 1, __ATOMIC_RELEASE);
+    }
+    uint64_t elapsed_us = stats_now_us() - g_start_us;
+    STATS_ADD(warm_us, (int64_t)elapsed_us);
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Prewarmed %u of %u hot files (%.1f MiB) in %.2f s.\n", getpid(), files,
+             manifest_count, (double)bytes / (1 << 20), (double)elapsed_us / 1e6);
+    free(buf);
+}
+
+// --- PARENT ---
+
+int warm_init(const char *manifest_path) {
+    if (manifest_path == NULL || manifest_path[0] == '\0') {
+        return 0;
+    }
+    snprintf(g_path, sizeof(g_path), "%s", manifest_path);
+    g_start_us = g_last_save_us = stats_now_us();
+    load();
+    if (manifest_count == 0) {
+        tftp_log(TFTP_LOG_INFO, "No hot-set manifest at %s yet; it is written once a minute.\n", g_path);
+        return 0;
+    }
+    void *mem = mmap(NULL, WARM_MANIFEST_MAX, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("warm mmap failed");
+        return -1;
+    }
+    g_warmed = mem;
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < manifest_count; i++) {
+        total += manifest[i].size;
+    }
+    tftp_log(TFTP_LOG_INFO, "Prewarming %u hot files (%.1f MiB) from %s in the background.\n", manifest_count,
+             (double)total / (1 << 20), g_path);
+    tftp_trace_flush();
+    g_warmer = fork();
+    if (g_warmer < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (g_warmer == 0) {
+        session_forked();
+        stats_forked();
+        tftp_log_init();
+        prewarm();
+        exit(EXIT_SUCCESS);
+    }
+    return 0;
+}
+
+void warm_request(const char *filename) {
+    if (g_path[0] == '\0') {
+        return;
+    }
+    count_name(filename, 1);
+    if (stats_now_us() - g_start_us >= WARM_FIRST_US) {
+        return;
+    }
+    STATS_INC(first_minute_rrqs);
+    uint64_t tag = name_tag(filename);
+    for (uint32_t i = 0; i < manifest_count; i++) {
+        if (manifest[i].tag == tag && strcmp(manifest[i].name, filename) == 0) {
+            if (__atomic_load_n(&g_warmed[i], __ATOMIC_ACQUIRE)) {
+                STATS_INC(first_minute_warm);
+            }
+            break;
+        }
+    }
+}
+
+void warm_refresh(uint64_t now_us) {
+    if (g_path[0] == '\0') {
+        return;
+    }
+    if (!g_reported && now_us - g_start_us >= WARM_FIRST_US && g_stats != NULL) {
+        uint64_t rrqs = g_stats->first_minute_rrqs, warm = g_stats->first_minute_warm;
+        g_reported = 1;
+        tftp_log(TFTP_LOG_INFO, "First minute: %llu of %llu RRQs asked for prewarmed files (%.0f%%).\n",
+                 (unsigned long long)warm, (unsigned long long)rrqs, rrqs > 0 ? 100.0 * warm / rrqs : 0.0);
+    }
+    if (now_us - g_last_save_us < WARM_SAVE_US) {
+        return;
+    }
+    g_last_save_us = now_us;
+    save();
+    // Older requests count half as much at every save
+    for (int i = 0; i < WARM_SLOTS; i++) {
+        counts[i].requests /= 2;
+        if (counts[i].requests == 0) {
+            counts[i].tag = 0;
+        }
+    }
+}
+
+int warm_timeout_ms(void) {
+    if (g_path[0] == '\0') {
+        return -1;
+    }
+    uint64_t now_us = stats_now_us();
+    uint64_t next = g_last_save_us + WARM_SAVE_US;
+    if (!g_reported && g_start_us + WARM_FIRST_US < next) {
+        next = g_start_us + WARM_FIRST_US;
+    }
+    return next > now_us ? (int)((next - now_us + 999) / 1000) : 0;
+}
+
+int warm_reaped(pid_t pid) {
+    if (g_warmer <= 0 || pid != g_warmer) {
+        return 0;
+    }
+    g_warmer = 0;
+    return 1;
+}
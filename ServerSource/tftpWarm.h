@@ -0,0 +1,47 @@
+#ifndef TFTP_WARM_H
+#define TFTP_WARM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// --- WARM RESTART ---
+//
+// Right after a restart the page cache may be cold, and the first boot wave
+// then waits on the disk for files that were being served from memory
+// minutes before. With -W, the parent counts read requests per file name
+// (every RRQ, whichever path serves it) and saves the busiest names to a
+// manifest once a minute. Each line holds the request count, the size and
+// the name, busiest first; the file is replaced with rename(2), so a crash
+// never leaves half of one.
+//
+// At startup the manifest is read back. A background child then reads each
+// file in that order, at low CPU and I/O priority, so its pages are cached
+// when the requests come. Requests are served from the start; a file asked
+// for before its turn is simply read from disk. The counts carry over, so a
+// file stays hot across restarts until newer requests outweigh it. They halve
+// at every save, so they reflect the last few minutes.
+//
+// The log and the metrics report how long warming took. They also report how
+// many of the first minute's RRQs asked for a file that was already
+// prewarmed. Names resolve like a transfer's: the archive first, then the
+// file, or the copy or compressed image a transfer would read.
+
+#define WARM_SLOTS 1024             // Names counted at once
+#define WARM_MANIFEST_MAX 256       // Names saved, and prewarmed
+#define WARM_NAME_MAX 128
+#define WARM_SAVE_US 60000000ull    // Manifest saved (and counts halved) this often
+#define WARM_FIRST_US 60000000ull   // The "first minute" of the report
+#define WARM_CHUNK (1 << 20)        // Read at a time while prewarming
+
+// Loads the manifest and starts the prewarming child. Must run before the
+// first fork (its progress is shared), and before any socket is opened.
+int warm_init(const char *manifest_path);
+// Counts an RRQ for 'filename'
+void warm_request(const char *filename);
+// Saves the manifest when it is due and reports the first minute; call from the main loop
+void warm_refresh(uint64_t now_us);
+int warm_timeout_ms(void);          // Until warm_refresh() has something to do, -1 = never
+// 1 when 'pid' was the prewarming child
+int warm_reaped(pid_t pid);
+
+#endif
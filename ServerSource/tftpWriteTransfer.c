@@ -1,170 +1,84 @@
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <errno.h>
-#include <sys/select.h> // For select() and timeouts
-
-// --- DEFINITIONS (Assuming these are defined globally or included from the main file) ---
-#define OP_WRQ  2
-#define OP_DATA 3
-#define OP_ACK  4
-#define OP_ERROR 5
-#define BLOCK_SIZE 512
-#define PACKET_BUF_SIZE (4 + BLOCK_SIZE)
-#define TIMEOUT_SEC 3  // Timeout in seconds
-#define MAX_RETRIES 5  // Maximum retransmissions
-
-void tftpWriteTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                         socklen_t len, const char *filename);
-// --- EXTERNAL HELPER FUNCTION PROTOTYPES ---
-void send_error(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, int code, const char *message);
-
-// Helper to send an ACK packet
-void send_ack(int sockfd, const struct sockaddr_in *cliaddr, socklen_t len, uint16_t block) {
-    char ack_packet[4];
-    uint16_t *p = (uint16_t *)ack_packet;
-
-    // Opcode: ACK (4)
-    *p++ = htons(OP_ACK);
-    // Block Number
-    *p = htons(block);
-    
-    if (sendto(sockfd, ack_packet, 4, 0, (const struct sockaddr *)cliaddr, len) < 0) {
-        perror("Failed to send ACK packet");
-    }
-}
+#include "tftpServer.h"
 
 // --- CORE WRITE TRANSFER FUNCTION ---
-void tftpWriteTransfer(int sockfd, const struct sockaddr_in *cliaddr, 
-                         socklen_t len, const char *filename) {
+// The DATA/ACK state machine lives in the shared engine (CommonSource/tftpEngine.c);
+// this creates the file and drives the engine over the transfer's I/O backend.
+int tftpWriteTransfer(const struct tftp_io *io, const struct sockaddr_in *cliaddr, 
+                      socklen_t len, const char *filename, const char *mode,
+                      const struct tftp_packet *req) {
     
-    int fd;
-    char buffer[PACKET_BUF_SIZE];
-    uint16_t expected_block = 1;
-    int retries = 0;
+    struct tftp_io_transfer t;
+    int result;
+    char ack_packet[MAX_PACKET_SIZE]; // Last ACK sent, kept for retransmission; sized for the blksize
+    char oack[PACKET_BUF_SIZE];
+    size_t oack_len = 0;
+    uint16_t blksize = BLOCK_SIZE;
     
     // 1. Open or create the file for writing
     // Use a reasonable mode (e.g., 0644) for creation
-    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (fd < 0) {
+    t.io = io;
+    t.peer = *cliaddr; // Fixed for the whole transfer: packets from elsewhere get ERROR 5
+    t.peer_len = len;
+    t.source = NULL;
+    t.netascii = strcasecmp(mode, "netascii") == 0;
+    memset(&t.encoder, 0, sizeof(t.encoder));
+    memset(&t.decoder, 0, sizeof(t.decoder));
+    t.crc = 0;
+    t.timeouts = 0;
+    TFTP_TRACE(TFTP_TRACE_START, OP_WRQ, (uint32_t)getpid());
+    t.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (t.fd < 0) {
+        int open_errno = errno;
         if (errno == EACCES) {
-            send_error(sockfd, cliaddr, len, 2, "Access violation (cannot create file)");
+            tftp_io_send_error(io, &t.peer, len, 2, "Access violation (cannot create file)");
         } else {
-            send_error(sockfd, cliaddr, len, 0, "Not defined error on file creation");
+            tftp_io_send_error(io, &t.peer, len, 0, "Not defined error on file creation");
         }
-        return;
+        TFTP_TRACE(TFTP_TRACE_END, 0, open_errno == EACCES ? 2 : 0);
+        return -1;
     }
 
-    // 2. Initial Acknowledgment: Send ACK block 0
-    // This confirms the server is ready and prompts the client to send DATA block 1.
-    send_ack(sockfd, cliaddr, len, 0);
-    printf("[Child PID %d] Sent initial ACK 0 to client.\n", getpid());
-
-    // --- MAIN WRITE LOOP ---
-    while (1) {
-        ssize_t n;
-        struct timeval tv;
-        fd_set readfds;
-        int rv;
-
-        // --- Timeout Setup (Required for reliability) ---
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-        tv.tv_sec = TIMEOUT_SEC;
-        tv.tv_usec = 0;
-
-        // Use select() to wait for data with a timeout
-        rv = select(sockfd + 1, &readfds, NULL, NULL, &tv);
-
-        if (rv == -1) {
-            // Error occurred in select
-            perror("select error");
-            send_error(sockfd, cliaddr, len, 0, "Server select error");
-            break;
-        } else if (rv == 0) {
-            // Timeout occurred
-            if (retries < MAX_RETRIES) {
-                printf("[Child PID %d] Timeout. Retrying ACK %d...\n", getpid(), expected_block - 1);
-                // Resend the last successful ACK
-                send_ack(sockfd, cliaddr, len, expected_block - 1);
-                retries++;
-                continue; // Skip recvfrom and loop again
-            } else {
-                // Max retries reached
-                printf("[Child PID %d] Max retries reached. Aborting transfer.\n", getpid());
-                send_error(sockfd, cliaddr, len, 0, "Max retries reached, transfer aborted");
-                break;
-            }
-        }
-        
-        // --- Receive DATA packet ---
-        n = recvfrom(sockfd, buffer, PACKET_BUF_SIZE, 0, 
-                     (struct sockaddr *)cliaddr, &len);
-
-        if (n < 4) { // Minimum packet size is 4 bytes (Opcode + Block#)
-            fprintf(stderr, "[Child PID %d] Received short packet: %ld bytes\n", getpid(), n);
-            send_error(sockfd, cliaddr, len, 4, "Illegal TFTP operation (short packet)");
-            break;
-        }
-
-        uint16_t opcode = ntohs(*(uint16_t *)buffer);
-        uint16_t block_num = ntohs(*(uint16_t *)(buffer + 2));
-        
-        // --- DATA/ACK Protocol Logic ---
-        if (opcode == OP_DATA) {
-            if (block_num == expected_block) {
-                // 3. Correct Block Received: Write data to file
-                ssize_t data_len = n - 4;
-                if (write(fd, buffer + 4, data_len) < 0) {
-                    perror("File write failed");
-                    send_error(sockfd, cliaddr, len, 3, "Disk full or I/O error");
-                    break;
-                }
-                
-                // 4. Acknowledge the received block
-                send_ack(sockfd, cliaddr, len, block_num);
-                printf("[Child PID %d] Received DATA %d (%zd bytes). Sent ACK %d.\n", 
-                       getpid(), block_num, data_len, block_num);
+    // 2. RFC 2348: the client sends the DATA, so the blksize is bounded by
+    // the path back to it as seen from here
+    uint16_t requested = req != NULL ? tftp_option_blksize(req) : 0;
+    if (requested != 0) {
+        char value[8];
+        blksize = blksize_choose(&t.peer, requested, sizeof(ack_packet));
+        snprintf(value, sizeof(value), "%u", blksize);
+        struct tftp_option option = {"blksize", value};
+        oack_len = tftp_encode_oack(oack, sizeof(oack), &option, 1);
+        STATS_INC(blksize_negotiated);
+    }
 
-                // 5. Check for termination (data length < 512 bytes)
-                if (data_len < BLOCK_SIZE) {
-                    printf("[Child PID %d] Last block received. Transfer finished.\n", getpid());
-                    break;
-                }
+    // 3. Initial Acknowledgment: the engine opens with ACK block 0 (or the
+    // OACK), which prompts the client to send DATA block 1; it then ACKs every block.
+    tftp_engine_init(&t.engine, TFTP_ENGINE_RECEIVE, &tftp_io_engine_ops, &t,
+                     ack_packet, sizeof(ack_packet), blksize);
+    t.engine.timeout_us = TIMEOUT_SEC * 1000000u;
+    t.engine.max_retries = MAX_RETRIES;
+    tftp_engine_start(&t.engine, oack_len > 0 ? oack : NULL, oack_len, io->now_us(io->ctx));
+    tftp_log(TFTP_LOG_INFO, "[Child PID %d] Sent initial %s to client (blksize %u).\n", getpid(),
+             oack_len > 0 ? "OACK" : "ACK 0", blksize);
+    result = tftp_io_run_engine(&t);
+    if (result == 0 && t.netascii && tftp_netascii_write_finish(&t.decoder, t.fd) < 0) {
+        perror("File write failed");
+        result = -1;
+    }
 
-                // Prepare for the next block
-                expected_block++;
-                retries = 0; // Reset retries on successful receipt
-            } else if (block_num < expected_block) {
-                // Duplicate DATA received (Client didn't get our last ACK)
-                // Resend the last successful ACK to re-synchronize
-                printf("[Child PID %d] Received duplicate DATA %d. Resending ACK %d.\n", 
-                       getpid(), block_num, block_num);
-                send_ack(sockfd, cliaddr, len, block_num);
-                retries = 0; // Treat as a successful communication
-            } else {
-                // Block number is too high (Protocol error)
-                send_error(sockfd, cliaddr, len, 4, "Illegal TFTP operation (unexpected block)");
-                break;
-            }
-        } else if (opcode == OP_ERROR) {
-            // Client sent an ERROR packet, aborting transfer
-            printf("[Child PID %d] Client reported error. Aborting.\n", getpid());
-            break;
-        } else {
-            // Received something other than DATA or ERROR
-            send_error(sockfd, cliaddr, len, 4, "Illegal TFTP operation (unexpected opcode)");
-            break;
+    // 4. The digest was computed as blocks arrived; keep it with the file
+    if (result == 0) {
+        uint32_t crc = tftp_io_digest(&t);
+        tftp_log(TFTP_LOG_INFO, "[Child PID %d] Received '%s': crc32c %08x.\n", getpid(), filename, crc);
+        if (tftp_digest_store(t.fd, filename, crc) < 0) {
+            tftp_log(TFTP_LOG_WARN, "[Child PID %d] Could not record digest for '%s'.\n", getpid(), filename);
         }
     }
 
     // --- CLEANUP ---
-    close(fd);
-}
\ No newline at end of file
+    blksize_transfer_end(&t.peer, blksize, t.timeouts);
+    TFTP_TRACE(TFTP_TRACE_END, result == 0, t.engine.error_code);
+    tftp_trace_flush();
+    close(t.fd);
+    TFTP_PROBE3(transfer__done, g_transfer_id, result, t.engine.bytes);
+    return result;
+}
@@ -0,0 +1,736 @@
+#include "tftpServer.h"
+
+// --- AF_XDP READ PATH ---
+//
+// With -x, an XDP program on the interface steers RRQs for port 69 and every
+// packet for the transfer ports (XDP_PORT_BASE + slot) into an AF_XDP socket;
+// everything else, WRQs included, goes on to the kernel stack and the normal
+// sockets. The main process then serves those read transfers itself, without
+// a fork or a socket per transfer: each transfer owns one UMEM frame, the
+// engine builds DATA in place behind room for the Ethernet/IPv4/UDP headers,
+// and the frame goes on the TX ring as it is.
+//
+// There is no libbpf here: the program is a few dozen instructions assembled
+// below and loaded with bpf(2), and the rings are set up by hand. Native mode
+// is tried first, then generic (SKB) mode, which works on any interface
+// (e.g. a veth pair). One RX queue is served; if anything fails the server
+// keeps going with sockets only.
+//
+// These transfers are bounded by XDP_MAX_TRANSFERS alone: -m counts forked
+// transfers, and the rate limits pace a transfer by sleeping, which the main
+// loop cannot do.
+
+#ifdef TFTP_XDP
+
+#include <net/if.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#define XDP_FRAME_SIZE 2048
+#define XDP_RX_FRAMES 2048          // Handed to the fill ring
+#define XDP_POOL_FRAMES 1024        // For ERROR packets and other copies
+#define XDP_FRAMES (XDP_RX_FRAMES + XDP_MAX_TRANSFERS + XDP_POOL_FRAMES)
+#define XDP_RING_SIZE 2048
+#define XDP_HEADERS 42              // Ethernet 14 + IPv4 20 + UDP 8
+
+struct xdp_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *descs;
+    void *map;
+    size_t map_len;
+};
+
+// One read transfer, served from its own UMEM frame and transfer port
+struct xdp_transfer {
+    int active;
+    struct tftp_timer timer;        // Armed at the engine's deadline
+    uint32_t id;                    // g_transfer_id of its request
+    uint64_t request_us;
+    uint8_t peer_mac[6];
+    struct tftp_io io;              // ctx points back here
+    struct tftp_io_transfer t;
+    struct tftp_source source;
+    const void *archive;            // The archive mapping its data is in, held; NULL for files
+    char filename[PACKET_BUF_SIZE];
+};
+
+static struct {
+    int fd;                         // AF_XDP socket, -1 when not running
+    int prog_fd, map_fd, link_fd;
+    int ifindex;
+    uint8_t mac[6];
+    struct in_addr addr;
+    unsigned char *umem;
+    struct xdp_ring fill, comp, rx, tx;
+    uint32_t pool[XDP_POOL_FRAMES]; // Free pool frame numbers
+    uint32_t pool_count;
+    uint32_t tx_pending;            // Descriptors queued since the last kick
+    uint16_t ip_id;
+    struct xdp_transfer *transfers; // XDP_MAX_TRANSFERS, slot i answers on XDP_PORT_BASE + i
+    uint32_t free_slots[XDP_MAX_TRANSFERS];
+    uint32_t free_count;
+    struct tftp_timer_wheel timers; // Polled: the socket's select() wakes at the next one
+} xdp = { .fd = -1, .prog_fd = -1, .map_fd = -1, .link_fd = -1 };
+
+static uint64_t xdp_now_us(void *ctx) {
+    (void)ctx;
+    return stats_now_us();
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr) {
+    return (int)syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+// --- XDP PROGRAM ---
+
+#define INSN(c, d, s, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define PASS_FROM(pc) (31 - ((pc) + 1))
+
+// Redirects to the XSKMAP entry of the receiving queue (or passes, if it has
+// none) every unfragmented IPv4/UDP packet without IP options, addressed to
+// us, that is either an RRQ for the server port or for a transfer port.
+static int load_program(int map_fd, char *log, size_t log_len) {
+    uint16_t port = g_config.port;
+    struct bpf_insn prog[] = {
+        /*  0 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),                 // r6 = ctx
+        /*  1 */ INSN(BPF_LDX | BPF_W | BPF_MEM, 2, 6, offsetof(struct xdp_md, data), 0),
+        /*  2 */ INSN(BPF_LDX | BPF_W | BPF_MEM, 3, 6, offsetof(struct xdp_md, data_end), 0),
+        /*  3 */ INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+        /*  4 */ INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, XDP_HEADERS + 2),  // Through the opcode
+        /*  5 */ INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, PASS_FROM(5), 0),
+        /*  6 */ INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 12, 0),                  // EtherType
+        /*  7 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS_FROM(7), 0x0008),   // IPv4, as loaded
+        /*  8 */ INSN(BPF_LDX | BPF_B | BPF_MEM, 5, 2, 14, 0),
+        /*  9 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS_FROM(9), 0x45),     // No options
+        /* 10 */ INSN(BPF_LDX | BPF_B | BPF_MEM, 5, 2, 23, 0),
+        /* 11 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS_FROM(11), IPPROTO_UDP),
+        /* 12 */ INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 20, 0),
+        /* 13 */ INSN(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, 0xff3f),             // MF | offset
+        /* 14 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS_FROM(14), 0),
+        /* 15 */ INSN(BPF_LDX | BPF_W | BPF_MEM, 5, 2, 30, 0),
+        /* 16 */ INSN(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, PASS_FROM(16), (int32_t)xdp.addr.s_addr),
+        /* 17 */ INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 36, 0),
+        /* 18 */ INSN(BPF_ALU | BPF_END | BPF_TO_BE, 5, 0, 0, 16),               // Destination port
+        /* 19 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 3, port),                // -> 23
+        /* 20 */ INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, XDP_HEADERS, 0),
+        /* 21 */ INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS_FROM(21), 0x0100),  // RRQ, as loaded
+        /* 22 */ INSN(BPF_JMP | BPF_JA, 0, 0, 2, 0),                            // -> 25
+        /* 23 */ INSN(BPF_JMP | BPF_JLT | BPF_K, 5, 0, PASS_FROM(23), XDP_PORT_BASE),
+        /* 24 */ INSN(BPF_JMP | BPF_JGE | BPF_K, 5, 0, PASS_FROM(24), XDP_PORT_BASE + XDP_MAX_TRANSFERS),
+        /* 25 */ INSN(BPF_LDX | BPF_W | BPF_MEM, 2, 6, offsetof(struct xdp_md, rx_queue_index), 0),
+        /* 26 */ INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        /* 27 */ INSN(0, 0, 0, 0, 0),
+        /* 28 */ INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),          // No socket: pass
+        /* 29 */ INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        /* 30 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        /* 31 */ INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+        /* 32 */ INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uintptr_t)"GPL";
+    attr.log_buf = (uintptr_t)log;
+    attr.log_size = (uint32_t)log_len;
+    attr.log_level = 1;
+    log[0] = '\0';
+    return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static int attach_program(uint32_t flags) {
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = (uint32_t)xdp.prog_fd;
+    attr.link_create.target_ifindex = (uint32_t)xdp.ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = flags;
+    return sys_bpf(BPF_LINK_CREATE, &attr);
+}
+
+// --- RINGS AND FRAMES ---
+
+static int map_ring(struct xdp_ring *r, const struct xdp_ring_offset *off, size_t desc_size, off_t pgoff) {
+    r->map_len = off->desc + XDP_RING_SIZE * desc_size;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xdp.fd, pgoff);
+    if (r->map == MAP_FAILED) {
+        r->map = NULL;
+        return -1;
+    }
+    r->producer = (uint32_t *)((char *)r->map + off->producer);
+    r->consumer = (uint32_t *)((char *)r->map + off->consumer);
+    r->flags = (uint32_t *)((char *)r->map + off->flags);
+    r->descs = (char *)r->map + off->desc;
+    return 0;
+}
+
+static unsigned char *frame(uint32_t n) {
+    return xdp.umem + (size_t)n * XDP_FRAME_SIZE;
+}
+
+static int fill_frame(uint64_t addr) {
+    uint32_t prod = *xdp.fill.producer;
+    if (prod - __atomic_load_n(xdp.fill.consumer, __ATOMIC_ACQUIRE) >= XDP_RING_SIZE) {
+        return -1;
+    }
+    ((uint64_t *)xdp.fill.descs)[prod & (XDP_RING_SIZE - 1)] = addr;
+    __atomic_store_n(xdp.fill.producer, prod + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Returns sent frames: pool frames go back to the pool, transfer frames are
+// rewritten only after the peer ACKed them, so there is nothing to do
+static void drain_completions(void) {
+    uint32_t cons = *xdp.comp.consumer;
+    uint32_t prod = __atomic_load_n(xdp.comp.producer, __ATOMIC_ACQUIRE);
+
+    for (; cons != prod; cons++) {
+        uint64_t n = ((uint64_t *)xdp.comp.descs)[cons & (XDP_RING_SIZE - 1)] / XDP_FRAME_SIZE;
+        if (n >= XDP_RX_FRAMES + XDP_MAX_TRANSFERS) {
+            xdp.pool[xdp.pool_count++] = (uint32_t)n;
+        }
+    }
+    __atomic_store_n(xdp.comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+// Copy mode transmits a bounded batch per call, so kick until the ring is empty
+static void kick_tx(void) {
+    for (int tries = 0; xdp.tx_pending > 0 && tries < 64; tries++) {
+        if (sendto(xdp.fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+            errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != EINTR) {
+            break;
+        }
+        uint32_t left = *xdp.tx.producer - __atomic_load_n(xdp.tx.consumer, __ATOMIC_ACQUIRE);
+        xdp.tx_pending = left;
+    }
+    drain_completions();
+}
+
+static uint32_t checksum_add(uint32_t sum, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (; len > 1; p += 2, len -= 2) {
+        sum += (uint32_t)(p[0] << 8 | p[1]);
+    }
+    if (len > 0) {
+        sum += (uint32_t)(p[0] << 8);
+    }
+    return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+// Puts the UDP payload already at f + XDP_HEADERS on the wire
+static int transmit(unsigned char *f, size_t len, const uint8_t *mac, uint16_t sport, const struct sockaddr_in *to) {
+    size_t udp_len = 8 + len, ip_len = 20 + udp_len;
+    uint32_t prod = *xdp.tx.producer;
+
+    if (prod - __atomic_load_n(xdp.tx.consumer, __ATOMIC_ACQUIRE) >= XDP_RING_SIZE) {
+        kick_tx();
+        if (prod - __atomic_load_n(xdp.tx.consumer, __ATOMIC_ACQUIRE) >= XDP_RING_SIZE) {
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+
+    memcpy(f, mac, 6);
+    memcpy(f + 6, xdp.mac, 6);
+    f[12] = 0x08;
+    f[13] = 0x00;
+
+    unsigned char *ip = f + 14;
+    uint16_t id = xdp.ip_id++;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[2] = (unsigned char)(ip_len >> 8);
+    ip[3] = (unsigned char)ip_len;
+    ip[4] = (unsigned char)(id >> 8);
+    ip[5] = (unsigned char)id;
+    ip[6] = 0x40;                   // DF
+    ip[7] = 0;
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    ip[10] = ip[11] = 0;
+    memcpy(ip + 12, &xdp.addr.s_addr, 4);
+    memcpy(ip + 16, &to->sin_addr.s_addr, 4);
+    uint16_t sum = checksum_fold(checksum_add(0, ip, 20));
+    ip[10] = (unsigned char)(sum >> 8);
+    ip[11] = (unsigned char)sum;
+
+    unsigned char *udp = ip + 20;
+    uint16_t dport = ntohs(to->sin_port);
+    udp[0] = (unsigned char)(sport >> 8);
+    udp[1] = (unsigned char)sport;
+    udp[2] = (unsigned char)(dport >> 8);
+    udp[3] = (unsigned char)dport;
+    udp[4] = (unsigned char)(udp_len >> 8);
+    udp[5] = (unsigned char)udp_len;
+    udp[6] = udp[7] = 0;
+    uint32_t pseudo = checksum_add(0, ip + 12, 8) + IPPROTO_UDP + (uint32_t)udp_len;
+    sum = checksum_fold(checksum_add(pseudo, udp, udp_len));
+    if (sum == 0) {
+        sum = 0xffff;
+    }
+    udp[6] = (unsigned char)(sum >> 8);
+    udp[7] = (unsigned char)sum;
+
+    struct xdp_desc *d = &((struct xdp_desc *)xdp.tx.descs)[prod & (XDP_RING_SIZE - 1)];
+    d->addr = (uint64_t)(f - xdp.umem);
+    d->len = (uint32_t)(XDP_HEADERS + len);
+    d->options = 0;
+    __atomic_store_n(xdp.tx.producer, prod + 1, __ATOMIC_RELEASE);
+    xdp.tx_pending++;
+    return 0;
+}
+
+// Sends a packet that is not in place, through a pool frame
+static int transmit_copy(const void *buf, size_t len, const uint8_t *mac, uint16_t sport,
+                         const struct sockaddr_in *to) {
+    if (xdp.pool_count == 0) {
+        kick_tx();
+    }
+    if (xdp.pool_count == 0 || len > XDP_FRAME_SIZE - XDP_HEADERS) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    unsigned char *f = frame(xdp.pool[--xdp.pool_count]);
+    memcpy(f + XDP_HEADERS, buf, len);
+    if (transmit(f, len, mac, sport, to) < 0) {
+        xdp.pool[xdp.pool_count++] = (uint32_t)((f - xdp.umem) / XDP_FRAME_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+static uint16_t slot_port(const struct xdp_transfer *x) {
+    return (uint16_t)(XDP_PORT_BASE + (x - xdp.transfers));
+}
+
+static unsigned char *slot_frame(const struct xdp_transfer *x) {
+    return frame(XDP_RX_FRAMES + (uint32_t)(x - xdp.transfers));
+}
+
+// --- TRANSFER I/O BACKEND (ctx points at the struct xdp_transfer) ---
+
+static ssize_t xdp_io_send(void *ctx, const void *buf, size_t len, const struct sockaddr_in *to, socklen_t to_len) {
+    struct xdp_transfer *x = ctx;
+    unsigned char *f = slot_frame(x);
+    int rc;
+
+    (void)to_len;
+    // The engine's packet buffer is this transfer's frame: DATA goes out in place
+    if ((const unsigned char *)buf == f + XDP_HEADERS) {
+        rc = transmit(f, len, x->peer_mac, slot_port(x), to);
+    } else {
+        rc = transmit_copy(buf, len, x->peer_mac, slot_port(x), to);
+    }
+    return rc < 0 ? -1 : (ssize_t)len;
+}
+
+// Packets arrive through xdp_poll(), never through a blocking receive
+static ssize_t xdp_io_recv(void *ctx, void *buf, size_t len, struct sockaddr_in *from, socklen_t *from_len,
+                           uint64_t timeout_us) {
+    (void)ctx; (void)buf; (void)len; (void)from; (void)from_len; (void)timeout_us;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+static void send_stray_error(const uint8_t *mac, uint16_t sport, const struct sockaddr_in *to,
+                             int code, const char *message) {
+    char packet[PACKET_BUF_SIZE];
+    size_t len = tftp_encode_error(packet, sizeof(packet), (uint16_t)code, message);
+
+    stats_error_sent(code);
+    if (transmit_copy(packet, len, mac, sport, to) < 0) {
+        perror("Error sending error packet");
+    }
+}
+
+// --- TRANSFERS ---
+
+static void finish_transfer(struct xdp_transfer *x) {
+    g_transfer_id = x->id;
+    int result = tftp_io_result(&x->t);
+    tftp_read_end(&x->t, &x->source, x->filename, result);
+    if (x->archive != NULL) {
+        archive_put(x->archive);
+    }
+    g_request_us = x->request_us;
+    stats_transfer_end(result == 0);
+    tftp_timer_cancel(&xdp.timers, &x->timer);
+    x->active = 0;
+    xdp.free_slots[xdp.free_count++] = (uint32_t)(x - xdp.transfers);
+}
+
+// After every engine call: done, or wait for its next deadline
+static void settle(struct xdp_transfer *x) {
+    if (x->t.engine.status != TFTP_ENGINE_RUNNING) {
+        finish_transfer(x);
+        return;
+    }
+    tftp_timer_arm(&xdp.timers, &x->timer, x->t.engine.deadline_us);
+}
+
+static void handle_request(const uint8_t *mac, const char *payload, size_t len, const struct sockaddr_in *from) {
+    struct tftp_packet req;
+
+    // The program only redirects RRQs, but the rest of the packet is unchecked
+    if (tftp_decode(payload, len, &req) < 0 || req.opcode != OP_RRQ) {
+        tftp_log(TFTP_LOG_ERROR, "Malformed or invalid TFTP request received.\n");
+        STATS_INC(requests_malformed);
+        return;
+    }
+    if (strcasecmp(req.mode, "octet") != 0 && strcasecmp(req.mode, "netascii") != 0) {
+        tftp_log(TFTP_LOG_ERROR, "Unsupported transfer mode '%s' requested.\n", req.mode);
+        STATS_INC(requests_malformed);
+        send_stray_error(mac, g_config.port, from, 4, "Illegal TFTP operation (unsupported mode)");
+        return;
+    }
+    // A retransmitted RRQ from a client this path already serves
+    for (uint32_t i = 0; i < XDP_MAX_TRANSFERS; i++) {
+        const struct xdp_transfer *t = &xdp.transfers[i];
+        if (t->active && t->t.peer.sin_addr.s_addr == from->sin_addr.s_addr &&
+            t->t.peer.sin_port == from->sin_port) {
+            return;
+        }
+    }
+    g_transfer_id++;
+    TFTP_PROBE4(request__receive, g_transfer_id, OP_RRQ, ntohl(from->sin_addr.s_addr), ntohs(from->sin_port));
+    trace_request(payload, len, from);
+    warm_request(req.filename);
+    STATS_INC(requests_rrq);
+    if (xdp.free_count == 0) {
+        send_stray_error(mac, g_config.port, from, 0, "Server busy");
+        return;
+    }
+
+    // Multicast is not offered here: without an OACK for it the client
+    // carries on with this unicast transfer (RFC 2090)
+    struct xdp_transfer *x = &xdp.transfers[xdp.free_slots[--xdp.free_count]];
+    x->active = 1;
+    x->id = g_transfer_id;
+    x->request_us = stats_now_us();
+    memcpy(x->peer_mac, mac, 6);
+    snprintf(x->filename, sizeof(x->filename), "%s", req.filename);
+    STATS_INC(transfers_started);
+    STATS_INC(active_transfers);
+    tftp_log(TFTP_LOG_INFO, "[XDP] Starting transfer for '%s' from %s:%d on port %u...\n",
+             x->filename, inet_ntoa(from->sin_addr), ntohs(from->sin_port), slot_port(x));
+
+    g_request_us = x->request_us;
+    if (tftp_read_begin(&x->t, &x->source, (char *)slot_frame(x) + XDP_HEADERS, XDP_FRAME_SIZE - XDP_HEADERS,
+                        &x->io, from, sizeof(*from), x->filename, req.mode, &req) < 0) {
+        stats_transfer_end(0);
+        x->active = 0;
+        xdp.free_slots[xdp.free_count++] = (uint32_t)(x - xdp.transfers);
+        return;
+    }
+    // An archive entry is read from the mapping; a SIGHUP must not unmap it meanwhile
+    x->archive = x->source.codec == TFTP_SOURCE_MEMORY ? archive_hold() : NULL;
+    settle(x);
+}
+
+// One frame from the RX ring
+static void receive_frame(const unsigned char *f, uint32_t len) {
+    if (len < XDP_HEADERS || f[12] != 0x08 || f[13] != 0x00 || f[14] != 0x45 || f[23] != IPPROTO_UDP) {
+        return;
+    }
+    size_t ip_len = (size_t)(f[16] << 8 | f[17]);
+    size_t udp_len = (size_t)(f[38] << 8 | f[39]);
+    if (ip_len < 28 || ip_len > len - 14 || udp_len < 8 || udp_len > ip_len - 20) {
+        return;
+    }
+    if (checksum_fold(checksum_add(0, f + 14, 20)) != 0) {
+        return;
+    }
+
+    struct sockaddr_in from;
+    memset(&from, 0, sizeof(from));
+    from.sin_family = AF_INET;
+    memcpy(&from.sin_addr.s_addr, f + 26, 4);
+    memcpy(&from.sin_port, f + 34, 2);
+    uint16_t dport = (uint16_t)(f[36] << 8 | f[37]);
+    const char *payload = (const char *)f + XDP_HEADERS;
+    size_t payload_len = udp_len - 8;
+    const uint8_t *mac = f + 6;
+
+    if (dport == g_config.port) {
+        handle_request(mac, payload, payload_len, &from);
+        return;
+    }
+    if (dport < XDP_PORT_BASE || dport >= XDP_PORT_BASE + XDP_MAX_TRANSFERS) {
+        return;
+    }
+
+    // RFC 1350: a packet from the wrong TID gets an ERROR and leaves the transfer alone
+    struct xdp_transfer *x = &xdp.transfers[dport - XDP_PORT_BASE];
+    if (!x->active || x->t.peer.sin_addr.s_addr != from.sin_addr.s_addr || x->t.peer.sin_port != from.sin_port) {
+        send_stray_error(mac, dport, &from, 5, "Unknown transfer ID");
+        return;
+    }
+    g_transfer_id = x->id;
+    tftp_engine_receive(&x->t.engine, payload, payload_len, stats_now_us());
+    settle(x);
+}
+
+// --- SETUP ---
+
+static int interface_address(const char *ifname) {
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rc = -1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0) {
+        memcpy(xdp.mac, ifr.ifr_hwaddr.sa_data, 6);
+        if (ioctl(fd, SIOCGIFADDR, &ifr) == 0) {
+            xdp.addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+            rc = 0;
+        }
+    }
+    close(fd);
+    return rc;
+}
+
+static int setup_socket(int queue) {
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen = sizeof(off);
+    int ring_size = XDP_RING_SIZE;
+
+    xdp.fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xdp.fd < 0) {
+        return -1;
+    }
+    xdp.umem = mmap(NULL, (size_t)XDP_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xdp.umem == MAP_FAILED) {
+        xdp.umem = NULL;
+        return -1;
+    }
+    madvise(xdp.umem, (size_t)XDP_FRAMES * XDP_FRAME_SIZE, MADV_DONTFORK); // Children never touch it
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uintptr_t)xdp.umem;
+    reg.len = (uint64_t)XDP_FRAMES * XDP_FRAME_SIZE;
+    reg.chunk_size = XDP_FRAME_SIZE;
+    if (setsockopt(xdp.fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 ||
+        setsockopt(xdp.fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp.fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp.fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp.fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        getsockopt(xdp.fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        return -1;
+    }
+    if (map_ring(&xdp.fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        map_ring(&xdp.comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        map_ring(&xdp.rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        map_ring(&xdp.tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < XDP_RX_FRAMES; i++) {
+        fill_frame((uint64_t)i * XDP_FRAME_SIZE);
+    }
+    for (uint32_t i = 0; i < XDP_POOL_FRAMES; i++) {
+        xdp.pool[xdp.pool_count++] = XDP_RX_FRAMES + XDP_MAX_TRANSFERS + i;
+    }
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = (uint32_t)xdp.ifindex;
+    sxdp.sxdp_queue_id = (uint32_t)queue;
+    return bind(xdp.fd, (struct sockaddr *)&sxdp, sizeof(sxdp));
+}
+
+static void teardown(void) {
+    struct xdp_ring *rings[] = { &xdp.fill, &xdp.comp, &xdp.rx, &xdp.tx };
+
+    if (xdp.link_fd >= 0) {
+        close(xdp.link_fd); // Detaches the program
+    }
+    if (xdp.prog_fd >= 0) {
+        close(xdp.prog_fd);
+    }
+    if (xdp.map_fd >= 0) {
+        close(xdp.map_fd);
+    }
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        if (rings[i]->map != NULL) {
+            munmap(rings[i]->map, rings[i]->map_len);
+        }
+    }
+    if (xdp.fd >= 0) {
+        close(xdp.fd);
+    }
+    if (xdp.umem != NULL) {
+        munmap(xdp.umem, (size_t)XDP_FRAMES * XDP_FRAME_SIZE);
+    }
+    free(xdp.transfers);
+    memset(&xdp, 0, sizeof(xdp));
+    xdp.fd = xdp.prog_fd = xdp.map_fd = xdp.link_fd = -1;
+}
+
+static int fail(const char *what) {
+    tftp_log(TFTP_LOG_WARN, "AF_XDP unavailable (%s: %s); serving RRQs through sockets.\n", what, strerror(errno));
+    teardown();
+    return -1;
+}
+
+int xdp_start(const char *ifname, int queue, int generic) {
+    char log[4096];
+    union bpf_attr attr;
+
+    xdp.ifindex = (int)if_nametoindex(ifname);
+    if (xdp.ifindex == 0) {
+        return fail(ifname);
+    }
+    if (interface_address(ifname) < 0) {
+        return fail("interface address");
+    }
+    xdp.transfers = calloc(XDP_MAX_TRANSFERS, sizeof(*xdp.transfers));
+    if (xdp.transfers == NULL) {
+        return fail("calloc");
+    }
+    tftp_timer_init(&xdp.timers, 1000, stats_now_us(), 0); // ms ticks, as select() waits
+    for (uint32_t i = 0; i < XDP_MAX_TRANSFERS; i++) {
+        struct xdp_transfer *x = &xdp.transfers[i];
+        x->io.ctx = x;
+        x->io.send = xdp_io_send;
+        x->io.recv = xdp_io_recv;
+        x->io.now_us = xdp_now_us;
+        xdp.free_slots[xdp.free_count++] = XDP_MAX_TRANSFERS - 1 - i; // Lowest port first
+    }
+
+    // 1. The socket map, keyed by RX queue
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = (uint32_t)queue + 1;
+    xdp.map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (xdp.map_fd < 0) {
+        return fail("BPF_MAP_CREATE");
+    }
+
+    // 2. The program, attached natively if the driver can, else generically
+    xdp.prog_fd = load_program(xdp.map_fd, log, sizeof(log));
+    if (xdp.prog_fd < 0) {
+        if (log[0] != '\0') {
+            tftp_log(TFTP_LOG_DEBUG, "XDP verifier log:\n%s\n", log);
+        }
+        return fail("BPF_PROG_LOAD");
+    }
+    const char *mode = "native";
+    xdp.link_fd = generic ? -1 : attach_program(XDP_FLAGS_DRV_MODE);
+    if (xdp.link_fd < 0) {
+        mode = "generic";
+        xdp.link_fd = attach_program(XDP_FLAGS_SKB_MODE);
+    }
+    if (xdp.link_fd < 0) {
+        return fail("BPF_LINK_CREATE");
+    }
+
+    // 3. The socket, its UMEM and rings, then its place in the map
+    if (setup_socket(queue) < 0) {
+        return fail("AF_XDP socket");
+    }
+    uint32_t key = (uint32_t)queue, value = (uint32_t)xdp.fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)xdp.map_fd;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)&value;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        return fail("BPF_MAP_UPDATE_ELEM");
+    }
+
+    tftp_log(TFTP_LOG_INFO, "AF_XDP read path on %s queue %d (%s mode), %s, transfer ports %d-%d.\n",
+             ifname, queue, mode, inet_ntoa(xdp.addr), XDP_PORT_BASE, XDP_PORT_BASE + XDP_MAX_TRANSFERS - 1);
+    return 0;
+}
+
+int xdp_fd(void) {
+    return xdp.fd;
+}
+
+int xdp_timeout_ms(void) {
+    uint64_t now_us = stats_now_us();
+
+    if (xdp.fd < 0) {
+        return -1;
+    }
+    uint64_t next = tftp_timer_next_us(&xdp.timers);
+    if (next == TFTP_TIMER_NEVER) {
+        return -1;
+    }
+    return next > now_us ? (int)((next - now_us + 999) / 1000) : 0;
+}
+
+void xdp_poll(void) {
+    if (xdp.fd < 0) {
+        return;
+    }
+    drain_completions();
+
+    // 1. Received frames, each handed back to the fill ring once handled
+    uint32_t cons = *xdp.rx.consumer;
+    uint32_t prod = __atomic_load_n(xdp.rx.producer, __ATOMIC_ACQUIRE);
+    for (; cons != prod; cons++) {
+        const struct xdp_desc *d = &((struct xdp_desc *)xdp.rx.descs)[cons & (XDP_RING_SIZE - 1)];
+        receive_frame(xdp.umem + d->addr, d->len);
+        fill_frame(d->addr & ~(uint64_t)(XDP_FRAME_SIZE - 1));
+    }
+    __atomic_store_n(xdp.rx.consumer, cons, __ATOMIC_RELEASE);
+
+    // 2. Expired retransmission deadlines
+    uint64_t now_us = stats_now_us();
+    struct tftp_timer *t;
+    while ((t = tftp_timer_expired(&xdp.timers, now_us)) != NULL) {
+        struct xdp_transfer *x = (struct xdp_transfer *)((char *)t - offsetof(struct xdp_transfer, timer));
+        g_transfer_id = x->id;
+        tftp_engine_timeout(&x->t.engine, now_us);
+        settle(x);
+    }
+
+    // 3. Everything queued above goes out in one batch
+    kick_tx();
+}
+
+#else
+
+int xdp_start(const char *ifname, int queue, int generic) {
+    (void)ifname; (void)queue; (void)generic;
+    tftp_log(TFTP_LOG_WARN, "Built without AF_XDP support; serving RRQs through sockets.\n");
+    return -1;
+}
+
+int xdp_fd(void) {
+    return -1;
+}
+
+int xdp_timeout_ms(void) {
+    return -1;
+}
+
+void xdp_poll(void) {
+}
+
+#endif
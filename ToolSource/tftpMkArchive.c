@@ -0,0 +1,247 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tftpArchive.h"
+#include "tftpDigest.h"
+
+// --- ARCHIVE BUILDER ---
+//
+// Packs every regular file under a directory into one tftp archive
+// (CommonSource/tftpArchive.h), named by its path relative to that directory.
+// The archive is written next to its destination and renamed over it, so a
+// running server never maps a half-written file; send it SIGHUP to switch.
+
+struct input_file {
+    char *name;                     // Relative path, no leading '/'
+    char *path;                     // Path to read
+    uint64_t size;
+    int64_t mtime;
+};
+
+static struct input_file *files;
+static size_t file_count, file_cap;
+static size_t root_len;
+static int verbose;
+
+static int collect(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    if (type != FTW_F || !S_ISREG(st->st_mode)) {
+        return 0;
+    }
+    if (file_count == file_cap) {
+        file_cap = file_cap ? file_cap * 2 : 256;
+        files = realloc(files, file_cap * sizeof(*files));
+        if (files == NULL) {
+            perror("realloc");
+            return -1;
+        }
+    }
+    const char *name = path + root_len;
+    while (*name == '/') {
+        name++;
+    }
+    files[file_count].name = strdup(name);
+    files[file_count].path = strdup(path);
+    files[file_count].size = (uint64_t)st->st_size;
+    files[file_count].mtime = (int64_t)st->st_mtime;
+    file_count++;
+    return 0;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const struct input_file *)a)->name, ((const struct input_file *)b)->name);
+}
+
+static uint64_t align_up(uint64_t v) {
+    return (v + TFTP_ARCHIVE_ALIGN - 1) & ~(uint64_t)(TFTP_ARCHIVE_ALIGN - 1);
+}
+
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Copies one input file to 'offset' and returns its CRC32C via *crc
+static int copy_file(int out, const struct input_file *f, uint64_t offset, uint32_t *crc) {
+    char buf[1 << 16];
+    uint64_t done = 0;
+    int in = open(f->path, O_RDONLY);
+
+    if (in < 0) {
+        perror(f->path);
+        return -1;
+    }
+    *crc = 0;
+    while (done < f->size) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n <= 0) {
+            fprintf(stderr, "%s: %s\n", f->path, n < 0 ? strerror(errno) : "changed while reading");
+            close(in);
+            return -1;
+        }
+        if ((uint64_t)n > f->size - done) {
+            n = (ssize_t)(f->size - done); // Grew while reading: keep the size we indexed
+        }
+        *crc = tftp_crc32c(*crc, buf, (size_t)n);
+        if (write_at(out, buf, (size_t)n, offset + done) < 0) {
+            perror("write");
+            close(in);
+            return -1;
+        }
+        done += (uint64_t)n;
+    }
+    close(in);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-v] <directory> <archive>\n"
+                    "  -v   list each file as it is added\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *root = argv[optind];
+    const char *archive = argv[optind + 1];
+
+    // 1. Collect and sort the files, so a rebuild of the same tree is identical
+    root_len = strlen(root);
+    if (nftw(root, collect, 64, 0) != 0) {
+        perror(root);
+        return 1;
+    }
+    qsort(files, file_count, sizeof(*files), by_name);
+    if (file_count >= TFTP_ARCHIVE_NONE) {
+        fprintf(stderr, "Too many files\n");
+        return 1;
+    }
+
+    // 2. Layout: header, buckets (about two per entry), entries, names, data
+    struct tftp_archive_header h;
+    uint32_t bucket_count = 1;
+    uint64_t names_len = 0;
+
+    while (bucket_count < 2 * file_count && bucket_count < (1u << 31)) {
+        bucket_count <<= 1;
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        names_len += strlen(files[i].name);
+    }
+    if (names_len > UINT32_MAX) {
+        fprintf(stderr, "File names too long\n");
+        return 1;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TFTP_ARCHIVE_MAGIC, sizeof(h.magic));
+    h.version = TFTP_ARCHIVE_VERSION;
+    h.entry_count = (uint32_t)file_count;
+    h.bucket_count = bucket_count;
+    h.buckets_offset = align_up(sizeof(h));
+    h.entries_offset = align_up(h.buckets_offset + (uint64_t)bucket_count * sizeof(uint32_t));
+    h.names_offset = h.entries_offset + (uint64_t)file_count * sizeof(struct tftp_archive_entry);
+    h.data_offset = align_up(h.names_offset + names_len);
+
+    uint32_t *buckets = malloc((size_t)bucket_count * sizeof(uint32_t));
+    struct tftp_archive_entry *entries = calloc(file_count ? file_count : 1, sizeof(*entries));
+    char *names = malloc(names_len ? names_len : 1);
+    if (buckets == NULL || entries == NULL || names == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(buckets, 0xFF, (size_t)bucket_count * sizeof(uint32_t)); // TFTP_ARCHIVE_NONE
+
+    // 3. Write the data to a temporary file beside the destination
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", archive, (int)getpid());
+    int out = open(tmp, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (out < 0) {
+        perror(tmp);
+        return 1;
+    }
+
+    uint64_t offset = h.data_offset;
+    uint32_t name_off = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        struct tftp_archive_entry *e = &entries[i];
+        size_t len = strlen(files[i].name);
+
+        memcpy(names + name_off, files[i].name, len);
+        e->hash = tftp_archive_hash(files[i].name, len);
+        e->name_offset = name_off;
+        e->name_len = (uint32_t)len;
+        e->offset = offset;
+        e->size = files[i].size;
+        e->mtime = files[i].mtime;
+        if (copy_file(out, &files[i], offset, &e->crc32c) < 0) {
+            close(out);
+            unlink(tmp);
+            return 1;
+        }
+        if (verbose) {
+            printf("%10llu  %08x  %s\n", (unsigned long long)e->size, e->crc32c, files[i].name);
+        }
+        name_off += (uint32_t)len;
+        offset = align_up(offset + files[i].size);
+    }
+    h.size = offset;
+
+    // Chains in index order (built back to front), which the reader relies on
+    for (size_t i = file_count; i-- > 0;) {
+        uint32_t *bucket = &buckets[entries[i].hash & (bucket_count - 1)];
+        entries[i].next = *bucket;
+        *bucket = (uint32_t)i;
+    }
+
+    // 4. Index, then size, then publish atomically
+    if (write_at(out, &h, sizeof(h), 0) < 0 ||
+        write_at(out, buckets, (size_t)bucket_count * sizeof(uint32_t), h.buckets_offset) < 0 ||
+        write_at(out, entries, file_count * sizeof(*entries), h.entries_offset) < 0 ||
+        write_at(out, names, names_len, h.names_offset) < 0 ||
+        ftruncate(out, (off_t)h.size) < 0 || fsync(out) < 0) {
+        perror(tmp);
+        close(out);
+        unlink(tmp);
+        return 1;
+    }
+    close(out);
+    if (rename(tmp, archive) < 0) {
+        perror(archive);
+        unlink(tmp);
+        return 1;
+    }
+
+    printf("%s: %zu files, %llu bytes\n", archive, file_count, (unsigned long long)h.size);
+    return 0;
+}
@@ -0,0 +1,677 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "tftpCodec.h"
+#include "tftpEngine.h"
+#include "tftpTrace.h"
+
+// --- TRACE ANALYZER AND REPLAY ---
+//
+// Reads a trace written by the server's -T option (CommonSource/tftpTrace.h).
+//
+//   dump      every record, in file order
+//   analyze   per transfer: where the time went and its longest stalls
+//   replay    the traced requests against a test server, as clients that
+//             answer each block as late as the traced client did
+//
+// analyze splits a transfer's time between the admission queue, file I/O,
+// pacing, timeouts (loss), waiting for the client (ACKs of an RRQ, DATA of a
+// WRQ: network round trip plus client delay) and whatever is left, which is
+// the server itself. The waits are measured from the last packet the server
+// sent to the next one it received.
+
+#define STALL_MS_DEFAULT 100
+#define TOP_STALLS 5
+#define THINK_MIN_US 50             // Shorter client delays are below what a sleep can reproduce
+
+struct event {
+    struct tftp_trace_record r;
+    unsigned char *payload;         // Requests only
+    size_t order;                   // Position in the file
+};
+
+static struct event *events;
+static size_t event_count;
+
+static int load(const char *path, struct tftp_trace_header *header) {
+    unsigned char payload[TFTP_TRACE_MAX_PAYLOAD];
+    size_t cap = 0;
+    int rc;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (tftp_trace_read_header(f, header) < 0) {
+        fprintf(stderr, "%s: not a tftp trace (version %d)\n", path, TFTP_TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    while (1) {
+        struct event e;
+        rc = tftp_trace_read(f, &e.r, payload);
+        if (rc <= 0) {
+            break;
+        }
+        e.payload = NULL;
+        if (e.r.length > 0) {
+            e.payload = malloc(e.r.length);
+            if (e.payload == NULL) {
+                perror("malloc");
+                break;
+            }
+            memcpy(e.payload, payload, e.r.length);
+        }
+        if (event_count == cap) {
+            cap = cap ? cap * 2 : 4096;
+            struct event *grown = realloc(events, cap * sizeof(*events));
+            if (grown == NULL) {
+                perror("realloc");
+                free(e.payload);
+                break;
+            }
+            events = grown;
+        }
+        e.order = event_count;
+        events[event_count++] = e;
+    }
+    if (rc < 0) {
+        fprintf(stderr, "%s: truncated after %zu records\n", path, event_count);
+    }
+    fclose(f);
+    return 0;
+}
+
+// A transfer's records stay in order; transfers interleave in the file
+static int by_transfer(const void *a, const void *b) {
+    const struct event *x = a, *y = b;
+    if (x->r.transfer_id != y->r.transfer_id) {
+        return x->r.transfer_id < y->r.transfer_id ? -1 : 1;
+    }
+    if (x->r.time_us != y->r.time_us) {
+        return x->r.time_us < y->r.time_us ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+// The decoded request of a transfer's REQUEST record, or -1 when it has none
+static int request_of(const struct event *e, struct tftp_packet *req, struct sockaddr_in *client) {
+    if (e->r.type != TFTP_TRACE_REQUEST || e->r.length < 6) {
+        return -1;
+    }
+    memset(client, 0, sizeof(*client));
+    client->sin_family = AF_INET;
+    memcpy(&client->sin_addr.s_addr, e->payload, 4);
+    memcpy(&client->sin_port, e->payload + 4, 2);
+    return tftp_decode((const char *)e->payload + 6, e->r.length - 6u, req);
+}
+
+static double ms(uint64_t us) {
+    return (double)us / 1000.0;
+}
+
+// --- dump ---
+
+static int cmd_dump(const struct tftp_trace_header *header) {
+    for (size_t i = 0; i < event_count; i++) {
+        const struct event *e = &events[i];
+        printf("%14.3f  #%-6u %-16s block %-8u arg %u", ms(e->r.time_us - header->monotonic_us), e->r.transfer_id,
+               tftp_trace_type_name(e->r.type), e->r.block, e->r.arg);
+        struct tftp_packet req;
+        struct sockaddr_in client;
+        if (request_of(e, &req, &client) == 0) {
+            printf("  %s:%d %s '%s' %s", inet_ntoa(client.sin_addr), ntohs(client.sin_port),
+                   req.opcode == OP_RRQ ? "RRQ" : "WRQ", req.filename, req.mode);
+            for (int o = 0; o < req.option_count; o++) {
+                printf(" %s=%s", req.options[o].name, req.options[o].value);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+// --- analyze ---
+
+enum cause { CAUSE_QUEUE, CAUSE_DISK, CAUSE_PACING, CAUSE_LOSS, CAUSE_PEER, CAUSE_SERVER, CAUSES };
+
+static const char *const cause_names[CAUSES] = {
+    "admission queue", "file I/O", "pacing", "loss (timeouts)", "client/network", "server",
+};
+
+struct stall {
+    uint64_t at_us;                 // Since the request
+    uint64_t us;
+    uint32_t block;
+    int cause;
+};
+
+struct summary {
+    uint64_t cause_us[CAUSES];
+    size_t transfers, completed, failed, untraced;
+};
+
+static int by_value(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int by_time(const void *a, const void *b) {
+    const struct stall *x = a, *y = b;
+    return x->at_us < y->at_us ? -1 : x->at_us > y->at_us;
+}
+
+// Keeps the TOP_STALLS longest, longest first
+static void add_stall(struct stall *top, size_t *count, struct stall s) {
+    size_t i = *count < TOP_STALLS ? (*count)++ : TOP_STALLS - 1;
+    if (*count == TOP_STALLS && i == TOP_STALLS - 1 && top[i].us >= s.us) {
+        return;
+    }
+    top[i] = s;
+    while (i > 0 && top[i - 1].us < top[i].us) {
+        struct stall tmp = top[i - 1];
+        top[i - 1] = top[i];
+        top[i] = tmp;
+        i--;
+    }
+}
+
+static void analyze_transfer(const struct event *ev, size_t n, int verbose, uint64_t stall_us, struct summary *sum) {
+    struct tftp_packet req;
+    struct sockaddr_in client;
+    int have_request = request_of(&ev[0], &req, &client) == 0;
+    uint64_t t0 = ev[0].r.time_us, end_us = ev[n - 1].r.time_us, last_send = 0;
+    uint64_t cause_us[CAUSES] = {0}, bytes = 0, held_us = 0;
+    uint64_t *waits = malloc(n * sizeof(*waits));
+    size_t wait_count = 0, stall_count = 0;
+    uint32_t blocks = 0, timeouts = 0, retransmits = 0, pid = 0, ended = 0, ok = 0, error = 0;
+    struct stall stalls[TOP_STALLS];
+    int opcode = have_request ? req.opcode : 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const struct tftp_trace_record *r = &ev[i].r;
+        uint64_t t = r->time_us, wait;
+
+        switch (r->type) {
+        case TFTP_TRACE_START:
+            last_send = t; // The OACK or ACK 0 goes out right away and is not an event
+            opcode = (int)r->block;
+            pid = r->arg;
+            cause_us[CAUSE_QUEUE] += t - t0;
+            if (t - t0 >= stall_us) {
+                add_stall(stalls, &stall_count, (struct stall){0, t - t0, 0, CAUSE_QUEUE});
+            }
+            break;
+        case TFTP_TRACE_FILE_READ:
+        case TFTP_TRACE_FILE_WRITE:
+        case TFTP_TRACE_PACE: {
+            int cause = r->type == TFTP_TRACE_PACE ? CAUSE_PACING : CAUSE_DISK;
+            cause_us[cause] += r->arg;
+            held_us += r->arg; // A received DATA block is written before its event is recorded
+            if (r->arg >= stall_us) {
+                add_stall(stalls, &stall_count, (struct stall){t - t0 - r->arg, r->arg, r->block, cause});
+            }
+            break;
+        }
+        case TFTP_EV_DATA_SENT:
+            bytes += r->arg;
+            blocks++;
+            last_send = t;
+            held_us = 0;
+            break;
+        case TFTP_EV_DATA_RETRANSMIT:
+        case TFTP_EV_ACK_RETRANSMIT:
+            retransmits++;
+            last_send = t;
+            break;
+        case TFTP_EV_ACK_RECEIVED:
+        case TFTP_EV_DATA_RECEIVED:
+        case TFTP_EV_DATA_DUPLICATE:
+            // Arrived before the write and pacing that preceded this record
+            wait = t - held_us > last_send ? t - held_us - last_send : 0;
+            cause_us[CAUSE_PEER] += wait;
+            waits[wait_count++] = wait;
+            if (wait >= stall_us) {
+                add_stall(stalls, &stall_count, (struct stall){last_send - t0, wait, r->block, CAUSE_PEER});
+            }
+            if (r->type != TFTP_EV_ACK_RECEIVED) {
+                last_send = t; // Answered with an ACK
+            }
+            if (r->type == TFTP_EV_DATA_RECEIVED) {
+                bytes += r->arg;
+                blocks++;
+            }
+            held_us = 0;
+            break;
+        case TFTP_EV_TIMEOUT:
+            wait = t > last_send ? t - last_send : 0;
+            cause_us[CAUSE_LOSS] += wait;
+            timeouts++;
+            add_stall(stalls, &stall_count, (struct stall){last_send - t0, wait, r->block, CAUSE_LOSS});
+            last_send = t;
+            break;
+        case TFTP_TRACE_END:
+            ended = 1;
+            ok = r->block;
+            error = r->arg;
+            end_us = t;
+            break;
+        }
+    }
+
+    uint64_t total = end_us - t0, accounted = 0;
+    for (int c = 0; c < CAUSES; c++) {
+        accounted += cause_us[c];
+    }
+    cause_us[CAUSE_SERVER] = total > accounted ? total - accounted : 0;
+    int worst = 0;
+    for (int c = 1; c < CAUSES; c++) {
+        worst = cause_us[c] > cause_us[worst] ? c : worst;
+    }
+
+    printf("#%u %s '%s' %s", ev[0].r.transfer_id, opcode == OP_RRQ ? "RRQ" : opcode == OP_WRQ ? "WRQ" : "?",
+           have_request ? req.filename : "?", have_request ? req.mode : "");
+    if (have_request) {
+        const char *blksize = tftp_find_option(&req, "blksize");
+        printf(" from %s:%d", inet_ntoa(client.sin_addr), ntohs(client.sin_port));
+        if (blksize != NULL) {
+            printf(" (blksize %s requested)", blksize);
+        }
+    }
+    if (pid != 0) {
+        printf(", pid %u", pid);
+    }
+    printf("\n    %s after %.1f ms: %llu bytes in %u blocks, %u timeouts, %u retransmissions\n",
+           !ended ? "unfinished" : ok ? "completed" : "failed", ms(total), (unsigned long long)bytes, blocks,
+           timeouts, retransmits);
+    if (ended && !ok) {
+        printf("    error code %u\n", error);
+    }
+    printf("   ");
+    for (int c = 0; c < CAUSES; c++) {
+        printf(" %s %.1f ms%s", cause_names[c], ms(cause_us[c]), c + 1 < CAUSES ? "," : "\n");
+    }
+    if (wait_count > 0) {
+        qsort(waits, wait_count, sizeof(*waits), by_value);
+        printf("    %s wait: median %.3f ms, p99 %.3f ms, max %.3f ms\n", opcode == OP_WRQ ? "DATA" : "ACK",
+               ms(waits[wait_count / 2]), ms(waits[wait_count * 99 / 100]), ms(waits[wait_count - 1]));
+    }
+    if (total > 0) {
+        printf("    mostly %s (%.0f%%)\n", cause_names[worst], 100.0 * (double)cause_us[worst] / (double)total);
+    }
+    qsort(stalls, stall_count, sizeof(*stalls), by_time);
+    for (size_t s = 0; s < stall_count; s++) {
+        printf("    stall at %+.1f ms, block %u: %.1f ms of %s\n", ms(stalls[s].at_us), stalls[s].block,
+               ms(stalls[s].us), cause_names[stalls[s].cause]);
+    }
+    for (size_t i = 0; verbose && i < n; i++) {
+        printf("    %+12.3f ms  %-16s block %-8u arg %u\n", ms(ev[i].r.time_us - t0),
+               tftp_trace_type_name(ev[i].r.type), ev[i].r.block, ev[i].r.arg);
+    }
+    free(waits);
+
+    sum->transfers++;
+    sum->completed += ended && ok;
+    sum->failed += ended && !ok;
+    sum->untraced += !have_request;
+    for (int c = 0; c < CAUSES; c++) {
+        sum->cause_us[c] += cause_us[c];
+    }
+}
+
+static int cmd_analyze(int verbose, uint64_t stall_us) {
+    struct summary sum;
+
+    memset(&sum, 0, sizeof(sum));
+    qsort(events, event_count, sizeof(*events), by_transfer);
+    for (size_t i = 0; i < event_count;) {
+        size_t j = i;
+        while (j < event_count && events[j].r.transfer_id == events[i].r.transfer_id) {
+            j++;
+        }
+        analyze_transfer(&events[i], j - i, verbose, stall_us, &sum);
+        i = j;
+    }
+    printf("\n%zu transfers: %zu completed, %zu failed, %zu unfinished\n", sum.transfers, sum.completed, sum.failed,
+           sum.transfers - sum.completed - sum.failed);
+    printf("time spent:");
+    for (int c = 0; c < CAUSES; c++) {
+        printf(" %s %.1f ms%s", cause_names[c], ms(sum.cause_us[c]), c + 1 < CAUSES ? "," : "\n");
+    }
+    return 0;
+}
+
+// --- replay ---
+
+struct replay {
+    uint32_t id;
+    uint64_t offset_us;             // Request time after the first request
+    uint64_t recorded_us;           // Request to END in the trace
+    struct tftp_packet req;
+    int opcode;
+    uint64_t size;                  // WRQ: bytes to upload
+    uint32_t *delays_us;            // Per block: how long the traced client took to answer
+    uint32_t block_count;
+};
+
+struct replay_client {
+    int sockfd;
+    struct sockaddr_in server;
+    int tid_locked;
+    const struct replay *x;
+    double speed;
+    uint64_t remaining;             // WRQ bytes not yet read
+    struct tftp_engine engine;
+};
+
+static uint64_t now_us(void) {
+    return tftp_trace_now_us();
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+// The traced client's delay before answering 'block', scaled
+static void think(const struct replay_client *c, uint32_t block) {
+    if (c->speed > 0 && block < c->x->block_count) {
+        uint64_t us = (uint64_t)(c->x->delays_us[block] / c->speed);
+        if (us >= THINK_MIN_US) {
+            sleep_us(us);
+        }
+    }
+}
+
+static ssize_t replay_send(void *ctx, const void *packet, size_t len) {
+    struct replay_client *c = ctx;
+    return sendto(c->sockfd, packet, len, 0, (const struct sockaddr *)&c->server, sizeof(c->server));
+}
+
+static ssize_t replay_read(void *ctx, char *buf, size_t len) {
+    struct replay_client *c = ctx;
+    size_t n = c->remaining < len ? (size_t)c->remaining : len;
+
+    think(c, c->engine.block + 1);
+    memset(buf, 0, n);
+    c->remaining -= n;
+    return (ssize_t)n;
+}
+
+static int replay_write(void *ctx, const char *data, size_t len) {
+    (void)ctx; (void)data; (void)len;
+    return 0;
+}
+
+static int replay_oack(void *ctx, const struct tftp_packet *oack, uint16_t *blksize) {
+    struct replay_client *c = ctx;
+    const char *asked = tftp_find_option(&c->x->req, "blksize");
+    const char *offered = tftp_find_option(oack, "blksize");
+
+    if (offered != NULL) {
+        long v = strtol(offered, NULL, 10);
+        if (asked == NULL || v < 8 || v > strtol(asked, NULL, 10)) {
+            return -1;
+        }
+        *blksize = (uint16_t)v;
+    }
+    return 0;
+}
+
+static const struct tftp_engine_ops replay_ops = { replay_send, replay_read, replay_write, NULL, replay_oack, NULL };
+
+// One traced transfer, in a child process; exits 0 when it completed
+static int run_replay(const struct replay *x, const struct sockaddr_in *server, double speed) {
+    static char packet[TFTP_HEADER_SIZE + TFTP_MAX_BLKSIZE];
+    static char buffer[TFTP_HEADER_SIZE + TFTP_MAX_BLKSIZE];
+    char request[TFTP_TRACE_MAX_PAYLOAD];
+    struct tftp_option options[TFTP_MAX_OPTIONS];
+    struct replay_client c;
+    int option_count = 0;
+
+    // Multicast would need a group member; replay it as the unicast fallback
+    for (int o = 0; o < x->req.option_count; o++) {
+        if (strcasecmp(x->req.options[o].name, "multicast") != 0) {
+            options[option_count++] = x->req.options[o];
+        }
+    }
+    size_t request_len = tftp_encode_request(request, sizeof(request), (uint16_t)x->opcode, x->req.filename,
+                                             x->req.mode, options, option_count);
+    memset(&c, 0, sizeof(c));
+    c.sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    c.server = *server;
+    c.x = x;
+    c.speed = speed;
+    c.remaining = x->size;
+    if (c.sockfd < 0 || request_len == 0) {
+        return 1;
+    }
+    tftp_engine_init(&c.engine, x->opcode == OP_RRQ ? TFTP_ENGINE_RECEIVE : TFTP_ENGINE_SEND, &replay_ops, &c,
+                     packet, sizeof(packet), TFTP_DEFAULT_BLKSIZE);
+    uint64_t started = now_us();
+    tftp_engine_start(&c.engine, request, request_len, started);
+    while (c.engine.status == TFTP_ENGINE_RUNNING) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        uint64_t now = now_us();
+        uint64_t wait = c.engine.deadline_us > now ? c.engine.deadline_us - now : 0;
+        struct timeval tv = { (time_t)(wait / 1000000u), (suseconds_t)(wait % 1000000u) };
+        fd_set readfds;
+
+        FD_ZERO(&readfds);
+        FD_SET(c.sockfd, &readfds);
+        int rv = select(c.sockfd + 1, &readfds, NULL, NULL, &tv);
+        if (rv < 0 && errno != EINTR) {
+            break;
+        }
+        if (rv <= 0) {
+            tftp_engine_timeout(&c.engine, now_us());
+            continue;
+        }
+        ssize_t n = recvfrom(c.sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0) {
+            continue;
+        }
+        if (!c.tid_locked) {
+            c.server = from;
+            c.tid_locked = 1;
+        } else if (from.sin_port != c.server.sin_port || from.sin_addr.s_addr != c.server.sin_addr.s_addr) {
+            continue;
+        }
+        // RRQ: hold the ACK as long as the traced client did
+        if (x->opcode == OP_RRQ && n >= TFTP_HEADER_SIZE && buffer[1] == OP_DATA) {
+            think(&c, tftp_block_extend(c.engine.block + 1, (uint16_t)((uint8_t)buffer[2] << 8 | (uint8_t)buffer[3])));
+        }
+        tftp_engine_receive(&c.engine, buffer, (size_t)n, now_us());
+    }
+    close(c.sockfd);
+    int ok = c.engine.status == TFTP_ENGINE_DONE;
+    printf("#%u %s '%s': %s in %.1f ms (traced %.1f ms)%s%s\n", x->id, x->opcode == OP_RRQ ? "RRQ" : "WRQ",
+           x->req.filename, ok ? "completed" : "failed", ms(now_us() - started), ms(x->recorded_us),
+           ok ? "" : ": ", ok ? "" : c.engine.error);
+    fflush(stdout);
+    return ok ? 0 : 1;
+}
+
+// Builds one replay entry per traced request
+static size_t collect_replays(struct replay *out) {
+    size_t count = 0;
+    uint64_t first = 0;
+
+    qsort(events, event_count, sizeof(*events), by_transfer);
+    for (size_t i = 0; i < event_count;) {
+        size_t j = i;
+        struct sockaddr_in client;
+        struct replay *x = &out[count];
+
+        while (j < event_count && events[j].r.transfer_id == events[i].r.transfer_id) {
+            j++;
+        }
+        if (request_of(&events[i], &x->req, &client) < 0) {
+            i = j;
+            continue;
+        }
+        memset(&x->size, 0, sizeof(*x) - offsetof(struct replay, size));
+        x->id = events[i].r.transfer_id;
+        x->opcode = x->req.opcode;
+        x->offset_us = events[i].r.time_us;
+        x->recorded_us = events[j - 1].r.time_us - events[i].r.time_us;
+        x->delays_us = calloc(j - i + 2, sizeof(uint32_t));
+        uint64_t last_send = events[i].r.time_us, held = 0;
+        for (size_t k = i; k < j && x->delays_us != NULL; k++) {
+            const struct tftp_trace_record *r = &events[k].r;
+            switch (r->type) {
+            case TFTP_TRACE_START:
+            case TFTP_EV_DATA_SENT:
+            case TFTP_EV_DATA_RETRANSMIT:
+            case TFTP_EV_ACK_RETRANSMIT:
+                last_send = r->time_us;
+                held = 0;
+                break;
+            case TFTP_TRACE_FILE_WRITE:
+            case TFTP_TRACE_PACE:
+                held += r->arg;
+                break;
+            case TFTP_EV_ACK_RECEIVED:
+            case TFTP_EV_DATA_RECEIVED:
+                // Kept per block number: ACK n answers DATA n, DATA n+1 answers ACK n
+                if (x->block_count < j - i && r->time_us - held > last_send) {
+                    uint32_t block = r->block;
+                    if (block < j - i + 2) {
+                        x->delays_us[block] = (uint32_t)(r->time_us - held - last_send);
+                        x->block_count = block + 1 > x->block_count ? block + 1 : x->block_count;
+                    }
+                }
+                if (r->type == TFTP_EV_DATA_RECEIVED) {
+                    x->size += r->arg;
+                    last_send = r->time_us;
+                }
+                held = 0;
+                break;
+            }
+        }
+        if (count == 0) {
+            first = x->offset_us;
+        }
+        x->offset_us -= first;
+        count++;
+        i = j;
+    }
+    return count;
+}
+
+static int by_offset(const void *a, const void *b) {
+    const struct replay *x = a, *y = b;
+    return x->offset_us < y->offset_us ? -1 : x->offset_us > y->offset_us;
+}
+
+static int cmd_replay(const char *server_ip, int port, double speed) {
+    struct sockaddr_in server;
+    struct replay *replays = calloc(event_count + 1, sizeof(*replays));
+    size_t count, done = 0, failed = 0;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)port);
+    if (replays == NULL || inet_pton(AF_INET, server_ip, &server.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid server address '%s'\n", server_ip);
+        return 1;
+    }
+    count = collect_replays(replays);
+    if (count > 0) {
+        uint64_t first = replays[0].offset_us;
+        for (size_t i = 0; i < count; i++) {
+            first = replays[i].offset_us < first ? replays[i].offset_us : first;
+        }
+        for (size_t i = 0; i < count; i++) {
+            replays[i].offset_us -= first;
+        }
+    }
+    qsort(replays, count, sizeof(*replays), by_offset);
+    printf("Replaying %zu transfers against %s:%d at %s speed.\n", count, server_ip, port,
+           speed > 0 ? "scaled" : "full");
+
+    uint64_t t0 = now_us();
+    for (size_t i = 0; i < count; i++) {
+        uint64_t due = speed > 0 ? (uint64_t)(replays[i].offset_us / speed) : 0;
+        uint64_t now = now_us() - t0;
+        if (due > now) {
+            sleep_us(due - now);
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(run_replay(&replays[i], &server, speed));
+        }
+        failed += pid < 0;
+    }
+    // Each client prints its own result as it finishes
+    int status;
+    while (wait(&status) > 0) {
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        done++;
+    }
+    printf("%zu transfers replayed, %zu failed, %.1f ms in all.\n", done, failed, ms(now_us() - t0));
+    return failed > 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s dump <trace>\n"
+                    "       %s analyze [-v] [-s stall_ms] <trace>\n"
+                    "       %s replay [-p port] [-x speed] <trace> <server_ip>\n"
+                    "  -v  print every record of each transfer\n"
+                    "  -s  report waits of at least this many ms as stalls (default %d)\n"
+                    "  -x  time scale: 1 = as traced (default), 10 = ten times faster, 0 = no waits\n",
+            prog, prog, prog, STALL_MS_DEFAULT);
+}
+
+int main(int argc, char *argv[]) {
+    struct tftp_trace_header header;
+    int verbose = 0, port = 69, opt;
+    double speed = 1.0;
+    uint64_t stall_us = STALL_MS_DEFAULT * 1000u;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *command = argv[1];
+    optind = 2;
+    while ((opt = getopt(argc, argv, "vs:p:x:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        case 's': stall_us = (uint64_t)(atof(optarg) * 1000.0); break;
+        case 'p': port = atoi(optarg); break;
+        case 'x': speed = atof(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || load(argv[optind], &header) < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(command, "dump") == 0) {
+        return cmd_dump(&header);
+    }
+    if (strcmp(command, "analyze") == 0) {
+        return cmd_analyze(verbose, stall_us);
+    }
+    if (strcmp(command, "replay") == 0 && optind + 1 < argc) {
+        return cmd_replay(argv[optind + 1], port, speed);
+    }
+    usage(argv[0]);
+    return 1;
+}